@@ -0,0 +1,688 @@
+#include "asyncfilereader.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(Q_OS_UNIX)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(Q_OS_LINUX)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define ASYNCFILEREADER_HAS_IO_URING
+#endif
+#endif
+
+namespace {
+
+// O_DIRECT wants buffers, file offsets and read lengths on block boundaries; 4 KB suits every disk
+const qint64 Alignment = 4096;
+
+qint64 roundUp(qint64 value)
+{
+    return (value + Alignment - 1) / Alignment * Alignment;
+}
+
+// One buffer of the ring and the piece of the file it holds
+struct Slot {
+    char* data = nullptr;
+    qint64 offset = 0;     // Where the piece starts in the file
+    qint64 length = 0;     // Bytes in the piece (less than the buffer for the last one)
+    qint64 filled = 0;     // Bytes read so far
+    bool done = false;     // Read completely, waiting for the parser
+};
+
+// The file being read: a plain descriptor on Unix (so O_DIRECT and pread work), a QFile elsewhere.
+// It is either opened here or borrowed from a QFile the caller already has open.
+class InputFile
+{
+public:
+    ~InputFile() { close(); }
+
+    bool open(const QString& fileName, bool direct, QString* errorMessage)
+    {
+        close();
+#if defined(Q_OS_UNIX)
+        fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            *errorMessage = QString::fromLocal8Bit(std::strerror(errno));
+            return false;
+        }
+        ownsFd = true;
+        return start(direct, errorMessage);
+#else
+        Q_UNUSED(direct);
+        ownFile.setFileName(fileName);
+        if (!ownFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            *errorMessage = ownFile.errorString();
+            return false;
+        }
+        file = &ownFile;
+        fileSize = file->size();
+        return true;
+#endif
+    }
+
+    // Read through a file that is already open; it stays open (and unchanged) afterwards
+    bool borrow(QFile& openFile, bool direct, QString* errorMessage)
+    {
+        close();
+#if defined(Q_OS_UNIX)
+        fd = openFile.handle();
+        if (fd < 0) {
+            *errorMessage = "The file is not open";
+            return false;
+        }
+        ownsFd = false;
+        return start(direct, errorMessage);
+#else
+        Q_UNUSED(direct);
+        Q_UNUSED(errorMessage);
+        file = &openFile;
+        fileSize = file->size();
+        return true;
+#endif
+    }
+
+    // Turn page cache bypassing on or off. File systems that refuse O_DIRECT (tmpfs, network shares)
+    // say so here, and are then simply read through the cache.
+    void setDirect(bool direct)
+    {
+#if defined(Q_OS_UNIX) && defined(O_DIRECT)
+        if (fd < 0 || direct == directIO) {
+            return;
+        }
+        const int flags = direct ? (originalFlags | O_DIRECT) : (originalFlags & ~O_DIRECT);
+        if (::fcntl(fd, F_SETFL, flags) == 0) {
+            directIO = direct;
+        }
+#else
+        Q_UNUSED(direct);
+#endif
+    }
+
+    void close()
+    {
+#if defined(Q_OS_UNIX)
+        if (fd >= 0) {
+            setDirect(false);   // A borrowed descriptor is handed back the way it came
+            if (ownsFd) {
+                ::close(fd);
+            }
+            fd = -1;
+        }
+#else
+        if (file == &ownFile) {
+            ownFile.close();
+        }
+        file = nullptr;
+#endif
+        directIO = false;
+    }
+
+    // Read up to size bytes at offset, stopping early only at the end of the file; -1 on error
+    qint64 readAt(char* data, qint64 offset, qint64 size, QString* errorMessage)
+    {
+        qint64 total = 0;
+        while (total < size && offset + total < fileSize) {
+#if defined(Q_OS_UNIX)
+            ssize_t got = ::pread(fd, data + total, size_t(size - total), off_t(offset + total));
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                *errorMessage = QString::fromLocal8Bit(std::strerror(errno));
+                return -1;
+            }
+#else
+            qint64 got = file->seek(offset + total) ? file->read(data + total, size - total) : -1;
+            if (got < 0) {
+                *errorMessage = file->errorString();
+                return -1;
+            }
+#endif
+            if (got == 0) {
+                break;
+            }
+            total += got;
+            if (directIO && total < size && offset + total < fileSize) {
+                // A short read in the middle of the file: with O_DIRECT the rest has to be asked for
+                // from a block boundary, so the part of the last block that did arrive is read again
+                total = total / Alignment * Alignment;
+            }
+        }
+        return total;
+    }
+
+    int fd = -1;
+    qint64 fileSize = 0;
+    bool directIO = false;
+
+private:
+#if defined(Q_OS_UNIX)
+    // Size and flags of the descriptor, then O_DIRECT if asked for
+    bool start(bool direct, QString* errorMessage)
+    {
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            *errorMessage = QString::fromLocal8Bit(std::strerror(errno));
+            close();
+            return false;
+        }
+        fileSize = qint64(info.st_size);
+        originalFlags = ::fcntl(fd, F_GETFL);
+        if (originalFlags < 0) {
+            originalFlags = O_RDONLY;
+        }
+#if defined(O_DIRECT)
+        originalFlags &= ~O_DIRECT;
+#endif
+        setDirect(direct);
+        return true;
+    }
+
+    bool ownsFd = false;
+    int originalFlags = 0;
+#else
+    QFile ownFile;
+    QFile* file = nullptr;
+#endif
+};
+
+// Keeps the piece bookkeeping that both backends share
+struct Pipeline {
+    InputFile* input = nullptr;
+    std::vector<Slot> buffers;
+    qint64 bufferSize = 0;
+    const AsyncFileReader::Consumer* consume = nullptr;
+    qint64 delivered = 0;
+    QString error;
+    std::exception_ptr thrown;   // Thrown by the parser; re-thrown once the reads have stopped
+
+    // Hand one finished piece to the parser; false to stop reading
+    bool deliver(const Slot& slot)
+    {
+        bool more = false;
+        try {
+            more = (*consume)(slot.data, slot.length, slot.offset);
+        } catch (...) {
+            thrown = std::current_exception();
+            return false;
+        }
+        delivered += slot.length;
+        return more;
+    }
+
+    // How much to ask the disk for when a slot still needs bytes. With O_DIRECT the length must be
+    // whole blocks; the last read then simply comes back short at the end of the file.
+    qint64 wanted(const Slot& slot) const
+    {
+        qint64 remaining = slot.length - slot.filled;
+        return input->directIO ? roundUp(remaining) : remaining;
+    }
+};
+
+#if defined(ASYNCFILEREADER_HAS_IO_URING)
+
+// The bare minimum of io_uring: a submission queue we write reads into and a completion queue
+// the kernel writes results into, both shared with the kernel through mapped memory
+class Ring
+{
+public:
+    ~Ring()
+    {
+        if (sqes) {
+            munmap(sqes, sqeBytes);
+        }
+        if (cqRing) {
+            munmap(cqRing, cqRingBytes);
+        }
+        if (sqRing) {
+            munmap(sqRing, sqRingBytes);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // False if the kernel is too old or io_uring is blocked (containers often forbid it)
+    bool setup(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return false;
+        }
+
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing = mapRing(sqRingBytes, IORING_OFF_SQ_RING);
+        cqRing = mapRing(cqRingBytes, IORING_OFF_CQ_RING);
+        void* sqeMemory = mapRing(sqeBytes, IORING_OFF_SQES);
+        sqes = static_cast<io_uring_sqe*>(sqeMemory);
+        if (!sqRing || !cqRing || !sqes) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        localTail = *sqTail;
+        return true;
+    }
+
+    // Queue a read of one buffer; it goes to the kernel with the next enter()
+    void queueRead(int fileFd, struct iovec* vector, qint64 offset, quint64 userData)
+    {
+        unsigned index = localTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;   // Plain READ needs Linux 5.6, READV works since io_uring began
+        sqe->fd = fileFd;
+        sqe->addr = quint64(reinterpret_cast<quintptr>(vector));
+        sqe->len = 1;
+        sqe->off = quint64(offset);
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        ++localTail;
+        ++unsubmitted;
+    }
+
+    // Hand queued reads to the kernel and wait until at least one has finished
+    bool enter(QString* errorMessage)
+    {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        for (;;) {
+            long submitted = syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted >= 0) {
+                unsubmitted -= unsigned(submitted);
+                return true;
+            }
+            if (errno != EINTR) {
+                *errorMessage = QString::fromLocal8Bit(std::strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    // Take one finished read off the completion queue
+    bool popCompletion(quint64& userData, int& result)
+    {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        const io_uring_cqe& cqe = cqes[head & cqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    unsigned capacity() const { return sqEntries; }
+
+private:
+    void* mapRing(size_t bytes, off_t what)
+    {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, what);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    int fd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingBytes = 0;
+    size_t cqRingBytes = 0;
+    size_t sqeBytes = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned localTail = 0;
+    unsigned unsubmitted = 0;
+};
+
+// Keep every buffer busy with a read; whenever the oldest piece is complete, parse it and send its
+// buffer off for the next unread piece. Pieces can finish in any order, but are parsed in file order.
+bool readWithRing(Ring& ring, Pipeline& pipeline)
+{
+    InputFile& input = *pipeline.input;
+    std::vector<Slot>& buffers = pipeline.buffers;
+    std::vector<struct iovec> vectors(buffers.size());
+    std::deque<int> order;   // Slots in file order, oldest first
+    qint64 nextOffset = 0;
+    int inFlight = 0;
+
+    auto queueRead = [&](int index) {
+        Slot& slot = buffers[size_t(index)];
+        if (input.directIO) {
+            // O_DIRECT reads must start on a block boundary. Buffers and pieces do; after a short
+            // read the rest is asked for from the start of the block it stopped in.
+            slot.filled = slot.filled / Alignment * Alignment;
+        }
+        vectors[size_t(index)].iov_base = slot.data + slot.filled;
+        vectors[size_t(index)].iov_len = size_t(pipeline.wanted(slot));
+        ring.queueRead(input.fd, &vectors[size_t(index)], slot.offset + slot.filled, quint64(index));
+        ++inFlight;
+    };
+    auto startPiece = [&](int index) {
+        Slot& slot = buffers[size_t(index)];
+        slot.offset = nextOffset;
+        slot.length = qMin(pipeline.bufferSize, input.fileSize - nextOffset);
+        slot.filled = 0;
+        slot.done = false;
+        nextOffset += slot.length;
+        order.push_back(index);
+        queueRead(index);
+    };
+    // Collect finished reads; false if one failed
+    auto collect = [&]() {
+        if (!ring.enter(&pipeline.error)) {
+            return false;
+        }
+        bool ok = true;
+        quint64 index = 0;
+        int result = 0;
+        while (ring.popCompletion(index, result)) {
+            --inFlight;
+            Slot& slot = buffers[size_t(index)];
+            if (result == -EINTR || result == -EAGAIN) {
+                queueRead(int(index));
+            } else if (result < 0) {
+                pipeline.error = QString::fromLocal8Bit(std::strerror(-result));
+                ok = false;
+            } else if (result == 0) {
+                pipeline.error = "The file ended early (was it changed while reading?)";
+                ok = false;
+            } else {
+                slot.filled += result;
+                if (slot.filled >= slot.length) {
+                    slot.filled = slot.length;
+                    slot.done = true;
+                } else if (ok) {
+                    queueRead(int(index));   // Short read, ask for the rest
+                }
+            }
+        }
+        return ok;
+    };
+
+    for (size_t i = 0; i < buffers.size() && nextOffset < input.fileSize; ++i) {
+        startPiece(int(i));
+    }
+
+    bool ok = true;
+    while (ok && !order.empty()) {
+        int index = order.front();
+        while (ok && !buffers[size_t(index)].done) {
+            ok = collect();
+        }
+        if (!ok) {
+            break;
+        }
+        order.pop_front();
+        if (!pipeline.deliver(buffers[size_t(index)])) {
+            break;
+        }
+        if (nextOffset < input.fileSize) {
+            startPiece(index);
+        }
+    }
+
+    // The kernel may still be writing into the buffers; wait for every read before they are freed
+    QString drainError;
+    while (inFlight > 0 && ring.enter(&drainError)) {
+        quint64 index = 0;
+        int result = 0;
+        while (ring.popCompletion(index, result)) {
+            --inFlight;
+        }
+    }
+    return ok;
+}
+
+#endif // ASYNCFILEREADER_HAS_IO_URING
+
+// One reader thread fills the buffers in turn while the calling thread parses them, so reading
+// and parsing still overlap, just with a single read waiting on the disk at a time
+bool readWithThread(Pipeline& pipeline)
+{
+    InputFile& input = *pipeline.input;
+    std::vector<Slot>& buffers = pipeline.buffers;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping = false;
+    bool failed = false;
+    QString readError;
+
+    std::thread reader([&]() {
+        qint64 offset = 0;
+        size_t index = 0;
+        while (offset < input.fileSize) {
+            Slot& slot = buffers[index];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return stopping || !slot.done; });
+                if (stopping) {
+                    return;
+                }
+            }
+            slot.offset = offset;
+            slot.length = qMin(pipeline.bufferSize, input.fileSize - offset);
+            slot.filled = 0;
+            QString error;
+            qint64 got = input.readAt(slot.data, offset, pipeline.wanted(slot), &error);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (got < slot.length) {
+                    failed = true;
+                    readError = got < 0 ? error : QString("The file ended early (was it changed while reading?)");
+                } else {
+                    slot.filled = slot.length;
+                    slot.done = true;
+                }
+            }
+            changed.notify_all();
+            if (got < slot.length) {
+                return;
+            }
+            offset += slot.length;
+            index = (index + 1) % buffers.size();
+        }
+    });
+
+    bool ok = true;
+    qint64 offset = 0;
+    size_t index = 0;
+    while (offset < input.fileSize) {
+        Slot& slot = buffers[index];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return failed || slot.done; });
+            if (!slot.done) {
+                pipeline.error = readError;
+                ok = false;
+                break;
+            }
+        }
+        bool more = pipeline.deliver(slot);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.done = false;
+        }
+        changed.notify_all();
+        if (!more) {
+            break;
+        }
+        offset += slot.length;
+        index = (index + 1) % buffers.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    reader.join();
+    return ok;
+}
+
+// Everything after the file is open: set up the buffers, read with the best backend, report
+bool readInput(InputFile& input, const AsyncFileReader::Consumer& consume, const AsyncFileReader::Options& options,
+               AsyncFileReader::Report* report, QString* errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    auto fail = [&](const QString& message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    int bufferCount = qBound(2, options.bufferCount, 64);
+    qint64 bufferSize = roundUp(qMax<qint64>(options.bufferSize, Alignment));
+
+    // A small file needs no more buffer space than its own size. (Sequences of small frames
+    // would otherwise spend longer allocating the ring than reading.)
+    bufferSize = qMin(bufferSize, roundUp(qMax<qint64>(input.fileSize, Alignment)));
+    bufferCount = int(qBound<qint64>(2, (input.fileSize + bufferSize - 1) / bufferSize, bufferCount));
+
+    // All buffers in one block, each starting on a block boundary. Left uninitialised: every byte
+    // handed to the parser is read from the file first.
+    std::unique_ptr<char[]> storage(new char[size_t(bufferCount * bufferSize + Alignment)]);
+    char* aligned = storage.get() + (Alignment - qint64(reinterpret_cast<quintptr>(storage.get()) % Alignment)) % Alignment;
+
+    Pipeline pipeline;
+    pipeline.input = &input;
+    pipeline.bufferSize = bufferSize;
+    pipeline.consume = &consume;
+    pipeline.buffers.resize(size_t(bufferCount));
+    for (int i = 0; i < bufferCount; ++i) {
+        pipeline.buffers[size_t(i)].data = aligned + i * bufferSize;
+    }
+
+    AsyncFileReader::Backend backend = AsyncFileReader::PRead;
+    bool ok = true;
+#if defined(ASYNCFILEREADER_HAS_IO_URING)
+    Ring ring;
+    if (options.allowIoUring && ring.setup(unsigned(bufferCount)) && ring.capacity() >= unsigned(bufferCount)) {
+        backend = AsyncFileReader::IoUring;
+        ok = readWithRing(ring, pipeline);
+    } else {
+        ok = readWithThread(pipeline);
+    }
+#else
+    ok = readWithThread(pipeline);
+#endif
+
+    // A file system that accepts O_DIRECT when it is switched on but not when reading fails the
+    // very first read; try once more through the page cache
+    const bool directRefused = !ok && input.directIO && pipeline.delivered == 0 && !pipeline.thrown;
+    if (directRefused) {
+        qWarning() << "AsyncFileReader: direct reads refused (" << pipeline.error << "), reading through the cache";
+        input.setDirect(false);
+        pipeline.error.clear();
+        for (Slot& slot : pipeline.buffers) {
+            slot.done = false;
+        }
+#if defined(ASYNCFILEREADER_HAS_IO_URING)
+        ok = backend == AsyncFileReader::IoUring ? readWithRing(ring, pipeline) : readWithThread(pipeline);
+#else
+        ok = readWithThread(pipeline);
+#endif
+    }
+
+    if (pipeline.thrown) {
+        std::rethrow_exception(pipeline.thrown);
+    }
+
+    const bool usedDirect = input.directIO;
+    if (report) {
+        report->backend = backend;
+        report->directIO = usedDirect;
+        report->bytes = pipeline.delivered;
+        report->milliseconds = timer.elapsed();
+        double seconds = double(timer.nsecsElapsed()) / 1e9;
+        report->gigabytesPerSecond = seconds > 0.0 ? double(pipeline.delivered) / seconds / 1e9 : 0.0;
+    }
+    qDebug() << "AsyncFileReader:" << pipeline.delivered << "bytes with" << AsyncFileReader::backendName(backend)
+             << (usedDirect ? "(direct)" : "") << "in" << timer.elapsed() << "ms";
+
+    if (!ok) {
+        return fail("Read failed: " + pipeline.error);
+    }
+    return true;
+}
+
+} // namespace
+
+bool AsyncFileReader::readFile(const QString& fileName, const Consumer& consume, const Options& options,
+                               Report* report, QString* errorMessage)
+{
+    QString error;
+    InputFile input;
+    if (!input.open(fileName, options.directIO, &error)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot open file: " + error;
+        }
+        return false;
+    }
+    return readInput(input, consume, options, report, errorMessage);
+}
+
+bool AsyncFileReader::readFile(QFile& file, const Consumer& consume, const Options& options,
+                               Report* report, QString* errorMessage)
+{
+    QString error;
+    InputFile input;
+    if (!input.borrow(file, options.directIO, &error)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot read file: " + error;
+        }
+        return false;
+    }
+    return readInput(input, consume, options, report, errorMessage);
+}
+
+QString AsyncFileReader::backendName(Backend backend)
+{
+    switch (backend) {
+    case IoUring: return "io_uring";
+    case PRead: return "pread";
+    }
+    return QString();
+}
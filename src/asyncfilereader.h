@@ -0,0 +1,56 @@
+#ifndef ASYNCFILEREADER_H
+#define ASYNCFILEREADER_H
+
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+#include <functional>
+
+// Reads a file from front to back as fast as the disk allows, handing each piece to a parser
+// while the next pieces are still being read.
+//
+// A plain QFile read asks the disk for one small piece at a time and waits for it, and the parser
+// waits for the read: a fast NVMe drive sits idle most of the time. Here a ring of large buffers
+// is kept in flight at once. On Linux the reads are queued with io_uring (and can skip the page
+// cache with O_DIRECT); where io_uring is missing or blocked, a reader thread fills the same ring
+// with pread. Either way the parser runs on the calling thread and sees the pieces in file order.
+class AsyncFileReader
+{
+public:
+    enum Backend {
+        IoUring,    // Linux io_uring, several reads queued in the kernel at once
+        PRead       // One reader thread, one read at a time (works everywhere)
+    };
+
+    struct Options {
+        int bufferCount = 8;                    // Reads kept in flight
+        qint64 bufferSize = 8 * 1024 * 1024;    // Bytes per read (rounded up to 4 KB)
+        bool directIO = false;                  // Skip the page cache (Linux only, ignored if refused)
+        bool allowIoUring = true;               // False forces the pread backend
+    };
+
+    struct Report {
+        Backend backend = PRead;
+        bool directIO = false;                  // Whether O_DIRECT was actually used
+        qint64 bytes = 0;                       // Bytes handed to the parser
+        double gigabytesPerSecond = 0.0;        // Including the parser's time
+        qint64 milliseconds = 0;
+    };
+
+    // Called for consecutive pieces of the file in order; offset is where data starts in the file.
+    // Return false to stop reading early (that is not an error).
+    using Consumer = std::function<bool(const char* data, qint64 size, qint64 offset)>;
+
+    // Read the whole file through consume(). Returns false if the file cannot be opened or a read
+    // fails; pieces already handed over stay handed over.
+    static bool readFile(const QString& fileName, const Consumer& consume, const Options& options,
+                         Report* report = nullptr, QString* errorMessage = nullptr);
+    // The same for a file the caller already has open (on Unix its descriptor is read directly).
+    // The file stays open, and its flags are put back as they were.
+    static bool readFile(QFile& file, const Consumer& consume, const Options& options,
+                         Report* report = nullptr, QString* errorMessage = nullptr);
+
+    static QString backendName(Backend backend);
+};
+
+#endif // ASYNCFILEREADER_H
@@ -0,0 +1,56 @@
+#include "backgroundjob.h"
+#include <QDebug>
+#include <exception>
+
+BackgroundJob::BackgroundJob()
+    : busy(false)
+{
+}
+
+BackgroundJob::~BackgroundJob()
+{
+    wait();
+}
+
+bool BackgroundJob::start(std::function<void()> work, std::function<void()> done)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (busy) {
+            return false;
+        }
+        busy = true;
+    }
+    // The previous job has finished, but its thread still has to be collected
+    if (worker.joinable()) {
+        worker.join();
+    }
+    worker = std::thread([this, work, done]() {
+        try {
+            work();
+        } catch (const std::exception &e) {
+            qWarning() << "BackgroundJob: job failed:" << e.what();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = false;
+        }
+        if (done) {
+            done();
+        }
+    });
+    return true;
+}
+
+bool BackgroundJob::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busy;
+}
+
+void BackgroundJob::wait()
+{
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef BACKGROUNDJOB_H
+#define BACKGROUNDJOB_H
+
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs one slow job at a time (slicing, deviation) on a background thread, so the window keeps
+// responding while it works. The job's inputs are copied in when it starts, and it hands its
+// result back through its own done callback; a widget usually passes the result on to its own
+// thread with QMetaObject::invokeMethod and applies it there.
+class BackgroundJob
+{
+public:
+    BackgroundJob();
+    ~BackgroundJob();     // Waits for a running job
+
+    // Run work on a background thread, then done (on the same thread, once the job no longer
+    // counts as busy, so whatever done hands the result to can start the next job right away).
+    // False if a job is still running.
+    bool start(std::function<void()> work, std::function<void()> done);
+    bool isBusy() const;
+    void wait();          // Until the running job, if any, has finished
+
+private:
+    std::thread worker;
+    mutable std::mutex mutex;
+    bool busy;
+};
+
+#endif // BACKGROUNDJOB_H
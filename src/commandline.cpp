@@ -0,0 +1,664 @@
+#include "commandline.h"
+#include "asyncfilereader.h"
+#include "glbwriter.h"
+#include "mesharchive.h"
+#include "meshbvh.h"
+#include "meshfeed.h"
+#include "meshquery.h"
+#include "meshscanner.h"
+#include "renderservice.h"
+#include "stlloader.h"
+#include "stlwriter.h"
+#include "tileset.h"
+#include <QFileInfo>
+#include <QTextStream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+QTextStream &standardOutput()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream &standardError()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+QString formatPoint(const QVector3D &p)
+{
+    return QString("%1 %2 %3").arg(p.x(), 0, 'g', 9).arg(p.y(), 0, 'g', 9).arg(p.z(), 0, 'g', 9);
+}
+
+} // namespace
+
+bool CommandLine::isCommand(int argc, char *argv[])
+{
+    if (argc < 2) {
+        return false;
+    }
+    const char *command = argv[1];
+    return std::strcmp(command, "--probe") == 0 || std::strcmp(command, "--part-distance") == 0 ||
+           std::strcmp(command, "--convert") == 0 || std::strcmp(command, "--export-glb") == 0 ||
+           std::strcmp(command, "--archive") == 0 || std::strcmp(command, "--build-tiles") == 0 ||
+           std::strcmp(command, "--read-speed") == 0 || std::strcmp(command, "--feed-demo") == 0 ||
+           std::strcmp(command, "--scan") == 0 || std::strcmp(command, "--serve") == 0 ||
+           std::strcmp(command, "--help") == 0;
+}
+
+bool CommandLine::needsOpenGL(int argc, char *argv[])
+{
+    return argc >= 2 && std::strcmp(argv[1], "--serve") == 0;
+}
+
+int CommandLine::run(const QStringList &arguments)
+{
+    QString command = arguments.value(1);
+    if (command == "--probe") {
+        return probe(arguments);
+    }
+    if (command == "--part-distance") {
+        return partDistance(arguments);
+    }
+    if (command == "--convert") {
+        return convert(arguments);
+    }
+    if (command == "--export-glb") {
+        return exportGLB(arguments);
+    }
+    if (command == "--archive") {
+        return archive(arguments);
+    }
+    if (command == "--build-tiles") {
+        return buildTiles(arguments);
+    }
+    if (command == "--read-speed") {
+        return readSpeed(arguments);
+    }
+    if (command == "--feed-demo") {
+        return feedDemo(arguments);
+    }
+    if (command == "--scan") {
+        return scan(arguments);
+    }
+    if (command == "--serve") {
+        return serve(arguments);
+    }
+    printUsage();
+    return command == "--help" ? 0 : 1;
+}
+
+void CommandLine::printUsage()
+{
+    standardOutput() << "Usage:\n"
+                     << "  STLViewer --probe model.stl points.csv [--signed] [--output results.csv]\n"
+                     << "      Distance from every point (one \"x y z\" per line) to the model, with the\n"
+                     << "      closest point on the surface. --signed makes points inside negative.\n"
+                     << "  STLViewer --part-distance model.stl [other.stl]\n"
+                     << "      Smallest gap between the two largest parts of a model, or between two models.\n"
+                     << "  STLViewer --convert input output [--ascii] [--recursive]\n"
+                     << "      Convert an STL file, or every .stl file in a folder, to binary (or text with\n"
+                     << "      --ascii). Folders are converted into the output folder with one file per core.\n"
+                     << "  STLViewer --export-glb model.stl output.glb\n"
+                     << "      Save the welded model as compressed glTF (quantized, meshopt-compressed) for\n"
+                     << "      web viewers, and print how much smaller it is than binary STL.\n"
+                     << "  STLViewer --archive model.stl output.cmesh\n"
+                     << "      Save the welded model as a compact mesh archive, read it back, and print the\n"
+                     << "      compression ratio and how fast it decodes.\n"
+                     << "  STLViewer --build-tiles model.stl output.tiles\n"
+                     << "      Cut a binary STL that is too big to load into an octree of simplified tiles\n"
+                     << "      for File > Open Tile Set. The model is read through a memory map, not loaded.\n"
+                     << "  STLViewer --read-speed file [--direct] [--pread]\n"
+                     << "      Read a file the way the loader does (io_uring on Linux) and print the speed in\n"
+                     << "      GB/s; for a binary STL also the speed with parsing. --direct skips the page\n"
+                     << "      cache, --pread uses the simple reader thread instead of io_uring.\n"
+                     << "  STLViewer --feed-demo [name] [--frames n] [--grid n] [--fps rate]\n"
+                     << "      Publish a growing, rippling surface through shared memory (default name\n"
+                     << "      stlviewer-feed, 900 frames of a 256 x 256 grid at 30 fps) for File > Open\n"
+                     << "      Live Feed. A reference producer for the MeshFeed protocol.\n"
+                     << "  STLViewer --scan folder output.csv|output.json [--resume] [--threads n]\n"
+                     << "               [--max-in-flight MB] [--no-recursive]\n"
+                     << "      Measure every model file under a folder (triangles, bounds, area, volume,\n"
+                     << "      watertightness, degenerate/duplicate/flipped facets) on all cores, writing one\n"
+                     << "      record per file as it finishes (.json gives one JSON object per line).\n"
+                     << "      --resume skips files already in the output; --max-in-flight caps the file\n"
+                     << "      bytes being loaded at once (default 2048).\n"
+                     << "  STLViewer --serve [socket] [--cache MB] [--gpu-cache MB] [--threads n] [--deadline ms]\n"
+                     << "      Run as a render service on a Unix domain socket (default\n"
+                     << "      $XDG_RUNTIME_DIR/stlviewer-render.sock) until Ctrl+C. Clients send lines like\n"
+                     << "      \"render file=part.stl width=800 height=600 view=iso\" and get a PNG back, or\n"
+                     << "      \"measure file=part.stl\" for the --scan statistics as JSON. Meshes stay loaded\n"
+                     << "      (--cache, default 1024 MB; --gpu-cache, default 512 MB) between requests.\n"
+                     << "All values are in the units of the STL files.\n";
+    standardOutput().flush();
+}
+
+bool CommandLine::loadModel(const QString &fileName, QVector<float> &vertexData, QVector<unsigned int> &indices,
+                            QString *errorMessage)
+{
+    STLLoader loader;
+    loader.setAutoCenter(false);
+    loader.setAutoNormalize(false);
+    loader.setRemoveDuplicateFacets(true);
+    loader.setRepairOrientation(true);  // Signed distances need consistent winding
+    if (loader.loadFile(fileName) != STLLoader::Success) {
+        if (errorMessage) {
+            *errorMessage = fileName + ": " + loader.getErrorString();
+        }
+        return false;
+    }
+    vertexData = loader.getVertexData();
+    indices = loader.getIndices();
+    return true;
+}
+
+int CommandLine::probe(const QStringList &arguments)
+{
+    // Positional arguments first, then the options in any order
+    QStringList files;
+    bool signedResult = false;
+    QString outputFile;
+    for (int i = 2; i < arguments.size(); ++i) {
+        if (arguments[i] == "--signed") {
+            signedResult = true;
+        } else if (arguments[i] == "--output" && i + 1 < arguments.size()) {
+            outputFile = arguments[++i];
+        } else {
+            files << arguments[i];
+        }
+    }
+    if (files.size() != 2) {
+        printUsage();
+        return 1;
+    }
+
+    QString errorMessage;
+    QVector<float> vertexData;
+    QVector<unsigned int> indices;
+    if (!loadModel(files[0], vertexData, indices, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+
+    QVector<QVector3D> points;
+    if (!MeshQuery::readProbes(files[1], points, &errorMessage)) {
+        standardError() << "Error: " << files[1] << ": " << errorMessage << "\n";
+        return 1;
+    }
+
+    MeshBVH surface;
+    surface.build(vertexData, indices);
+    if (signedResult && !surface.hasPseudoNormals()) {
+        standardError() << "Warning: the model has no merged vertices, distances are not signed\n";
+    }
+
+    QVector<MeshBVH::Hit> hits;
+    MeshQuery::ProbeReport report = MeshQuery::probe(surface, points, signedResult, hits);
+
+    if (!outputFile.isEmpty()) {
+        if (!MeshQuery::writeProbeResults(outputFile, points, hits, &errorMessage)) {
+            standardError() << "Error: " << outputFile << ": " << errorMessage << "\n";
+            return 1;
+        }
+    } else {
+        QTextStream &out = standardOutput();
+        out << "# x y z distance closest_x closest_y closest_z triangle\n";
+        for (int i = 0; i < points.size(); ++i) {
+            out << formatPoint(points[i]) << " " << QString::number(hits[i].distance, 'g', 9) << " "
+                << formatPoint(hits[i].point) << " " << hits[i].triangle << "\n";
+        }
+    }
+
+    standardOutput() << "# " << report.probes << " probes in " << report.milliseconds << " ms, distance "
+                     << report.minDistance << " to " << report.maxDistance << "\n";
+    standardOutput().flush();
+    return 0;
+}
+
+int CommandLine::partDistance(const QStringList &arguments)
+{
+    QStringList files = arguments.mid(2);
+    if (files.isEmpty() || files.size() > 2) {
+        printUsage();
+        return 1;
+    }
+
+    QString errorMessage;
+    QVector<float> vertexData;
+    QVector<unsigned int> indices;
+    if (!loadModel(files[0], vertexData, indices, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+
+    MeshBVH first;
+    MeshBVH second;
+    if (files.size() == 2) {
+        QVector<float> otherVertexData;
+        QVector<unsigned int> otherIndices;
+        if (!loadModel(files[1], otherVertexData, otherIndices, &errorMessage)) {
+            standardError() << "Error: " << errorMessage << "\n";
+            return 1;
+        }
+        first.build(vertexData, indices);
+        second.build(otherVertexData, otherIndices);
+    } else {
+        QVector<QVector<unsigned int>> parts = MeshQuery::splitParts(indices);
+        if (parts.size() < 2) {
+            standardError() << "Error: " << files[0] << " has only one part\n";
+            return 1;
+        }
+        first.build(vertexData, parts[0]);
+        second.build(vertexData, parts[1]);
+    }
+
+    MeshQuery::PartReport report = MeshQuery::partDistance(first, second);
+    if (!report.found) {
+        standardError() << "Error: the parts could not be measured\n";
+        return 1;
+    }
+
+    QTextStream &out = standardOutput();
+    out << "distance " << QString::number(report.pair.distance, 'g', 9) << "\n"
+        << "point_a " << formatPoint(report.pair.point) << "\n"
+        << "point_b " << formatPoint(report.pair.otherPoint) << "\n"
+        << "# found in " << report.milliseconds << " ms\n";
+    out.flush();
+    return 0;
+}
+
+int CommandLine::convert(const QStringList &arguments)
+{
+    QStringList paths;
+    STLWriter::Format format = STLWriter::Binary;
+    bool recursive = false;
+    for (int i = 2; i < arguments.size(); ++i) {
+        if (arguments[i] == "--ascii") {
+            format = STLWriter::ASCII;
+        } else if (arguments[i] == "--recursive") {
+            recursive = true;
+        } else {
+            paths << arguments[i];
+        }
+    }
+    if (paths.size() != 2) {
+        printUsage();
+        return 1;
+    }
+
+    if (!QFileInfo(paths[0]).isDir()) {
+        QString errorMessage;
+        qint64 triangles = 0;
+        if (!STLWriter::convertFile(paths[0], paths[1], format, &triangles, &errorMessage)) {
+            standardError() << "Error: " << paths[0] << ": " << errorMessage << "\n";
+            return 1;
+        }
+        standardOutput() << paths[1] << ": " << triangles << " triangles\n";
+        standardOutput().flush();
+        return 0;
+    }
+
+    STLWriter::ConvertReport report = STLWriter::convertFolder(paths[0], paths[1], format, recursive);
+    for (const QString &error : report.errors) {
+        standardError() << "Error: " << error << "\n";
+    }
+    standardOutput() << report.converted << " of " << report.files << " files converted, " << report.triangles
+                     << " triangles, " << report.bytesRead << " bytes read, " << report.bytesWritten
+                     << " bytes written in " << report.milliseconds << " ms\n";
+    standardOutput().flush();
+    return report.failed > 0 || report.files == 0 ? 1 : 0;
+}
+
+int CommandLine::exportGLB(const QStringList &arguments)
+{
+    if (arguments.size() != 4) {
+        printUsage();
+        return 1;
+    }
+
+    QVector<float> vertexData;
+    QVector<unsigned int> indices;
+    QString errorMessage;
+    if (!loadModel(arguments[2], vertexData, indices, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+
+    GLBWriter::Report report;
+    if (!GLBWriter::write(arguments[3], vertexData, indices, 1.0f, QVector3D(), &report, &errorMessage)) {
+        standardError() << "Error: " << arguments[3] << ": " << errorMessage << "\n";
+        return 1;
+    }
+
+    QTextStream &out = standardOutput();
+    out << "triangles " << report.triangles << "\n"
+        << "vertices " << report.vertices << "\n"
+        << "stl_bytes " << report.stlBytes << "\n"
+        << "glb_bytes " << report.fileBytes << "\n"
+        << "compression_ratio " << QString::number(report.compressionRatio, 'f', 2) << "\n"
+        << "encode_mb_per_s " << QString::number(report.encodeMegabytesPerSecond, 'f', 1) << "\n"
+        << "# written in " << report.milliseconds << " ms\n";
+    out.flush();
+    return 0;
+}
+
+int CommandLine::archive(const QStringList &arguments)
+{
+    if (arguments.size() != 4) {
+        printUsage();
+        return 1;
+    }
+
+    QVector<float> vertexData;
+    QVector<unsigned int> indices;
+    QString errorMessage;
+    if (!loadModel(arguments[2], vertexData, indices, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+
+    MeshArchive::WriteReport writeReport;
+    if (!MeshArchive::write(arguments[3], vertexData, indices, 1.0f, QVector3D(), &writeReport, &errorMessage)) {
+        standardError() << "Error: " << arguments[3] << ": " << errorMessage << "\n";
+        return 1;
+    }
+
+    // Reading it back checks the file and measures the decoder
+    MeshArchive::ReadReport readReport;
+    if (!MeshArchive::read(arguments[3], vertexData, indices, &readReport, &errorMessage)) {
+        standardError() << "Error: " << arguments[3] << ": " << errorMessage << "\n";
+        return 1;
+    }
+
+    QTextStream &out = standardOutput();
+    out << "triangles " << writeReport.triangles << "\n"
+        << "vertices " << writeReport.vertices << "\n"
+        << "blocks " << writeReport.blocks << "\n"
+        << "stl_bytes " << writeReport.stlBytes << "\n"
+        << "archive_bytes " << writeReport.fileBytes << "\n"
+        << "compression_ratio " << QString::number(writeReport.compressionRatio, 'f', 2) << "\n"
+        << "decode_mtri_per_s " << QString::number(readReport.trianglesPerSecond / 1e6, 'f', 1) << "\n"
+        << "# written in " << writeReport.milliseconds << " ms, read back in " << readReport.milliseconds << " ms\n";
+    out.flush();
+    return 0;
+}
+
+int CommandLine::buildTiles(const QStringList &arguments)
+{
+    if (arguments.size() != 4) {
+        printUsage();
+        return 1;
+    }
+
+    TileSet::BuildReport report;
+    QString errorMessage;
+    if (!TileSet::build(arguments[2], arguments[3], &report, &errorMessage)) {
+        standardError() << "Error: " << arguments[3] << ": " << errorMessage << "\n";
+        return 1;
+    }
+
+    QTextStream &out = standardOutput();
+    out << "triangles " << report.sourceTriangles << "\n"
+        << "nodes " << report.nodes << "\n"
+        << "leaves " << report.leaves << "\n"
+        << "levels " << report.levels << "\n"
+        << "depth " << report.depth << "\n"
+        << "stored_triangles " << report.storedTriangles << "\n"
+        << "tile_bytes " << report.fileBytes << "\n"
+        << "build_mtri_per_s " << QString::number(report.trianglesPerSecond / 1e6, 'f', 2) << "\n"
+        << "# built in " << report.milliseconds << " ms\n";
+    out.flush();
+    return 0;
+}
+
+int CommandLine::readSpeed(const QStringList &arguments)
+{
+    QString fileName;
+    AsyncFileReader::Options options;
+    for (int i = 2; i < arguments.size(); ++i) {
+        if (arguments[i] == "--direct") {
+            options.directIO = true;
+        } else if (arguments[i] == "--pread") {
+            options.allowIoUring = false;
+        } else if (fileName.isEmpty()) {
+            fileName = arguments[i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (fileName.isEmpty()) {
+        printUsage();
+        return 1;
+    }
+
+    // The bytes are only touched, so this is the speed of the disk and the read path alone
+    quint64 checksum = 0;
+    auto touch = [&checksum](const char *data, qint64 size, qint64) {
+        for (qint64 i = 0; i < size; i += 4096) {
+            checksum += quint8(data[i]);
+        }
+        return true;
+    };
+    AsyncFileReader::Report report;
+    QString errorMessage;
+    if (!AsyncFileReader::readFile(fileName, touch, options, &report, &errorMessage)) {
+        standardError() << "Error: " << fileName << ": " << errorMessage << "\n";
+        return 1;
+    }
+
+    QTextStream &out = standardOutput();
+    out << "backend " << AsyncFileReader::backendName(report.backend) << "\n"
+        << "direct_io " << (report.directIO ? "yes" : "no") << "\n"
+        << "bytes " << report.bytes << "\n"
+        << "read_gb_per_s " << QString::number(report.gigabytesPerSecond, 'f', 2) << "\n";
+
+    if (STLLoader::isBinarySTL(fileName)) {
+        STLLoader loader;
+        loader.setAutoCenter(false);
+        loader.setMergeVertices(false);
+        loader.setDirectIO(options.directIO);
+        if (loader.loadFile(fileName) != STLLoader::Success) {
+            standardError() << "Error: " << fileName << ": " << loader.getErrorString() << "\n";
+            return 1;
+        }
+        out << "triangles " << loader.getTriangleCount() << "\n"
+            << "parse_gb_per_s " << QString::number(loader.getReadReport().gigabytesPerSecond, 'f', 2) << "\n";
+    }
+    out << "# read in " << report.milliseconds << " ms\n";
+    out.flush();
+    return 0;
+}
+
+int CommandLine::feedDemo(const QStringList &arguments)
+{
+    QString name = "stlviewer-feed";
+    int frames = 900;
+    int grid = 256;
+    double framesPerSecond = 30.0;
+    bool named = false;
+    for (int i = 2; i < arguments.size(); ++i) {
+        bool ok = true;
+        if (arguments[i] == "--frames" && i + 1 < arguments.size()) {
+            frames = arguments[++i].toInt(&ok);
+        } else if (arguments[i] == "--grid" && i + 1 < arguments.size()) {
+            grid = arguments[++i].toInt(&ok);
+        } else if (arguments[i] == "--fps" && i + 1 < arguments.size()) {
+            framesPerSecond = arguments[++i].toDouble(&ok);
+        } else if (!named) {
+            name = arguments[i];
+            named = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            printUsage();
+            return 1;
+        }
+    }
+    if (frames < 1 || grid < 2 || grid > 4096 || framesPerSecond <= 0.0) {
+        printUsage();
+        return 1;
+    }
+
+    const int maxVertices = grid * grid;
+    const int maxIndices = (grid - 1) * (grid - 1) * 6;
+    MeshFeedWriter writer;
+    QString errorMessage;
+    if (!writer.create(name, 3, maxVertices, maxIndices, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+    QTextStream &out = standardOutput();
+    out << "feed " << name << "\n"
+        << "# open it with File > Open Live Feed; publishing " << frames << " frames\n";
+    out.flush();
+
+    // A 100 x 100 unit sheet with ripples running out from the middle. For the first third of the
+    // run it grows row by row, the way a scanner fills in a surface.
+    const float size = 100.0f;
+    const float spacing = size / float(grid - 1);
+    std::vector<float> vertexData(size_t(maxVertices) * 6);
+    std::vector<quint32> indices;
+    indices.reserve(size_t(maxIndices));
+    const auto period = std::chrono::duration<double>(1.0 / framesPerSecond);
+    const auto start = std::chrono::steady_clock::now();
+    double publishSeconds = 0.0;
+
+    for (int frame = 0; frame < frames; ++frame) {
+        const float time = float(frame / framesPerSecond);
+        const int rows = qMin(grid, 2 + int(qint64(grid) * frame * 3 / frames));
+        for (int row = 0; row < rows; ++row) {
+            for (int column = 0; column < grid; ++column) {
+                const float x = column * spacing - size * 0.5f;
+                const float y = row * spacing - size * 0.5f;
+                const float r = std::sqrt(x * x + y * y) + 1e-3f;
+                // Height and its slope, for the normal
+                const float wave = 0.3f * r - 4.0f * time;
+                const float height = 4.0f * std::sin(wave) / (1.0f + 0.05f * r);
+                const float slope = (4.0f * 0.3f * std::cos(wave) * (1.0f + 0.05f * r) - 4.0f * std::sin(wave) * 0.05f)
+                                    / ((1.0f + 0.05f * r) * (1.0f + 0.05f * r));
+                QVector3D normal = QVector3D(-slope * x / r, -slope * y / r, 1.0f).normalized();
+                float *vertex = &vertexData[size_t(row * grid + column) * 6];
+                vertex[0] = x;
+                vertex[1] = y;
+                vertex[2] = height;
+                vertex[3] = normal.x();
+                vertex[4] = normal.y();
+                vertex[5] = normal.z();
+            }
+        }
+        indices.clear();
+        for (int row = 0; row + 1 < rows; ++row) {
+            for (int column = 0; column + 1 < grid; ++column) {
+                const quint32 corner = quint32(row * grid + column);
+                indices.insert(indices.end(), {corner, corner + 1, corner + quint32(grid),
+                                               corner + 1, corner + quint32(grid) + 1, corner + quint32(grid)});
+            }
+        }
+
+        const auto publishStart = std::chrono::steady_clock::now();
+        if (!writer.publish(vertexData.data(), rows * grid, indices.data(), int(indices.size()), &errorMessage)) {
+            standardError() << "Error: " << errorMessage << "\n";
+            return 1;
+        }
+        publishSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - publishStart).count();
+        std::this_thread::sleep_until(start + period * (frame + 1));
+    }
+    writer.close();
+
+    out << "frames " << frames << "\n"
+        << "publish_ms " << QString::number(publishSeconds * 1000.0 / frames, 'f', 3) << "\n";
+    out.flush();
+    return 0;
+}
+
+int CommandLine::scan(const QStringList &arguments)
+{
+    QStringList paths;
+    MeshScanner::Options options;
+    for (int i = 2; i < arguments.size(); ++i) {
+        if (arguments[i] == "--resume") {
+            options.resume = true;
+        } else if (arguments[i] == "--no-recursive") {
+            options.recursive = false;
+        } else if (arguments[i] == "--threads" && i + 1 < arguments.size()) {
+            options.threads = arguments[++i].toInt();
+        } else if (arguments[i] == "--max-in-flight" && i + 1 < arguments.size()) {
+            options.maxBytesInFlight = qint64(arguments[++i].toDouble() * 1024 * 1024);
+        } else {
+            paths << arguments[i];
+        }
+    }
+    if (paths.size() != 2 || options.maxBytesInFlight <= 0) {
+        printUsage();
+        return 1;
+    }
+    QString suffix = QFileInfo(paths[1]).suffix().toLower();
+    options.format = suffix == "json" || suffix == "jsonl" || suffix == "ndjson" ? MeshScanner::JsonLines
+                                                                                 : MeshScanner::Csv;
+
+    // A line now and then on standard error, so long runs show they are moving
+    auto progress = [](const MeshScanner::FileStats &stats, const MeshScanner::Report &soFar) {
+        if (!stats.ok) {
+            standardError() << "Error: " << stats.file << ": " << stats.error << "\n";
+        }
+        int done = soFar.measured + soFar.failed;
+        if (done % 1000 == 0) {
+            standardError() << done << " files measured\n";
+            standardError().flush();
+        }
+    };
+
+    MeshScanner::Report report;
+    QString errorMessage;
+    if (!MeshScanner::scan(paths[0], paths[1], options, report, progress, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+    standardOutput() << report.measured << " measured, " << report.failed << " unreadable, " << report.skipped
+                     << " already done, of " << report.files << " model files; " << report.triangles
+                     << " triangles, " << report.bytes << " bytes in " << report.milliseconds << " ms (at most "
+                     << report.peakBytesInFlight << " bytes loading at once)\n";
+    standardOutput().flush();
+    return report.files == 0 ? 1 : 0;
+}
+
+int CommandLine::serve(const QStringList &arguments)
+{
+    RenderService::Options options;
+    for (int i = 2; i < arguments.size(); ++i) {
+        if (arguments[i] == "--cache" && i + 1 < arguments.size()) {
+            options.meshCacheBytes = qint64(arguments[++i].toDouble() * 1024 * 1024);
+        } else if (arguments[i] == "--gpu-cache" && i + 1 < arguments.size()) {
+            options.gpuCacheBytes = qint64(arguments[++i].toDouble() * 1024 * 1024);
+        } else if (arguments[i] == "--threads" && i + 1 < arguments.size()) {
+            options.measureThreads = arguments[++i].toInt();
+        } else if (arguments[i] == "--deadline" && i + 1 < arguments.size()) {
+            options.defaultDeadline = arguments[++i].toLongLong();
+        } else if (options.socketPath.isEmpty() && !arguments[i].startsWith("--")) {
+            options.socketPath = arguments[i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (options.meshCacheBytes < 0 || options.gpuCacheBytes < 0 || options.defaultDeadline <= 0) {
+        printUsage();
+        return 1;
+    }
+
+    QString errorMessage;
+    if (!RenderService::run(options, &errorMessage)) {
+        standardError() << "Error: " << errorMessage << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Runs the measuring tools from the command line, without opening a window, so they can be
+// used from scripts and inspection plans:
+//   STLViewer --probe model.stl points.csv [--signed] [--output results.csv]
+//   STLViewer --part-distance model.stl [other.stl]
+//   STLViewer --convert input output [--ascii] [--recursive]
+//   STLViewer --export-glb model.stl output.glb
+//   STLViewer --archive model.stl output.cmesh
+//   STLViewer --build-tiles model.stl output.tiles
+//   STLViewer --read-speed file [--direct] [--pread]
+//   STLViewer --feed-demo [name] [--frames n] [--grid n] [--fps rate]
+//   STLViewer --scan folder output.csv|output.json [--resume] [--threads n] [--max-in-flight MB] [--no-recursive]
+//   STLViewer --serve [socket] [--cache MB] [--gpu-cache MB] [--threads n] [--deadline ms]
+// Models are used in file units (no centering or scaling). Results go to standard output.
+class CommandLine
+{
+public:
+    // Does the command line ask for one of the tools instead of the viewer?
+    static bool isCommand(int argc, char *argv[]);
+
+    // Does that tool draw with OpenGL (and so need a QGuiApplication rather than a QCoreApplication)?
+    static bool needsOpenGL(int argc, char *argv[]);
+
+    // Run the tool; returns the exit code for main()
+    static int run(const QStringList &arguments);
+
+private:
+    static int probe(const QStringList &arguments);
+    static int partDistance(const QStringList &arguments);
+    static int convert(const QStringList &arguments);
+    static int exportGLB(const QStringList &arguments);
+    static int archive(const QStringList &arguments);
+    static int buildTiles(const QStringList &arguments);
+    static int readSpeed(const QStringList &arguments);
+    static int feedDemo(const QStringList &arguments);
+    static int scan(const QStringList &arguments);
+    static int serve(const QStringList &arguments);
+    static void printUsage();
+
+    // Load an STL file in file units
+    static bool loadModel(const QString &fileName, QVector<float> &vertexData, QVector<unsigned int> &indices,
+                          QString *errorMessage);
+};
+
+#endif // COMMANDLINE_H
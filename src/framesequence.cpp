@@ -0,0 +1,285 @@
+#include "framesequence.h"
+#include "stlloader.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Two readers keep up with a fast disk while one of them is busy parsing
+const int ReaderThreads = 2;
+
+// How a sequence's file names look: prefix, a number, suffix ("wave_", 12, ".stl")
+struct NamePattern {
+    QString prefix;
+    QString suffix;
+    int minDigits = 1;
+};
+
+bool isDigit(QChar c)
+{
+    return c >= QChar('0') && c <= QChar('9');
+}
+
+// Split a file name around its number. Understands "%04d", "####" and a plain numbered name.
+bool parseNamePattern(const QString& name, NamePattern& pattern)
+{
+    int percent = name.indexOf('%');
+    if (percent >= 0) {
+        int end = percent + 1;
+        while (end < name.size() && isDigit(name[end])) {
+            ++end;
+        }
+        if (end >= name.size() || name[end] != QChar('d')) {
+            return false;
+        }
+        QString width = name.mid(percent + 1, end - percent - 1);
+        pattern.prefix = name.left(percent);
+        pattern.suffix = name.mid(end + 1);
+        pattern.minDigits = width.startsWith('0') ? qMax(1, width.toInt()) : 1;
+        return true;
+    }
+
+    int hash = name.indexOf('#');
+    if (hash >= 0) {
+        int end = hash;
+        while (end < name.size() && name[end] == QChar('#')) {
+            ++end;
+        }
+        pattern.prefix = name.left(hash);
+        pattern.suffix = name.mid(end);
+        pattern.minDigits = end - hash;
+        return true;
+    }
+
+    // One file of the sequence: the number is the last run of digits before the extension
+    int dot = name.lastIndexOf('.');
+    int end = dot >= 0 ? dot : name.size();
+    while (end > 0 && !isDigit(name[end - 1])) {
+        --end;
+    }
+    if (end == 0) {
+        return false;
+    }
+    int begin = end;
+    while (begin > 0 && isDigit(name[begin - 1])) {
+        --begin;
+    }
+    pattern.prefix = name.left(begin);
+    pattern.suffix = name.mid(end);
+    // A zero-padded number tells the width; wave_0001.stl does not pull in a stray wave_7.stl
+    pattern.minDigits = name[begin] == QChar('0') ? end - begin : 1;
+    return true;
+}
+
+} // namespace
+
+FrameSequence::FrameSequence()
+    : nextTick(0)
+    , playhead(0)
+    , busy(0)
+    , readyLimit(0)
+    , stopping(false)
+{
+}
+
+FrameSequence::~FrameSequence()
+{
+    stop();
+}
+
+QStringList FrameSequence::findFiles(const QString& pattern, QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return QStringList();
+    };
+
+    QFileInfo info(pattern);
+    NamePattern name;
+    if (!parseNamePattern(info.fileName(), name)) {
+        return fail(QString("\"%1\" has no frame number (use a name like wave_0001.stl or wave_%04d.stl)")
+                        .arg(info.fileName()));
+    }
+
+    struct Numbered {
+        qint64 number;
+        QString name;
+    };
+    QVector<Numbered> found;
+    QDir dir(info.absolutePath());
+    const QStringList entries = dir.entryList(QDir::Files);
+    for (const QString& entry : entries) {
+        if (entry.size() <= name.prefix.size() + name.suffix.size()
+            || !entry.startsWith(name.prefix) || !entry.endsWith(name.suffix)) {
+            continue;
+        }
+        QString digits = entry.mid(name.prefix.size(), entry.size() - name.prefix.size() - name.suffix.size());
+        if (digits.size() < name.minDigits || !std::all_of(digits.begin(), digits.end(), isDigit)) {
+            continue;
+        }
+        found.append({digits.toLongLong(), entry});
+    }
+    if (found.isEmpty()) {
+        return fail(QString("No files in %1 match \"%2\"").arg(dir.absolutePath(), info.fileName()));
+    }
+
+    // By number, so frame_10 comes after frame_9 even without zero padding
+    std::sort(found.begin(), found.end(), [](const Numbered& a, const Numbered& b) {
+        return a.number != b.number ? a.number < b.number : a.name < b.name;
+    });
+    QStringList files;
+    for (const Numbered& file : found) {
+        files.append(dir.absoluteFilePath(file.name));
+    }
+    return files;
+}
+
+bool FrameSequence::decode(const QString& fileName, Frame& frame, QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    // Every frame keeps its own coordinates so the viewer can place them all with one transform.
+    // Vertices are not merged: a frame has to be decoded in well under a frame period, and
+    // searching for shared corners is most of the cost of loading. Every corner is its own vertex,
+    // in the order the file lists them, so frames that share their triangle order share their
+    // vertex order too, and their (plain 0, 1, 2, ...) index lists are equal.
+    STLLoader loader;
+    loader.setAutoCenter(false);
+    loader.setAutoNormalize(false);
+    loader.setMergeVertices(false);
+    if (loader.loadFile(fileName) != STLLoader::Success) {
+        return fail(loader.getErrorString());
+    }
+    const int vertexCount = loader.getVertexData().size() / 6;
+    if (vertexCount == 0) {
+        return fail(QString("%1 has no triangles").arg(QFileInfo(fileName).fileName()));
+    }
+    frame.vertexData = loader.getVertexData();
+    frame.indices.resize(vertexCount);
+    std::iota(frame.indices.begin(), frame.indices.end(), 0u);
+    frame.ok = true;
+    return true;
+}
+
+void FrameSequence::start(const QStringList& files, qint64 firstTick, int readyFrames, std::function<void()> frameReady)
+{
+    stop();
+    fileList = files;
+    nextTick = firstTick;
+    playhead = firstTick;
+    readyLimit = qMax(1, readyFrames);
+    readyCallback = std::move(frameReady);
+    stopping = false;
+    if (fileList.isEmpty()) {
+        return;
+    }
+    for (int i = 0; i < ReaderThreads; ++i) {
+        readers.emplace_back(&FrameSequence::decodeFrames, this);
+    }
+}
+
+void FrameSequence::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    readers.clear();
+
+    ready.clear();
+    busy = 0;
+    fileList.clear();
+    readyCallback = nullptr;
+}
+
+void FrameSequence::setPlayhead(qint64 tick)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        playhead = tick;
+        dropPassedFrames();
+    }
+    wake.notify_all();
+}
+
+QVector<FrameSequence::Frame> FrameSequence::takeReady(int maxFrames)
+{
+    QVector<Frame> frames;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!ready.empty() && frames.size() < maxFrames) {
+            frames.append(std::move(ready.begin()->second));
+            ready.erase(ready.begin());
+        }
+    }
+    if (!frames.isEmpty()) {
+        wake.notify_all();
+    }
+    return frames;
+}
+
+int FrameSequence::pendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return int(ready.size()) + busy;
+}
+
+void FrameSequence::dropPassedFrames()
+{
+    // Keep the newest frame at or before the playhead; everything older will never be shown
+    auto newest = ready.upper_bound(playhead);
+    if (newest != ready.begin()) {
+        --newest;
+        ready.erase(ready.begin(), newest);
+    }
+}
+
+void FrameSequence::decodeFrames()
+{
+    for (;;) {
+        qint64 tick;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || int(ready.size()) + busy < readyLimit; });
+            if (stopping) {
+                return;
+            }
+            // Never start on a frame the playhead has already passed
+            tick = qMax(nextTick, playhead);
+            nextTick = tick + 1;
+            ++busy;
+        }
+
+        Frame frame;
+        frame.tick = tick;
+        frame.file = int(tick % fileList.size());
+        QString error;
+        if (!decode(fileList[frame.file], frame, &error)) {
+            qWarning() << "FrameSequence: frame" << frame.file << "could not be read:" << error;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy;
+            ready[tick] = std::move(frame);
+            dropPassedFrames();
+        }
+        if (readyCallback) {
+            readyCallback();
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef FRAMESEQUENCE_H
+#define FRAMESEQUENCE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A simulation written as one model file per time step (wave_0001.stl, wave_0002.stl, ...),
+// decoded a few frames ahead of playback on background threads.
+//
+// Frames are counted in "ticks": tick t shows file t % fileCount(), so looping playback simply
+// keeps counting up. The player moves the playhead; readers decode the ticks just ahead of it into a
+// bounded set of ready frames. When the readers fall behind, the ticks the playhead has passed are
+// skipped instead of waited for, so playback drops frames rather than stalling.
+class FrameSequence
+{
+public:
+    struct Frame {
+        qint64 tick = -1;
+        int file = -1;                    // Position in the file list
+        bool ok = false;                  // False if the file could not be read
+        QVector<float> vertexData;        // Position + normal per vertex, file units
+        QVector<unsigned int> indices;    // Three per triangle
+    };
+
+    FrameSequence();
+    ~FrameSequence();
+
+    // The files of a numbered sequence, in number order. The pattern can be printf style
+    // ("wave_%04d.stl"), use # for digits ("wave_####.stl"), or be any one file of the sequence
+    // ("wave_0001.stl"), in which case every file differing only in that number belongs to it.
+    static QStringList findFiles(const QString& pattern, QString* errorMessage = nullptr);
+
+    // Read one frame with the model loader, in file units (no centering or scaling)
+    static bool decode(const QString& fileName, Frame& frame, QString* errorMessage = nullptr);
+
+    // Start decoding from firstTick on, keeping at most readyFrames frames decoded and waiting.
+    // frameReady is called on a reader thread whenever a frame is ready to collect.
+    void start(const QStringList& files, qint64 firstTick, int readyFrames, std::function<void()> frameReady);
+    void stop();
+    int fileCount() const { return fileList.size(); }
+
+    // Where playback is. Frames behind it are thrown away, except the newest one, which is still
+    // worth showing when nothing newer has been decoded yet.
+    void setPlayhead(qint64 tick);
+
+    // Collect up to maxFrames ready frames, oldest first
+    QVector<Frame> takeReady(int maxFrames);
+
+    // Frames decoded or being decoded, not collected yet
+    int pendingCount() const;
+
+private:
+    void decodeFrames();
+    void dropPassedFrames();    // Mutex must be held
+
+    QStringList fileList;
+    std::vector<std::thread> readers;
+    mutable std::mutex mutex;
+    std::condition_variable wake;      // Playhead moved, frames collected, or stopping
+    std::map<qint64, Frame> ready;     // By tick
+    qint64 nextTick;                   // Next tick to hand to a reader
+    qint64 playhead;
+    int busy;                          // Frames being decoded
+    int readyLimit;
+    bool stopping;
+    std::function<void()> readyCallback;
+};
+
+#endif // FRAMESEQUENCE_H
@@ -0,0 +1,314 @@
+#include "glbwriter.h"
+#include "meshcodec.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const quint32 GlbMagic = 0x46546c67;       // "glTF"
+const quint32 JsonChunk = 0x4e4f534a;      // "JSON"
+const quint32 BinaryChunk = 0x004e4942;    // "BIN\0"
+
+// x, y, z as 16-bit integers plus two bytes of padding, and x, y, z as 8-bit integers plus one
+const int PositionStride = 8;
+const int NormalStride = 4;
+const int PositionRange = 32767;
+const int NormalRange = 127;
+
+// glTF component types
+const int ComponentByte = 5120;
+const int ComponentShort = 5122;
+const int ComponentUnsignedShort = 5123;
+const int ComponentUnsignedInt = 5125;
+
+qint64 padTo4(qint64 size)
+{
+    return (size + 3) & ~qint64(3);
+}
+
+QByteArray numberList(const double *values, int count)
+{
+    QByteArray result = "[";
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) {
+            result += ",";
+        }
+        result += QByteArray::number(values[i], 'g', 9);
+    }
+    result += "]";
+    return result;
+}
+
+// A buffer view of the (empty) fallback buffer with the compressed bytes it stands for
+QByteArray bufferView(qint64 offset, qint64 length, int stride, int target, qint64 compressedOffset,
+                      qint64 compressedLength, qint64 count, const char *mode)
+{
+    QByteArray view = "{\"buffer\":1,\"byteOffset\":" + QByteArray::number(offset) +
+                      ",\"byteLength\":" + QByteArray::number(length);
+    if (target == 34962) {
+        view += ",\"byteStride\":" + QByteArray::number(stride);
+    }
+    view += ",\"target\":" + QByteArray::number(target) +
+            ",\"extensions\":{\"EXT_meshopt_compression\":{\"buffer\":0,\"byteOffset\":" +
+            QByteArray::number(compressedOffset) + ",\"byteLength\":" + QByteArray::number(compressedLength) +
+            ",\"byteStride\":" + QByteArray::number(stride) + ",\"mode\":\"" + mode +
+            "\",\"count\":" + QByteArray::number(count) + "}}}";
+    return view;
+}
+
+void appendUInt32(QByteArray &data, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 4);
+}
+
+} // namespace
+
+bool GLBWriter::write(const QString& fileName, const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                      float displayScale, const QVector3D& displayOffset, Report* report, QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    const qint64 inputVertices = vertexData.size() / 6;
+    const qint64 indexCount = indices.isEmpty() ? inputVertices / 3 * 3 : indices.size() / 3 * 3;
+    if (indexCount == 0) {
+        return fail("No model to save");
+    }
+    if (inputVertices > qint64(0xffffffffu)) {
+        return fail("Too many vertices for a glTF file");
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Triangle list, checked, then reordered for the cache and with vertices numbered by first use
+    std::vector<unsigned int> triangleList(size_t(indexCount), 0);
+    for (qint64 i = 0; i < indexCount; ++i) {
+        const unsigned int v = indices.isEmpty() ? unsigned(i) : indices[int(i)];
+        if (qint64(v) >= inputVertices) {
+            return fail("A triangle uses a vertex that does not exist");
+        }
+        triangleList[size_t(i)] = v;
+    }
+    triangleList = MeshCodec::optimizeVertexCache(triangleList.data(), triangleList.size(), size_t(inputVertices));
+    std::vector<unsigned int> remap;
+    const size_t vertexCount = MeshCodec::optimizeVertexFetch(triangleList.data(), triangleList.size(),
+                                                              size_t(inputVertices), remap);
+    std::vector<unsigned int> original(vertexCount);
+    for (size_t v = 0; v < remap.size(); ++v) {
+        if (remap[v] != ~0u) {
+            original[remap[v]] = unsigned(v);
+        }
+    }
+
+    // Positions back in file units, and their bounding box (per thread, then combined)
+    const float inverseScale = displayScale != 0.0f ? 1.0f / displayScale : 1.0f;
+    const float offset[3] = {displayOffset.x(), displayOffset.y(), displayOffset.z()};
+    std::vector<float> positions(vertexCount * 3);
+    std::vector<float> boxes(size_t(Parallel::threadCount()) * 6);
+    for (int t = 0; t < Parallel::threadCount(); ++t) {
+        std::fill(boxes.begin() + t * 6, boxes.begin() + t * 6 + 3, FLT_MAX);
+        std::fill(boxes.begin() + t * 6 + 3, boxes.begin() + t * 6 + 6, -FLT_MAX);
+    }
+    Parallel::forChunks(qint64(vertexCount), [&](qint64 begin, qint64 end, int thread) {
+        float *box = &boxes[size_t(thread) * 6];
+        for (qint64 v = begin; v < end; ++v) {
+            const float *source = vertexData.constData() + qint64(original[v]) * 6;
+            for (int k = 0; k < 3; ++k) {
+                const float p = source[k] * inverseScale - offset[k];
+                positions[v * 3 + k] = p;
+                box[k] = std::min(box[k], p);
+                box[3 + k] = std::max(box[3 + k], p);
+            }
+        }
+    });
+    double minimum[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+    double maximum[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    for (int t = 0; t < Parallel::threadCount(); ++t) {
+        for (int k = 0; k < 3; ++k) {
+            minimum[k] = std::min(minimum[k], double(boxes[t * 6 + k]));
+            maximum[k] = std::max(maximum[k], double(boxes[t * 6 + 3 + k]));
+        }
+    }
+
+    // One scale for all axes, so the node transform doesn't bend the normals
+    double center[3];
+    double halfSize = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        center[k] = (minimum[k] + maximum[k]) * 0.5;
+        halfSize = std::max(halfSize, (maximum[k] - minimum[k]) * 0.5);
+    }
+    if (halfSize <= 0.0) {
+        halfSize = 1.0;
+    }
+    const double step = halfSize / PositionRange;
+
+    std::vector<qint16> quantizedPositions(vertexCount * 4, 0);
+    std::vector<qint8> quantizedNormals(vertexCount * 4, 0);
+    Parallel::forChunks(qint64(vertexCount), [&](qint64 begin, qint64 end, int) {
+        for (qint64 v = begin; v < end; ++v) {
+            for (int k = 0; k < 3; ++k) {
+                const double q = std::round((positions[v * 3 + k] - center[k]) / step);
+                quantizedPositions[v * 4 + k] = qint16(std::max(-double(PositionRange), std::min(double(PositionRange), q)));
+            }
+            const float *n = vertexData.constData() + qint64(original[v]) * 6 + 3;
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; ++k) {
+                const float unit = length > 0.0f ? n[k] / length : (k == 2 ? 1.0f : 0.0f);
+                quantizedNormals[v * 4 + k] = qint8(std::lround(unit * NormalRange));
+            }
+        }
+    });
+
+    int quantizedMin[3] = {PositionRange, PositionRange, PositionRange};
+    int quantizedMax[3] = {-PositionRange, -PositionRange, -PositionRange};
+    for (size_t v = 0; v < vertexCount; ++v) {
+        for (int k = 0; k < 3; ++k) {
+            quantizedMin[k] = std::min<int>(quantizedMin[k], quantizedPositions[v * 4 + k]);
+            quantizedMax[k] = std::max<int>(quantizedMax[k], quantizedPositions[v * 4 + k]);
+        }
+    }
+
+    // The three streams are independent, so each gets its own thread
+    std::vector<unsigned char> streams[3];
+    Parallel::forBlocks(3, 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 s = begin; s < end; ++s) {
+            if (s == 0) {
+                streams[0] = MeshCodec::encodeVertexBuffer(quantizedPositions.data(), vertexCount, PositionStride);
+            } else if (s == 1) {
+                streams[1] = MeshCodec::encodeVertexBuffer(quantizedNormals.data(), vertexCount, NormalStride);
+            } else {
+                streams[2] = MeshCodec::encodeIndexBuffer(triangleList.data(), triangleList.size());
+            }
+        }
+    });
+    const qint64 encodeMilliseconds = timer.elapsed();
+
+    // Small meshes get 16-bit indices in the (virtual) uncompressed buffer
+    const bool shortIndices = vertexCount <= 65536;
+    const int indexSize = shortIndices ? 2 : 4;
+    const qint64 positionBytes = qint64(vertexCount) * PositionStride;
+    const qint64 normalBytes = qint64(vertexCount) * NormalStride;
+    const qint64 indexBytes = indexCount * indexSize;
+
+    qint64 compressedOffsets[3];
+    qint64 binaryLength = 0;
+    for (int s = 0; s < 3; ++s) {
+        compressedOffsets[s] = binaryLength;
+        binaryLength = padTo4(binaryLength + qint64(streams[s].size()));
+    }
+
+    const double stlBytes = 84.0 + 50.0 * double(indexCount / 3);
+    const double floatBytes = double(inputVertices) * 24.0 + double(indexCount) * 4.0;
+    const double encodeSeconds = std::max<qint64>(encodeMilliseconds, 1) / 1000.0;
+    const double megabytesPerSecond = floatBytes / encodeSeconds / 1e6;
+
+    // The JSON part: one node holding the de-quantizing transform, one mesh, three accessors
+    const double scale[3] = {step, step, step};
+    const double quantizedMinimum[3] = {double(quantizedMin[0]), double(quantizedMin[1]), double(quantizedMin[2])};
+    const double quantizedMaximum[3] = {double(quantizedMax[0]), double(quantizedMax[1]), double(quantizedMax[2])};
+    auto document = [&](double ratio) {
+        QByteArray json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"STLViewer\",\"extras\":{"
+                          "\"sourceTriangles\":" + QByteArray::number(indexCount / 3) +
+                          ",\"compressionRatio\":" + QByteArray::number(ratio, 'f', 2) +
+                          ",\"encodeMegabytesPerSecond\":" + QByteArray::number(megabytesPerSecond, 'f', 1) + "}},";
+        json += "\"extensionsUsed\":[\"EXT_meshopt_compression\",\"KHR_mesh_quantization\"],"
+                "\"extensionsRequired\":[\"EXT_meshopt_compression\",\"KHR_mesh_quantization\"],"
+                "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],";
+        json += "\"nodes\":[{\"mesh\":0,\"translation\":" + numberList(center, 3) + ",\"scale\":" + numberList(scale, 3) + "}],";
+        json += "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"mode\":4}]}],";
+        json += "\"accessors\":["
+                "{\"bufferView\":0,\"componentType\":" + QByteArray::number(ComponentShort) +
+                ",\"count\":" + QByteArray::number(qint64(vertexCount)) + ",\"type\":\"VEC3\",\"min\":" +
+                numberList(quantizedMinimum, 3) + ",\"max\":" + numberList(quantizedMaximum, 3) + "},"
+                "{\"bufferView\":1,\"componentType\":" + QByteArray::number(ComponentByte) +
+                ",\"normalized\":true,\"count\":" + QByteArray::number(qint64(vertexCount)) + ",\"type\":\"VEC3\"},"
+                "{\"bufferView\":2,\"componentType\":" +
+                QByteArray::number(shortIndices ? ComponentUnsignedShort : ComponentUnsignedInt) +
+                ",\"count\":" + QByteArray::number(indexCount) + ",\"type\":\"SCALAR\"}],";
+        json += "\"bufferViews\":[" +
+                bufferView(0, positionBytes, PositionStride, 34962, compressedOffsets[0], qint64(streams[0].size()),
+                           qint64(vertexCount), "ATTRIBUTES") + "," +
+                bufferView(positionBytes, normalBytes, NormalStride, 34962, compressedOffsets[1],
+                           qint64(streams[1].size()), qint64(vertexCount), "ATTRIBUTES") + "," +
+                bufferView(positionBytes + normalBytes, indexBytes, indexSize, 34963, compressedOffsets[2],
+                           qint64(streams[2].size()), indexCount, "TRIANGLES") + "],";
+        // Buffer 1 has no data of its own: readers must decompress buffer 0 into it
+        json += "\"buffers\":[{\"byteLength\":" + QByteArray::number(binaryLength) + "},"
+                "{\"byteLength\":" + QByteArray::number(padTo4(positionBytes + normalBytes + indexBytes)) +
+                ",\"extensions\":{\"EXT_meshopt_compression\":{\"fallback\":true}}}]}";
+        while (json.size() % 4 != 0) {
+            json += " ";
+        }
+        return json;
+    };
+
+    // The ratio depends on the file size, which depends (a little) on how the ratio is printed
+    QByteArray json = document(0.0);
+    qint64 fileBytes = 12 + 8 + json.size() + 8 + binaryLength;
+    json = document(stlBytes / double(fileBytes));
+    fileBytes = 12 + 8 + json.size() + 8 + binaryLength;
+
+    QString temporaryFile = fileName + ".part";
+    QFile file(temporaryFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail("Cannot write file: " + file.errorString());
+    }
+    QByteArray header;
+    appendUInt32(header, GlbMagic);
+    appendUInt32(header, 2);
+    appendUInt32(header, quint32(fileBytes));
+    appendUInt32(header, quint32(json.size()));
+    appendUInt32(header, JsonChunk);
+    header += json;
+    appendUInt32(header, quint32(binaryLength));
+    appendUInt32(header, BinaryChunk);
+
+    bool ok = file.write(header) == header.size();
+    static const char zeros[4] = {0, 0, 0, 0};
+    for (int s = 0; s < 3 && ok; ++s) {
+        const qint64 size = qint64(streams[s].size());
+        ok = file.write(reinterpret_cast<const char *>(streams[s].data()), size) == size;
+        const qint64 padding = padTo4(size) - size;
+        ok = ok && (padding == 0 || file.write(zeros, padding) == padding);
+    }
+    file.close();
+    if (!ok) {
+        QFile::remove(temporaryFile);
+        return fail("Cannot write file: " + file.errorString());
+    }
+    QFile::remove(fileName);
+    if (!QFile::rename(temporaryFile, fileName)) {
+        QFile::remove(temporaryFile);
+        return fail("Cannot replace " + fileName);
+    }
+
+    if (report) {
+        report->vertices = qint64(vertexCount);
+        report->triangles = indexCount / 3;
+        report->stlBytes = qint64(stlBytes);
+        report->quantizedBytes = positionBytes + normalBytes + indexBytes;
+        report->compressedBytes = qint64(streams[0].size() + streams[1].size() + streams[2].size());
+        report->fileBytes = fileBytes;
+        report->compressionRatio = stlBytes / double(fileBytes);
+        report->encodeMegabytesPerSecond = megabytesPerSecond;
+        report->milliseconds = timer.elapsed();
+    }
+
+    qDebug() << "GLBWriter: saved" << indexCount / 3 << "triangles," << fileBytes << "bytes ("
+             << stlBytes / double(fileBytes) << "x smaller than binary STL), encoded at" << megabytesPerSecond << "MB/s";
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef GLBWRITER_H
+#define GLBWRITER_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+
+// Writes a welded mesh as a compressed glTF 2.0 binary (.glb) for web viewers.
+//
+// Triangles are reordered for the vertex cache and vertices renumbered in the order they are used.
+// Positions are quantized to 16 bits over the model's bounding box (KHR_mesh_quantization, undone
+// by the node's scale and translation), normals to 8 bits. The three buffers are then compressed in
+// parallel with the EXT_meshopt_compression codecs, which browsers unpack at memory speed.
+//
+// The file records what the compression achieved in asset.extras: compressionRatio (against binary
+// STL) and encodeMegabytesPerSecond.
+class GLBWriter
+{
+public:
+    struct Report {
+        qint64 vertices = 0;                 // Vertices written (unused ones are dropped)
+        qint64 triangles = 0;
+        qint64 stlBytes = 0;                 // Size of the same mesh as binary STL
+        qint64 quantizedBytes = 0;           // Buffers after quantizing, before compression
+        qint64 compressedBytes = 0;          // Buffers after compression
+        qint64 fileBytes = 0;                // Whole .glb file
+        double compressionRatio = 0.0;       // stlBytes / fileBytes
+        double encodeMegabytesPerSecond = 0.0;  // Float mesh data (positions, normals, indices) per second
+        qint64 milliseconds = 0;
+    };
+
+    // Save a mesh from the loader's buffers (6 floats per vertex, position + normal, with or without
+    // indices). Positions are turned back into file units with file = displayed / scale - offset.
+    static bool write(const QString& fileName, const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                      float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(),
+                      Report* report = nullptr, QString* errorMessage = nullptr);
+};
+
+#endif // GLBWRITER_H
@@ -11,6 +11,30 @@
 #include <QDebug>
 #include <QApplication>
 #include <iostream>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Tile mode limits
+static const qint64 DefaultTileMemory = 512ll << 20;        // Graphics card memory for tile levels
+static const qint64 TileStagingBytes = 128ll << 20;         // Levels read from disk but not uploaded yet
+static const qint64 TileUploadBytesPerFrame = 32ll << 20;   // Keeps frames smooth while tiles pour in
+static const float TilePixelError = 2.0f;                   // Simplification error allowed on screen, in pixels
+static const float StandInPriority = 1.0e6f;                // Added to requests that fill a hole in the picture
+
+// Sequence mode limits
+static const int SequenceGpuFrames = 3;                     // Frame buffers on the graphics card (one is on screen)
+static const int SequenceDecodeAhead = 4;                   // Frames decoded ahead and waiting in memory
+static const int SequenceDeltaGap = 16;                     // Unchanged vertices worth re-sending to join two changed runs
+static const double DefaultSequenceRate = 24.0;             // Frames per second
+
+// Live feed
+static const int FeedPollMilliseconds = 15;                 // How often to look for a new frame (about 60 times a second)
+
+// Reloading changed files
+static const int ReloadDebounceMilliseconds = 500;          // Quiet time after the last write before reloading
 
 // Convert mouse coordinates to 3D sphere coordinates (used for smooth rotation)
 static QVector3D mapToArcball(int x, int y, int w, int h) {
@@ -32,9 +56,40 @@ GLWidget::GLWidget(QWidget *parent)
     , lightingEnabled(true)
     , mousePressed(false)
     , mouseButton(Qt::NoButton)
+    , modelScale(1.0f)
     , triangleCount(0)
     , hasModel(false)
     , boundingBoxValid(false)
+    , geometryGeneration(0)
+    , slicePreviewPending(false)
+    , slicePreviewEnabled(false)
+    , sliceHeightFraction(0.5f)
+    , sliceVertexCount(0)
+    , bvhReady(false)
+    , partsReady(false)
+    , distanceSectionEnabled(false)
+    , sectionIndexBuffer(QOpenGLBuffer::IndexBuffer)
+    , sectionIndexCount(0)
+    , sectionRange(1.0f)
+    , scalarFieldEnabled(false)
+    , scalarLow(0.0f)
+    , scalarHigh(1.0f)
+    , scalarColorMap(Rainbow)
+    , tileMode(false)
+    , tileScale(1.0f)
+    , residentTileBytes(0)
+    , tileMemoryBudget(DefaultTileMemory)
+    , tileFrame(0)
+    , sequenceMode(false)
+    , sequenceScale(1.0f)
+    , shownSequenceFrame(-1)
+    , sequenceRate(DefaultSequenceRate)
+    , playStartTick(0)
+    , feedMode(false)
+    , feedScale(1.0f)
+    , watchedSize(-1)
+    , autoReload(true)
+    , reloadAgain(false)
     , camera(nullptr)
     , isInitialized(false)
 {
@@ -54,6 +109,26 @@ GLWidget::GLWidget(QWidget *parent)
     
     // Set default material color to light gray
     defaultColor = QVector3D(0.8f, 0.8f, 0.8f);
+
+    // Sequence playback repaints on its own clock; the playhead follows real time, not the repaints
+    connect(&sequenceTimer, &QTimer::timeout, this, [this]() { update(); });
+    // Exporters write a file in several steps; every write restarts the wait, so the reload
+    // happens once the file has been quiet for a moment
+    reloadTimer.setSingleShot(true);
+    reloadTimer.setInterval(ReloadDebounceMilliseconds);
+    connect(&fileWatcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &path) {
+        if (path == watchedFile && autoReload) {
+            reloadTimer.start();
+        }
+    });
+    connect(&reloadTimer, &QTimer::timeout, this, &GLWidget::reloadWatchedFile);
+
+    // The feed is only repainted when the producer has published something new
+    connect(&feedTimer, &QTimer::timeout, this, [this]() {
+        if (meshFeed.latestNumber() > feedStats.frameNumber || meshFeed.producerFinished()) {
+            update();
+        }
+    });
 }
 
 GLWidget::~GLWidget()
@@ -61,6 +136,17 @@ GLWidget::~GLWidget()
     std::cout << "GLWidget: Destructor called" << std::endl;
     qDebug() << "GLWidget: Destructor called";
     
+    // Let background jobs finish before the widget it reports to goes away
+    slicePreviewJob.wait();
+    sliceExportJob.wait();
+    comparisonJob.wait();
+    voxelJob.wait();
+    distanceFieldJob.wait();
+    thicknessJob.wait();
+    curvatureJob.wait();
+    probeJob.wait();
+    partDistanceJob.wait();
+    
     // Stop timers and free up graphics card memory
     cleanup();
     
@@ -76,6 +162,9 @@ void GLWidget::cleanup()
     // Stop any timers first to prevent further updates
     renderTimer.stop();
     renderTimer.disconnect();
+    sequenceTimer.stop();
+    feedTimer.stop();
+    stopWatching();
     
     // Make sure we have a valid context before cleanup
     if (context() && context()->isValid()) {
@@ -84,6 +173,36 @@ void GLWidget::cleanup()
         qDebug() << "GLWidget: Cleaning up OpenGL resources...";
         
         // Free up graphics card memory in the right order
+        cleanupTiles();
+        cleanupSequence();
+        cleanupFeed();
+        if (scalarBuffer.isCreated()) {
+            scalarBuffer.destroy();
+        }
+        if (colorBuffer.isCreated()) {
+            colorBuffer.destroy();
+        }
+        
+        if (sectionVao.isCreated()) {
+            sectionVao.destroy();
+        }
+        
+        if (sectionBuffer.isCreated()) {
+            sectionBuffer.destroy();
+        }
+        
+        if (sectionIndexBuffer.isCreated()) {
+            sectionIndexBuffer.destroy();
+        }
+        
+        if (sliceVao.isCreated()) {
+            sliceVao.destroy();
+        }
+        
+        if (sliceBuffer.isCreated()) {
+            sliceBuffer.destroy();
+        }
+        
         if (vao.isCreated()) {
             vao.destroy();
         }
@@ -179,8 +298,6 @@ void GLWidget::paintGL()
         return;
     }
     
-    qDebug() << "GLWidget::paintGL: Starting paint operation";
-
     try {
         static int frameCounter = 0;
         frameCounter++;
@@ -193,7 +310,7 @@ void GLWidget::paintGL()
         // Clear buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
-        if (!shaderProgram || !vao.isCreated()) {
+        if (!shaderProgram || (!vao.isCreated() && !tileMode && !sequenceMode && !feedMode)) {
             qDebug() << "Shader program or VAO not ready";
             return;
         }
@@ -221,18 +338,14 @@ void GLWidget::paintGL()
             QVector3D camTarget = camera->getTarget();
             QVector3D camUp = camera->getUp();
             
-            qDebug() << "Camera state - Pos:" << camPos << "Target:" << camTarget << "Up:" << camUp;
-            
             // Check for invalid values
             bool validCamera = qIsFinite(camPos.x()) && qIsFinite(camPos.y()) && qIsFinite(camPos.z()) &&
                               qIsFinite(camTarget.x()) && qIsFinite(camTarget.y()) && qIsFinite(camTarget.z()) &&
                               qIsFinite(camUp.x()) && qIsFinite(camUp.y()) && qIsFinite(camUp.z());
             
             if (validCamera) {
-                qDebug() << "Camera state is valid, getting matrices";
                 viewMatrix = camera->getViewMatrix();
                 projectionMatrix = camera->getProjectionMatrix();
-                qDebug() << "Camera matrices obtained successfully";
             } else {
                 qWarning() << "Invalid camera state detected, using fallback matrices";
                 camera->reset(); // Reset to safe state
@@ -334,11 +447,19 @@ void GLWidget::paintGL()
         shaderProgram->setUniformValue("u_shininess", 32.0f);
 
         // Choose colors: blue-gray for STL models, red for default cube
-        QVector3D materialColor = hasModel ? QVector3D(0.8f, 0.8f, 0.9f) : QVector3D(0.7f, 0.3f, 0.3f);
+        QVector3D materialColor = hasModel || tileMode || sequenceMode || feedMode ? QVector3D(0.8f, 0.8f, 0.9f) : QVector3D(0.7f, 0.3f, 0.3f);
         shaderProgram->setUniformValue("u_materialColor", materialColor);
         shaderProgram->setUniformValue("u_wireframe", wireframeMode);
         shaderProgram->setUniformValue("u_lightingEnabled", lightingEnabled);
         
+        // Analysis colours replace the material colour when a scalar field is shown
+        shaderProgram->setUniformValue("u_useScalar", scalarFieldEnabled && hasModel);
+        shaderProgram->setUniformValue("u_scalarMin", scalarLow);
+        shaderProgram->setUniformValue("u_scalarMax", scalarHigh);
+        shaderProgram->setUniformValue("u_colormap", int(scalarColorMap));
+        glVertexAttrib1f(2, 0.0f);
+        shaderProgram->setUniformValue("u_useVertexColor", hasModel && !meshVertexColors.isEmpty());
+        
         // Set up realistic lighting values for nice visual appearance
         shaderProgram->setUniformValue("u_diffuseStrength", 0.7f);
         shaderProgram->setUniformValue("u_lightConstant", 1.0f);
@@ -353,6 +474,28 @@ void GLWidget::paintGL()
         return;
     }
     
+    // A streamed tile set takes the place of the model (there are no overlays for it)
+    if (tileMode) {
+        drawTiles();
+        shaderProgram->release();
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        emit frameRendered();
+        return;
+    }
+
+    // So do a sequence and a live feed, one frame at a time
+    if (sequenceMode || feedMode) {
+        if (sequenceMode) {
+            drawSequence();
+        } else {
+            drawFeed();
+        }
+        shaderProgram->release();
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        emit frameRendered();
+        return;
+    }
+    
     // Bind VAO and draw
     vao.bind();
     
@@ -364,30 +507,16 @@ void GLWidget::paintGL()
     
     // Choose how to draw based on whether we have a loaded 3D model or default cube
     if (hasModel && !indices.isEmpty()) {
-        // Draw STL models using indexed triangles (more efficient)
-        int indexCount = indices.size();
-        qDebug() << "Drawing STL with" << indexCount << "indices";
+        // Draw STL models using indexed triangles (more efficient). The index buffer holds exactly
+        // this list, so every triangle is drawn however big the model is.
+        const int indexCount = indices.size();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.bufferId());
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount), GL_UNSIGNED_INT, 0);
         
-        // Make sure we have a reasonable number of triangles to draw
-        if (indexCount > 0 && indexCount < 1000000) { // Sanity check
-            qDebug() << "About to call glDrawElements with" << indexCount << "indices";
-
-            // Tell OpenGL to draw triangles using our index list
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.bufferId());
-            
-            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount), GL_UNSIGNED_INT, 0);
-            
-            qDebug() << "glDrawElements call completed successfully";
-            
-            // Check for errors immediately after draw call
-            GLenum drawError = glGetError();
-            if (drawError != GL_NO_ERROR) {
-                qWarning() << "OpenGL error during glDrawElements:" << drawError;
-            } else {
-                qDebug() << "No OpenGL errors after glDrawElements";
-            }
-        } else {
-            qWarning() << "Invalid index count for drawing:" << indexCount;
+        // Check for errors immediately after draw call
+        GLenum drawError = glGetError();
+        if (drawError != GL_NO_ERROR) {
+            qWarning() << "OpenGL error during glDrawElements:" << drawError;
         }
     } else {
         // Draw the default cube using simple triangle vertices
@@ -415,37 +544,67 @@ void GLWidget::paintGL()
     error = glGetError();
     if (error != GL_NO_ERROR) {
         qWarning() << "OpenGL error after drawing:" << error;
-    } else {
-        qDebug() << "No OpenGL errors after drawing";
     }
     
-    qDebug() << "About to release VAO";
     vao.release();
-    qDebug() << "VAO released successfully";
+    shaderProgram->setUniformValue("u_useVertexColor", false);  // Overlays below have no colour attribute
+    
+    // Draw the distance field section as a flat, two-sided plane coloured by distance
+    if (distanceSectionEnabled && hasModel && sectionVao.isCreated() && sectionIndexCount > 0) {
+        shaderProgram->setUniformValue("u_useScalar", true);
+        shaderProgram->setUniformValue("u_scalarMin", -sectionRange);
+        shaderProgram->setUniformValue("u_scalarMax", sectionRange);
+        shaderProgram->setUniformValue("u_colormap", int(Diverging));
+        shaderProgram->setUniformValue("u_wireframe", false);
+        shaderProgram->setUniformValue("u_lightingEnabled", false);
+        
+        glDisable(GL_CULL_FACE);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        sectionVao.bind();
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(sectionIndexCount), GL_UNSIGNED_INT, 0);
+        sectionVao.release();
+        glEnable(GL_CULL_FACE);
+        
+        shaderProgram->setUniformValue("u_useScalar", false);
+        
+        GLenum sectionError = glGetError();
+        if (sectionError != GL_NO_ERROR) {
+            qWarning() << "OpenGL error while drawing distance section:" << sectionError;
+        }
+    }
+    
+    // Draw the slice outline on top of the model so it stays visible inside it
+    if (slicePreviewEnabled && hasModel && sliceVao.isCreated() && sliceVertexCount > 0) {
+        shaderProgram->setUniformValue("u_materialColor", QVector3D(1.0f, 0.55f, 0.1f));
+        shaderProgram->setUniformValue("u_wireframe", false);
+        shaderProgram->setUniformValue("u_lightingEnabled", false);
+        
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        sliceVao.bind();
+        glDrawArrays(GL_LINES, 0, sliceVertexCount);
+        sliceVao.release();
+        glEnable(GL_DEPTH_TEST);
+        
+        GLenum sliceError = glGetError();
+        if (sliceError != GL_NO_ERROR) {
+            qWarning() << "OpenGL error while drawing slice preview:" << sliceError;
+        }
+    }
     
-    qDebug() << "About to release shader program";
     shaderProgram->release();
-    qDebug() << "Shader program released successfully";
     
     // Reset polygon mode
-    qDebug() << "About to reset polygon mode";
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    qDebug() << "Polygon mode reset successfully";
     
     // Track frame completion
-    qDebug() << "About to emit frameRendered signal";
     emit frameRendered();
-    qDebug() << "frameRendered signal emitted successfully";
-    
-    qDebug() << "paintGL method completing normally";
     
     } catch (const std::exception& e) {
         qCritical() << "Exception in paintGL:" << e.what();
     } catch (...) {
         qCritical() << "Unknown exception in paintGL";
     }
-    
-    qDebug() << "paintGL method finished (after catch blocks)";
 }
 
 void GLWidget::resizeGL(int width, int height)
@@ -563,6 +722,8 @@ bool GLWidget::setupShaders()
         
         layout (location = 0) in vec3 a_position;
         layout (location = 1) in vec3 a_normal;
+        layout (location = 2) in float a_scalar;   // Optional per-vertex value for colour mapping
+        layout (location = 3) in vec3 a_color;     // Optional per-vertex colour from the file
         
         uniform mat4 u_mvpMatrix;
         uniform mat4 u_modelMatrix;
@@ -578,6 +739,8 @@ bool GLWidget::setupShaders()
         out vec3 v_viewDir;
         out vec3 v_lightDir;
         out float v_distance;
+        out float v_scalar;
+        out vec3 v_color;
         
         void main()
         {
@@ -590,6 +753,8 @@ bool GLWidget::setupShaders()
             v_viewDir = normalize(u_viewPos - v_fragPos);
             v_lightDir = normalize(u_lightPos - v_fragPos);
             v_distance = length(u_lightPos - v_fragPos);
+            v_scalar = a_scalar;
+            v_color = a_color;
             
             gl_Position = u_mvpMatrix * vec4(a_position, 1.0);
         }
@@ -606,6 +771,8 @@ bool GLWidget::setupShaders()
         in vec3 v_viewDir;
         in vec3 v_lightDir;
         in float v_distance;
+        in float v_scalar;
+        in vec3 v_color;
         
         uniform vec3 u_lightColor;
         uniform vec3 u_materialColor;
@@ -621,9 +788,33 @@ bool GLWidget::setupShaders()
         uniform float u_metallic;
         uniform float u_roughness;
         uniform float u_ao;
+        uniform bool u_useScalar;      // Colour by v_scalar instead of the material colour
+        uniform float u_scalarMin;     // Value mapped to the start of the colour map
+        uniform float u_scalarMax;     // Value mapped to the end of the colour map
+        uniform int u_colormap;        // 0 = rainbow (low blue, high red), 1 = diverging (blue, white, red)
+        uniform bool u_useVertexColor; // Colour by v_color (from the file) instead of the material colour
         
         out vec4 FragColor;
         
+        vec3 scalarColor(float value)
+        {
+            float range = u_scalarMax - u_scalarMin;
+            float t = clamp(abs(range) > 1e-20 ? (value - u_scalarMin) / range : 0.5, 0.0, 1.0);
+            vec3 color;
+            if (u_colormap == 1) {
+                vec3 low = vec3(0.23, 0.30, 0.75);
+                vec3 middle = vec3(0.87, 0.87, 0.87);
+                vec3 high = vec3(0.71, 0.02, 0.15);
+                color = t < 0.5 ? mix(low, middle, t * 2.0) : mix(middle, high, t * 2.0 - 1.0);
+            } else {
+                color = clamp(vec3(1.5 - abs(4.0 * t - 3.0),
+                                   1.5 - abs(4.0 * t - 2.0),
+                                   1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+            }
+            // Undo the gamma correction below so the map shows its intended colours
+            return pow(color, vec3(2.2));
+        }
+        
         vec3 calculateBlinnPhong(vec3 normal, vec3 lightDir, vec3 viewDir, vec3 lightColor, vec3 materialColor)
         {
             vec3 ambient = u_ambientStrength * lightColor * materialColor;
@@ -653,7 +844,10 @@ bool GLWidget::setupShaders()
             vec3 lightDir = normalize(v_lightDir);
             vec3 viewDir = normalize(v_viewDir);
             
-            vec3 finalColor = u_materialColor;
+            // File colours are already gamma corrected, so undo that like the colour maps do
+            vec3 materialColor = u_useScalar ? scalarColor(v_scalar)
+                               : u_useVertexColor ? pow(v_color, vec3(2.2)) : u_materialColor;
+            vec3 finalColor = materialColor;
             
             if (u_wireframe) {
                 finalColor = vec3(1.0, 1.0, 1.0);
@@ -663,7 +857,7 @@ bool GLWidget::setupShaders()
                 vec3 attenuatedLightColor = u_lightColor * attenuation;
                 
                 vec3 litColor = calculateBlinnPhong(normal, lightDir, viewDir, 
-                                                   attenuatedLightColor, u_materialColor);
+                                                   attenuatedLightColor, materialColor);
                 
                 litColor *= u_ao > 0.0 ? u_ao : 1.0;
                 finalColor = litColor;
@@ -763,6 +957,8 @@ void GLWidget::setupDefaultGeometry()
     triangleCount = 12; // 12 triangles for a cube
     hasModel = false;
     indices.clear(); // No indices for cube
+    meshVertexData.clear();
+    meshBlockHashes.clear();
     
     setupVertexBuffer(cubeVertices);
     
@@ -850,6 +1046,21 @@ void GLWidget::setupVertexBuffer(const QVector<float>& vertexData)
     }
 }
 
+void GLWidget::showPrefetchedModel(const ModelPrefetcher::Model &model)
+{
+    qDebug() << "Showing prefetched model:" << model.fileName;
+
+    if (!isInitialized || !context() || !context()->isValid()) {
+        qWarning() << "OpenGL not initialized, cannot show model";
+        return;
+    }
+
+    // Parsed with the same loader settings as loadSTLFile, so only the upload is left
+    cleanupModel();
+    showLoadedModel(model.fileName, model.vertexData, model.indices, model.triangleCount, model.modelScale,
+                    model.modelOffset, model.vertexColors, true);
+}
+
 void GLWidget::loadSTLFile(const QString &fileName)
 {
     qDebug() << "Loading STL file:" << fileName;
@@ -863,10 +1074,9 @@ void GLWidget::loadSTLFile(const QString &fileName)
         // Remove any previously loaded model
         cleanupModel();
         
-        // Set up the STL file reader
+        // Set up the STL file reader (the same way a reload does)
         STLLoader loader;
-        loader.setAutoCenter(true);
-        loader.setAutoNormalize(true);
+        ModelReloader::configureLoader(loader);
         
         // Try to read the STL file
         STLLoader::LoadResult result = loader.loadFile(fileName);
@@ -902,24 +1112,13 @@ void GLWidget::loadSTLFile(const QString &fileName)
             }
         }
         
-        // Store the model information before setting up GPU buffers
-        triangleCount = loader.getTriangleCount();
-        hasModel = true;
-        indices = indexData;
-        
-        qDebug() << "STL loaded successfully. Triangles:" << triangleCount 
+        qDebug() << "STL loaded successfully. Triangles:" << loader.getTriangleCount()
                  << "Vertices:" << expectedVertexCount;
         
-            // Send the model data to the graphics card
-            setupVertexBuffer(vertexData);
-            
-            // Adjust the camera to show the whole model nicely
-            QTimer::singleShot(100, this, &GLWidget::fitToWindow);
-            
-            emit fileLoaded(QFileInfo(fileName).fileName(), triangleCount, expectedVertexCount);
-            
-            // Redraw the display
-            update();        } else {
+            showLoadedModel(fileName, vertexData, indexData, loader.getTriangleCount(), loader.getModelScale(),
+                            loader.getModelOffset(), loader.hasVertexColors() ? loader.getVertexColors() : QVector<float>(),
+                            true);
+        } else {
             QString errorMsg = "Failed to load STL file: " + loader.getErrorString();
             qWarning() << errorMsg;
             // Fallback to default cube on error
@@ -935,6 +1134,46 @@ void GLWidget::loadSTLFile(const QString &fileName)
     }
 }
 
+void GLWidget::showLoadedModel(const QString &fileName, const QVector<float> &vertexData, const QVector<unsigned int> &indexData,
+                               int triangles, float scale, const QVector3D &offset, const QVector<float> &vertexColors,
+                               bool fitView)
+{
+    // Store the model information before setting up GPU buffers
+    triangleCount = triangles;
+    hasModel = true;
+    indices = indexData;
+    meshVertexData = vertexData;  // Shared copy, kept for slicing and analysis
+    meshBlockHashes.clear();
+    modelScale = scale;
+    modelOffset = offset;
+    invalidateBackgroundResults();
+    bvhReady = false;
+    partsReady = false;
+    
+    // Send the model data to the graphics card
+    setupVertexBuffer(vertexData);
+    if (!vertexColors.isEmpty()) {
+        meshVertexColors = vertexColors;
+        uploadVertexColors();
+    }
+    
+    // Refresh the slice outline for the new model
+    if (slicePreviewEnabled) {
+        updateSlicePreview();
+    }
+    
+    // Adjust the camera to show the whole model nicely
+    if (fitView) {
+        QTimer::singleShot(100, this, &GLWidget::fitToWindow);
+    }
+    
+    emit fileLoaded(QFileInfo(fileName).fileName(), triangleCount, vertexData.size() / 6);
+    watchFile(fileName);
+    
+    // Redraw the display
+    update();
+}
+
 void GLWidget::calculateBoundingBox(const QVector<float>& vertexData)
 {
     if (vertexData.isEmpty()) {
@@ -1011,6 +1250,13 @@ void GLWidget::cleanupModel()
     makeCurrent();
 
     // Clean up buffers
+    if (scalarBuffer.isCreated()) {
+        scalarBuffer.destroy();
+    }
+    scalarFieldEnabled = false;
+    if (colorBuffer.isCreated()) {
+        colorBuffer.destroy();
+    }
     if (vertexBuffer.isCreated()) {
         vertexBuffer.destroy();
     }
@@ -1020,16 +1266,41 @@ void GLWidget::cleanupModel()
     if (vao.isCreated()) {
         vao.destroy();
     }
+    cleanupTiles();
+    cleanupSequence();
+    cleanupFeed();
 
     doneCurrent();
 
+    stopWatching();
+    resetModelAnalysis();
+
     // Reset model data
     indices.clear();
+    meshVertexData.clear();
+    meshBlockHashes.clear();
+    meshVertexColors.clear();
+    modelScale = 1.0f;
+    modelOffset = QVector3D(0, 0, 0);
     triangleCount = 0;
     hasModel = false;
     boundingBoxValid = false;
 }
 
+void GLWidget::resetModelAnalysis()
+{
+    // Slice outline and analysis data belong to the old geometry
+    cleanupSlicePreview();
+    invalidateBackgroundResults();
+    voxelGrid.clear();
+    cleanupDistanceSection();
+    distanceField.clear();
+    meshBvh.clear();
+    bvhReady = false;
+    modelParts.clear();
+    partsReady = false;
+}
+
 void GLWidget::resetCamera()
 {
     // Put the camera back to its starting position
@@ -1055,7 +1326,7 @@ void GLWidget::fitToWindow()
     rotationX = rotationY = rotationZ = 0.0f;
     zoomFactor = 1.0f;
     
-    if (!boundingBoxValid || !hasModel) {
+    if (!boundingBoxValid || (!hasModel && !tileMode && !sequenceMode && !feedMode)) {
         // Nothing special to do for the default cube
         update();
         return;
@@ -1159,4 +1430,1858 @@ void GLWidget::setRotationZ(int degrees)
 {
     rotationZ = degrees;
     update();
-}
\ No newline at end of file
+}
+
+void GLWidget::setSlicePreviewEnabled(bool enabled)
+{
+    slicePreviewEnabled = enabled;
+    if (enabled) {
+        updateSlicePreview();
+    }
+    update();
+}
+
+void GLWidget::setSliceHeight(float fraction)
+{
+    sliceHeightFraction = qBound(0.0f, fraction, 1.0f);
+    if (slicePreviewEnabled) {
+        updateSlicePreview();
+    }
+    if (distanceSectionEnabled) {
+        updateDistanceSection();
+    }
+    if (slicePreviewEnabled || distanceSectionEnabled) {
+        update();
+    }
+}
+
+// A copy of what slicing needs; the vectors are shared with the widget, not duplicated
+struct GLWidget::SliceInput {
+    std::shared_ptr<const MeshSlicer> slicer;   // Null: the job builds one
+    QVector<float> vertexData;
+    QVector<unsigned int> indices;
+    float scale = 1.0f;
+    QVector3D offset;
+    quint64 generation = 0;
+};
+
+// The outline a preview job cut, ready to upload
+struct GLWidget::SlicePreview {
+    std::shared_ptr<const MeshSlicer> slicer;
+    quint64 generation = 0;
+    bool ok = false;
+    float z = 0.0f;
+    int contours = 0;
+    QVector<float> lineData;                    // Line segments, position + normal per end
+};
+
+// The slicer for a job's input: the one the widget already had, or a new one built on the job's thread
+std::shared_ptr<const MeshSlicer> GLWidget::readySlicer(const SliceInput &input)
+{
+    if (input.slicer) {
+        return input.slicer;
+    }
+    auto built = std::make_shared<MeshSlicer>();
+    built->setMesh(input.vertexData, input.indices, input.scale, input.offset);
+    return built;
+}
+
+GLWidget::SliceInput GLWidget::sliceInput() const
+{
+    SliceInput input;
+    input.slicer = slicer;
+    input.vertexData = meshVertexData;
+    input.indices = indices;
+    input.scale = modelScale;
+    input.offset = modelOffset;
+    input.generation = geometryGeneration;
+    return input;
+}
+
+void GLWidget::invalidateBackgroundResults()
+{
+    slicer.reset();
+    ++geometryGeneration;
+}
+
+void GLWidget::updateSlicePreview()
+{
+    if (!hasModel || meshVertexData.isEmpty() || indices.isEmpty()) {
+        cleanupSlicePreview();
+        return;
+    }
+    
+    // One cut at a time; while the slider is being dragged only the newest height is cut next
+    if (slicePreviewJob.isBusy()) {
+        slicePreviewPending = true;
+        return;
+    }
+    slicePreviewPending = false;
+    
+    const SliceInput input = sliceInput();
+    const float fraction = sliceHeightFraction;
+    auto preview = std::make_shared<SlicePreview>();
+    slicePreviewJob.start([input, fraction, preview]() {
+        preview->generation = input.generation;
+        preview->slicer = readySlicer(input);
+        const MeshSlicer &cutter = *preview->slicer;
+        if (cutter.isEmpty()) {
+            return;
+        }
+        
+        // Cut the model (in file units) at the chosen height
+        preview->z = cutter.getMinZ() + (cutter.getMaxZ() - cutter.getMinZ()) * fraction;
+        SliceLayer layer = cutter.sliceAt(preview->z);
+        preview->contours = layer.contours.size();
+        
+        // Turn every outline into line segments, moved back into the displayed model's coordinates
+        QVector<float> &lineData = preview->lineData;
+        for (const SliceContour& contour : layer.contours) {
+            int segments = contour.closed ? contour.points.size() : contour.points.size() - 1;
+            for (int i = 0; i < segments; ++i) {
+                const QVector3D ends[2] = {
+                    (contour.points[i] + input.offset) * input.scale,
+                    (contour.points[(i + 1) % contour.points.size()] + input.offset) * input.scale
+                };
+                for (const QVector3D& point : ends) {
+                    lineData.append(point.x());
+                    lineData.append(point.y());
+                    lineData.append(point.z());
+                    lineData.append(0.0f);
+                    lineData.append(0.0f);
+                    lineData.append(1.0f);
+                }
+            }
+        }
+        preview->ok = true;
+    }, [this, preview]() {
+        // Finished on the widget's own thread, which owns the OpenGL context
+        QMetaObject::invokeMethod(this, [this, preview]() { finishSlicePreview(*preview); }, Qt::QueuedConnection);
+    });
+}
+
+void GLWidget::finishSlicePreview(const SlicePreview &preview)
+{
+    if (preview.generation != geometryGeneration) {
+        // The model changed while cutting: cut the new one instead
+        if (slicePreviewEnabled) {
+            updateSlicePreview();
+        }
+        return;
+    }
+    if (!slicer && preview.slicer && !preview.slicer->isEmpty()) {
+        slicer = preview.slicer;
+    }
+    if (slicePreviewPending && slicePreviewEnabled) {
+        updateSlicePreview();    // The slider has moved on; this outline is already out of date
+        return;
+    }
+    if (!slicePreviewEnabled || !preview.ok || !isInitialized || !context() || !context()->isValid()) {
+        if (!preview.ok) {
+            cleanupSlicePreview();
+        }
+        return;
+    }
+    
+    const QVector<float> &lineData = preview.lineData;
+    makeCurrent();
+    
+    if (!sliceVao.isCreated() && !sliceVao.create()) {
+        qCritical() << "Failed to create slice preview VAO";
+        doneCurrent();
+        return;
+    }
+    sliceVao.bind();
+    
+    if (!sliceBuffer.isCreated() && !sliceBuffer.create()) {
+        qCritical() << "Failed to create slice preview buffer";
+        sliceVao.release();
+        doneCurrent();
+        return;
+    }
+    sliceBuffer.bind();
+    sliceBuffer.allocate(lineData.constData(), static_cast<int>(lineData.size() * sizeof(float)));
+    
+    // Same layout as the model: position + normal
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    
+    sliceBuffer.release();
+    sliceVao.release();
+    doneCurrent();
+    
+    sliceVertexCount = lineData.size() / 6;
+    emit slicePreviewUpdated(preview.z, preview.contours);
+    update();
+}
+
+void GLWidget::cleanupSlicePreview()
+{
+    sliceVertexCount = 0;
+    
+    if (!isInitialized || !context() || !context()->isValid()) {
+        return;
+    }
+    
+    makeCurrent();
+    if (sliceVao.isCreated()) {
+        sliceVao.destroy();
+    }
+    if (sliceBuffer.isCreated()) {
+        sliceBuffer.destroy();
+    }
+    doneCurrent();
+}
+
+bool GLWidget::startSliceExport(const QString &fileName, float layerHeight, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty() || indices.isEmpty()) {
+        return fail("No model loaded");
+    }
+    if (layerHeight <= 0.0f) {
+        return fail("Layer height must be greater than zero");
+    }
+    
+    const SliceInput input = sliceInput();
+    struct ExportResult {
+        std::shared_ptr<const MeshSlicer> slicer;
+        bool saved = false;
+        QString errorMessage;
+    };
+    auto result = std::make_shared<ExportResult>();
+    const bool started = sliceExportJob.start([input, fileName, layerHeight, result]() {
+        try {
+            result->slicer = readySlicer(input);
+            if (result->slicer->isEmpty()) {
+                result->errorMessage = "The model has nothing to slice";
+                return;
+            }
+            QVector<SliceLayer> layers = result->slicer->sliceUniform(layerHeight);
+            result->saved = MeshSlicer::exportCLI(fileName, layers, &result->errorMessage);
+        } catch (const std::exception &e) {
+            result->errorMessage = QString("Slicing failed: %1").arg(e.what());
+        }
+    }, [this, input, fileName, result]() {
+        QMetaObject::invokeMethod(this, [this, input, fileName, result]() {
+            if (input.generation == geometryGeneration && !slicer && result->slicer && !result->slicer->isEmpty()) {
+                slicer = result->slicer;
+            }
+            emit sliceExportFinished(fileName, result->saved, result->errorMessage);
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("Another slice export is still running");
+    }
+    return true;
+}
+
+// The current geometry, copied when an analysis job starts so the model can change while it runs
+struct GLWidget::ModelCopy {
+    QVector<float> vertexData;
+    QVector<unsigned int> indices;
+    float scale = 1.0f;
+    QVector3D offset;
+    quint64 generation = 0;
+    MeshBVH bvh;                 // The model's tree, if it was already built
+    bool haveBvh = false;
+    bool bvhBuilt = false;       // The job built the tree; the widget can keep it
+    
+    // The tree, built on the job's thread if the widget had none yet
+    const MeshBVH &readyBvh()
+    {
+        if (!haveBvh) {
+            bvh.build(vertexData, indices, scale, offset);
+            haveBvh = bvhBuilt = !bvh.isEmpty();
+        }
+        return bvh;
+    }
+};
+
+std::shared_ptr<GLWidget::ModelCopy> GLWidget::copyModel(bool withBvh) const
+{
+    auto model = std::make_shared<ModelCopy>();
+    model->vertexData = meshVertexData;
+    model->indices = indices;
+    model->scale = modelScale;
+    model->offset = modelOffset;
+    model->generation = geometryGeneration;
+    if (withBvh && bvhReady) {
+        model->bvh = meshBvh;
+        model->haveBvh = true;
+    }
+    return model;
+}
+
+void GLWidget::adoptBvh(ModelCopy &model)
+{
+    if (model.bvhBuilt && !bvhReady && model.generation == geometryGeneration) {
+        meshBvh = std::move(model.bvh);
+        bvhReady = true;
+        model.bvhBuilt = false;
+    }
+}
+
+bool GLWidget::startVoxelization(int resolution, bool solid, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty()) {
+        return fail("No model loaded");
+    }
+    
+    struct Voxelization {
+        std::shared_ptr<ModelCopy> model;
+        VoxelGrid grid;
+        MeshVoxelizer::Report report;
+    };
+    auto job = std::make_shared<Voxelization>();
+    job->model = copyModel();
+    
+    const bool started = voxelJob.start([job, resolution, solid]() {
+        const ModelCopy &model = *job->model;
+        job->report = MeshVoxelizer::voxelize(model.vertexData, model.indices, resolution,
+                                              solid ? MeshVoxelizer::Solid : MeshVoxelizer::Surface,
+                                              job->grid, model.scale, model.offset);
+    }, [this, job]() {
+        QMetaObject::invokeMethod(this, [this, job]() {
+            if (job->model->generation != geometryGeneration) {
+                emit voxelizationFinished(MeshVoxelizer::Report(), "The model changed while it was being voxelized");
+                return;
+            }
+            if (job->report.filledVoxels == 0) {
+                emit voxelizationFinished(job->report, "The model could not be voxelized");
+                return;
+            }
+            voxelGrid = std::move(job->grid);
+            emit voxelizationFinished(job->report, QString());
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("The model is still being voxelized");
+    }
+    return true;
+}
+
+bool GLWidget::prepareBvh()
+{
+    if (!hasModel || meshVertexData.isEmpty()) {
+        return false;
+    }
+    
+    if (!bvhReady) {
+        meshBvh.build(meshVertexData, indices, modelScale, modelOffset);
+        bvhReady = !meshBvh.isEmpty();
+    }
+    return bvhReady;
+}
+
+bool GLWidget::startDistanceField(int resolution, bool fullField, int bandVoxels, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty()) {
+        return fail("No model loaded");
+    }
+    
+    struct FieldBuild {
+        std::shared_ptr<ModelCopy> model;
+        MeshDistanceField field;
+        MeshDistanceField::Report report;
+        QString errorMessage;
+    };
+    auto job = std::make_shared<FieldBuild>();
+    job->model = copyModel(true);
+    
+    const bool started = distanceFieldJob.start([job, resolution, fullField, bandVoxels]() {
+        job->report = job->field.build(job->model->readyBvh(), resolution,
+                                       fullField ? MeshDistanceField::Full : MeshDistanceField::NarrowBand,
+                                       bandVoxels, &job->errorMessage);
+        if (job->field.isEmpty() && job->errorMessage.isEmpty()) {
+            job->errorMessage = "The distance field could not be built";
+        }
+    }, [this, job]() {
+        QMetaObject::invokeMethod(this, [this, job]() {
+            if (job->model->generation != geometryGeneration) {
+                emit distanceFieldFinished(MeshDistanceField::Report(), "The model changed while the field was built");
+                return;
+            }
+            adoptBvh(*job->model);
+            distanceField = std::move(job->field);
+            if (distanceField.isEmpty()) {
+                cleanupDistanceSection();
+            } else if (distanceSectionEnabled) {
+                updateDistanceSection();
+                update();
+            }
+            emit distanceFieldFinished(job->report, job->errorMessage);
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("A distance field is still being built");
+    }
+    return true;
+}
+
+bool GLWidget::saveSTLFile(const QString &fileName, STLWriter::Format format, QString *errorMessage)
+{
+    if (!hasModel) {
+        if (errorMessage) {
+            *errorMessage = "No model loaded";
+        }
+        return false;
+    }
+    // Undo the loader's centering and scaling so the file has the original coordinates
+    return STLWriter::write(fileName, meshVertexData, indices, format, modelScale, modelOffset, errorMessage);
+}
+
+bool GLWidget::saveGLBFile(const QString &fileName, GLBWriter::Report *report, QString *errorMessage)
+{
+    if (!hasModel) {
+        if (errorMessage) {
+            *errorMessage = "No model loaded";
+        }
+        return false;
+    }
+    return GLBWriter::write(fileName, meshVertexData, indices, modelScale, modelOffset, report, errorMessage);
+}
+
+bool GLWidget::saveArchiveFile(const QString &fileName, MeshArchive::WriteReport *report, QString *errorMessage)
+{
+    if (!hasModel) {
+        if (errorMessage) {
+            *errorMessage = "No model loaded";
+        }
+        return false;
+    }
+    return MeshArchive::write(fileName, meshVertexData, indices, modelScale, modelOffset, report, errorMessage);
+}
+
+bool GLWidget::exportDistanceField(const QString &fileName, QString *errorMessage)
+{
+    return distanceField.save(fileName, errorMessage);
+}
+
+void GLWidget::setDistanceSectionEnabled(bool enabled)
+{
+    distanceSectionEnabled = enabled;
+    if (enabled) {
+        updateDistanceSection();
+    }
+    update();
+}
+
+void GLWidget::updateDistanceSection()
+{
+    if (!isInitialized || !context() || !context()->isValid()) {
+        return;
+    }
+    
+    if (distanceField.isEmpty() || !prepareBvh()) {
+        cleanupDistanceSection();
+        return;
+    }
+    
+    // Pick the grid layer closest to the slice height (same height as the slice outline)
+    float bottom = meshBvh.getBoundsMin().z();
+    float z = bottom + (meshBvh.getBoundsMax().z() - bottom) * sliceHeightFraction;
+    int sizeX = distanceField.getSizeX();
+    int sizeY = distanceField.getSizeY();
+    int layer = qBound(0, qRound((z - distanceField.getOrigin().z()) / distanceField.getVoxelSize()),
+                       distanceField.getSizeZ() - 1);
+    
+    // One vertex per grid point (position + normal + distance), moved into display coordinates
+    QVector<float> vertexData(sizeX * sizeY * 7);
+    float largest = 0.0f;
+    for (int y = 0; y < sizeY; ++y) {
+        for (int x = 0; x < sizeX; ++x) {
+            QVector3D point = (distanceField.pointPosition(x, y, layer) + modelOffset) * modelScale;
+            float distance = distanceField.value(x, y, layer);
+            float* vertex = &vertexData[(y * sizeX + x) * 7];
+            vertex[0] = point.x();
+            vertex[1] = point.y();
+            vertex[2] = point.z();
+            vertex[3] = 0.0f;
+            vertex[4] = 0.0f;
+            vertex[5] = 1.0f;
+            vertex[6] = distance;
+            largest = qMax(largest, qAbs(distance));
+        }
+    }
+    sectionRange = largest > 0.0f ? largest : 1.0f;
+    
+    // Two triangles per grid cell
+    QVector<unsigned int> cellIndices;
+    cellIndices.reserve((sizeX - 1) * (sizeY - 1) * 6);
+    for (int y = 0; y + 1 < sizeY; ++y) {
+        for (int x = 0; x + 1 < sizeX; ++x) {
+            unsigned int corner = unsigned(y * sizeX + x);
+            cellIndices << corner << corner + 1 << corner + sizeX + 1
+                        << corner << corner + sizeX + 1 << corner + sizeX;
+        }
+    }
+    
+    makeCurrent();
+    
+    if (!sectionVao.isCreated() && !sectionVao.create()) {
+        qCritical() << "Failed to create distance section VAO";
+        doneCurrent();
+        return;
+    }
+    sectionVao.bind();
+    
+    if ((!sectionBuffer.isCreated() && !sectionBuffer.create())
+        || (!sectionIndexBuffer.isCreated() && !sectionIndexBuffer.create())) {
+        qCritical() << "Failed to create distance section buffers";
+        sectionVao.release();
+        doneCurrent();
+        return;
+    }
+    sectionBuffer.bind();
+    sectionBuffer.allocate(vertexData.constData(), static_cast<int>(vertexData.size() * sizeof(float)));
+    sectionIndexBuffer.bind();
+    sectionIndexBuffer.allocate(cellIndices.constData(), static_cast<int>(cellIndices.size() * sizeof(unsigned int)));
+    
+    // Position + normal like the model, plus the distance for the colour map
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(6 * sizeof(float)));
+    
+    // The VAO remembers the index buffer, so only the vertex buffer is released
+    sectionVao.release();
+    sectionBuffer.release();
+    doneCurrent();
+    
+    sectionIndexCount = cellIndices.size();
+}
+
+void GLWidget::cleanupDistanceSection()
+{
+    sectionIndexCount = 0;
+    
+    if (!isInitialized || !context() || !context()->isValid()) {
+        return;
+    }
+    
+    makeCurrent();
+    if (sectionVao.isCreated()) {
+        sectionVao.destroy();
+    }
+    if (sectionBuffer.isCreated()) {
+        sectionBuffer.destroy();
+    }
+    if (sectionIndexBuffer.isCreated()) {
+        sectionIndexBuffer.destroy();
+    }
+    doneCurrent();
+}
+
+void GLWidget::setScalarField(const QVector<float> &values, float low, float high, ColorMap colorMap)
+{
+    if (!isInitialized || !context() || !context()->isValid() || !vao.isCreated()) {
+        return;
+    }
+    
+    if (!hasModel || values.size() != meshVertexData.size() / 6) {
+        qWarning() << "GLWidget: scalar field has" << values.size() << "values for"
+                   << meshVertexData.size() / 6 << "vertices, ignoring it";
+        return;
+    }
+    
+    makeCurrent();
+    vao.bind();
+    
+    if (!scalarBuffer.isCreated() && !scalarBuffer.create()) {
+        qCritical() << "Failed to create scalar buffer";
+        vao.release();
+        doneCurrent();
+        return;
+    }
+    scalarBuffer.bind();
+    scalarBuffer.allocate(values.constData(), static_cast<int>(values.size() * sizeof(float)));
+    
+    // Attribute 2 now reads from the buffer instead of the constant default
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    
+    vao.release();
+    scalarBuffer.release();
+    doneCurrent();
+    
+    scalarLow = low;
+    scalarHigh = high;
+    scalarColorMap = colorMap;
+    scalarFieldEnabled = true;
+    update();
+}
+
+void GLWidget::uploadVertexColors()
+{
+    if (!isInitialized || !context() || !context()->isValid() || !vao.isCreated()) {
+        return;
+    }
+    if (meshVertexColors.size() != meshVertexData.size() / 2) {
+        qWarning() << "GLWidget: vertex colours do not match the vertices, ignoring them";
+        meshVertexColors.clear();
+        return;
+    }
+    
+    makeCurrent();
+    vao.bind();
+    
+    if (!colorBuffer.isCreated() && !colorBuffer.create()) {
+        qCritical() << "Failed to create colour buffer";
+        meshVertexColors.clear();
+        vao.release();
+        doneCurrent();
+        return;
+    }
+    colorBuffer.bind();
+    colorBuffer.allocate(meshVertexColors.constData(), static_cast<int>(meshVertexColors.size() * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    
+    vao.release();
+    colorBuffer.release();
+    doneCurrent();
+}
+
+void GLWidget::clearScalarField()
+{
+    scalarFieldEnabled = false;
+    
+    if (isInitialized && context() && context()->isValid()) {
+        makeCurrent();
+        if (vao.isCreated()) {
+            vao.bind();
+            glDisableVertexAttribArray(2);
+            vao.release();
+        }
+        if (scalarBuffer.isCreated()) {
+            scalarBuffer.destroy();
+        }
+        doneCurrent();
+    }
+    update();
+}
+
+bool GLWidget::startThicknessAnalysis(float thinLimit, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty()) {
+        return fail("No model loaded");
+    }
+    
+    struct ThicknessAnalysis {
+        std::shared_ptr<ModelCopy> model;
+        MeshThickness::Report report;
+        QVector<float> values;       // Colour value per vertex
+        float low = 0.0f;
+        float high = 0.0f;
+    };
+    auto job = std::make_shared<ThicknessAnalysis>();
+    job->model = copyModel(true);
+    
+    const bool started = thicknessJob.start([job, thinLimit]() {
+        ModelCopy &model = *job->model;
+        const MeshBVH &bvh = model.readyBvh();
+        if (bvh.isEmpty()) {
+            return;
+        }
+        
+        // Welded models get one ray per vertex; unwelded ones one per triangle, shared by its 3 vertices
+        int vertexCount = model.vertexData.size() / 6;
+        bool perVertex = !model.indices.isEmpty();
+        QVector<float> thickness;
+        MeshThickness::Report &report = job->report;
+        report = MeshThickness::measure(bvh, model.indices, vertexCount,
+                                        perVertex ? MeshThickness::Vertices : MeshThickness::Facets,
+                                        thickness, thinLimit);
+        if (report.samples == report.missed) {
+            return;
+        }
+        
+        // Colour from red at the thinnest wall to blue at twice the limit (or the thickest wall).
+        // Rays that found no opposite wall are shown as thick.
+        job->low = report.minThickness;
+        job->high = thinLimit > 0.0f ? qMin(report.maxThickness, 2.0f * thinLimit) : report.maxThickness;
+        if (job->high <= job->low) {
+            job->high = report.maxThickness;
+        }
+        job->values.resize(vertexCount);
+        for (int v = 0; v < vertexCount; ++v) {
+            float value = thickness[perVertex ? v : v / 3];
+            job->values[v] = (value == MeshThickness::NoHit) ? report.maxThickness : value;
+        }
+    }, [this, job]() {
+        QMetaObject::invokeMethod(this, [this, job]() {
+            if (job->model->generation != geometryGeneration) {
+                emit thicknessFinished(MeshThickness::Report(), "The model changed while it was being measured");
+                return;
+            }
+            adoptBvh(*job->model);
+            const MeshThickness::Report &report = job->report;
+            if (report.samples == report.missed) {
+                emit thicknessFinished(report, "No wall thickness could be measured");
+                return;
+            }
+            setScalarField(job->values, job->high, job->low, Rainbow);
+            emit thicknessFinished(report, QString());
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("Wall thickness is still being measured");
+    }
+    return true;
+}
+
+bool GLWidget::startCurvatureAnalysis(bool gaussian, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty()) {
+        return fail("No model loaded");
+    }
+    if (indices.isEmpty()) {
+        return fail("Curvature needs a model with merged vertices");
+    }
+    
+    struct CurvatureAnalysis {
+        std::shared_ptr<ModelCopy> model;
+        MeshCurvature::Report report;
+        QVector<float> mean;
+        QVector<float> gaussian;
+    };
+    auto job = std::make_shared<CurvatureAnalysis>();
+    job->model = copyModel();
+    
+    const bool started = curvatureJob.start([job]() {
+        const ModelCopy &model = *job->model;
+        job->report = MeshCurvature::compute(model.vertexData, model.indices, job->mean, job->gaussian,
+                                             model.scale, model.offset);
+    }, [this, job, gaussian]() {
+        QMetaObject::invokeMethod(this, [this, job, gaussian]() {
+            if (job->model->generation != geometryGeneration) {
+                emit curvatureFinished(MeshCurvature::Report(), gaussian, "The model changed during the analysis");
+                return;
+            }
+            const MeshCurvature::Report &report = job->report;
+            if (report.vertices == 0) {
+                emit curvatureFinished(report, gaussian, "Curvature needs a model with merged vertices");
+                return;
+            }
+            
+            // Zero curvature sits in the white middle of the map; the range skips the most extreme 2%
+            float range = gaussian ? report.gaussianRange : report.meanRange;
+            if (!(range > 0.0f)) {
+                range = 1.0f;
+            }
+            setScalarField(gaussian ? job->gaussian : job->mean, -range, range, Diverging);
+            emit curvatureFinished(report, gaussian, QString());
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("Curvature is still being computed");
+    }
+    return true;
+}
+
+bool GLWidget::startComparison(const QString &fileName, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty() || indices.isEmpty()) {
+        return fail("No model loaded");
+    }
+    if (comparisonJob.isBusy()) {
+        return fail("Another comparison is still running");
+    }
+    
+    // Everything the job reads is copied here, so the model can change while it runs
+    struct Comparison {
+        QVector<float> vertexData;
+        QVector<unsigned int> indices;
+        float scale = 1.0f;
+        QVector3D offset;
+        quint64 generation = 0;
+        MeshBVH bvh;                 // The model's tree, if it was already built
+        bool bvhBuilt = false;       // The job built the tree; the widget can keep it
+        MeshDeviation::Report report;
+        QVector<float> deviation;
+        QString errorMessage;
+    };
+    auto job = std::make_shared<Comparison>();
+    job->vertexData = meshVertexData;
+    job->indices = indices;
+    job->scale = modelScale;
+    job->offset = modelOffset;
+    job->generation = geometryGeneration;
+    const bool haveBvh = bvhReady;
+    if (haveBvh) {
+        job->bvh = meshBvh;
+    }
+    
+    // Stage messages are sent to the widget's thread as they happen
+    auto progress = [this](const QString &stage) {
+        QMetaObject::invokeMethod(this, [this, stage]() { emit comparisonProgress(stage); }, Qt::QueuedConnection);
+    };
+    
+    comparisonJob.start([job, fileName, haveBvh, progress]() {
+        progress("Loading reference...");
+        
+        // Keep the reference in file units: no centering or scaling
+        STLLoader loader;
+        loader.setAutoCenter(false);
+        loader.setAutoNormalize(false);
+        loader.setRemoveDuplicateFacets(true);
+        loader.setRepairOrientation(true);  // Inside/outside signs need consistent winding
+        if (loader.loadFile(fileName) != STLLoader::Success) {
+            job->errorMessage = loader.getErrorString();
+            return;
+        }
+        
+        progress("Building search trees...");
+        if (!haveBvh) {
+            job->bvh.build(job->vertexData, job->indices, job->scale, job->offset);
+            job->bvhBuilt = !job->bvh.isEmpty();
+        }
+        MeshBVH referenceBvh;
+        referenceBvh.build(loader.getVertexData(), loader.getIndices(), loader.getModelScale(), loader.getModelOffset());
+        
+        progress("Measuring distances...");
+        job->report = MeshDeviation::compare(job->vertexData, job->scale, job->offset, job->bvh,
+                                             loader.getVertexData(), loader.getModelScale(),
+                                             loader.getModelOffset(), referenceBvh, job->deviation);
+        if (job->report.forward.points == 0) {
+            job->errorMessage = "The models could not be compared";
+        }
+    }, [this, job]() {
+        QMetaObject::invokeMethod(this, [this, job]() {
+            if (job->generation != geometryGeneration) {
+                emit comparisonFinished(MeshDeviation::Report(), "The model changed during the comparison");
+                return;
+            }
+            if (job->bvhBuilt && !bvhReady) {
+                meshBvh = std::move(job->bvh);
+                bvhReady = true;
+            }
+            const MeshDeviation::Report &report = job->report;
+            if (report.forward.points > 0) {
+                // Zero deviation is white; the colours reach their ends at the largest deviation
+                float range = report.forward.hausdorff > 0.0f ? report.forward.hausdorff : 1.0f;
+                if (report.signedDistances) {
+                    setScalarField(job->deviation, -range, range, Diverging);
+                } else {
+                    setScalarField(job->deviation, 0.0f, range, Rainbow);
+                }
+            }
+            emit comparisonFinished(report, job->errorMessage);
+        }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+MeshRepair::HoleFillReport GLWidget::fillHoles(float maxPerimeter, bool fair)
+{
+    if (!hasModel || meshVertexData.isEmpty() || indices.isEmpty()) {
+        return MeshRepair::HoleFillReport();
+    }
+    
+    // The buffers are in display units
+    MeshRepair::HoleFillReport report = MeshRepair::fillHoles(meshVertexData, indices, maxPerimeter * modelScale, fair);
+    if (report.addedTriangles == 0) {
+        return report;
+    }
+    
+    // Everything built from the old triangles is out of date
+    meshBlockHashes.clear();
+    clearScalarField();
+    invalidateBackgroundResults();
+    voxelGrid.clear();
+    cleanupDistanceSection();
+    distanceField.clear();
+    meshBvh.clear();
+    bvhReady = false;
+    modelParts.clear();
+    partsReady = false;
+    
+    // Upload the grown buffers; the camera and model placement stay as they are
+    triangleCount = indices.size() / 3;
+    setupVertexBuffer(meshVertexData);
+    if (!meshVertexColors.isEmpty()) {
+        // New vertices of the patches get the plain material colour
+        while (meshVertexColors.size() < meshVertexData.size() / 2) {
+            meshVertexColors << 0.8f << 0.8f << 0.9f;
+        }
+        uploadVertexColors();
+    }
+    if (slicePreviewEnabled) {
+        updateSlicePreview();
+    }
+    update();
+    return report;
+}
+
+bool GLWidget::startProbe(const QVector<QVector3D> &points, bool signedResult, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    if (!hasModel || meshVertexData.isEmpty()) {
+        return fail("No model loaded");
+    }
+    
+    struct Probe {
+        std::shared_ptr<ModelCopy> model;
+        QVector<QVector3D> points;
+        QVector<MeshBVH::Hit> hits;
+        MeshQuery::ProbeReport report;
+    };
+    auto job = std::make_shared<Probe>();
+    job->model = copyModel(true);
+    job->points = points;
+    
+    const bool started = probeJob.start([job, signedResult]() {
+        const MeshBVH &bvh = job->model->readyBvh();
+        if (!bvh.isEmpty()) {
+            job->report = MeshQuery::probe(bvh, job->points, signedResult, job->hits);
+        }
+    }, [this, job]() {
+        QMetaObject::invokeMethod(this, [this, job]() {
+            if (job->model->generation != geometryGeneration) {
+                emit probeFinished(MeshQuery::ProbeReport(), job->points, QVector<MeshBVH::Hit>(),
+                                   "The model changed while the probes were measured");
+                return;
+            }
+            adoptBvh(*job->model);
+            emit probeFinished(job->report, job->points, job->hits,
+                               job->report.found == 0 ? QString("No distances could be measured") : QString());
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("Other probes are still being measured");
+    }
+    return true;
+}
+
+int GLWidget::getPartCount()
+{
+    if (!hasModel || indices.isEmpty()) {
+        return 0;
+    }
+    if (!partsReady) {
+        modelParts = MeshQuery::splitParts(indices);
+        partsReady = true;
+    }
+    return modelParts.size();
+}
+
+int GLWidget::getPartTriangleCount(int part)
+{
+    if (part < 0 || part >= getPartCount()) {
+        return 0;
+    }
+    return modelParts[part].size() / 3;
+}
+
+bool GLWidget::startPartDistance(int first, int second, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+    
+    int count = getPartCount();
+    if (first < 0 || second < 0 || first >= count || second >= count || first == second) {
+        return fail("Pick two different parts");
+    }
+    
+    struct PartDistance {
+        std::shared_ptr<ModelCopy> model;
+        QVector<unsigned int> firstPart;
+        QVector<unsigned int> secondPart;
+        MeshQuery::PartReport report;
+    };
+    auto job = std::make_shared<PartDistance>();
+    job->model = copyModel();
+    job->firstPart = modelParts[first];
+    job->secondPart = modelParts[second];
+    
+    const bool started = partDistanceJob.start([job]() {
+        // Small trees over just the two parts
+        const ModelCopy &model = *job->model;
+        MeshBVH firstSurface;
+        MeshBVH secondSurface;
+        firstSurface.build(model.vertexData, job->firstPart, model.scale, model.offset);
+        secondSurface.build(model.vertexData, job->secondPart, model.scale, model.offset);
+        job->report = MeshQuery::partDistance(firstSurface, secondSurface);
+    }, [this, job, first, second]() {
+        QMetaObject::invokeMethod(this, [this, job, first, second]() {
+            if (job->model->generation != geometryGeneration) {
+                emit partDistanceFinished(MeshQuery::PartReport(), first, second,
+                                          "The model changed while the parts were measured");
+                return;
+            }
+            emit partDistanceFinished(job->report, first, second,
+                                      job->report.found ? QString() : QString("The parts could not be measured"));
+        }, Qt::QueuedConnection);
+    });
+    if (!started) {
+        return fail("Two parts are still being measured");
+    }
+    return true;
+}
+
+bool GLWidget::openTileSet(const QString &fileName, QString *errorMessage)
+{
+    if (!isInitialized || !context() || !context()->isValid()) {
+        if (errorMessage) {
+            *errorMessage = "OpenGL is not ready";
+        }
+        return false;
+    }
+
+    // The tile set replaces whatever was shown before
+    cleanupModel();
+    if (!tileSet.open(fileName, errorMessage)) {
+        setupDefaultGeometry();
+        return false;
+    }
+
+    // Same placement the loader gives models: centred, and 2 units across the biggest side
+    const TileSet::Node &root = tileSet.nodes().first();
+    QVector3D boundsMin(root.boundsMin[0], root.boundsMin[1], root.boundsMin[2]);
+    QVector3D boundsMax(root.boundsMax[0], root.boundsMax[1], root.boundsMax[2]);
+    QVector3D size = boundsMax - boundsMin;
+    float maxDimension = qMax(size.x(), qMax(size.y(), size.z()));
+    tileScale = maxDimension > 0.0f ? 2.0f / maxDimension : 1.0f;
+    tileOffset = -(boundsMin + boundsMax) * 0.5f;
+    modelMin = (boundsMin + tileOffset) * tileScale;
+    modelMax = (boundsMax + tileOffset) * tileScale;
+    modelCenter = QVector3D(0.0f, 0.0f, 0.0f);
+    modelRadius = (modelMax - modelMin).length() * 0.5f;
+    boundingBoxValid = true;
+
+    makeCurrent();
+    tileVao.create();
+    doneCurrent();
+    tileMode = true;
+    tileFrame = 0;
+
+    // Called on a reader thread: ask for a repaint on the widget's own thread
+    tileStreamer.start(&tileSet, TileStagingBytes, [this]() {
+        QMetaObject::invokeMethod(this, [this]() { update(); }, Qt::QueuedConnection);
+    });
+
+    qDebug() << "GLWidget: streaming tile set" << fileName << "with" << tileSet.nodes().size() << "nodes";
+    QTimer::singleShot(100, this, &GLWidget::fitToWindow);
+    emit fileLoaded(QFileInfo(fileName).fileName(), int(qMin<qint64>(tileSet.sourceTriangles(), INT_MAX)), 0);
+    update();
+    return true;
+}
+
+void GLWidget::setTileMemoryBudget(qint64 bytes)
+{
+    tileMemoryBudget = qMax<qint64>(bytes, 16ll << 20);
+    update();
+}
+
+void GLWidget::drawTiles()
+{
+    if (!tileSet.isOpen() || !tileVao.isCreated()) {
+        return;
+    }
+
+    ++tileFrame;
+    TileStats stats;
+    tileVao.bind();
+    uploadLoadedTiles();
+
+    // Tiles are in file units
+    QMatrix4x4 tileMatrix = modelMatrix;
+    tileMatrix.scale(tileScale);
+    tileMatrix.translate(tileOffset);
+    const QMatrix4x4 mvpMatrix = projectionMatrix * viewMatrix * tileMatrix;
+    shaderProgram->setUniformValue("u_mvpMatrix", mvpMatrix);
+    shaderProgram->setUniformValue("u_modelMatrix", tileMatrix);
+    shaderProgram->setUniformValue("u_normalMatrix", tileMatrix.inverted().transposed());
+
+    // A length of one file unit at distance d from the eye covers pixelsPerUnit / d pixels
+    const float fov = camera ? camera->getFov() : 45.0f;
+    const float pixelsPerUnit = float(height()) / (2.0f * std::tan(qDegreesToRadians(fov) * 0.5f));
+    const QVector3D eye = (viewMatrix * tileMatrix).inverted() * QVector3D(0.0f, 0.0f, 0.0f);
+
+    const QVector<TileSet::Node> &nodes = tileSet.nodes();
+    const QVector<TileSet::Level> &levels = tileSet.levels();
+    const TileSet::Node &root = nodes.first();
+    const float minimumDistance = 1e-3f * QVector3D(root.boundsMax[0] - root.boundsMin[0], root.boundsMax[1] - root.boundsMin[1],
+                                                    root.boundsMax[2] - root.boundsMin[2]).length();
+
+    // Outside the view if all eight corners are beyond the same side of it
+    auto isVisible = [&](const TileSet::Node &node) {
+        int outside[6] = {0, 0, 0, 0, 0, 0};
+        for (int corner = 0; corner < 8; ++corner) {
+            const QVector4D p = mvpMatrix * QVector4D(corner & 1 ? node.boundsMax[0] : node.boundsMin[0],
+                                                      corner & 2 ? node.boundsMax[1] : node.boundsMin[1],
+                                                      corner & 4 ? node.boundsMax[2] : node.boundsMin[2], 1.0f);
+            outside[0] += p.x() < -p.w();
+            outside[1] += p.x() > p.w();
+            outside[2] += p.y() < -p.w();
+            outside[3] += p.y() > p.w();
+            outside[4] += p.z() < -p.w();
+            outside[5] += p.z() > p.w();
+        }
+        return std::find(outside, outside + 6, 8) == outside + 6;
+    };
+
+    // Pixels per file unit at the node's closest point
+    auto screenScale = [&](const TileSet::Node &node) {
+        QVector3D gap;
+        for (int k = 0; k < 3; ++k) {
+            gap[k] = qMax(0.0f, qMax(node.boundsMin[k] - eye[k], eye[k] - node.boundsMax[k]));
+        }
+        return pixelsPerUnit / qMax(gap.length(), minimumDistance);
+    };
+
+    // Node size on screen, used to order the requests
+    auto screenSize = [&](const TileSet::Node &node) {
+        return QVector3D(node.boundsMax[0] - node.boundsMin[0], node.boundsMax[1] - node.boundsMin[1],
+                         node.boundsMax[2] - node.boundsMin[2]).length() * screenScale(node);
+    };
+
+    auto finestResident = [&](const TileSet::Node &node) {
+        for (int level = node.firstLevel; level < node.firstLevel + node.levelCount; ++level) {
+            if (residentTiles.contains(level)) {
+                return level;
+            }
+        }
+        return -1;
+    };
+
+    QVector<TileStreamer::Request> wanted;
+    auto want = [&](int level, float priority) {
+        if (!residentTiles.contains(level) && !brokenTileLevels.contains(level)) {
+            TileStreamer::Request request;
+            request.level = level;
+            request.priority = priority;
+            wanted.append(request);
+        }
+    };
+
+    auto draw = [&](int level) {
+        ResidentTile &tile = residentTiles[level];
+        tile.lastUsedFrame = tileFrame;
+        if (tile.indexCount == 0) {
+            return;
+        }
+        tile.vertexBuffer.bind();
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        tile.indexBuffer.bind();
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(tile.indexCount), GL_UNSIGNED_INT, 0);
+        ++stats.drawnTiles;
+        stats.drawnTriangles += tile.indexCount / 3;
+    };
+
+    // Walk down from the root. Each node either draws the coarsest of its levels that is detailed
+    // enough for its distance, or hands over to its children once all of them have something to show.
+    QVector<int> stack(1, 0);
+    while (!stack.isEmpty()) {
+        const TileSet::Node &node = nodes[stack.takeLast()];
+        if (!isVisible(node)) {
+            continue;
+        }
+        const float scale = screenScale(node);
+        const float priority = screenSize(node);
+        const int coarsest = node.firstLevel + node.levelCount - 1;
+
+        int chosen = -1;
+        for (int level = coarsest; level >= node.firstLevel; --level) {
+            if (levels[level].error * scale <= TilePixelError) {
+                chosen = level;
+                break;
+            }
+        }
+        if (chosen < 0 && node.childCount == 0) {
+            chosen = node.firstLevel;
+        }
+
+        if (chosen < 0) {
+            bool childrenReady = true;
+            for (int child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+                if (isVisible(nodes[child]) && finestResident(nodes[child]) < 0) {
+                    childrenReady = false;
+                    want(nodes[child].firstLevel + nodes[child].levelCount - 1, screenSize(nodes[child]));
+                }
+            }
+            if (childrenReady) {
+                for (int child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+                    stack.append(child);
+                }
+                continue;
+            }
+            chosen = node.firstLevel;
+        } else if (!residentTiles.contains(chosen)) {
+            want(chosen, priority);
+        }
+
+        // Until the right level arrives, show the nearest one that is here (finer ones first)
+        int shown = residentTiles.contains(chosen) ? chosen : -1;
+        for (int level = chosen - 1; shown < 0 && level >= node.firstLevel; --level) {
+            shown = residentTiles.contains(level) ? level : -1;
+        }
+        for (int level = chosen + 1; shown < 0 && level <= coarsest; ++level) {
+            shown = residentTiles.contains(level) ? level : -1;
+        }
+        if (shown >= 0) {
+            draw(shown);
+        } else {
+            want(coarsest, StandInPriority + priority);
+        }
+    }
+    tileVao.release();
+
+    tileStreamer.request(wanted);
+    evictTiles();
+
+    stats.residentLevels = residentTiles.size();
+    stats.residentBytes = residentTileBytes;
+    stats.pendingLevels = tileStreamer.pendingCount();
+    lastTileStats = stats;
+}
+
+void GLWidget::uploadLoadedTiles()
+{
+    const QVector<TileStreamer::LoadedLevel> loaded = tileStreamer.takeLoaded(TileUploadBytesPerFrame);
+    for (const TileStreamer::LoadedLevel &level : loaded) {
+        if (!level.ok) {
+            brokenTileLevels.insert(level.level);
+            continue;
+        }
+        if (residentTiles.contains(level.level)) {
+            continue;
+        }
+
+        const TileSet::Level &info = tileSet.levels()[level.level];
+        const int vertexBytes = info.vertices * 6 * int(sizeof(float));
+        ResidentTile tile;
+        if (!tile.vertexBuffer.create() || !tile.indexBuffer.create()) {
+            qWarning() << "GLWidget: cannot create buffers for tile level" << level.level;
+            tile.vertexBuffer.destroy();
+            tile.indexBuffer.destroy();
+            continue;
+        }
+        tile.vertexBuffer.bind();
+        tile.vertexBuffer.allocate(level.data.constData(), vertexBytes);
+        tile.indexBuffer.bind();
+        tile.indexBuffer.allocate(level.data.constData() + vertexBytes, level.data.size() - vertexBytes);
+        tile.indexCount = info.triangles * 3;
+        tile.bytes = level.data.size();
+        tile.lastUsedFrame = tileFrame;
+        residentTileBytes += tile.bytes;
+        residentTiles.insert(level.level, tile);
+    }
+
+    // More may be waiting than one frame uploads
+    if (!loaded.isEmpty()) {
+        update();
+    }
+}
+
+void GLWidget::evictTiles()
+{
+    if (residentTileBytes <= tileMemoryBudget) {
+        return;
+    }
+
+    // Least recently drawn first. Levels drawn in this frame stay, even if the view needs more
+    // than the budget.
+    std::vector<std::pair<quint64, int>> candidates;
+    for (auto it = residentTiles.constBegin(); it != residentTiles.constEnd(); ++it) {
+        if (it->lastUsedFrame < tileFrame) {
+            candidates.emplace_back(it->lastUsedFrame, it.key());
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (const std::pair<quint64, int> &candidate : candidates) {
+        if (residentTileBytes <= tileMemoryBudget) {
+            break;
+        }
+        ResidentTile tile = residentTiles.take(candidate.second);
+        tile.vertexBuffer.destroy();
+        tile.indexBuffer.destroy();
+        residentTileBytes -= tile.bytes;
+    }
+}
+
+void GLWidget::cleanupTiles()
+{
+    // Readers first, they use the tile set
+    tileStreamer.stop();
+    for (auto it = residentTiles.begin(); it != residentTiles.end(); ++it) {
+        it->vertexBuffer.destroy();
+        it->indexBuffer.destroy();
+    }
+    residentTiles.clear();
+    residentTileBytes = 0;
+    brokenTileLevels.clear();
+    if (tileVao.isCreated()) {
+        tileVao.destroy();
+    }
+    tileSet.close();
+    tileMode = false;
+    lastTileStats = TileStats();
+}
+
+bool GLWidget::openSequence(const QString &pattern, QString *errorMessage)
+{
+    if (!isInitialized || !context() || !context()->isValid()) {
+        if (errorMessage) {
+            *errorMessage = "OpenGL is not ready";
+        }
+        return false;
+    }
+
+    const QStringList files = FrameSequence::findFiles(pattern, errorMessage);
+    if (files.isEmpty()) {
+        return false;
+    }
+
+    // Read the first frame before letting go of the current model, so a sequence that cannot be
+    // shown leaves it on screen
+    FrameSequence::Frame first;
+    first.tick = 0;
+    first.file = 0;
+    if (!FrameSequence::decode(files.first(), first, errorMessage)) {
+        return false;
+    }
+
+    cleanupModel();
+
+    // Same placement the loader gives models, taken from the first frame: centred, and 2 units
+    // across the biggest side. Later frames move within that space.
+    calculateBoundingBox(first.vertexData);
+    QVector3D size = modelMax - modelMin;
+    float maxDimension = qMax(size.x(), qMax(size.y(), size.z()));
+    sequenceScale = maxDimension > 0.0f ? 2.0f / maxDimension : 1.0f;
+    sequenceOffset = -modelCenter;
+    modelMin = (modelMin + sequenceOffset) * sequenceScale;
+    modelMax = (modelMax + sequenceOffset) * sequenceScale;
+    modelCenter = QVector3D(0.0f, 0.0f, 0.0f);
+    modelRadius = (modelMax - modelMin).length() * 0.5f;
+    boundingBoxValid = true;
+
+    const int triangles = first.indices.size() / 3;
+    const int vertices = first.vertexData.size() / 6;
+    makeCurrent();
+    sequenceVao.create();
+    sequenceFrames.resize(SequenceGpuFrames);
+    SequenceBuffers &buffers = sequenceFrames[0];
+    buffers.vertexBuffer.create();
+    buffers.vertexBuffer.bind();
+    buffers.vertexBuffer.allocate(first.vertexData.constData(), first.vertexData.size() * int(sizeof(float)));
+    buffers.indexBuffer.create();
+    buffers.indexBuffer.bind();
+    buffers.indexBuffer.allocate(first.indices.constData(), first.indices.size() * int(sizeof(unsigned int)));
+    buffers.tick = 0;
+    buffers.vertexData = std::move(first.vertexData);
+    buffers.indices = std::move(first.indices);
+    doneCurrent();
+
+    sequenceMode = true;
+    shownSequenceFrame = 0;
+    sequenceStats = SequenceStats();
+    sequenceStats.frameCount = files.size();
+    sequenceStats.shownFrame = 0;
+    sequenceStats.shownFrames = 1;
+    sequenceStats.uploadedBytes = sequenceStats.fullUploadBytes =
+        qint64(buffers.vertexData.size()) * qint64(sizeof(float)) + qint64(buffers.indices.size()) * qint64(sizeof(unsigned int));
+    sequenceStats.framesPerSecond = sequenceRate;
+
+    // Called on a reader thread: ask for a repaint on the widget's own thread
+    frameSequence.start(files, 1, SequenceDecodeAhead, [this]() {
+        QMetaObject::invokeMethod(this, [this]() { update(); }, Qt::QueuedConnection);
+    });
+    setSequencePlaying(true);
+
+    qDebug() << "GLWidget: playing sequence of" << files.size() << "frames from" << files.first();
+    QTimer::singleShot(100, this, &GLWidget::fitToWindow);
+    emit fileLoaded(QFileInfo(files.first()).fileName(), triangles, vertices);
+    update();
+    return true;
+}
+
+void GLWidget::setSequencePlaying(bool playing)
+{
+    if (!sequenceMode) {
+        return;
+    }
+    // The play clock counts from the frame on screen, so pausing and changing the rate never jump
+    const SequenceBuffers *shown = shownSequenceFrame >= 0 ? &sequenceFrames[shownSequenceFrame] : nullptr;
+    playStartTick = shown ? shown->tick : 0;
+    playClock.start();
+    sequenceStats.playing = playing;
+    if (playing) {
+        sequenceTimer.start(qMax(1, int(500.0 / sequenceRate)));    // Twice per frame, so no frame is late by a whole period
+    } else {
+        sequenceTimer.stop();
+    }
+    update();
+}
+
+void GLWidget::setSequenceRate(double framesPerSecond)
+{
+    sequenceRate = qBound(0.1, framesPerSecond, 1000.0);
+    sequenceStats.framesPerSecond = sequenceRate;
+    if (sequenceMode) {
+        setSequencePlaying(sequenceStats.playing);
+    }
+}
+
+void GLWidget::drawSequence()
+{
+    if (shownSequenceFrame < 0 || !sequenceVao.isCreated()) {
+        return;
+    }
+
+    // Where playback should be now. Readers are told, so they skip what is already too late.
+    const qint64 shownTick = sequenceFrames[shownSequenceFrame].tick;
+    const qint64 playhead = sequenceStats.playing ? playStartTick + qint64(double(playClock.elapsed()) * sequenceRate / 1000.0)
+                                                   : shownTick;
+    frameSequence.setPlayhead(playhead);
+    uploadSequenceFrames(playhead);
+
+    // Show the newest frame that is due; anything between it and the last one shown was not ready in time
+    int best = shownSequenceFrame;
+    for (int i = 0; i < sequenceFrames.size(); ++i) {
+        const qint64 tick = sequenceFrames[i].tick;
+        if (tick >= 0 && tick <= playhead && tick > sequenceFrames[best].tick) {
+            best = i;
+        }
+    }
+    if (best != shownSequenceFrame) {
+        sequenceStats.droppedFrames += sequenceFrames[best].tick - shownTick - 1;
+        sequenceStats.shownFrames++;
+        shownSequenceFrame = best;
+    }
+    SequenceBuffers &shown = sequenceFrames[shownSequenceFrame];
+    sequenceStats.shownFrame = int(shown.tick % qMax(1, sequenceStats.frameCount));
+    sequenceStats.pendingFrames = frameSequence.pendingCount();
+
+    sequenceVao.bind();
+    drawFileUnitMesh(shown.vertexBuffer, shown.indexBuffer, shown.indices.size(), sequenceScale, sequenceOffset);
+    sequenceVao.release();
+}
+
+void GLWidget::drawFileUnitMesh(QOpenGLBuffer &meshVertexBuffer, QOpenGLBuffer &meshIndexBuffer, int indexCount,
+                                float scale, const QVector3D &offset)
+{
+    QMatrix4x4 meshMatrix = modelMatrix;
+    meshMatrix.scale(scale);
+    meshMatrix.translate(offset);
+    shaderProgram->setUniformValue("u_mvpMatrix", projectionMatrix * viewMatrix * meshMatrix);
+    shaderProgram->setUniformValue("u_modelMatrix", meshMatrix);
+    shaderProgram->setUniformValue("u_normalMatrix", meshMatrix.inverted().transposed());
+
+    meshVertexBuffer.bind();
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    meshIndexBuffer.bind();
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount), GL_UNSIGNED_INT, 0);
+}
+
+void GLWidget::uploadSequenceFrames(qint64 playhead)
+{
+    // Buffers behind the frame on screen will not be shown again
+    const qint64 shownTick = sequenceFrames[shownSequenceFrame].tick;
+    QVector<int> freeBuffers;
+    for (int i = 0; i < sequenceFrames.size(); ++i) {
+        if (sequenceFrames[i].tick < shownTick) {
+            freeBuffers.append(i);
+        }
+    }
+    if (freeBuffers.isEmpty()) {
+        return;
+    }
+
+    QVector<FrameSequence::Frame> frames = frameSequence.takeReady(freeBuffers.size());
+    int nextFree = 0;
+    for (FrameSequence::Frame &frame : frames) {
+        if (!frame.ok || frame.tick <= shownTick) {
+            continue;
+        }
+        SequenceBuffers &buffers = sequenceFrames[freeBuffers[nextFree++]];
+        const int vertexBytes = frame.vertexData.size() * int(sizeof(float));
+        const int indexBytes = frame.indices.size() * int(sizeof(unsigned int));
+        sequenceStats.fullUploadBytes += vertexBytes + indexBytes;
+
+        if (buffers.vertexBuffer.isCreated() && frame.indices == buffers.indices
+            && frame.vertexData.size() == buffers.vertexData.size()) {
+            // Same triangles as the frame these buffers held: send only the runs of vertices that
+            // moved. Short unchanged gaps are sent along, one bigger write beats many small ones.
+            buffers.vertexBuffer.bind();
+            const int vertexCount = frame.vertexData.size() / 6;
+            const int stride = 6 * int(sizeof(float));
+            const float *newData = frame.vertexData.constData();
+            const float *oldData = buffers.vertexData.constData();
+            int runStart = -1;
+            int lastChanged = -1;
+            for (int v = 0; v <= vertexCount; ++v) {
+                const bool changed = v < vertexCount && std::memcmp(newData + v * 6, oldData + v * 6, size_t(stride)) != 0;
+                if (changed) {
+                    if (runStart < 0) {
+                        runStart = v;
+                    }
+                    lastChanged = v;
+                } else if (runStart >= 0 && (v == vertexCount || v - lastChanged > SequenceDeltaGap)) {
+                    buffers.vertexBuffer.write(runStart * stride, newData + runStart * 6, (lastChanged + 1 - runStart) * stride);
+                    sequenceStats.uploadedBytes += (lastChanged + 1 - runStart) * stride;
+                    runStart = -1;
+                }
+            }
+        } else {
+            if (!buffers.vertexBuffer.isCreated()) {
+                buffers.vertexBuffer.create();
+                buffers.indexBuffer.create();
+            }
+            buffers.vertexBuffer.bind();
+            buffers.vertexBuffer.allocate(frame.vertexData.constData(), vertexBytes);
+            buffers.indexBuffer.bind();
+            buffers.indexBuffer.allocate(frame.indices.constData(), indexBytes);
+            sequenceStats.uploadedBytes += vertexBytes + indexBytes;
+            buffers.indices = std::move(frame.indices);
+        }
+        buffers.vertexData = std::move(frame.vertexData);
+        buffers.tick = frame.tick;
+    }
+
+    // A frame that is already due may be waiting behind the ones just taken
+    if (!frames.isEmpty() && frames.last().tick < playhead) {
+        update();
+    }
+}
+
+void GLWidget::cleanupSequence()
+{
+    // Readers first, then the buffers they would fill
+    frameSequence.stop();
+    sequenceTimer.stop();
+    for (SequenceBuffers &buffers : sequenceFrames) {
+        buffers.vertexBuffer.destroy();
+        buffers.indexBuffer.destroy();
+    }
+    sequenceFrames.clear();
+    if (sequenceVao.isCreated()) {
+        sequenceVao.destroy();
+    }
+    shownSequenceFrame = -1;
+    sequenceMode = false;
+    sequenceStats = SequenceStats();
+}
+
+bool GLWidget::openFeed(const QString &name, QString *errorMessage)
+{
+    if (!isInitialized || !context() || !context()->isValid()) {
+        if (errorMessage) {
+            *errorMessage = "OpenGL is not ready";
+        }
+        return false;
+    }
+
+    // Look first, so a producer that is not running leaves the current model on screen
+    {
+        MeshFeed feed;
+        if (!feed.open(name, errorMessage)) {
+            return false;
+        }
+    }
+    cleanupModel();
+    if (!meshFeed.open(name, errorMessage)) {
+        setupDefaultGeometry();
+        return false;
+    }
+
+    makeCurrent();
+    feedVao.create();
+    doneCurrent();
+    feedMode = true;
+    feedStats = FeedStats();
+    feedStats.name = name;
+    feedTimer.start(FeedPollMilliseconds);
+
+    // The model is placed and the window told about it when the first frame arrives
+    qDebug() << "GLWidget: watching live feed" << name;
+    update();
+    return true;
+}
+
+void GLWidget::drawFeed()
+{
+    if (!meshFeed.isOpen() || !feedVao.isCreated()) {
+        return;
+    }
+
+    feedVao.bind();
+    MeshFeed::Frame frame;
+    if (meshFeed.latestFrame(frame) && frame.number > feedStats.frameNumber) {
+        // Straight from the shared memory to the driver; nothing is copied on the way
+        if (!feedBack.vertexBuffer.isCreated()) {
+            feedBack.vertexBuffer.create();
+            feedBack.indexBuffer.create();
+        }
+        feedBack.vertexBuffer.bind();
+        feedBack.vertexBuffer.allocate(frame.vertexData, frame.vertexCount * 6 * int(sizeof(float)));
+        feedBack.indexBuffer.bind();
+        feedBack.indexBuffer.allocate(frame.indices, frame.indexCount * int(sizeof(quint32)));
+        feedBack.indexCount = frame.indexCount;
+
+        if (!meshFeed.isIntact(frame)) {
+            // The producer came round the ring during the upload; the next repaint gets a newer frame
+            feedStats.tornFrames++;
+            update();
+        } else {
+            if (feedStats.frameNumber == 0) {
+                // Same placement the loader gives models, from the first frame's bounds
+                QVector3D size = frame.boundsMax - frame.boundsMin;
+                float maxDimension = qMax(size.x(), qMax(size.y(), size.z()));
+                feedScale = maxDimension > 0.0f ? 2.0f / maxDimension : 1.0f;
+                feedOffset = -(frame.boundsMin + frame.boundsMax) * 0.5f;
+                modelMin = (frame.boundsMin + feedOffset) * feedScale;
+                modelMax = (frame.boundsMax + feedOffset) * feedScale;
+                modelCenter = QVector3D(0.0f, 0.0f, 0.0f);
+                modelRadius = (modelMax - modelMin).length() * 0.5f;
+                boundingBoxValid = true;
+                QTimer::singleShot(0, this, &GLWidget::fitToWindow);
+                emit fileLoaded(feedStats.name, frame.indexCount / 3, frame.vertexCount);
+            } else {
+                feedStats.skippedFrames += qint64(frame.number - feedStats.frameNumber - 1);
+            }
+            std::swap(feedFront, feedBack);
+            feedStats.frameNumber = frame.number;
+            feedStats.shownFrames++;
+            feedStats.triangles = frame.indexCount / 3;
+        }
+    }
+
+    // Once the producer is done its last frame stays, and the polling stops
+    feedStats.finished = meshFeed.producerFinished();
+    if (feedStats.finished && feedTimer.isActive()) {
+        feedTimer.stop();
+        update();    // One more look, in case a frame came in just before the end
+    }
+
+    if (feedFront.indexCount > 0) {
+        drawFileUnitMesh(feedFront.vertexBuffer, feedFront.indexBuffer, feedFront.indexCount, feedScale, feedOffset);
+    }
+    feedVao.release();
+}
+
+void GLWidget::cleanupFeed()
+{
+    feedTimer.stop();
+    meshFeed.close();
+    for (FeedBuffers *buffers : {&feedFront, &feedBack}) {
+        buffers->vertexBuffer.destroy();
+        buffers->indexBuffer.destroy();
+        buffers->indexCount = 0;
+    }
+    if (feedVao.isCreated()) {
+        feedVao.destroy();
+    }
+    feedMode = false;
+    feedStats = FeedStats();
+}
+
+void GLWidget::setAutoReload(bool enabled)
+{
+    autoReload = enabled;
+    if (watchedFile.isEmpty()) {
+        return;
+    }
+    if (enabled) {
+        fileWatcher.addPath(watchedFile);
+    } else {
+        reloadTimer.stop();
+        fileWatcher.removePath(watchedFile);
+    }
+}
+
+void GLWidget::watchFile(const QString &fileName)
+{
+    if (watchedFile != fileName) {
+        stopWatching();
+    }
+    watchedFile = fileName;
+    QFileInfo info(fileName);
+    watchedSize = info.size();
+    watchedModified = info.lastModified();
+    if (autoReload && !fileWatcher.files().contains(fileName)) {
+        fileWatcher.addPath(fileName);
+    }
+}
+
+void GLWidget::stopWatching()
+{
+    reloadTimer.stop();
+    modelReloader.stop();
+    if (!watchedFile.isEmpty()) {
+        fileWatcher.removePath(watchedFile);
+    }
+    watchedFile.clear();
+    watchedSize = -1;
+    watchedModified = QDateTime();
+    reloadAgain = false;
+}
+
+void GLWidget::reloadWatchedFile()
+{
+    if (watchedFile.isEmpty() || !hasModel || !autoReload) {
+        return;
+    }
+
+    // Saving by writing a new file and renaming it over the old one makes the watcher forget the
+    // path. While the new file is not there yet, look again a little later.
+    QFileInfo info(watchedFile);
+    if (!info.exists()) {
+        reloadTimer.start();
+        return;
+    }
+    if (!fileWatcher.files().contains(watchedFile)) {
+        fileWatcher.addPath(watchedFile);
+    }
+    if (info.size() == watchedSize && info.lastModified() == watchedModified) {
+        return;    // Touched, but still the version on screen
+    }
+    if (modelReloader.isBusy()) {
+        reloadAgain = true;
+        return;
+    }
+
+    // Compared against what is on screen now; the vectors are shared with the reload, not copied
+    ModelReloader::Current current;
+    current.vertexData = meshVertexData;
+    current.indices = indices;
+    current.blockHashes = meshBlockHashes;
+    watchedSize = info.size();
+    watchedModified = info.lastModified();
+    qDebug() << "GLWidget:" << watchedFile << "changed on disk, reloading";
+    // Called on the reload thread: finish on the widget's own thread
+    modelReloader.start(watchedFile, current, [this]() {
+        QMetaObject::invokeMethod(this, [this]() { finishReload(); }, Qt::QueuedConnection);
+    });
+}
+
+void GLWidget::finishReload()
+{
+    ModelReloader::Result reloaded;
+    if (!modelReloader.takeResult(reloaded)) {
+        return;
+    }
+    const bool changedAgain = reloadAgain;
+    reloadAgain = false;
+    const QString name = QFileInfo(reloaded.fileName).fileName();
+    if (reloaded.fileName != watchedFile || !hasModel || !isInitialized || !context() || !context()->isValid()) {
+        return;    // Something else was opened meanwhile
+    }
+
+    if (!reloaded.ok) {
+        // Often the exporter is not quite done; the next write starts another reload
+        qWarning() << "GLWidget: reload of" << reloaded.fileName << "failed:" << reloaded.errorMessage;
+        emit reloadFailed(name, reloaded.errorMessage);
+    } else if (reloaded.sameTopology) {
+        // Same triangles: the index buffer stays, and only the vertex blocks that changed are sent
+        qint64 uploadedBytes = 0;
+        const int stride = 6 * int(sizeof(float));
+        makeCurrent();
+        vertexBuffer.bind();
+        for (const ModelReloader::Range &range : reloaded.changedRanges) {
+            vertexBuffer.write(range.firstVertex * stride, reloaded.vertexData.constData() + range.firstVertex * 6,
+                               range.vertexCount * stride);
+            uploadedBytes += qint64(range.vertexCount) * stride;
+        }
+        vertexBuffer.release();
+        doneCurrent();
+
+        meshVertexData = reloaded.vertexData;
+        meshBlockHashes = reloaded.blockHashes;
+        modelScale = reloaded.modelScale;
+        modelOffset = reloaded.modelOffset;
+        calculateBoundingBox(meshVertexData);
+        resetModelAnalysis();
+        clearScalarField();    // Analysis colours were worked out for the old shape
+        meshVertexColors = reloaded.vertexColors;
+        if (!meshVertexColors.isEmpty()) {
+            uploadVertexColors();
+        }
+        if (slicePreviewEnabled) {
+            updateSlicePreview();
+        }
+        emit modelReloaded(name, true, reloaded.changedVertices, uploadedBytes);
+    } else {
+        // New triangles: replace the whole model, but leave the camera where the user put it
+        const qint64 uploadedBytes = qint64(reloaded.vertexData.size()) * qint64(sizeof(float))
+                                     + qint64(reloaded.indices.size()) * qint64(sizeof(unsigned int));
+        const qint64 keptSize = watchedSize;
+        const QDateTime keptModified = watchedModified;
+        cleanupModel();
+        showLoadedModel(reloaded.fileName, reloaded.vertexData, reloaded.indices, reloaded.triangleCount,
+                        reloaded.modelScale, reloaded.modelOffset, reloaded.vertexColors, false);
+        meshBlockHashes = reloaded.blockHashes;
+        // The version just shown, even if the file has moved on since (that change is picked up below)
+        watchedSize = keptSize;
+        watchedModified = keptModified;
+        emit modelReloaded(name, false, reloaded.changedVertices, uploadedBytes);
+    }
+    update();
+
+    if (changedAgain) {
+        reloadTimer.start();
+    }
+}
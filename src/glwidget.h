@@ -7,22 +7,61 @@
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
+#include <QHash>
+#include <QSet>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QMatrix4x4>
 #include <QTimer>
 #include <QVector>
 #include <QVector3D>
+#include <memory>
+#include "backgroundjob.h"
 #include "camera.h"
+#include "framesequence.h"
+#include "glbwriter.h"
+#include "meshfeed.h"
+#include "mesharchive.h"
+#include "meshbvh.h"
+#include "meshcurvature.h"
+#include "meshdeviation.h"
+#include "meshdistancefield.h"
+#include "meshquery.h"
+#include "meshrepair.h"
+#include "meshslicer.h"
+#include "meshthickness.h"
+#include "meshvoxelizer.h"
+#include "modelprefetcher.h"
+#include "modelreloader.h"
+#include "stlwriter.h"
+#include "tileset.h"
+#include "tilestreamer.h"
 
 class GLWidget : public QOpenGLWidget, protected QOpenGLFunctions
 {
     Q_OBJECT
 
 public:
+    // Colour maps for analysis overlays
+    enum ColorMap {
+        Rainbow = 0,      // Blue (low) through green to red (high)
+        Diverging = 1     // Blue (low), white (middle), red (high)
+    };
+
     explicit GLWidget(QWidget *parent = nullptr);
     ~GLWidget();
 
     // Public methods for external control
     void loadSTLFile(const QString &fileName);
+    void showPrefetchedModel(const ModelPrefetcher::Model &model);  // Already parsed in the background: only uploads
+    // Load the open file again whenever it changes on disk (on by default). Writes are waited out,
+    // and a file whose triangles stayed the same only has its changed vertices re-sent.
+    void setAutoReload(bool enabled);
+    bool getAutoReload() const { return autoReload; }
+    bool saveSTLFile(const QString &fileName, STLWriter::Format format, QString *errorMessage = nullptr);  // In file units
+    bool saveGLBFile(const QString &fileName, GLBWriter::Report *report = nullptr, QString *errorMessage = nullptr);  // Compressed glTF, file units
+    bool saveArchiveFile(const QString &fileName, MeshArchive::WriteReport *report = nullptr, QString *errorMessage = nullptr);  // Compact .cmesh, file units
     void resetCamera();
     void fitToWindow();
     void centerModel();
@@ -32,11 +71,136 @@ public:
     void setRotationX(int degrees);
     void setRotationY(int degrees);
     void setRotationZ(int degrees);
+    
+    // Slicing for additive manufacturing. Cutting runs on a background thread; the preview outline
+    // appears when it is ready (slicePreviewUpdated) and an export reports back with sliceExportFinished.
+    bool hasLoadedModel() const { return hasModel; }
+    void setSlicePreviewEnabled(bool enabled);     // Show the outline at the current slice height
+    void setSliceHeight(float fraction);           // 0 = bottom of the model, 1 = top
+    // Start slicing the whole model into a CLI file; false (with the reason) if it cannot start
+    bool startSliceExport(const QString &fileName, float layerHeight, QString *errorMessage = nullptr);
+    bool isSliceExportRunning() const { return sliceExportJob.isBusy(); }
+    
+    // Voxelization for simulation meshing (grid is in file units). Runs in the background and
+    // reports with voxelizationFinished; false (with the reason) if it cannot start.
+    bool startVoxelization(int resolution, bool solid, QString *errorMessage = nullptr);
+    bool isVoxelizationRunning() const { return voxelJob.isBusy(); }
+    const VoxelGrid& getVoxelGrid() const { return voxelGrid; }
+    
+    // Signed distance field (grid is in file units). Built in the background, reporting with
+    // distanceFieldFinished; false (with the reason) if it cannot start.
+    bool startDistanceField(int resolution, bool fullField, int bandVoxels, QString *errorMessage = nullptr);
+    bool isDistanceFieldRunning() const { return distanceFieldJob.isBusy(); }
+    bool hasDistanceField() const { return !distanceField.isEmpty(); }
+    bool exportDistanceField(const QString &fileName, QString *errorMessage = nullptr);
+    void setDistanceSectionEnabled(bool enabled);  // Colour a cut through the field at the slice height
+    
+    // Colour the model by a value per vertex of the display buffer (values from low to high span the
+    // colour map; low > high turns it around)
+    void setScalarField(const QVector<float> &values, float low, float high, ColorMap colorMap = Rainbow);
+    void clearScalarField();
+    
+    // Wall thickness, shown as colours (thin = red). Thickness is in file units. Measured in the
+    // background, reporting with thicknessFinished; false (with the reason) if it cannot start.
+    bool startThicknessAnalysis(float thinLimit, QString *errorMessage = nullptr);
+    bool isThicknessAnalysisRunning() const { return thicknessJob.isBusy(); }
+    
+    // Mean or Gaussian curvature per vertex, shown blue (concave/saddle) to red (convex). Computed in
+    // the background, reporting with curvatureFinished; false (with the reason) if it cannot start.
+    bool startCurvatureAnalysis(bool gaussian, QString *errorMessage = nullptr);
+    bool isCurvatureAnalysisRunning() const { return curvatureJob.isBusy(); }
+    
+    // Load a reference STL (same coordinate system) and colour the current model by its signed
+    // distance to it: blue = inside the reference, red = outside. Runs in the background, reporting its
+    // stage with comparisonProgress and the result with comparisonFinished; false if it cannot start.
+    bool startComparison(const QString &fileName, QString *errorMessage = nullptr);
+    bool isComparisonRunning() const { return comparisonJob.isBusy(); }
+    
+    // Close holes whose rim is shorter than maxPerimeter (file units). New triangles are added to the
+    // current buffers, so the model keeps its place and camera; derived data is rebuilt when needed.
+    MeshRepair::HoleFillReport fillHoles(float maxPerimeter, bool fair);
+    
+    // Measurements in file units: closest points on the surface for probe points, and the gap
+    // between two parts (pieces of the model that share no vertices, biggest first). Both run in the
+    // background and report with probeFinished / partDistanceFinished; false if they cannot start.
+    bool startProbe(const QVector<QVector3D> &points, bool signedResult, QString *errorMessage = nullptr);
+    bool isProbeRunning() const { return probeJob.isBusy(); }
+    int getPartCount();
+    int getPartTriangleCount(int part);
+    bool startPartDistance(int first, int second, QString *errorMessage = nullptr);
+    bool isPartDistanceRunning() const { return partDistanceJob.isBusy(); }
+    
+    // Out-of-core viewing of a tile set (TileSet::build): only the tiles in view are read, at the
+    // detail the view needs, while a bounded number of them stay on the graphics card. Coarser
+    // tiles are shown until finer ones have streamed in. The analysis tools need a loaded model
+    // and are not available for tile sets.
+    struct TileStats {
+        int residentLevels = 0;      // Tile levels on the graphics card
+        qint64 residentBytes = 0;
+        int drawnTiles = 0;          // In the last frame
+        qint64 drawnTriangles = 0;
+        int pendingLevels = 0;       // Wanted but not uploaded yet
+    };
+    bool openTileSet(const QString &fileName, QString *errorMessage = nullptr);
+    bool isTileMode() const { return tileMode; }
+    void setTileMemoryBudget(qint64 bytes);    // Graphics card memory for tiles (least recently drawn go first)
+    TileStats getTileStats() const { return lastTileStats; }
+
+    // Playback of a simulation saved as one model file per time step (see FrameSequence for the
+    // file name patterns). Frames are decoded ahead on background threads and a few of them wait on
+    // the graphics card. When decoding cannot keep up with the frame rate, late frames are skipped
+    // instead of waited for. A frame with the same triangles as the one whose buffers it reuses only
+    // uploads the vertices that moved. The analysis tools are not available for sequences.
+    struct SequenceStats {
+        int frameCount = 0;          // Files in the sequence
+        int shownFrame = -1;         // File on screen
+        qint64 shownFrames = 0;      // Frames put on screen since the sequence was opened
+        qint64 droppedFrames = 0;    // Frames skipped because they were not decoded in time
+        int pendingFrames = 0;       // Decoded or being decoded, not on the graphics card yet
+        qint64 uploadedBytes = 0;    // Sent to the graphics card since the sequence was opened
+        qint64 fullUploadBytes = 0;  // What sending every frame whole would have cost
+        bool playing = false;
+        double framesPerSecond = 0.0;
+    };
+    bool openSequence(const QString &pattern, QString *errorMessage = nullptr);
+    bool isSequenceMode() const { return sequenceMode; }
+    void setSequencePlaying(bool playing);
+    void setSequenceRate(double framesPerSecond);
+    SequenceStats getSequenceStats() const { return sequenceStats; }
+
+    // Live view of a mesh another program publishes through shared memory (see MeshFeed). The
+    // newest frame is uploaded straight from the shared memory into a second pair of buffers, and
+    // only shown once it is known the producer did not overwrite it during the upload.
+    struct FeedStats {
+        QString name;
+        quint64 frameNumber = 0;     // Producer's number of the frame on screen (0 while waiting)
+        qint64 shownFrames = 0;
+        qint64 skippedFrames = 0;    // Published and replaced before a repaint picked them up
+        qint64 tornFrames = 0;       // Overwritten while being uploaded, not shown
+        int triangles = 0;           // In the frame on screen
+        bool finished = false;       // The producer has stopped publishing
+    };
+    bool openFeed(const QString &name, QString *errorMessage = nullptr);
+    bool isFeedMode() const { return feedMode; }
+    FeedStats getFeedStats() const { return feedStats; }
 
 signals:
     // Signals sent to parent window
     void frameRendered();                                                    // Emitted after each frame
     void fileLoaded(const QString &filename, int triangles, int vertices);   // Emitted when STL loads successfully
+    void slicePreviewUpdated(float z, int contours);                         // Emitted when the preview slice changes
+    void sliceExportFinished(const QString &fileName, bool saved, const QString &errorMessage);  // A startSliceExport() is done
+    void comparisonProgress(const QString &stage);                           // What a startComparison() is doing now
+    void comparisonFinished(const MeshDeviation::Report &report, const QString &errorMessage);  // Colours applied if it worked
+    void voxelizationFinished(const MeshVoxelizer::Report &report, const QString &errorMessage);  // Grid kept if it worked
+    void distanceFieldFinished(const MeshDistanceField::Report &report, const QString &errorMessage);  // Field kept if it worked
+    void thicknessFinished(const MeshThickness::Report &report, const QString &errorMessage);  // Colours applied if it worked
+    void curvatureFinished(const MeshCurvature::Report &report, bool gaussian, const QString &errorMessage);  // Likewise
+    void probeFinished(const MeshQuery::ProbeReport &report, const QVector<QVector3D> &points,
+                       const QVector<MeshBVH::Hit> &hits, const QString &errorMessage);  // Closest point per probe
+    void partDistanceFinished(const MeshQuery::PartReport &report, int first, int second, const QString &errorMessage);
+    void modelReloaded(const QString &filename, bool incremental, int changedVertices, qint64 uploadedBytes);  // The file changed on disk
+    void reloadFailed(const QString &filename, const QString &errorMessage);  // Changed file could not be read; old model kept
 
 protected:
     // Qt OpenGL widget lifecycle methods
@@ -54,10 +218,45 @@ private:
     // Setup and cleanup methods
     void cleanup();                                      // Clean up all OpenGL resources
     void cleanupModel();                                 // Clean up current model data
+    void resetModelAnalysis();                           // Forget slicer, BVH, voxels and parts of the old geometry
+    void showLoadedModel(const QString &fileName, const QVector<float> &vertexData, const QVector<unsigned int> &indexData,
+                         int triangles, float scale, const QVector3D &offset, const QVector<float> &vertexColors,
+                         bool fitView);                  // Make loaded data the current model
+    void watchFile(const QString &fileName);             // Follow changes to the shown file
+    void stopWatching();
+    void reloadWatchedFile();                            // Debounce timer ran out: start a background reload
+    void finishReload();                                 // Apply a finished background reload
     bool setupShaders();                                 // Create and compile shaders
     void setupDefaultGeometry();                         // Create default cube geometry
     void setupVertexBuffer(const QVector<float>& vertexData);  // Upload vertex data to GPU
     void calculateBoundingBox(const QVector<float>& vertexData);  // Calculate model bounds
+    struct SliceInput;
+    struct SlicePreview;
+    SliceInput sliceInput() const;                       // What a slicing job needs from the current model
+    static std::shared_ptr<const MeshSlicer> readySlicer(const SliceInput &input);  // Reuse or build (any thread)
+    struct ModelCopy;
+    std::shared_ptr<ModelCopy> copyModel(bool withBvh = false) const;  // What an analysis job needs from the current model
+    void adoptBvh(ModelCopy &model);                     // Keep a tree a job built, if the model is still the same
+    void invalidateBackgroundResults();                  // The geometry changed: slicers and jobs so far are stale
+    void updateSlicePreview();                           // Start cutting the model at the slice height
+    void finishSlicePreview(const SlicePreview &preview);  // Upload the outline a finished cut produced
+    void cleanupSlicePreview();                          // Free the outline buffers
+    bool prepareBvh();                                   // Build the BVH for the current model if needed
+    void updateDistanceSection();                        // Upload the coloured cut through the distance field
+    void cleanupDistanceSection();                       // Free the section buffers
+    void uploadVertexColors();                           // Attach meshVertexColors to the model's vertex setup
+    void drawTiles();                                    // Pick, request and draw tile levels for this frame
+    void uploadLoadedTiles();                            // Move levels the streamer has read to the GPU
+    void evictTiles();                                   // Free least recently drawn levels over the budget
+    void cleanupTiles();                                 // Leave tile mode (needs the context current)
+    void drawSequence();                                 // Move the playhead and draw the frame it is on
+    void uploadSequenceFrames(qint64 playhead);          // Move decoded frames into free frame buffers
+    void cleanupSequence();                              // Leave sequence mode (needs the context current)
+    void drawFeed();                                     // Pick up the producer's newest frame and draw
+    void cleanupFeed();                                  // Leave feed mode (needs the context current)
+    // Draw a mesh kept in file units (sequence and feed frames), placed with scale and offset
+    void drawFileUnitMesh(QOpenGLBuffer &meshVertexBuffer, QOpenGLBuffer &meshIndexBuffer, int indexCount,
+                          float scale, const QVector3D &offset);
     
     // OpenGL objects (handles to GPU resources)
     QOpenGLShaderProgram *shaderProgram;    // Compiled shader program
@@ -84,6 +283,9 @@ private:
     
     // Current model data
     QVector<unsigned int> indices;  // Index buffer for vertex reuse
+    QVector<float> meshVertexData;  // CPU copy of the vertex buffer (position + normal) for analysis
+    float modelScale;               // Loader scaling: displayed = (file + modelOffset) * modelScale
+    QVector3D modelOffset;          // Loader centering offset
     int triangleCount;              // Number of triangles in current model
     bool hasModel;                  // Is a model currently loaded (vs default cube)
     
@@ -94,6 +296,123 @@ private:
     float modelRadius;        // Distance from center to furthest point
     bool boundingBoxValid;    // Is bounding box data valid
     
+    // Slice preview. Slicers are built and used on background jobs; a finished job hands its
+    // slicer back so the next cut of the same geometry does not have to build one again.
+    std::shared_ptr<const MeshSlicer> slicer; // Ready for the current model, or null
+    quint64 geometryGeneration;               // Counts geometry changes, so stale results are ignored
+    BackgroundJob slicePreviewJob;            // Cuts one preview outline at a time
+    BackgroundJob sliceExportJob;             // Slices the whole model for export
+    bool slicePreviewPending;                 // The height changed while a cut was running
+    BackgroundJob comparisonJob;              // Compares the model with a reference file
+    bool slicePreviewEnabled;                 // Draw the outline at sliceHeightFraction
+    float sliceHeightFraction;                // Where to cut, 0 = bottom, 1 = top
+    QOpenGLBuffer sliceBuffer;                // Outline line segments (position + normal)
+    QOpenGLVertexArrayObject sliceVao;        // Vertex setup for the outline
+    int sliceVertexCount;                     // Number of line vertices to draw
+    
+    // Voxels of the current model (filled on request, by voxelJob)
+    VoxelGrid voxelGrid;
+    BackgroundJob voxelJob;
+    
+    // Distance queries and the signed distance field
+    MeshBVH meshBvh;                          // Triangle hierarchy for closest-point and ray queries
+    bool bvhReady;                            // Has the BVH seen the current model yet
+    QVector<QVector<unsigned int>> modelParts; // Index lists of the separate parts (filled on request)
+    bool partsReady;                          // Is modelParts up to date
+    BackgroundJob probeJob;                   // Closest points for a list of probes
+    BackgroundJob partDistanceJob;            // Gap between two parts
+    MeshDistanceField distanceField;          // Filled on request, by distanceFieldJob
+    BackgroundJob distanceFieldJob;
+    bool distanceSectionEnabled;              // Draw the field's values on a plane at sliceHeightFraction
+    QOpenGLBuffer sectionBuffer;              // Section grid vertices (position + normal + distance)
+    QOpenGLBuffer sectionIndexBuffer;         // Two triangles per grid cell
+    QOpenGLVertexArrayObject sectionVao;      // Vertex setup for the section
+    int sectionIndexCount;                    // Number of indices to draw
+    float sectionRange;                       // Distances from -sectionRange to +sectionRange span the colours
+    
+    // Analysis colours on the model itself
+    BackgroundJob thicknessJob;               // Measures wall thickness
+    BackgroundJob curvatureJob;               // Computes curvature
+    QOpenGLBuffer scalarBuffer;               // One value per vertex, shader attribute 2
+    bool scalarFieldEnabled;                  // Colour by scalarBuffer instead of the material colour
+    float scalarLow;                          // Value at the start of the colour map
+    float scalarHigh;                         // Value at the end of the colour map
+    ColorMap scalarColorMap;
+    
+    // Colours stored in the file itself (PLY), shown when no analysis colours are
+    QOpenGLBuffer colorBuffer;                // Red, green, blue per vertex, shader attribute 3
+    QVector<float> meshVertexColors;          // CPU copy, empty if the file had no colours
+    
+    // Tile set being streamed (tile mode); levels are in file units, displayed = (file + tileOffset) * tileScale
+    struct ResidentTile {
+        QOpenGLBuffer vertexBuffer{QOpenGLBuffer::VertexBuffer};
+        QOpenGLBuffer indexBuffer{QOpenGLBuffer::IndexBuffer};
+        int indexCount = 0;
+        qint64 bytes = 0;
+        quint64 lastUsedFrame = 0;
+    };
+    TileSet tileSet;
+    TileStreamer tileStreamer;                // Declared after tileSet so it stops before the file closes
+    bool tileMode;
+    float tileScale;
+    QVector3D tileOffset;
+    QOpenGLVertexArrayObject tileVao;         // Re-pointed at each tile's buffers when drawing
+    QHash<int, ResidentTile> residentTiles;   // By level number
+    QSet<int> brokenTileLevels;               // Levels that could not be read; never asked for again
+    qint64 residentTileBytes;
+    qint64 tileMemoryBudget;
+    quint64 tileFrame;                        // Frame counter for least-recently-used eviction
+    TileStats lastTileStats;
+
+    // Sequence being played (sequence mode). Frames are in file units and placed with the first
+    // frame's bounds: displayed = (file + sequenceOffset) * sequenceScale
+    struct SequenceBuffers {
+        QOpenGLBuffer vertexBuffer{QOpenGLBuffer::VertexBuffer};
+        QOpenGLBuffer indexBuffer{QOpenGLBuffer::IndexBuffer};
+        qint64 tick = -1;                     // Frame held (see FrameSequence), -1 if none
+        QVector<float> vertexData;            // Copy of what the buffers hold, to find what changed
+        QVector<unsigned int> indices;
+    };
+    FrameSequence frameSequence;
+    bool sequenceMode;
+    float sequenceScale;
+    QVector3D sequenceOffset;
+    QOpenGLVertexArrayObject sequenceVao;     // Re-pointed at the shown frame's buffers when drawing
+    QVector<SequenceBuffers> sequenceFrames;  // Frames on the graphics card
+    int shownSequenceFrame;                   // Index into sequenceFrames
+    double sequenceRate;                      // Frames per second
+    qint64 playStartTick;                     // Tick on screen when playClock was started
+    QElapsedTimer playClock;
+    QTimer sequenceTimer;                     // Repaints while playing
+    SequenceStats sequenceStats;
+
+    // Live feed (feed mode); placed like a sequence, from the first frame that arrives
+    struct FeedBuffers {
+        QOpenGLBuffer vertexBuffer{QOpenGLBuffer::VertexBuffer};
+        QOpenGLBuffer indexBuffer{QOpenGLBuffer::IndexBuffer};
+        int indexCount = 0;
+    };
+    MeshFeed meshFeed;
+    bool feedMode;
+    float feedScale;
+    QVector3D feedOffset;
+    QOpenGLVertexArrayObject feedVao;
+    FeedBuffers feedFront;                    // On screen
+    FeedBuffers feedBack;                     // Receives the next frame
+    QTimer feedTimer;                         // Looks for new frames while the producer runs
+    FeedStats feedStats;
+    
+    // Reloading the shown file when it changes on disk
+    QFileSystemWatcher fileWatcher;
+    QTimer reloadTimer;                       // Waits until writes to the file have stopped
+    ModelReloader modelReloader;
+    QString watchedFile;
+    qint64 watchedSize;                       // Size and time of the version on screen
+    QDateTime watchedModified;
+    bool autoReload;
+    bool reloadAgain;                         // The file changed again while a reload was running
+    QVector<quint64> meshBlockHashes;         // Block hashes of meshVertexData from the last reload, if still valid
+    
     // Rendering control
     QTimer renderTimer;       // Timer for continuous rendering (~60 FPS)
     
@@ -1,11 +1,29 @@
 #include "mainwindow.h"
+#include "commandline.h"
 #include <QApplication>
+#include <QCoreApplication>
+#include <QGuiApplication>
 #include <iostream>
 #include <exception>
 
 int main(int argc, char *argv[])
 {
     try {
+        // Command-line tools run without a window (and without a display)
+        if (CommandLine::isCommand(argc, argv)) {
+            if (CommandLine::needsOpenGL(argc, argv)) {
+                // Offscreen OpenGL still needs a platform plugin; "offscreen" works without a display
+                if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") && qEnvironmentVariableIsEmpty("DISPLAY")
+                    && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY")) {
+                    qputenv("QT_QPA_PLATFORM", "offscreen");
+                }
+                QGuiApplication app(argc, argv);
+                return CommandLine::run(app.arguments());
+            }
+            QCoreApplication app(argc, argv);
+            return CommandLine::run(app.arguments());
+        }
+        
         // Create Qt application instance
         QApplication a(argc, argv);
         
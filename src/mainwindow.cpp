@@ -2,13 +2,17 @@
 #include "mainwindow.h"
 #include "../build/ui_mainwindow.h"
 #include "glwidget.h"
+#include "stlloader.h"
 #include <QApplication>
 #include <QMessageBox>
 #include <QFileInfo>
 #include <QDir>
 #include <QProgressDialog>
+#include <QInputDialog>
+#include <QLineEdit>
 #include <QThread>
 #include <QDebug>
+#include <QSettings>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -17,9 +21,15 @@ MainWindow::MainWindow(QWidget *parent)
     , frameCount(0)
     , currentFileName("")
     , frameRateTimer(nullptr)
+    , prefetchTimer(nullptr)
 {
     ui->setupUi(this);
     
+    // Remembered from the last session
+    QSettings settings("STLViewer", "STLViewer");
+    recentFiles = settings.value("recentFiles").toStringList();
+    prefetcher.setMemoryBudget(qint64(settings.value("prefetchMemoryMB", 512).toInt()) * 1024 * 1024);
+    
     // Configure main window appearance
     setWindowTitle("STL Viewer - 3D Model Viewer");
     setMinimumSize(800, 600);
@@ -38,6 +48,13 @@ MainWindow::MainWindow(QWidget *parent)
     connect(frameRateTimer, &QTimer::timeout, this, &MainWindow::updateFrameRate);
     frameRateTimer->start(1000);
     
+    // Prefetch a couple of seconds after the last load, when the user is looking at the model
+    prefetchTimer = new QTimer(this);
+    prefetchTimer->setSingleShot(true);
+    prefetchTimer->setInterval(2000);
+    connect(prefetchTimer, &QTimer::timeout, this, &MainWindow::startPrefetch);
+    prefetchTimer->start();
+    
     // Show initial status
     statusLabel->setText("Ready - Open an STL file to begin");
     
@@ -75,6 +92,10 @@ void MainWindow::closeEvent(QCloseEvent *event)
     if (frameRateTimer) {
         frameRateTimer->stop();
     }
+    if (prefetchTimer) {
+        prefetchTimer->stop();
+    }
+    prefetcher.pause();
     
     // Prepare OpenGL widget for shutdown
     if (glWidget) {
@@ -93,7 +114,31 @@ void MainWindow::createActions()
     // File menu actions
     openAction = new QAction(QIcon(":/icons/open.png"), "&Open STL...", this);
     openAction->setShortcut(QKeySequence::Open);  // Ctrl+O
-    openAction->setStatusTip("Open an STL file");
+    openAction->setStatusTip("Open an STL, OBJ, PLY, 3MF or mesh archive file");
+    
+    openTilesAction = new QAction("Open &Tile Set...", this);
+    openTilesAction->setStatusTip("Stream a model that is too big to load from a tile set made with --build-tiles");
+    
+    openSequenceAction = new QAction("Open &Sequence...", this);
+    openSequenceAction->setStatusTip("Play numbered model files (one per time step) as an animation");
+    
+    playSequenceAction = new QAction("&Play Sequence", this);
+    playSequenceAction->setCheckable(true);
+    playSequenceAction->setEnabled(false);       // Until a sequence is open
+    playSequenceAction->setShortcut(QKeySequence(Qt::Key_Space));
+    playSequenceAction->setStatusTip("Pause or resume the sequence");
+    
+    openFeedAction = new QAction("Open &Live Feed...", this);
+    openFeedAction->setStatusTip("Watch a mesh that a running simulation or scanner publishes through shared memory");
+    
+    autoReloadAction = new QAction("&Reload When File Changes", this);
+    autoReloadAction->setCheckable(true);
+    autoReloadAction->setChecked(true);
+    autoReloadAction->setStatusTip("Show the new version of the model when another program saves its file");
+    
+    saveAsAction = new QAction("Save &As...", this);
+    saveAsAction->setShortcut(QKeySequence::SaveAs);  // Ctrl+Shift+S
+    saveAsAction->setStatusTip("Save the model as a binary or text STL file, or as compressed glTF for web viewers");
     
     exitAction = new QAction(QIcon(":/icons/exit.png"), "E&xit", this);
     exitAction->setShortcut(QKeySequence::Quit);  // Ctrl+Q
@@ -115,6 +160,45 @@ void MainWindow::createActions()
     lightingAction->setCheckable(true);
     lightingAction->setChecked(true);             // Start with lighting enabled
     lightingAction->setStatusTip("Toggle lighting");
+    
+    // Slicing actions
+    slicePreviewAction = new QAction("Slice Preview", this);
+    slicePreviewAction->setCheckable(true);
+    slicePreviewAction->setStatusTip("Show the model outline at the slice height");
+    
+    exportSlicesAction = new QAction("Export Slice &Contours...", this);
+    exportSlicesAction->setStatusTip("Slice the model into layers and save the outlines");
+    
+    voxelizeAction = new QAction("&Voxelize...", this);
+    voxelizeAction->setStatusTip("Convert the model into a voxel grid");
+    
+    distanceFieldAction = new QAction("Signed Distance &Field...", this);
+    distanceFieldAction->setStatusTip("Sample the distance to the surface on a grid and save it");
+    
+    distanceSectionAction = new QAction("Distance Section", this);
+    distanceSectionAction->setCheckable(true);
+    distanceSectionAction->setStatusTip("Colour a cut through the distance field at the slice height");
+    
+    thicknessAction = new QAction("Wall &Thickness...", this);
+    thicknessAction->setStatusTip("Colour the model by wall thickness to find thin walls");
+    
+    curvatureAction = new QAction("C&urvature...", this);
+    curvatureAction->setStatusTip("Colour the model by surface curvature");
+    
+    deviationAction = new QAction("Compare with &Reference...", this);
+    deviationAction->setStatusTip("Colour the model by its distance to a reference STL file");
+    
+    clearColorsAction = new QAction("Clear Analysis &Colours", this);
+    clearColorsAction->setStatusTip("Show the model in its normal colour again");
+    
+    fillHolesAction = new QAction("Fill &Holes...", this);
+    fillHolesAction->setStatusTip("Close holes in the surface with new triangles");
+    
+    probeAction = new QAction("&Probe Distances...", this);
+    probeAction->setStatusTip("Measure the distance from a list of points to the surface");
+    
+    partDistanceAction = new QAction("Distance Between &Parts...", this);
+    partDistanceAction->setStatusTip("Measure the smallest gap between two parts of the model");
 }
 
 void MainWindow::setupMenuBar()
@@ -122,6 +206,14 @@ void MainWindow::setupMenuBar()
     // File menu
     QMenu *fileMenu = menuBar()->addMenu("&File");
     fileMenu->addAction(openAction);
+    fileMenu->addAction(openTilesAction);
+    fileMenu->addAction(openSequenceAction);
+    fileMenu->addAction(openFeedAction);
+    recentMenu = fileMenu->addMenu("Open &Recent");
+    updateRecentMenu();
+    fileMenu->addAction(saveAsAction);
+    fileMenu->addSeparator();
+    fileMenu->addAction(autoReloadAction);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAction);
     
@@ -132,6 +224,27 @@ void MainWindow::setupMenuBar()
     viewMenu->addSeparator();
     viewMenu->addAction(wireframeAction);
     viewMenu->addAction(lightingAction);
+    viewMenu->addSeparator();
+    viewMenu->addAction(playSequenceAction);
+    
+    // Tools menu
+    QMenu *toolsMenu = menuBar()->addMenu("&Tools");
+    toolsMenu->addAction(slicePreviewAction);
+    toolsMenu->addAction(exportSlicesAction);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(voxelizeAction);
+    toolsMenu->addAction(distanceFieldAction);
+    toolsMenu->addAction(distanceSectionAction);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(thicknessAction);
+    toolsMenu->addAction(curvatureAction);
+    toolsMenu->addAction(deviationAction);
+    toolsMenu->addAction(clearColorsAction);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(probeAction);
+    toolsMenu->addAction(partDistanceAction);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(fillHolesAction);
     
     // Help menu with about dialog
     QMenu *helpMenu = menuBar()->addMenu("&Help");
@@ -227,6 +340,22 @@ void MainWindow::setupToolBar()
     rotationLayout->addWidget(rotationZSlider);
     
     mainToolBar->addWidget(rotationWidget);
+    mainToolBar->addSeparator();
+    
+    // Slice height control (0 = bottom of the model, 1000 = top)
+    QWidget *sliceWidget = new QWidget();
+    QHBoxLayout *sliceLayout = new QHBoxLayout(sliceWidget);
+    sliceLayout->setContentsMargins(5, 5, 5, 5);
+    
+    sliceSlider = new QSlider(Qt::Horizontal);
+    sliceSlider->setRange(0, 1000);
+    sliceSlider->setValue(500);
+    sliceSlider->setFixedWidth(100);
+    
+    sliceLayout->addWidget(new QLabel("Slice:"));
+    sliceLayout->addWidget(sliceSlider);
+    
+    mainToolBar->addWidget(sliceWidget);
 }
 
 void MainWindow::setupCentralWidget()
@@ -268,6 +397,12 @@ void MainWindow::connectSignals()
 {
     // Connect menu actions to their functions
     connect(openAction, &QAction::triggered, this, &MainWindow::openSTLFile);
+    connect(openTilesAction, &QAction::triggered, this, &MainWindow::openTileSet);
+    connect(openSequenceAction, &QAction::triggered, this, &MainWindow::openSequence);
+    connect(playSequenceAction, &QAction::triggered, this, &MainWindow::toggleSequencePlaying);
+    connect(openFeedAction, &QAction::triggered, this, &MainWindow::openFeed);
+    connect(autoReloadAction, &QAction::triggered, this, &MainWindow::toggleAutoReload);
+    connect(saveAsAction, &QAction::triggered, this, &MainWindow::saveSTLFileAs);
     connect(exitAction, &QAction::triggered, this, &MainWindow::exitApplication);
     
     // Connect toolbar actions
@@ -286,6 +421,21 @@ void MainWindow::connectSignals()
     connect(rotationXSlider, &QSlider::valueChanged, this, &MainWindow::onRotationXChanged);
     connect(rotationYSlider, &QSlider::valueChanged, this, &MainWindow::onRotationYChanged);
     connect(rotationZSlider, &QSlider::valueChanged, this, &MainWindow::onRotationZChanged);
+    
+    // Connect slicing controls
+    connect(slicePreviewAction, &QAction::triggered, this, &MainWindow::toggleSlicePreview);
+    connect(exportSlicesAction, &QAction::triggered, this, &MainWindow::exportSliceContours);
+    connect(sliceSlider, &QSlider::valueChanged, this, &MainWindow::onSliceHeightChanged);
+    connect(voxelizeAction, &QAction::triggered, this, &MainWindow::voxelizeModel);
+    connect(distanceFieldAction, &QAction::triggered, this, &MainWindow::buildDistanceField);
+    connect(distanceSectionAction, &QAction::triggered, this, &MainWindow::toggleDistanceSection);
+    connect(thicknessAction, &QAction::triggered, this, &MainWindow::analyzeThickness);
+    connect(curvatureAction, &QAction::triggered, this, &MainWindow::analyzeCurvature);
+    connect(deviationAction, &QAction::triggered, this, &MainWindow::compareWithReference);
+    connect(clearColorsAction, &QAction::triggered, this, &MainWindow::clearAnalysisColors);
+    connect(fillHolesAction, &QAction::triggered, this, &MainWindow::fillHoles);
+    connect(probeAction, &QAction::triggered, this, &MainWindow::probeDistances);
+    connect(partDistanceAction, &QAction::triggered, this, &MainWindow::measurePartDistance);
 
     // Connect OpenGL widget signals
     if (glWidget) {
@@ -293,6 +443,22 @@ void MainWindow::connectSignals()
         connect(glWidget, &GLWidget::frameRendered, this, [this]{ frameCount++; });
         // Update status when file loads
         connect(glWidget, &GLWidget::fileLoaded, this, &MainWindow::updateFileInfo);
+        // Say what happened when the file was reloaded after a change on disk
+        connect(glWidget, &GLWidget::modelReloaded, this, &MainWindow::showReloadInfo);
+        connect(glWidget, &GLWidget::reloadFailed, this, &MainWindow::showReloadFailure);
+        // Show where the slice preview is cutting
+        connect(glWidget, &GLWidget::slicePreviewUpdated, this, &MainWindow::updateSliceInfo);
+        connect(glWidget, &GLWidget::sliceExportFinished, this, &MainWindow::finishSliceExport);
+        // Comparing with a reference runs in the background too
+        connect(glWidget, &GLWidget::comparisonProgress, this, &MainWindow::showComparisonProgress);
+        connect(glWidget, &GLWidget::comparisonFinished, this, &MainWindow::finishComparison);
+        // So do the other analysis tools
+        connect(glWidget, &GLWidget::voxelizationFinished, this, &MainWindow::finishVoxelization);
+        connect(glWidget, &GLWidget::distanceFieldFinished, this, &MainWindow::finishDistanceField);
+        connect(glWidget, &GLWidget::thicknessFinished, this, &MainWindow::finishThickness);
+        connect(glWidget, &GLWidget::curvatureFinished, this, &MainWindow::finishCurvature);
+        connect(glWidget, &GLWidget::probeFinished, this, &MainWindow::finishProbe);
+        connect(glWidget, &GLWidget::partDistanceFinished, this, &MainWindow::finishPartDistance);
     }
 }
 
@@ -305,45 +471,298 @@ void MainWindow::openSTLFile()
     QString fileName = QFileDialog::getOpenFileName(this,
         "Open STL File", 
         QDir::homePath(),
-        "STL Files (*.stl);;All Files (*)");
+        STLLoader::openFileFilter());
 
     if (!fileName.isEmpty()) {
         qDebug() << "MainWindow: Selected file:" << fileName;
-        
-        if (!glWidget) {
-            QMessageBox::critical(this, "Error", "OpenGL widget not initialized");
-            return;
-        }
-        
-        // Disable UI during loading to prevent interference
-        setEnabled(false);
-        statusLabel->setText("Loading STL file...");
-        QApplication::processEvents();  // Update UI immediately
-        
-        try {
+        loadModelFile(fileName);
+    } else {
+        qDebug() << "MainWindow: File dialog cancelled";
+    }
+}
+
+void MainWindow::loadModelFile(const QString& fileName)
+{
+    if (!glWidget) {
+        QMessageBox::critical(this, "Error", "OpenGL widget not initialized");
+        return;
+    }
+    
+    // The background work would only compete with this load for the disk
+    prefetchTimer->stop();
+    prefetcher.pause();
+    
+    // Disable UI during loading to prevent interference
+    setEnabled(false);
+    statusLabel->setText("Loading STL file...");
+    QApplication::processEvents();  // Update UI immediately
+    
+    try {
+        ModelPrefetcher::Model prefetched;
+        if (prefetcher.take(fileName, prefetched)) {
+            // Parsed while the viewer was idle: only the upload is left
+            glWidget->showPrefetchedModel(prefetched);
+            statusLabel->setText("File loaded (prepared in the background)");
+        } else {
             // Load the file through OpenGL widget
             glWidget->loadSTLFile(fileName);
-            currentFileName = fileName;
             statusLabel->setText("File loaded successfully");
-            
-        } catch (const std::exception& e) {
-            QString errorMsg = QString("Error loading STL file: %1").arg(e.what());
-            QMessageBox::critical(this, "Load Error", errorMsg);
-            statusLabel->setText("Failed to load file");
-            qCritical() << errorMsg;
-            
-        } catch (...) {
-            QString errorMsg = "Unknown error occurred while loading STL file";
-            QMessageBox::critical(this, "Load Error", errorMsg);
-            statusLabel->setText("Failed to load file");
-            qCritical() << errorMsg;
+        }
+        currentFileName = fileName;
+        if (glWidget->hasLoadedModel()) {
+            addRecentFile(fileName);
         }
         
-        // Re-enable UI
-        setEnabled(true);
+    } catch (const std::exception& e) {
+        QString errorMsg = QString("Error loading STL file: %1").arg(e.what());
+        QMessageBox::critical(this, "Load Error", errorMsg);
+        statusLabel->setText("Failed to load file");
+        qCritical() << errorMsg;
         
+    } catch (...) {
+        QString errorMsg = "Unknown error occurred while loading STL file";
+        QMessageBox::critical(this, "Load Error", errorMsg);
+        statusLabel->setText("Failed to load file");
+        qCritical() << errorMsg;
+    }
+    
+    // Re-enable UI
+    setEnabled(true);
+    prefetchTimer->start();
+}
+
+void MainWindow::addRecentFile(const QString& fileName)
+{
+    recentFiles.removeAll(fileName);
+    recentFiles.prepend(fileName);
+    while (recentFiles.size() > MaxRecentFiles) {
+        recentFiles.removeLast();
+    }
+    QSettings settings("STLViewer", "STLViewer");
+    settings.setValue("recentFiles", recentFiles);
+    updateRecentMenu();
+}
+
+void MainWindow::updateRecentMenu()
+{
+    recentMenu->clear();
+    for (int i = 0; i < recentFiles.size(); ++i) {
+        const QString fileName = recentFiles[i];
+        QAction *action = recentMenu->addAction(QString("&%1 %2").arg(i + 1).arg(QFileInfo(fileName).fileName()));
+        action->setStatusTip(fileName);
+        connect(action, &QAction::triggered, this, [this, fileName]() {
+            if (!QFileInfo(fileName).exists()) {
+                QMessageBox::warning(this, "Open Recent", QString("%1 no longer exists.").arg(fileName));
+                recentFiles.removeAll(fileName);
+                QSettings settings("STLViewer", "STLViewer");
+                settings.setValue("recentFiles", recentFiles);
+                updateRecentMenu();
+                return;
+            }
+            loadModelFile(fileName);
+        });
+    }
+    if (recentFiles.isEmpty()) {
+        recentMenu->addAction("(none)")->setEnabled(false);
+    }
+    recentMenu->addSeparator();
+    QAction *clearAction = recentMenu->addAction("&Clear List");
+    clearAction->setEnabled(!recentFiles.isEmpty());
+    connect(clearAction, &QAction::triggered, this, &MainWindow::clearRecentFiles);
+    QAction *memoryAction = recentMenu->addAction("&Prefetch Memory...");
+    memoryAction->setStatusTip("Set how much memory recent models parsed ahead of time may use");
+    connect(memoryAction, &QAction::triggered, this, &MainWindow::setPrefetchMemory);
+}
+
+void MainWindow::clearRecentFiles()
+{
+    recentFiles.clear();
+    QSettings settings("STLViewer", "STLViewer");
+    settings.setValue("recentFiles", recentFiles);
+    updateRecentMenu();
+    prefetcher.prefetch(QStringList());    // Also frees the parsed models
+}
+
+void MainWindow::setPrefetchMemory()
+{
+    bool ok = false;
+    int megabytes = QInputDialog::getInt(this, "Prefetch Memory",
+        "Memory for recent models parsed ahead of time (MB, 0 only warms the disk cache):",
+        int(prefetcher.memoryBudget() / (1024 * 1024)), 0, 65536, 64, &ok);
+    if (!ok) {
+        return;
+    }
+    prefetcher.setMemoryBudget(qint64(megabytes) * 1024 * 1024);
+    QSettings settings("STLViewer", "STLViewer");
+    settings.setValue("prefetchMemoryMB", megabytes);
+    startPrefetch();
+}
+
+void MainWindow::startPrefetch()
+{
+    // The most likely next models are the recent ones, apart from the one on screen
+    QStringList files = recentFiles;
+    files.removeAll(currentFileName);
+    prefetcher.prefetch(files);
+    
+    ModelPrefetcher::Stats stats = prefetcher.stats();
+    qDebug() << "MainWindow: Prefetching" << files.size() << "recent files; so far" << stats.hits << "opens were prefetched,"
+             << stats.misses << "were not";
+}
+
+void MainWindow::openTileSet()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+        "Open Tile Set",
+        QDir::homePath(),
+        "Tile Sets (*.tiles);;All Files (*)");
+    if (fileName.isEmpty() || !glWidget) {
+        return;
+    }
+    
+    QString errorMessage;
+    if (!glWidget->openTileSet(fileName, &errorMessage)) {
+        QMessageBox::critical(this, "Open Tile Set", QString("Could not open the tile set: %1").arg(errorMessage));
+        statusLabel->setText("Failed to open tile set");
+        return;
+    }
+    currentFileName = fileName;
+    statusLabel->setText("Streaming tiles from " + QFileInfo(fileName).fileName());
+}
+
+void MainWindow::openSequence()
+{
+    // Any one file of the sequence will do; the others are found by their numbers
+    QString fileName = QFileDialog::getOpenFileName(this,
+        "Open Sequence (pick any frame)",
+        QDir::homePath(),
+        STLLoader::openFileFilter());
+    if (fileName.isEmpty() || !glWidget) {
+        return;
+    }
+    
+    bool ok = false;
+    double framesPerSecond = QInputDialog::getDouble(this, "Open Sequence",
+        "Frames per second:", 24.0, 0.1, 1000.0, 1, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    QString errorMessage;
+    glWidget->setSequenceRate(framesPerSecond);
+    if (!glWidget->openSequence(fileName, &errorMessage)) {
+        QMessageBox::critical(this, "Open Sequence", QString("Could not open the sequence: %1").arg(errorMessage));
+        statusLabel->setText("Failed to open sequence");
+        return;
+    }
+    currentFileName = fileName;
+    playSequenceAction->setChecked(true);
+    statusLabel->setText(QString("Playing %1 frames at %2 fps")
+                             .arg(glWidget->getSequenceStats().frameCount)
+                             .arg(framesPerSecond));
+}
+
+void MainWindow::openFeed()
+{
+    // The name the producer created its shared memory under (STLViewer --feed-demo uses this one)
+    bool ok = false;
+    QString name = QInputDialog::getText(this, "Open Live Feed",
+        "Shared memory name:", QLineEdit::Normal, "stlviewer-feed", &ok).trimmed();
+    if (!ok || name.isEmpty() || !glWidget) {
+        return;
+    }
+    
+    QString errorMessage;
+    if (!glWidget->openFeed(name, &errorMessage)) {
+        QMessageBox::critical(this, "Open Live Feed", QString("Could not open the feed: %1").arg(errorMessage));
+        statusLabel->setText("Failed to open live feed");
+        return;
+    }
+    statusLabel->setText("Waiting for frames from " + name);
+}
+
+void MainWindow::toggleAutoReload()
+{
+    if (!glWidget) {
+        return;
+    }
+    bool enabled = autoReloadAction->isChecked();
+    glWidget->setAutoReload(enabled);
+    statusLabel->setText(enabled ? "The model reloads when its file changes" : "Automatic reload off");
+}
+
+void MainWindow::toggleSequencePlaying()
+{
+    if (!glWidget || !glWidget->isSequenceMode()) {
+        playSequenceAction->setChecked(false);
+        return;
+    }
+    bool playing = playSequenceAction->isChecked();
+    glWidget->setSequencePlaying(playing);
+    statusLabel->setText(playing ? "Sequence playing" : "Sequence paused");
+}
+
+void MainWindow::saveSTLFileAs()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Save As", "Open an STL file first.");
+        return;
+    }
+    
+    // The chosen filter decides the format
+    const QString binaryFilter = "Binary STL (*.stl)";
+    const QString textFilter = "Text STL (*.stl)";
+    const QString glbFilter = "Compressed glTF for web viewers (*.glb)";
+    const QString archiveFilter = "Compact mesh archive (*.cmesh)";
+    QString selectedFilter = binaryFilter;
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Save STL File As",
+        currentFileName.isEmpty() ? QDir::homePath() : QFileInfo(currentFileName).absolutePath(),
+        binaryFilter + ";;" + textFilter + ";;" + glbFilter + ";;" + archiveFilter,
+        &selectedFilter);
+    if (fileName.isEmpty()) {
+        return;
+    }
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    const bool glb = selectedFilter == glbFilter || suffix == "glb";
+    const bool archive = !glb && (selectedFilter == archiveFilter || suffix == "cmesh");
+    if (suffix.isEmpty()) {
+        fileName += glb ? ".glb" : archive ? ".cmesh" : ".stl";
+    }
+    STLWriter::Format format = selectedFilter == textFilter ? STLWriter::ASCII : STLWriter::Binary;
+    
+    setEnabled(false);
+    statusLabel->setText(glb ? "Saving glTF file..." : archive ? "Saving mesh archive..." : "Saving STL file...");
+    QApplication::processEvents();
+    
+    QString errorMessage;
+    GLBWriter::Report glbReport;
+    MeshArchive::WriteReport archiveReport;
+    bool saved = glb ? glWidget->saveGLBFile(fileName, &glbReport, &errorMessage)
+                     : archive ? glWidget->saveArchiveFile(fileName, &archiveReport, &errorMessage)
+                               : glWidget->saveSTLFile(fileName, format, &errorMessage);
+    
+    setEnabled(true);
+    
+    if (saved && glb) {
+        // The web viewer copy is not the file being worked on, so the current file name stays
+        statusLabel->setText(QString("glTF saved: %1x smaller than binary STL, encoded at %2 MB/s")
+                                 .arg(glbReport.compressionRatio, 0, 'f', 1)
+                                 .arg(glbReport.encodeMegabytesPerSecond, 0, 'f', 0));
+        qDebug() << "MainWindow: Saved" << fileName;
+    } else if (saved && archive) {
+        // The archive opens again as the same model, so it becomes the current file
+        currentFileName = fileName;
+        statusLabel->setText(QString("Mesh archive saved: %1x smaller than binary STL")
+                                 .arg(archiveReport.compressionRatio, 0, 'f', 1));
+        qDebug() << "MainWindow: Saved" << fileName;
+    } else if (saved) {
+        currentFileName = fileName;
+        statusLabel->setText("File saved");
+        qDebug() << "MainWindow: Saved" << fileName;
     } else {
-        qDebug() << "MainWindow: File dialog cancelled";
+        QMessageBox::critical(this, "Save Error", QString("Could not save the file: %1").arg(errorMessage));
+        statusLabel->setText("Save failed");
     }
 }
 
@@ -434,14 +853,680 @@ void MainWindow::onRotationZChanged(int value)
     }
 }
 
+// Slicing functions
+void MainWindow::toggleSlicePreview()
+{
+    if (glWidget) {
+        bool preview = slicePreviewAction->isChecked();
+        glWidget->setSliceHeight(sliceSlider->value() / 1000.0f);
+        glWidget->setSlicePreviewEnabled(preview);
+        if (!preview) {
+            statusLabel->setText("Slice preview disabled");
+        }
+        qDebug() << "MainWindow: Slice preview" << (preview ? "enabled" : "disabled");
+    }
+}
+
+void MainWindow::onSliceHeightChanged(int value)
+{
+    if (glWidget) {
+        glWidget->setSliceHeight(value / 1000.0f);
+    }
+}
+
+void MainWindow::exportSliceContours()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Export Slice Contours", "Open an STL file first.");
+        return;
+    }
+    
+    // Layer height is in the same units as the STL file (usually millimeters)
+    bool ok = false;
+    double layerHeight = QInputDialog::getDouble(this, "Export Slice Contours",
+        "Layer height (file units):", 0.2, 0.001, 1000.0, 3, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Save Slice Contours",
+        QDir::homePath(),
+        "CLI Files (*.cli);;All Files (*)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    // Slicing runs in the background; finishSliceExport() reports the result
+    QString errorMessage;
+    if (!glWidget->startSliceExport(fileName, static_cast<float>(layerHeight), &errorMessage)) {
+        QMessageBox::critical(this, "Export Error", QString("Could not export slices: %1").arg(errorMessage));
+        return;
+    }
+    exportSlicesAction->setEnabled(false);
+    statusLabel->setText("Slicing model...");
+}
+
+void MainWindow::finishSliceExport(const QString &fileName, bool saved, const QString &errorMessage)
+{
+    exportSlicesAction->setEnabled(true);
+    
+    if (saved) {
+        statusLabel->setText("Slice contours saved");
+        qDebug() << "MainWindow: Slice contours saved to" << fileName;
+    } else {
+        QMessageBox::critical(this, "Export Error", QString("Could not export slices: %1").arg(errorMessage));
+        statusLabel->setText("Slice export failed");
+    }
+}
+
+void MainWindow::updateSliceInfo(float z, int contours)
+{
+    statusLabel->setText(QString("Slice at Z = %1: %2 contour(s)").arg(z, 0, 'f', 3).arg(contours));
+}
+
+void MainWindow::voxelizeModel()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Voxelize", "Open an STL file first.");
+        return;
+    }
+    
+    bool ok = false;
+    int resolution = QInputDialog::getInt(this, "Voxelize",
+        "Voxels along the longest side:", 256, 8, 4096, 1, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    QStringList modes;
+    modes << "Solid (surface and inside)" << "Surface only";
+    QString mode = QInputDialog::getItem(this, "Voxelize", "Fill:", modes, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    // finishVoxelization() shows the result when the background job is done
+    QString errorMessage;
+    if (!glWidget->startVoxelization(resolution, mode == modes.first(), &errorMessage)) {
+        QMessageBox::critical(this, "Voxelize", QString("Could not voxelize: %1").arg(errorMessage));
+        return;
+    }
+    voxelizeAction->setEnabled(false);
+    statusLabel->setText("Voxelizing model...");
+}
+
+void MainWindow::finishVoxelization(const MeshVoxelizer::Report &report, const QString &errorMessage)
+{
+    voxelizeAction->setEnabled(true);
+    
+    if (report.filledVoxels == 0) {
+        statusLabel->setText("Voxelization failed");
+        QMessageBox::warning(this, "Voxelize", errorMessage + ".");
+        return;
+    }
+    
+    statusLabel->setText(QString("Voxelized: %1 voxels").arg(report.filledVoxels));
+    
+    QString summary = QString("Grid: %1 x %2 x %3 (voxel size %4)\n"
+                              "Surface voxels: %5\n"
+                              "Filled voxels: %6\n"
+                              "Bricks: %7 (%8 completely full)\n"
+                              "Memory: %9 MB\n"
+                              "Time: %10 ms")
+                      .arg(report.sizeX).arg(report.sizeY).arg(report.sizeZ)
+                      .arg(report.voxelSize, 0, 'g', 5)
+                      .arg(report.surfaceVoxels)
+                      .arg(report.filledVoxels)
+                      .arg(report.bricks).arg(report.fullBricks)
+                      .arg(report.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                      .arg(report.milliseconds);
+    if (report.leakyRows > 0) {
+        summary += QString("\n\n%1 rows were left unfilled because the surface has holes.").arg(report.leakyRows);
+    }
+    QMessageBox::information(this, "Voxelize", summary);
+}
+
+void MainWindow::buildDistanceField()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Signed Distance Field", "Open an STL file first.");
+        return;
+    }
+    
+    bool ok = false;
+    int resolution = QInputDialog::getInt(this, "Signed Distance Field",
+        "Grid steps along the longest side:", 128, 8, MeshDistanceField::MaxResolution, 1, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    QStringList modes;
+    modes << "Narrow band (fast)" << "Full field";
+    QString mode = QInputDialog::getItem(this, "Signed Distance Field", "Distances:", modes, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    int band = QInputDialog::getInt(this, "Signed Distance Field",
+        "Exact band width (grid steps):", 4, 1, 64, 1, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    // finishDistanceField() shows the result when the background job is done
+    QString errorMessage;
+    if (!glWidget->startDistanceField(resolution, mode != modes.first(), band, &errorMessage)) {
+        QMessageBox::critical(this, "Signed Distance Field", QString("Could not build the field: %1").arg(errorMessage));
+        return;
+    }
+    distanceFieldAction->setEnabled(false);
+    statusLabel->setText("Building distance field...");
+}
+
+void MainWindow::finishDistanceField(const MeshDistanceField::Report &report, const QString &errorMessage)
+{
+    distanceFieldAction->setEnabled(true);
+    
+    if (report.sizeX == 0) {
+        statusLabel->setText("Distance field failed");
+        QMessageBox::warning(this, "Signed Distance Field", errorMessage + ".");
+        return;
+    }
+    
+    statusLabel->setText(QString("Distance field: %1 x %2 x %3").arg(report.sizeX).arg(report.sizeY).arg(report.sizeZ));
+    
+    QString summary = QString("Grid: %1 x %2 x %3 (spacing %4)\n"
+                              "Exact band: %5\n"
+                              "Exact points: %6\n"
+                              "Propagated points: %7\n"
+                              "Memory: %8 MB\n"
+                              "Time: %9 ms\n\n"
+                              "Save the field to a file?")
+                      .arg(report.sizeX).arg(report.sizeY).arg(report.sizeZ)
+                      .arg(report.voxelSize, 0, 'g', 5)
+                      .arg(report.bandWidth, 0, 'g', 5)
+                      .arg(report.exactPoints)
+                      .arg(report.propagatedPoints)
+                      .arg(report.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                      .arg(report.milliseconds);
+    if (QMessageBox::question(this, "Signed Distance Field", summary) != QMessageBox::Yes) {
+        return;
+    }
+    
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Save Signed Distance Field",
+        QDir::homePath(),
+        "Distance Field Files (*.sdf);;All Files (*)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    QString saveError;
+    if (glWidget->exportDistanceField(fileName, &saveError)) {
+        statusLabel->setText("Distance field saved");
+        qDebug() << "MainWindow: Distance field saved to" << fileName;
+    } else {
+        QMessageBox::critical(this, "Export Error", QString("Could not save the distance field: %1").arg(saveError));
+        statusLabel->setText("Distance field export failed");
+    }
+}
+
+void MainWindow::toggleDistanceSection()
+{
+    if (glWidget) {
+        bool show = distanceSectionAction->isChecked();
+        if (show && !glWidget->hasDistanceField()) {
+            statusLabel->setText("Build a distance field first (Tools > Signed Distance Field)");
+        }
+        glWidget->setSliceHeight(sliceSlider->value() / 1000.0f);
+        glWidget->setDistanceSectionEnabled(show);
+        qDebug() << "MainWindow: Distance section" << (show ? "enabled" : "disabled");
+    }
+}
+
+void MainWindow::analyzeThickness()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Wall Thickness", "Open an STL file first.");
+        return;
+    }
+    
+    // Walls thinner than this are counted and shown in red (same units as the STL file)
+    bool ok = false;
+    double thinLimit = QInputDialog::getDouble(this, "Wall Thickness",
+        "Thin wall limit (file units):", 1.0, 0.0, 1000000.0, 3, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    // finishThickness() shows the result when the background job is done
+    QString errorMessage;
+    if (!glWidget->startThicknessAnalysis(static_cast<float>(thinLimit), &errorMessage)) {
+        QMessageBox::critical(this, "Wall Thickness", QString("Could not measure: %1").arg(errorMessage));
+        return;
+    }
+    thicknessAction->setEnabled(false);
+    statusLabel->setText("Measuring wall thickness...");
+}
+
+void MainWindow::finishThickness(const MeshThickness::Report &report, const QString &errorMessage)
+{
+    thicknessAction->setEnabled(true);
+    
+    if (report.samples == report.missed) {
+        statusLabel->setText("Thickness analysis failed");
+        QMessageBox::warning(this, "Wall Thickness", errorMessage + ".");
+        return;
+    }
+    
+    statusLabel->setText(QString("Thickness: %1 to %2").arg(report.minThickness, 0, 'g', 4)
+                                                          .arg(report.maxThickness, 0, 'g', 4));
+    
+    QString summary = QString("Samples: %1\n"
+                              "Thinnest wall: %2\n"
+                              "Thickest wall: %3\n"
+                              "Average: %4\n"
+                              "Thinner than %5: %6 samples\n"
+                              "Time: %7 ms")
+                      .arg(report.samples)
+                      .arg(report.minThickness, 0, 'g', 5)
+                      .arg(report.maxThickness, 0, 'g', 5)
+                      .arg(report.averageThickness, 0, 'g', 5)
+                      .arg(report.thinLimit, 0, 'g', 5).arg(report.thinSamples)
+                      .arg(report.milliseconds);
+    if (report.missed > 0) {
+        summary += QString("\n\n%1 rays found no opposite wall (the surface may be open).").arg(report.missed);
+    }
+    QMessageBox::information(this, "Wall Thickness", summary);
+}
+
+void MainWindow::analyzeCurvature()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Curvature", "Open an STL file first.");
+        return;
+    }
+    
+    QStringList kinds;
+    kinds << "Mean curvature" << "Gaussian curvature";
+    bool ok = false;
+    QString kind = QInputDialog::getItem(this, "Curvature", "Show:", kinds, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    // finishCurvature() shows the result when the background job is done
+    QString errorMessage;
+    if (!glWidget->startCurvatureAnalysis(kind != kinds.first(), &errorMessage)) {
+        QMessageBox::warning(this, "Curvature", errorMessage + ".");
+        return;
+    }
+    curvatureAction->setEnabled(false);
+    statusLabel->setText("Computing curvature...");
+}
+
+void MainWindow::finishCurvature(const MeshCurvature::Report &report, bool gaussian, const QString &errorMessage)
+{
+    curvatureAction->setEnabled(true);
+    
+    if (report.vertices == 0) {
+        statusLabel->setText("Curvature analysis failed");
+        QMessageBox::warning(this, "Curvature", errorMessage + ".");
+        return;
+    }
+    
+    float range = gaussian ? report.gaussianRange : report.meanRange;
+    statusLabel->setText(QString("%1: colours span +/- %2 (%3 ms)").arg(gaussian ? "Gaussian curvature" : "Mean curvature")
+                                                                     .arg(range, 0, 'g', 4)
+                                                                     .arg(report.milliseconds));
+}
+
+void MainWindow::compareWithReference()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Compare with Reference", "Open the STL file to check first.");
+        return;
+    }
+    
+    QString fileName = QFileDialog::getOpenFileName(this,
+        "Open Reference STL File",
+        QDir::homePath(),
+        "STL Files (*.stl);;All Files (*)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    // finishComparison() shows the result when the background job is done
+    QString errorMessage;
+    if (!glWidget->startComparison(fileName, &errorMessage)) {
+        QMessageBox::critical(this, "Compare with Reference", QString("Could not compare: %1").arg(errorMessage));
+        return;
+    }
+    deviationAction->setEnabled(false);
+    statusLabel->setText("Comparing with reference...");
+}
+
+void MainWindow::showComparisonProgress(const QString &stage)
+{
+    statusLabel->setText(QString("Comparing with reference: %1").arg(stage));
+}
+
+void MainWindow::finishComparison(const MeshDeviation::Report &report, const QString &errorMessage)
+{
+    deviationAction->setEnabled(true);
+    
+    if (report.forward.points == 0) {
+        statusLabel->setText("Comparison failed");
+        QMessageBox::critical(this, "Compare with Reference", QString("Could not compare: %1").arg(errorMessage));
+        return;
+    }
+    
+    statusLabel->setText(QString("Deviation: Hausdorff %1, RMS %2").arg(report.symmetricHausdorff, 0, 'g', 4)
+                                                                   .arg(report.forward.rms, 0, 'g', 4));
+    
+    QString summary = QString("Model to reference (%1 vertices):\n"
+                              "  Hausdorff distance: %2\n"
+                              "  RMS distance: %3\n"
+                              "  Mean signed distance: %4\n"
+                              "  Range: %5 to %6\n\n"
+                              "Reference to model (%7 vertices):\n"
+                              "  Hausdorff distance: %8\n"
+                              "  RMS distance: %9\n\n"
+                              "Symmetric Hausdorff distance: %10\n"
+                              "Time: %11 ms")
+                      .arg(report.forward.points)
+                      .arg(report.forward.hausdorff, 0, 'g', 5)
+                      .arg(report.forward.rms, 0, 'g', 5)
+                      .arg(report.forward.mean, 0, 'g', 5)
+                      .arg(report.forward.minSigned, 0, 'g', 5).arg(report.forward.maxSigned, 0, 'g', 5)
+                      .arg(report.backward.points)
+                      .arg(report.backward.hausdorff, 0, 'g', 5)
+                      .arg(report.backward.rms, 0, 'g', 5)
+                      .arg(report.symmetricHausdorff, 0, 'g', 5)
+                      .arg(report.milliseconds);
+    if (!report.signedDistances) {
+        summary += "\n\nThe reference has no merged vertices, so distances are shown without inside/outside signs.";
+    }
+    QMessageBox::information(this, "Compare with Reference", summary);
+}
+
+void MainWindow::clearAnalysisColors()
+{
+    if (glWidget) {
+        glWidget->clearScalarField();
+        statusLabel->setText("Analysis colours cleared");
+    }
+}
+
+void MainWindow::fillHoles()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Fill Holes", "Open an STL file first.");
+        return;
+    }
+    
+    // Holes with a longer rim than this are left open (same units as the STL file)
+    bool ok = false;
+    double maxPerimeter = QInputDialog::getDouble(this, "Fill Holes",
+        "Largest hole perimeter (file units):", 100.0, 0.0, 1000000.0, 3, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    QStringList styles;
+    styles << "Smooth patch (adds vertices)" << "Flat patch (rim vertices only)";
+    QString style = QInputDialog::getItem(this, "Fill Holes", "Patch style:", styles, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    setEnabled(false);
+    statusLabel->setText("Filling holes...");
+    QApplication::processEvents();
+    
+    MeshRepair::HoleFillReport report = glWidget->fillHoles(float(maxPerimeter), style == styles.first());
+    
+    setEnabled(true);
+    
+    if (report.boundaryLoops == 0) {
+        statusLabel->setText("No holes found");
+        QMessageBox::information(this, "Fill Holes", "The model has no holes (or its vertices are not merged).");
+        return;
+    }
+    
+    statusLabel->setText(QString("Filled %1 of %2 holes (%3 ms)").arg(report.filledHoles)
+                                                                 .arg(report.boundaryLoops)
+                                                                 .arg(report.milliseconds));
+    
+    QString summary = QString("Holes found: %1\n"
+                              "Holes filled: %2\n"
+                              "Left open (too large): %3\n"
+                              "Triangles added: %4\n"
+                              "Vertices added: %5\n"
+                              "Time: %6 ms")
+                      .arg(report.boundaryLoops)
+                      .arg(report.filledHoles)
+                      .arg(report.skippedHoles)
+                      .arg(report.addedTriangles)
+                      .arg(report.addedVertices)
+                      .arg(report.milliseconds);
+    QMessageBox::information(this, "Fill Holes", summary);
+}
+
+void MainWindow::probeDistances()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Probe Distances", "Open an STL file first.");
+        return;
+    }
+    
+    QString probeFile = QFileDialog::getOpenFileName(this,
+        "Open Probe Points",
+        QDir::homePath(),
+        "Point Lists (*.csv *.txt *.xyz);;All Files (*)");
+    if (probeFile.isEmpty()) {
+        return;
+    }
+    
+    QString errorMessage;
+    QVector<QVector3D> points;
+    if (!MeshQuery::readProbes(probeFile, points, &errorMessage)) {
+        QMessageBox::critical(this, "Probe Distances", QString("Could not read the points: %1").arg(errorMessage));
+        return;
+    }
+    
+    QStringList kinds;
+    kinds << "Signed (negative inside)" << "Unsigned";
+    bool ok = false;
+    QString kind = QInputDialog::getItem(this, "Probe Distances", "Distances:", kinds, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    // finishProbe() shows the result when the background job is done
+    if (!glWidget->startProbe(points, kind == kinds.first(), &errorMessage)) {
+        QMessageBox::warning(this, "Probe Distances", errorMessage + ".");
+        return;
+    }
+    probeAction->setEnabled(false);
+    statusLabel->setText(QString("Measuring %1 probes...").arg(points.size()));
+}
+
+void MainWindow::finishProbe(const MeshQuery::ProbeReport &report, const QVector<QVector3D> &points,
+                             const QVector<MeshBVH::Hit> &hits, const QString &errorMessage)
+{
+    probeAction->setEnabled(true);
+    
+    if (!errorMessage.isEmpty()) {
+        statusLabel->setText("Probe measurement failed");
+        QMessageBox::warning(this, "Probe Distances", errorMessage + ".");
+        return;
+    }
+    
+    statusLabel->setText(QString("%1 probes: distance %2 to %3 (%4 ms)").arg(report.probes)
+                                                                       .arg(report.minDistance, 0, 'g', 4)
+                                                                       .arg(report.maxDistance, 0, 'g', 4)
+                                                                       .arg(report.milliseconds));
+    
+    QString summary = QString("Probes: %1\n"
+                              "Smallest distance: %2\n"
+                              "Largest distance: %3\n"
+                              "Average distance: %4\n"
+                              "Time: %5 ms\n\n"
+                              "Save the closest points to a CSV file?")
+                      .arg(report.probes)
+                      .arg(report.minDistance, 0, 'g', 6)
+                      .arg(report.maxDistance, 0, 'g', 6)
+                      .arg(report.averageDistance, 0, 'g', 6)
+                      .arg(report.milliseconds);
+    if (QMessageBox::question(this, "Probe Distances", summary) != QMessageBox::Yes) {
+        return;
+    }
+    
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Save Probe Results",
+        QDir::homePath() + "/probe_results.csv",
+        "CSV Files (*.csv);;All Files (*)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+    QString saveError;
+    if (!MeshQuery::writeProbeResults(fileName, points, hits, &saveError)) {
+        QMessageBox::critical(this, "Probe Distances", QString("Could not save: %1").arg(saveError));
+        return;
+    }
+    statusLabel->setText("Saved probe results to " + QFileInfo(fileName).fileName());
+}
+
+void MainWindow::measurePartDistance()
+{
+    if (!glWidget || !glWidget->hasLoadedModel()) {
+        QMessageBox::information(this, "Distance Between Parts", "Open an STL file first.");
+        return;
+    }
+    
+    int partCount = glWidget->getPartCount();
+    if (partCount < 2) {
+        QMessageBox::information(this, "Distance Between Parts",
+                                 "The model is a single part (or its vertices are not merged).");
+        return;
+    }
+    
+    QStringList parts;
+    for (int i = 0; i < partCount; ++i) {
+        parts << QString("Part %1 (%2 triangles)").arg(i + 1).arg(glWidget->getPartTriangleCount(i));
+    }
+    bool ok = false;
+    QString first = QInputDialog::getItem(this, "Distance Between Parts", "First part:", parts, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    QString second = QInputDialog::getItem(this, "Distance Between Parts", "Second part:", parts, 1, false, &ok);
+    if (!ok) {
+        return;
+    }
+    int firstIndex = parts.indexOf(first);
+    int secondIndex = parts.indexOf(second);
+    if (firstIndex == secondIndex) {
+        QMessageBox::information(this, "Distance Between Parts", "Pick two different parts.");
+        return;
+    }
+    
+    // finishPartDistance() shows the result when the background job is done
+    QString errorMessage;
+    if (!glWidget->startPartDistance(firstIndex, secondIndex, &errorMessage)) {
+        QMessageBox::warning(this, "Distance Between Parts", errorMessage + ".");
+        return;
+    }
+    partDistanceAction->setEnabled(false);
+    statusLabel->setText("Measuring...");
+}
+
+void MainWindow::finishPartDistance(const MeshQuery::PartReport &report, int firstIndex, int secondIndex,
+                                    const QString &errorMessage)
+{
+    partDistanceAction->setEnabled(true);
+    
+    if (!report.found) {
+        statusLabel->setText("Measurement failed");
+        QMessageBox::warning(this, "Distance Between Parts", errorMessage + ".");
+        return;
+    }
+    
+    const MeshBVH::PairHit &pair = report.pair;
+    statusLabel->setText(QString("Gap between parts %1 and %2: %3").arg(firstIndex + 1).arg(secondIndex + 1)
+                                                                    .arg(pair.distance, 0, 'g', 5));
+    QString summary = QString("Smallest distance: %1%2\n\n"
+                              "Closest point on part %3: (%4, %5, %6)\n"
+                              "Closest point on part %7: (%8, %9, %10)\n\n"
+                              "Time: %11 ms")
+                      .arg(pair.distance, 0, 'g', 6)
+                      .arg(pair.distance == 0.0f ? " (the parts touch or overlap)" : "")
+                      .arg(firstIndex + 1)
+                      .arg(pair.point.x(), 0, 'g', 6).arg(pair.point.y(), 0, 'g', 6).arg(pair.point.z(), 0, 'g', 6)
+                      .arg(secondIndex + 1)
+                      .arg(pair.otherPoint.x(), 0, 'g', 6).arg(pair.otherPoint.y(), 0, 'g', 6)
+                      .arg(pair.otherPoint.z(), 0, 'g', 6)
+                      .arg(report.milliseconds);
+    QMessageBox::information(this, "Distance Between Parts", summary);
+}
+
 void MainWindow::updateFrameRate()
 {
     if (frameRateLabel) {
-        frameRateLabel->setText(QString("FPS: %1").arg(frameCount));
+        QString text = QString("FPS: %1").arg(frameCount);
+        if (glWidget && glWidget->isTileMode()) {
+            // How much of the tile set is on the graphics card and still on its way
+            GLWidget::TileStats stats = glWidget->getTileStats();
+            text += QString(" | Tiles: %1 drawn, %2 MB resident, %3 loading")
+                        .arg(stats.drawnTiles)
+                        .arg(stats.residentBytes / (1024 * 1024))
+                        .arg(stats.pendingLevels);
+        } else if (glWidget && glWidget->isSequenceMode()) {
+            // Which frame is up, how many were skipped to keep time, and what the uploads cost
+            GLWidget::SequenceStats stats = glWidget->getSequenceStats();
+            text += QString(" | Frame %1/%2, %3 dropped, %4 MB uploaded (%5 MB whole)")
+                        .arg(stats.shownFrame + 1)
+                        .arg(stats.frameCount)
+                        .arg(stats.droppedFrames)
+                        .arg(stats.uploadedBytes / (1024 * 1024))
+                        .arg(stats.fullUploadBytes / (1024 * 1024));
+        } else if (glWidget && glWidget->isFeedMode()) {
+            // How well the viewer keeps up with the producer
+            GLWidget::FeedStats stats = glWidget->getFeedStats();
+            text += stats.frameNumber == 0
+                        ? QString(" | Feed %1: waiting for the first frame").arg(stats.name)
+                        : QString(" | Feed %1: frame %2, %3 skipped, %4 torn%5")
+                              .arg(stats.name)
+                              .arg(stats.frameNumber)
+                              .arg(stats.skippedFrames)
+                              .arg(stats.tornFrames)
+                              .arg(stats.finished ? ", ended" : "");
+        }
+        frameRateLabel->setText(text);
         frameCount = 0;  // Reset counter for next second
     }
 }
 
+void MainWindow::showReloadInfo(const QString& filename, bool incremental, int changedVertices, qint64 uploadedBytes)
+{
+    if (incremental) {
+        statusLabel->setText(QString("Reloaded %1: %2 vertices changed (%3 KB sent)")
+                             .arg(filename)
+                             .arg(changedVertices)
+                             .arg((uploadedBytes + 1023) / 1024));
+    } else {
+        statusLabel->setText(QString("Reloaded %1 (full reload)").arg(filename));
+    }
+}
+
+void MainWindow::showReloadFailure(const QString& filename, const QString& errorMessage)
+{
+    // Keep showing the last good version; the file may just be half written
+    statusLabel->setText(QString("Could not reload %1: %2").arg(filename, errorMessage));
+}
+
 void MainWindow::updateFileInfo(const QString& filename, int triangles, int vertices)
 {
     // Format file information string
@@ -454,5 +1539,12 @@ void MainWindow::updateFileInfo(const QString& filename, int triangles, int vert
         fileInfoLabel->setText(info);
     }
     
+    // Play/pause only means something while a sequence is shown
+    bool sequence = glWidget && glWidget->isSequenceMode();
+    playSequenceAction->setEnabled(sequence);
+    if (!sequence) {
+        playSequenceAction->setChecked(false);
+    }
+    
     qDebug() << "MainWindow: File info updated:" << info;
 }
\ No newline at end of file
@@ -16,6 +16,14 @@
 #include <QTimer>
 #include <QSpinBox>
 #include <QGroupBox>
+#include <QStringList>
+#include "meshcurvature.h"
+#include "meshdeviation.h"
+#include "meshdistancefield.h"
+#include "meshquery.h"
+#include "meshthickness.h"
+#include "meshvoxelizer.h"
+#include "modelprefetcher.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -36,6 +44,14 @@ public:
 private slots:
     // What happens when user clicks "Open" or "Exit" in the menu
     void openSTLFile();
+    void openTileSet();        // Stream a tile set made with --build-tiles (models bigger than memory)
+    void openSequence();       // Play one file per time step (simulation output)
+    void toggleSequencePlaying();
+    void openFeed();           // Watch a mesh another program publishes through shared memory
+    void clearRecentFiles();
+    void setPrefetchMemory();  // How much memory models parsed ahead of time may use
+    void toggleAutoReload();   // Reload the model by itself when its file changes on disk
+    void saveSTLFileAs();      // Save the model (with any repairs) as binary or text STL, or compressed glTF
     void exitApplication();
     
     // What happens when user clicks toolbar buttons
@@ -50,9 +66,37 @@ private slots:
     void onRotationYChanged(int value);   // User rotated around Y axis
     void onRotationZChanged(int value);   // User rotated around Z axis
     
+    // Slicing tools
+    void toggleSlicePreview();                 // Show/hide the outline at the slice height
+    void onSliceHeightChanged(int value);      // User moved the slice height slider
+    void exportSliceContours();                // Slice the whole model and save the outlines
+    void finishSliceExport(const QString &fileName, bool saved, const QString &errorMessage);
+    void updateSliceInfo(float z, int contours);
+    void voxelizeModel();                      // Turn the model into surface or solid voxels
+    void finishVoxelization(const MeshVoxelizer::Report &report, const QString &errorMessage);
+    void buildDistanceField();                 // Sample the signed distance field and save it
+    void finishDistanceField(const MeshDistanceField::Report &report, const QString &errorMessage);
+    void toggleDistanceSection();              // Show/hide the distance colours at the slice height
+    void analyzeThickness();                   // Colour the model by wall thickness
+    void finishThickness(const MeshThickness::Report &report, const QString &errorMessage);
+    void analyzeCurvature();                   // Colour the model by mean or Gaussian curvature
+    void finishCurvature(const MeshCurvature::Report &report, bool gaussian, const QString &errorMessage);
+    void compareWithReference();               // Colour the model by its deviation from another STL
+    void showComparisonProgress(const QString &stage);
+    void finishComparison(const MeshDeviation::Report &report, const QString &errorMessage);
+    void clearAnalysisColors();                // Back to the plain material colour
+    void fillHoles();                          // Close small holes in the surface
+    void probeDistances();                     // Distances from a file of probe points to the surface
+    void finishProbe(const MeshQuery::ProbeReport &report, const QVector<QVector3D> &points,
+                     const QVector<MeshBVH::Hit> &hits, const QString &errorMessage);
+    void measurePartDistance();                // Smallest gap between two parts of the model
+    void finishPartDistance(const MeshQuery::PartReport &report, int first, int second, const QString &errorMessage);
+    
     // Keep the display updated with current info
     void updateFrameRate();               // Show how fast we're drawing frames
     void updateFileInfo(const QString& filename, int triangles, int vertices);
+    void showReloadInfo(const QString& filename, bool incremental, int changedVertices, qint64 uploadedBytes);
+    void showReloadFailure(const QString& filename, const QString& errorMessage);
 
 private:
     // Build the different parts of the window
@@ -63,12 +107,25 @@ private:
     void createActions();     // Set up what menu items and buttons do
     void connectSignals();    // Wire up sliders to their functions
     
+    // Loading models and remembering them for next time
+    void loadModelFile(const QString& fileName);   // Uses the prefetched copy when there is one
+    void addRecentFile(const QString& fileName);
+    void updateRecentMenu();
+    void startPrefetch();     // Get the recent files ready while nothing else is going on
+    
     // The main parts of our window
     Ui::MainWindow *ui;
     GLWidget *glWidget;       // This is where we draw the 3D model
     
     // Menu items that user can click
     QAction *openAction;      // Open STL file
+    QAction *openTilesAction; // Open a tile set for streaming
+    QAction *openSequenceAction; // Open numbered files as an animation
+    QAction *playSequenceAction; // Pause and resume the animation
+    QAction *openFeedAction;  // Watch a live mesh feed
+    QMenu *recentMenu;        // Recently opened models
+    QAction *autoReloadAction; // Reload when the file changes on disk
+    QAction *saveAsAction;    // Save the model as a new STL file
     QAction *exitAction;      // Quit the program
     
     // Toolbar buttons
@@ -77,12 +134,27 @@ private:
     QAction *wireframeAction;    // Wireframe toggle button
     QAction *lightingAction;     // Lighting toggle button
     
+    // Slicing tools
+    QAction *slicePreviewAction;   // Slice preview toggle
+    QAction *exportSlicesAction;   // Export slice contours
+    QAction *voxelizeAction;       // Voxelize the model
+    QAction *distanceFieldAction;  // Build and save a signed distance field
+    QAction *distanceSectionAction;  // Distance field section toggle
+    QAction *thicknessAction;      // Wall thickness analysis
+    QAction *curvatureAction;      // Curvature analysis
+    QAction *deviationAction;      // Deviation from a reference model
+    QAction *clearColorsAction;    // Remove analysis colours
+    QAction *fillHolesAction;      // Close holes in the mesh
+    QAction *probeAction;          // Distances for a list of probe points
+    QAction *partDistanceAction;   // Gap between two parts
+    
     // User controls for manipulating the view
     QSlider *zoomSlider;         // Slider to zoom in/out
     QSlider *rotationXSlider;    // Slider to rotate left/right
     QSlider *rotationYSlider;    // Slider to rotate up/down
     QSlider *rotationZSlider;    // Slider to spin around
     QSpinBox *zoomSpinBox;       // Number box showing exact zoom level
+    QSlider *sliceSlider;        // Slider to move the slice plane from bottom to top
     
     // Information displayed at bottom of window
     QLabel *fileInfoLabel;       // Shows filename and model statistics
@@ -95,6 +167,12 @@ private:
     
     // Keep track of what file we have open
     QString currentFileName;
+    
+    // Recently opened models (newest first), and the helper that prepares them in the background
+    static const int MaxRecentFiles = 8;
+    QStringList recentFiles;
+    ModelPrefetcher prefetcher;
+    QTimer *prefetchTimer;    // Waits for the viewer to be idle before prefetching
 
 protected:
     // What to do when user tries to close the window
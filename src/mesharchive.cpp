@@ -0,0 +1,628 @@
+#include "mesharchive.h"
+#include "meshcodec.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// File layout (little-endian):
+//   header      "CMSH", version, vertex count (u64), triangle count (u64), block count,
+//               flags (0), origin[3] and step[3] (float) for the positions, padding to 64 bytes
+//   block table one 32 byte entry per block: file offset (u64), byte length, vertices, vertices
+//               owned by the block, triangles, seam table bytes, vertex stream bytes
+//   blocks      seam table, vertex stream, index stream
+const quint32 ArchiveMagic = 0x48534d43;  // "CMSH"
+const quint32 ArchiveVersion = 1;
+const int HeaderSize = 64;
+const int BlockEntrySize = 32;
+
+// Small enough that blocks keep every core busy, big enough that seams stay a small fraction
+const qint64 BlockTriangles = 65536;
+
+// x, y, z as 16-bit integers plus two bytes of padding (the vertex codec wants multiples of 4)
+const int PositionStride = 8;
+const double PositionRange = 65535.0;
+
+struct BlockEntry {
+    qint64 offset = 0;
+    qint64 length = 0;
+    qint64 vertices = 0;
+    qint64 ownedVertices = 0;
+    qint64 triangles = 0;
+    qint64 seamBytes = 0;
+    qint64 vertexBytes = 0;
+};
+
+// One block while it is being written
+struct EncodedBlock {
+    std::vector<unsigned int> triangles;  // Local vertex numbers, three per triangle
+    std::vector<unsigned int> vertices;   // Input vertex of every local vertex
+    qint64 ownedVertices = 0;
+    std::vector<unsigned char> seams;
+    std::vector<unsigned char> vertexStream;
+    std::vector<unsigned char> indexStream;
+};
+
+void appendVByte(std::vector<unsigned char>& data, quint32 value)
+{
+    do {
+        data.push_back(static_cast<unsigned char>((value & 127) | (value > 127 ? 128 : 0)));
+        value >>= 7;
+    } while (value);
+}
+
+bool readVByte(const uchar*& data, const uchar* end, quint32& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7) {
+        const uchar byte = *data++;
+        value |= quint32(byte & 127) << shift;
+        if (!(byte & 128)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Spread the low 10 bits of v out to every third bit, for Morton codes
+quint32 spreadBits(quint32 v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+void appendUInt32(QByteArray& data, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 4);
+}
+
+void appendUInt64(QByteArray& data, quint64 value)
+{
+    char bytes[8];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 8);
+}
+
+void appendFloat(QByteArray& data, float value)
+{
+    quint32 bits;
+    std::memcpy(&bits, &value, 4);
+    appendUInt32(data, bits);
+}
+
+float readFloat(const uchar* data)
+{
+    const quint32 bits = qFromLittleEndian<quint32>(data);
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+} // namespace
+
+bool MeshArchive::isArchive(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray start = file.read(4);
+    return isArchive(start.constData(), start.size());
+}
+
+bool MeshArchive::isArchive(const char* start, qint64 size)
+{
+    return size >= 4 && qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(start)) == ArchiveMagic;
+}
+
+bool MeshArchive::write(const QString& fileName, const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                        float displayScale, const QVector3D& displayOffset, WriteReport* report, QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    const qint64 vertexCount = vertexData.size() / 6;
+    const qint64 indexCount = indices.isEmpty() ? vertexCount / 3 * 3 : indices.size() / 3 * 3;
+    const qint64 triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return fail("No model to save");
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<unsigned int> triangleList(size_t(indexCount), 0);
+    for (qint64 i = 0; i < indexCount; ++i) {
+        const unsigned int v = indices.isEmpty() ? unsigned(i) : indices[int(i)];
+        if (qint64(v) >= vertexCount) {
+            return fail("A triangle uses a vertex that does not exist");
+        }
+        triangleList[size_t(i)] = v;
+    }
+
+    // Bounding box in file units (per thread, then combined)
+    const float inverseScale = displayScale != 0.0f ? 1.0f / displayScale : 1.0f;
+    const float offset[3] = {displayOffset.x(), displayOffset.y(), displayOffset.z()};
+    std::vector<float> boxes(size_t(Parallel::threadCount()) * 6);
+    for (int t = 0; t < Parallel::threadCount(); ++t) {
+        std::fill(boxes.begin() + t * 6, boxes.begin() + t * 6 + 3, FLT_MAX);
+        std::fill(boxes.begin() + t * 6 + 3, boxes.begin() + t * 6 + 6, -FLT_MAX);
+    }
+    Parallel::forChunks(vertexCount, [&](qint64 begin, qint64 end, int thread) {
+        float* box = &boxes[size_t(thread) * 6];
+        for (qint64 v = begin; v < end; ++v) {
+            for (int k = 0; k < 3; ++k) {
+                const float p = vertexData[int(v * 6 + k)] * inverseScale - offset[k];
+                box[k] = std::min(box[k], p);
+                box[3 + k] = std::max(box[3 + k], p);
+            }
+        }
+    });
+    float origin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float maximum[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int t = 0; t < Parallel::threadCount(); ++t) {
+        for (int k = 0; k < 3; ++k) {
+            origin[k] = std::min(origin[k], boxes[t * 6 + k]);
+            maximum[k] = std::max(maximum[k], boxes[t * 6 + 3 + k]);
+        }
+    }
+    float step[3];
+    for (int k = 0; k < 3; ++k) {
+        step[k] = maximum[k] > origin[k] ? float((double(maximum[k]) - origin[k]) / PositionRange) : 1.0f;
+    }
+
+    // 16-bit positions for every input vertex
+    std::vector<quint16> quantized(size_t(vertexCount) * 4, 0);
+    Parallel::forChunks(vertexCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 v = begin; v < end; ++v) {
+            for (int k = 0; k < 3; ++k) {
+                const double p = double(vertexData[int(v * 6 + k)]) * inverseScale - offset[k];
+                const double q = std::round((p - origin[k]) / step[k]);
+                quantized[size_t(v) * 4 + k] = quint16(std::max(0.0, std::min(PositionRange, q)));
+            }
+        }
+    });
+
+    // Sort triangles along a Morton curve through their centres, so every block is a compact patch
+    std::vector<quint64> order(static_cast<size_t>(triangleCount));
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 t = begin; t < end; ++t) {
+            quint32 centre[3];
+            for (int k = 0; k < 3; ++k) {
+                quint32 sum = 0;
+                for (int c = 0; c < 3; ++c) {
+                    sum += quantized[size_t(triangleList[size_t(t * 3 + c)]) * 4 + k];
+                }
+                centre[k] = sum / 3 >> 6;
+            }
+            const quint64 code = spreadBits(centre[0]) | (spreadBits(centre[1]) << 1) | (spreadBits(centre[2]) << 2);
+            order[size_t(t)] = (code << 32) | quint64(t);
+        }
+    });
+    Parallel::sort(order.begin(), order.end());
+
+    // Every vertex belongs to the first block that uses it; later blocks list it in their seam table
+    const qint64 blockCount = (triangleCount + BlockTriangles - 1) / BlockTriangles;
+    std::vector<unsigned int> owner(size_t(vertexCount), ~0u);
+    for (qint64 i = 0; i < triangleCount; ++i) {
+        const size_t t = size_t(order[size_t(i)] & 0xffffffffu);
+        for (int c = 0; c < 3; ++c) {
+            unsigned int& vertexOwner = owner[triangleList[t * 3 + c]];
+            if (vertexOwner == ~0u) {
+                vertexOwner = unsigned(i / BlockTriangles);
+            }
+        }
+    }
+
+    // Reorder each block on its own and number its vertices by first use
+    std::vector<EncodedBlock> blocks(static_cast<size_t>(blockCount));
+    Parallel::forBlocks(blockCount, 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 b = begin; b < end; ++b) {
+            EncodedBlock& block = blocks[size_t(b)];
+            const qint64 first = b * BlockTriangles;
+            const qint64 count = std::min(BlockTriangles, triangleCount - first);
+
+            std::vector<unsigned int> corners(size_t(count) * 3);
+            for (qint64 i = 0; i < count; ++i) {
+                const size_t t = size_t(order[size_t(first + i)] & 0xffffffffu);
+                for (int c = 0; c < 3; ++c) {
+                    corners[size_t(i * 3 + c)] = triangleList[t * 3 + c];
+                }
+            }
+            std::vector<unsigned int> unique(corners);
+            std::sort(unique.begin(), unique.end());
+            unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+            for (unsigned int& corner : corners) {
+                corner = unsigned(std::lower_bound(unique.begin(), unique.end(), corner) - unique.begin());
+            }
+
+            block.triangles = MeshCodec::optimizeVertexCache(corners.data(), corners.size(), unique.size());
+            std::vector<unsigned int> remap;
+            const size_t localCount = MeshCodec::optimizeVertexFetch(block.triangles.data(), block.triangles.size(),
+                                                                     unique.size(), remap);
+            block.vertices.assign(localCount, 0);
+            for (size_t u = 0; u < unique.size(); ++u) {
+                block.vertices[remap[u]] = unique[u];
+            }
+            for (unsigned int v : block.vertices) {
+                block.ownedVertices += owner[v] == unsigned(b);
+            }
+        }
+    });
+
+    // Owned vertices are numbered block after block, in each block's order
+    std::vector<qint64> vertexBase(size_t(blockCount) + 1, 0);
+    for (qint64 b = 0; b < blockCount; ++b) {
+        vertexBase[size_t(b) + 1] = vertexBase[size_t(b)] + blocks[size_t(b)].ownedVertices;
+    }
+    const qint64 outputVertices = vertexBase[size_t(blockCount)];
+    if (outputVertices > qint64(0xffffffffu)) {
+        return fail("Too many vertices for a mesh archive");
+    }
+    std::vector<unsigned int> newIndex(size_t(vertexCount), 0);
+    Parallel::forBlocks(blockCount, 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 b = begin; b < end; ++b) {
+            unsigned int next = unsigned(vertexBase[size_t(b)]);
+            for (unsigned int v : blocks[size_t(b)].vertices) {
+                if (owner[v] == unsigned(b)) {
+                    newIndex[v] = next++;
+                }
+            }
+        }
+    });
+
+    // Compress: seam table (local number and new index of every shared vertex, as differences),
+    // then the positions and the triangles
+    Parallel::forBlocks(blockCount, 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 b = begin; b < end; ++b) {
+            EncodedBlock& block = blocks[size_t(b)];
+            quint32 lastLocal = 0;
+            quint32 lastIndex = 0;
+            std::vector<quint16> positions(block.vertices.size() * 4, 0);
+            for (size_t j = 0; j < block.vertices.size(); ++j) {
+                const unsigned int v = block.vertices[j];
+                std::memcpy(&positions[j * 4], &quantized[size_t(v) * 4], 3 * sizeof(quint16));
+                if (owner[v] != unsigned(b)) {
+                    const quint32 difference = newIndex[v] - lastIndex;
+                    appendVByte(block.seams, quint32(j) - lastLocal);
+                    appendVByte(block.seams, (difference << 1) ^ quint32(qint32(difference) >> 31));
+                    lastLocal = quint32(j);
+                    lastIndex = newIndex[v];
+                }
+            }
+            block.vertexStream = MeshCodec::encodeVertexBuffer(positions.data(), block.vertices.size(), PositionStride);
+            block.indexStream = MeshCodec::encodeIndexBuffer(block.triangles.data(), block.triangles.size());
+            std::vector<unsigned int>().swap(block.triangles);
+        }
+    });
+
+    QByteArray header;
+    appendUInt32(header, ArchiveMagic);
+    appendUInt32(header, ArchiveVersion);
+    appendUInt64(header, quint64(outputVertices));
+    appendUInt64(header, quint64(triangleCount));
+    appendUInt32(header, quint32(blockCount));
+    appendUInt32(header, 0);
+    for (int k = 0; k < 3; ++k) {
+        appendFloat(header, origin[k]);
+    }
+    for (int k = 0; k < 3; ++k) {
+        appendFloat(header, step[k]);
+    }
+    header.append(QByteArray(HeaderSize - header.size(), '\0'));
+
+    qint64 fileBytes = HeaderSize + blockCount * BlockEntrySize;
+    for (qint64 b = 0; b < blockCount; ++b) {
+        const EncodedBlock& block = blocks[size_t(b)];
+        const qint64 length = qint64(block.seams.size() + block.vertexStream.size() + block.indexStream.size());
+        appendUInt64(header, quint64(fileBytes));
+        appendUInt32(header, quint32(length));
+        appendUInt32(header, quint32(block.vertices.size()));
+        appendUInt32(header, quint32(block.ownedVertices));
+        appendUInt32(header, quint32(std::min(BlockTriangles, triangleCount - b * BlockTriangles)));
+        appendUInt32(header, quint32(block.seams.size()));
+        appendUInt32(header, quint32(block.vertexStream.size()));
+        fileBytes += length;
+    }
+
+    QString temporaryFile = fileName + ".part";
+    QFile file(temporaryFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail("Cannot write file: " + file.errorString());
+    }
+    bool ok = file.write(header) == header.size();
+    for (qint64 b = 0; b < blockCount && ok; ++b) {
+        const EncodedBlock& block = blocks[size_t(b)];
+        for (const std::vector<unsigned char>* part : {&block.seams, &block.vertexStream, &block.indexStream}) {
+            const qint64 size = qint64(part->size());
+            ok = ok && (size == 0 || file.write(reinterpret_cast<const char*>(part->data()), size) == size);
+        }
+    }
+    file.close();
+    if (!ok) {
+        QFile::remove(temporaryFile);
+        return fail("Cannot write file: " + file.errorString());
+    }
+    QFile::remove(fileName);
+    if (!QFile::rename(temporaryFile, fileName)) {
+        QFile::remove(temporaryFile);
+        return fail("Cannot replace " + fileName);
+    }
+
+    const double stlBytes = 84.0 + 50.0 * double(triangleCount);
+    if (report) {
+        report->vertices = outputVertices;
+        report->triangles = triangleCount;
+        report->blocks = blockCount;
+        report->stlBytes = qint64(stlBytes);
+        report->fileBytes = fileBytes;
+        report->compressionRatio = stlBytes / double(fileBytes);
+        report->milliseconds = timer.elapsed();
+    }
+
+    qDebug() << "MeshArchive: saved" << triangleCount << "triangles in" << blockCount << "blocks," << fileBytes
+             << "bytes (" << stlBytes / double(fileBytes) << "x smaller than binary STL)";
+    return true;
+}
+
+bool MeshArchive::read(const QString& fileName, QVector<float>& vertexData, QVector<unsigned int>& indices,
+                       ReadReport* report, QString* errorMessage)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot open " + fileName + ": " + file.errorString();
+        }
+        return false;
+    }
+    return read(file, vertexData, indices, report, errorMessage);
+}
+
+bool MeshArchive::read(QFile& file, QVector<float>& vertexData, QVector<unsigned int>& indices,
+                       ReadReport* report, QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 size = file.size();
+    QByteArray content;
+    const uchar* data = file.map(0, size);
+    if (!data) {
+        file.seek(0);
+        content = file.readAll();
+        data = reinterpret_cast<const uchar*>(content.constData());
+        size = content.size();
+    }
+
+    if (size < HeaderSize || qFromLittleEndian<quint32>(data) != ArchiveMagic) {
+        return fail("Not a mesh archive");
+    }
+    if (qFromLittleEndian<quint32>(data + 4) != ArchiveVersion) {
+        return fail("Unsupported mesh archive version");
+    }
+    const quint64 vertexCount = qFromLittleEndian<quint64>(data + 8);
+    const quint64 triangleCount = qFromLittleEndian<quint64>(data + 16);
+    const qint64 blockCount = qFromLittleEndian<quint32>(data + 24);
+    float origin[3];
+    float step[3];
+    for (int k = 0; k < 3; ++k) {
+        origin[k] = readFloat(data + 32 + k * 4);
+        step[k] = readFloat(data + 44 + k * 4);
+    }
+
+    // The renderer's buffers are indexed with int
+    if (vertexCount > quint64(INT_MAX / 6) || triangleCount > quint64(INT_MAX / 3)) {
+        return fail("Mesh archive is too large to display");
+    }
+    const qint64 tableEnd = HeaderSize + blockCount * BlockEntrySize;
+    if (tableEnd > size) {
+        return fail("Mesh archive is truncated");
+    }
+
+    // Check the block table before touching any block, and work out where each one's output goes
+    std::vector<BlockEntry> blocks(static_cast<size_t>(blockCount));
+    std::vector<qint64> vertexBase(size_t(blockCount) + 1, 0);
+    std::vector<qint64> triangleBase(size_t(blockCount) + 1, 0);
+    for (qint64 b = 0; b < blockCount; ++b) {
+        const uchar* entry = data + HeaderSize + b * BlockEntrySize;
+        BlockEntry& block = blocks[size_t(b)];
+        block.offset = qint64(qFromLittleEndian<quint64>(entry));
+        block.length = qFromLittleEndian<quint32>(entry + 8);
+        block.vertices = qFromLittleEndian<quint32>(entry + 12);
+        block.ownedVertices = qFromLittleEndian<quint32>(entry + 16);
+        block.triangles = qFromLittleEndian<quint32>(entry + 20);
+        block.seamBytes = qFromLittleEndian<quint32>(entry + 24);
+        block.vertexBytes = qFromLittleEndian<quint32>(entry + 28);
+        if (block.offset < tableEnd || block.offset > size || block.length > size - block.offset ||
+            block.seamBytes + block.vertexBytes > block.length || block.ownedVertices > block.vertices ||
+            block.vertices > block.triangles * 3 || block.triangles > BlockTriangles) {
+            return fail(QString("Mesh archive block %1 is damaged").arg(b));
+        }
+        vertexBase[size_t(b) + 1] = vertexBase[size_t(b)] + block.ownedVertices;
+        triangleBase[size_t(b) + 1] = triangleBase[size_t(b)] + block.triangles;
+    }
+    if (quint64(vertexBase[size_t(blockCount)]) != vertexCount || quint64(triangleBase[size_t(blockCount)]) != triangleCount) {
+        return fail("Mesh archive block table does not match its header");
+    }
+
+    vertexData.fill(0.0f, int(vertexCount * 6));
+    indices.resize(int(triangleCount * 3));
+    float* vertexOut = vertexData.data();
+    unsigned int* indexOut = indices.data();
+
+    // Scratch space per thread: decoded positions (quantized, then in file units) and
+    // local -> output vertex numbers
+    const int threads = Parallel::threadCount();
+    std::vector<std::vector<quint16>> quantizedScratch(static_cast<size_t>(threads));
+    std::vector<std::vector<float>> pointScratch(static_cast<size_t>(threads));
+    std::vector<std::vector<unsigned int>> mapScratch(static_cast<size_t>(threads));
+    std::atomic<qint64> damagedBlock(-1);
+
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+    Parallel::forBlocks(blockCount, 1, [&](qint64 begin, qint64 end, int thread) {
+        for (qint64 b = begin; b < end; ++b) {
+            const BlockEntry& block = blocks[size_t(b)];
+            const size_t localCount = size_t(block.vertices);
+            const unsigned int base = unsigned(vertexBase[size_t(b)]);
+            std::vector<quint16>& quantized = quantizedScratch[size_t(thread)];
+            std::vector<float>& points = pointScratch[size_t(thread)];
+            std::vector<unsigned int>& map = mapScratch[size_t(thread)];
+            quantized.resize(localCount * 4);
+            points.resize(localCount * 3);
+            map.assign(localCount, ~0u);
+            auto damaged = [&]() {
+                damagedBlock = b;
+            };
+
+            // Shared vertices first (always owned by an earlier block), then the block's own ones in order
+            const uchar* seams = data + block.offset;
+            const uchar* seamsEnd = seams + block.seamBytes;
+            quint32 local = 0;
+            quint32 index = 0;
+            bool ok = true;
+            for (qint64 s = block.vertices - block.ownedVertices; s > 0 && ok; --s) {
+                quint32 localStep;
+                quint32 indexStep;
+                ok = readVByte(seams, seamsEnd, localStep) && readVByte(seams, seamsEnd, indexStep);
+                local += localStep;
+                index += (indexStep >> 1) ^ (0u - (indexStep & 1));
+                ok = ok && local < localCount && map[local] == ~0u && index < base;
+                if (ok) {
+                    map[local] = index;
+                }
+            }
+            if (!ok || seams != seamsEnd) {
+                damaged();
+                continue;
+            }
+            unsigned int next = base;
+            for (size_t j = 0; j < localCount; ++j) {
+                if (map[j] == ~0u) {
+                    map[j] = next++;
+                }
+            }
+
+            const uchar* vertexStream = seamsEnd;
+            const uchar* indexStream = vertexStream + block.vertexBytes;
+            const size_t indexBytes = size_t(block.length - block.seamBytes - block.vertexBytes);
+            unsigned int* triangles = indexOut + triangleBase[size_t(b)] * 3;
+            const size_t indexCount = size_t(block.triangles) * 3;
+            if (!MeshCodec::decodeVertexBuffer(quantized.data(), localCount, PositionStride, vertexStream,
+                                               size_t(block.vertexBytes)) ||
+                !MeshCodec::decodeIndexBuffer(triangles, indexCount, indexStream, indexBytes)) {
+                damaged();
+                continue;
+            }
+
+            // Shared vertices are written by the block that owns them, but normals need them too
+            for (size_t j = 0; j < localCount; ++j) {
+                float* point = &points[j * 3];
+                for (int k = 0; k < 3; ++k) {
+                    point[k] = origin[k] + float(quantized[j * 4 + k]) * step[k];
+                }
+                if (map[j] >= base) {
+                    float* out = vertexOut + size_t(map[j]) * 6;
+                    out[0] = point[0];
+                    out[1] = point[1];
+                    out[2] = point[2];
+                }
+            }
+
+            // Vertices are numbered by first use, so a triangle gives its normal to every vertex
+            // number it is the first to reach
+            size_t reached = 0;
+            for (size_t i = 0; i < indexCount; i += 3) {
+                const unsigned int v0 = triangles[i];
+                const unsigned int v1 = triangles[i + 1];
+                const unsigned int v2 = triangles[i + 2];
+                if (v0 >= localCount || v1 >= localCount || v2 >= localCount) {
+                    ok = false;
+                    break;
+                }
+                const size_t highest = std::max(v0, std::max(v1, v2));
+                if (highest >= reached) {
+                    const float* p0 = &points[v0 * 3];
+                    const float* p1 = &points[v1 * 3];
+                    const float* p2 = &points[v2 * 3];
+                    const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                    const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                    float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                                       e1[0] * e2[1] - e1[1] * e2[0]};
+                    const float lengthSquared = normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2];
+                    if (lengthSquared > 0.0f) {
+                        const float inverseLength = 1.0f / std::sqrt(lengthSquared);
+                        normal[0] *= inverseLength;
+                        normal[1] *= inverseLength;
+                        normal[2] *= inverseLength;
+                    } else {
+                        normal[0] = 0.0f;
+                        normal[1] = 0.0f;
+                        normal[2] = 1.0f;
+                    }
+                    for (; reached <= highest; ++reached) {
+                        if (map[reached] >= base) {
+                            float* out = vertexOut + size_t(map[reached]) * 6;
+                            out[3] = normal[0];
+                            out[4] = normal[1];
+                            out[5] = normal[2];
+                        }
+                    }
+                }
+                triangles[i] = map[v0];
+                triangles[i + 1] = map[v1];
+                triangles[i + 2] = map[v2];
+            }
+            if (!ok) {
+                damaged();
+            }
+        }
+    });
+    const qint64 decodeNanoseconds = decodeTimer.nsecsElapsed();
+
+    if (damagedBlock >= 0) {
+        vertexData.clear();
+        indices.clear();
+        return fail(QString("Mesh archive block %1 is damaged").arg(damagedBlock.load()));
+    }
+
+    if (report) {
+        report->vertices = qint64(vertexCount);
+        report->triangles = qint64(triangleCount);
+        report->blocks = blockCount;
+        report->fileBytes = size;
+        report->trianglesPerSecond = double(triangleCount) * 1e9 / double(std::max<qint64>(decodeNanoseconds, 1));
+        report->milliseconds = timer.elapsed();
+    }
+
+    qDebug() << "MeshArchive: read" << triangleCount << "triangles from" << blockCount << "blocks, decoded at"
+             << double(triangleCount) * 1e3 / double(std::max<qint64>(decodeNanoseconds, 1)) << "million triangles per second";
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef MESHARCHIVE_H
+#define MESHARCHIVE_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+
+// Long-term storage for processed (welded) meshes: .cmesh files, typically 10-20x smaller than
+// binary STL and quick enough to open that they can replace it.
+//
+// Triangles are sorted along a space-filling curve and cut into blocks of up to 65536, and every
+// block can be decoded on its own:
+//   - its triangles are reordered for the vertex cache and their connectivity compressed with the
+//     meshopt index codec (mostly one byte per triangle),
+//   - its vertices are quantized to 16 bits per axis over the model's bounding box and delta-coded
+//     with the meshopt vertex codec,
+//   - a small seam table names the vertices it shares with earlier blocks, so the decoded mesh is
+//     as welded as the saved one.
+// Normals are not stored: like the loader, every vertex takes the normal of the first triangle that
+// uses it. Blocks are decoded in parallel straight into the renderer's vertex and index buffers.
+class MeshArchive
+{
+public:
+    struct WriteReport {
+        qint64 vertices = 0;
+        qint64 triangles = 0;
+        qint64 blocks = 0;
+        qint64 stlBytes = 0;           // Size of the same mesh as binary STL
+        qint64 fileBytes = 0;
+        double compressionRatio = 0.0;  // stlBytes / fileBytes
+        qint64 milliseconds = 0;
+    };
+
+    struct ReadReport {
+        qint64 vertices = 0;
+        qint64 triangles = 0;
+        qint64 blocks = 0;
+        qint64 fileBytes = 0;
+        double trianglesPerSecond = 0.0;  // Decoding speed, not counting reading the file
+        qint64 milliseconds = 0;
+    };
+
+    // Save a mesh from the loader's buffers (6 floats per vertex, position + normal, with or without
+    // indices). Positions are turned back into file units with file = displayed / scale - offset.
+    static bool write(const QString& fileName, const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                      float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(),
+                      WriteReport* report = nullptr, QString* errorMessage = nullptr);
+
+    // Load an archive into the same kind of buffers, in file units
+    static bool read(const QString& fileName, QVector<float>& vertexData, QVector<unsigned int>& indices,
+                     ReadReport* report = nullptr, QString* errorMessage = nullptr);
+    // The same for an archive the caller already has open (the mapping goes when the file is closed)
+    static bool read(QFile& file, QVector<float>& vertexData, QVector<unsigned int>& indices,
+                     ReadReport* report = nullptr, QString* errorMessage = nullptr);
+
+    // Does the file start like an archive?
+    static bool isArchive(const QString& fileName);
+    static bool isArchive(const char* start, qint64 size);  // Given the first bytes of the file
+};
+
+#endif // MESHARCHIVE_H
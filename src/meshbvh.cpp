@@ -0,0 +1,1174 @@
+#include "meshbvh.h"
+#include "meshtopology.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// SSE2 is always there on 64-bit x86; other processors use a plain loop for the distance kernel
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHBVH_SSE2
+#endif
+
+namespace {
+
+// Where one triangle sits while the tree is being built
+struct PrimitiveRef {
+    float boundsMin[3];
+    float boundsMax[3];
+    float centroid[3];
+    int triangle;
+};
+
+// A node that still has to be split, covering refs [begin, end)
+struct BuildTask {
+    int node;
+    int begin;
+    int end;
+    int depth;
+};
+
+const int BinCount = 16;        // Candidate split planes per node (binned SAH)
+const int MaxLeafSize = 4;      // Leaves may hold up to this many triangles
+const int ForceSplitSize = 16;  // Bigger ranges are always split, even if SAH says a leaf is cheaper
+const int MedianDepth = 48;     // Below this depth use plain median splits to keep the tree shallow
+const int StackSize = 128;      // Traversal stack (the tree is never deeper than MedianDepth + 32)
+
+// Rays through a shared edge or vertex can miss both triangles by rounding; a little slack on
+// the barycentric tests makes them hit one of the two instead of slipping through the surface
+const float BarycentricSlack = 1e-5f;
+
+struct Box {
+    float lo[3];
+    float hi[3];
+
+    void reset() {
+        lo[0] = lo[1] = lo[2] = FLT_MAX;
+        hi[0] = hi[1] = hi[2] = -FLT_MAX;
+    }
+    void grow(const float* low, const float* high) {
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = qMin(lo[k], low[k]);
+            hi[k] = qMax(hi[k], high[k]);
+        }
+    }
+    void grow(const Box& other) { grow(other.lo, other.hi); }
+    float area() const {
+        float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        return (dx < 0.0f) ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+struct Bin {
+    Box bounds;
+    int count;
+};
+
+// Everything needed to decide how to split a range
+struct RangeInfo {
+    Box bounds;          // Bounds of the triangles
+    Box centroidBounds;  // Bounds of their centroids
+    Bin bins[BinCount];
+};
+
+int binOf(float centroid, float low, float scale)
+{
+    int bin = int((centroid - low) * scale);
+    return qBound(0, bin, BinCount - 1);
+}
+
+float boxDistanceSquared(const float* low, const float* high, const QVector3D& p)
+{
+    float dx = qMax(qMax(low[0] - p.x(), 0.0f), p.x() - high[0]);
+    float dy = qMax(qMax(low[1] - p.y(), 0.0f), p.y() - high[1]);
+    float dz = qMax(qMax(low[2] - p.z(), 0.0f), p.z() - high[2]);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Slab test: does the ray enter the box before maxDistance? Returns the entry distance in `entry`.
+bool rayBox(const float* low, const float* high, const QVector3D& origin, const QVector3D& inverse,
+            float maxDistance, float& entry)
+{
+    float tx1 = (low[0] - origin.x()) * inverse.x(), tx2 = (high[0] - origin.x()) * inverse.x();
+    float ty1 = (low[1] - origin.y()) * inverse.y(), ty2 = (high[1] - origin.y()) * inverse.y();
+    float tz1 = (low[2] - origin.z()) * inverse.z(), tz2 = (high[2] - origin.z()) * inverse.z();
+    float tNear = qMax(qMax(qMin(tx1, tx2), qMin(ty1, ty2)), qMin(tz1, tz2));
+    float tFar = qMin(qMin(qMax(tx1, tx2), qMax(ty1, ty2)), qMax(tz1, tz2));
+    entry = qMax(tNear, 0.0f);
+    return tFar >= entry && entry <= maxDistance;
+}
+
+// Closest point on triangle abc to p (Ericson, "Real-Time Collision Detection" 5.1.5),
+// also telling which vertex, edge or the face it landed on
+QVector3D closestOnTriangle(const QVector3D& p, const QVector3D& a, const QVector3D& b, const QVector3D& c,
+                            MeshBVH::Feature& feature)
+{
+    QVector3D ab = b - a;
+    QVector3D ac = c - a;
+    QVector3D ap = p - a;
+    float d1 = QVector3D::dotProduct(ab, ap);
+    float d2 = QVector3D::dotProduct(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        feature = MeshBVH::Vertex0;
+        return a;
+    }
+
+    QVector3D bp = p - b;
+    float d3 = QVector3D::dotProduct(ab, bp);
+    float d4 = QVector3D::dotProduct(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        feature = MeshBVH::Vertex1;
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        feature = MeshBVH::Edge01;
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    QVector3D cp = p - c;
+    float d5 = QVector3D::dotProduct(ab, cp);
+    float d6 = QVector3D::dotProduct(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        feature = MeshBVH::Vertex2;
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        feature = MeshBVH::Edge20;
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        feature = MeshBVH::Edge12;
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float sum = va + vb + vc;
+    if (!(sum > 0.0f)) {
+        // Zero-area triangle that slipped through the edge tests
+        feature = MeshBVH::Vertex0;
+        return a;
+    }
+    feature = MeshBVH::Face;
+    return a + ab * (vb / sum) + ac * (vc / sum);
+}
+
+// Squared distance from p to the 4 triangles in lane slots [slot, slot + 4). The lanes hold the
+// corner coordinates as 9 separate arrays (a.x, a.y, a.z, b.x, ... each `stride` long), so one load
+// fetches the same coordinate of 4 triangles. The test is branch free: the distance to the plane
+// if p projects inside the triangle, else the distance to the nearest edge. It only gives the
+// distance; closestOnTriangle is still used for the winning triangle.
+#ifdef MESHBVH_SSE2
+
+// Four 3D vectors, one per SSE lane
+struct Vector4x3 {
+    __m128 x, y, z;
+};
+
+inline Vector4x3 load4x3(const float* x, size_t stride)
+{
+    Vector4x3 v = { _mm_loadu_ps(x), _mm_loadu_ps(x + stride), _mm_loadu_ps(x + 2 * stride) };
+    return v;
+}
+
+inline Vector4x3 operator-(const Vector4x3& a, const Vector4x3& b)
+{
+    Vector4x3 v = { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+    return v;
+}
+
+inline Vector4x3 scaled(const Vector4x3& a, __m128 s)
+{
+    Vector4x3 v = { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) };
+    return v;
+}
+
+inline __m128 dot4(const Vector4x3& a, const Vector4x3& b)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+inline Vector4x3 cross4(const Vector4x3& a, const Vector4x3& b)
+{
+    Vector4x3 v = { _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+                    _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+                    _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)) };
+    return v;
+}
+
+// Squared distance from each lane's point to the segment from `start` along `edge`
+inline __m128 segmentDistance4(const Vector4x3& toPoint, const Vector4x3& edge)
+{
+    __m128 t = _mm_div_ps(dot4(toPoint, edge), _mm_add_ps(dot4(edge, edge), _mm_set1_ps(1e-30f)));
+    t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    Vector4x3 offset = toPoint - scaled(edge, t);
+    return dot4(offset, offset);
+}
+
+void distanceSquared4(const float* lanes, size_t stride, int slot, const QVector3D& p, float* result)
+{
+    Vector4x3 a = load4x3(lanes + slot, stride);
+    Vector4x3 b = load4x3(lanes + slot + 3 * stride, stride);
+    Vector4x3 c = load4x3(lanes + slot + 6 * stride, stride);
+    Vector4x3 point = { _mm_set1_ps(p.x()), _mm_set1_ps(p.y()), _mm_set1_ps(p.z()) };
+
+    Vector4x3 ab = b - a, bc = c - b, ca = a - c;
+    Vector4x3 ap = point - a, bp = point - b, cp = point - c;
+    Vector4x3 normal = cross4(ab, c - a);
+    __m128 n2 = dot4(normal, normal);
+
+    // p projects inside if it is on the inner side of all three edges (and the triangle has an area)
+    __m128 zero = _mm_setzero_ps();
+    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(dot4(cross4(ab, ap), normal), zero),
+                                          _mm_cmpge_ps(dot4(cross4(bc, bp), normal), zero)),
+                               _mm_and_ps(_mm_cmpge_ps(dot4(cross4(ca, cp), normal), zero),
+                                          _mm_cmpgt_ps(n2, zero)));
+    __m128 height = dot4(ap, normal);
+    __m128 plane = _mm_div_ps(_mm_mul_ps(height, height), _mm_max_ps(n2, _mm_set1_ps(FLT_MIN)));
+
+    __m128 edge = _mm_min_ps(_mm_min_ps(segmentDistance4(ap, ab), segmentDistance4(bp, bc)), segmentDistance4(cp, ca));
+    __m128 face = _mm_min_ps(plane, edge);
+    _mm_storeu_ps(result, _mm_or_ps(_mm_and_ps(inside, face), _mm_andnot_ps(inside, edge)));
+}
+
+#else
+
+// Same test one lane at a time, for processors without SSE2
+void distanceSquared4(const float* lanes, size_t stride, int slot, const QVector3D& p, float* result)
+{
+    for (int i = 0; i < 4; ++i) {
+        const float* corner = lanes + slot + i;
+        QVector3D a(corner[0], corner[stride], corner[2 * stride]);
+        QVector3D b(corner[3 * stride], corner[4 * stride], corner[5 * stride]);
+        QVector3D c(corner[6 * stride], corner[7 * stride], corner[8 * stride]);
+        MeshBVH::Feature feature;
+        result[i] = (closestOnTriangle(p, a, b, c, feature) - p).lengthSquared();
+    }
+}
+
+#endif
+
+// Closest points between segments p1-q1 and p2-q2 (Ericson 5.1.9); returns the squared distance
+float segmentSegment(const QVector3D& p1, const QVector3D& q1, const QVector3D& p2, const QVector3D& q2,
+                     QVector3D& c1, QVector3D& c2)
+{
+    const float epsilon = 1e-20f;
+    QVector3D d1 = q1 - p1;
+    QVector3D d2 = q2 - p2;
+    QVector3D r = p1 - p2;
+    float a = QVector3D::dotProduct(d1, d1);
+    float e = QVector3D::dotProduct(d2, d2);
+    float f = QVector3D::dotProduct(d2, r);
+    float s = 0.0f;
+    float t = 0.0f;
+
+    if (a <= epsilon && e <= epsilon) {
+        c1 = p1;
+        c2 = p2;
+        return (c1 - c2).lengthSquared();
+    }
+    if (a <= epsilon) {
+        t = qBound(0.0f, f / e, 1.0f);
+    } else {
+        float c = QVector3D::dotProduct(d1, r);
+        if (e <= epsilon) {
+            s = qBound(0.0f, -c / a, 1.0f);
+        } else {
+            float b = QVector3D::dotProduct(d1, d2);
+            float denominator = a * e - b * b;
+            s = (denominator > epsilon) ? qBound(0.0f, (b * f - c * e) / denominator, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = qBound(0.0f, -c / a, 1.0f);
+            } else if (t > 1.0f) {
+                t = 1.0f;
+                s = qBound(0.0f, (b - c) / a, 1.0f);
+            }
+        }
+    }
+    c1 = p1 + d1 * s;
+    c2 = p2 + d2 * t;
+    return (c1 - c2).lengthSquared();
+}
+
+// Does segment p-q pass through triangle abc? `where` gets the crossing point.
+bool segmentCrossesTriangle(const QVector3D& p, const QVector3D& q, const QVector3D* triangle, QVector3D& where)
+{
+    QVector3D direction = q - p;
+    QVector3D e1 = triangle[1] - triangle[0];
+    QVector3D e2 = triangle[2] - triangle[0];
+    QVector3D h = QVector3D::crossProduct(direction, e2);
+    float det = QVector3D::dotProduct(e1, h);
+    if (det == 0.0f) {
+        return false;   // Parallel; touching edges are found by the edge/edge distances
+    }
+    float inverseDet = 1.0f / det;
+    QVector3D s = p - triangle[0];
+    float u = QVector3D::dotProduct(s, h) * inverseDet;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    QVector3D r = QVector3D::crossProduct(s, e1);
+    float v = QVector3D::dotProduct(direction, r) * inverseDet;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+    float t = QVector3D::dotProduct(e2, r) * inverseDet;
+    if (t < 0.0f || t > 1.0f) {
+        return false;
+    }
+    where = p + direction * t;
+    return true;
+}
+
+// Squared distance between two triangles and the closest point on each. Separate triangles are
+// closest at a corner of one against the other, or between two edges; crossing triangles are 0 apart.
+float triangleTriangle(const QVector3D* s, const QVector3D* t, QVector3D& onS, QVector3D& onT)
+{
+    QVector3D crossing;
+    for (int k = 0; k < 3; ++k) {
+        if (segmentCrossesTriangle(s[k], s[(k + 1) % 3], t, crossing) ||
+            segmentCrossesTriangle(t[k], t[(k + 1) % 3], s, crossing)) {
+            onS = crossing;
+            onT = crossing;
+            return 0.0f;
+        }
+    }
+
+    float best = FLT_MAX;
+    QVector3D a, b;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            float d2 = segmentSegment(s[i], s[(i + 1) % 3], t[j], t[(j + 1) % 3], a, b);
+            if (d2 < best) {
+                best = d2;
+                onS = a;
+                onT = b;
+            }
+        }
+    }
+
+    MeshBVH::Feature feature;
+    for (int k = 0; k < 3; ++k) {
+        QVector3D closest = closestOnTriangle(s[k], t[0], t[1], t[2], feature);
+        float d2 = (closest - s[k]).lengthSquared();
+        if (d2 < best) {
+            best = d2;
+            onS = s[k];
+            onT = closest;
+        }
+        closest = closestOnTriangle(t[k], s[0], s[1], s[2], feature);
+        d2 = (closest - t[k]).lengthSquared();
+        if (d2 < best) {
+            best = d2;
+            onS = closest;
+            onT = t[k];
+        }
+    }
+    return best;
+}
+
+// Gap between two boxes (0 if they overlap), squared
+float boxBoxDistanceSquared(const MeshBVH::Node& a, const MeshBVH::Node& b)
+{
+    float sum = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+        float gap = qMax(qMax(a.boundsMin[k] - b.boundsMax[k], b.boundsMin[k] - a.boundsMax[k]), 0.0f);
+        sum += gap * gap;
+    }
+    return sum;
+}
+
+float boxSize(const MeshBVH::Node& node)
+{
+    return (node.boundsMax[0] - node.boundsMin[0]) + (node.boundsMax[1] - node.boundsMin[1]) +
+           (node.boundsMax[2] - node.boundsMin[2]);
+}
+
+// Lower the shared bound if value is smaller
+void atomicMin(std::atomic<float>& target, float value)
+{
+    float current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void collectBounds(const PrimitiveRef* refs, qint64 begin, qint64 end, Box& bounds, Box& centroidBounds)
+{
+    bounds.reset();
+    centroidBounds.reset();
+    for (qint64 i = begin; i < end; ++i) {
+        bounds.grow(refs[i].boundsMin, refs[i].boundsMax);
+        centroidBounds.grow(refs[i].centroid, refs[i].centroid);
+    }
+}
+
+void collectBins(const PrimitiveRef* refs, qint64 begin, qint64 end, int axis, float low, float scale, Bin* bins)
+{
+    for (int b = 0; b < BinCount; ++b) {
+        bins[b].bounds.reset();
+        bins[b].count = 0;
+    }
+    for (qint64 i = begin; i < end; ++i) {
+        Bin& bin = bins[binOf(refs[i].centroid[axis], low, scale)];
+        bin.bounds.grow(refs[i].boundsMin, refs[i].boundsMax);
+        bin.count++;
+    }
+}
+
+void scanRange(const std::vector<PrimitiveRef>& refs, int begin, int end, bool parallel, RangeInfo& info)
+{
+    const PrimitiveRef* data = refs.data();
+
+    // Bounds first (the bins need the centroid range)
+    if (parallel) {
+        int threads = Parallel::threadCount();
+        std::vector<Box> bounds(threads), centroids(threads);
+        for (int t = 0; t < threads; ++t) {
+            bounds[t].reset();
+            centroids[t].reset();
+        }
+        Parallel::forChunks(end - begin, [&](qint64 from, qint64 to, int thread) {
+            collectBounds(data, begin + from, begin + to, bounds[thread], centroids[thread]);
+        });
+        info.bounds.reset();
+        info.centroidBounds.reset();
+        for (int t = 0; t < threads; ++t) {
+            info.bounds.grow(bounds[t]);
+            info.centroidBounds.grow(centroids[t]);
+        }
+    } else {
+        collectBounds(data, begin, end, info.bounds, info.centroidBounds);
+    }
+}
+
+// Build the tree over refs, reordering them into leaf order
+void buildTree(std::vector<PrimitiveRef>& refs, std::vector<MeshBVH::Node>& nodes)
+{
+    typedef MeshBVH::Node Node;
+
+    const int count = int(refs.size());
+    const int threads = Parallel::threadCount();
+    const int parallelScanSize = 1 << 16;
+
+    // Split one range: fills the node (bounds, leaf or inner) and returns the split point, or -1 for a leaf.
+    // Inner nodes get their child indices from the caller.
+    auto splitTask = [&refs](const BuildTask& task, Node& node, bool parallel) -> int {
+        int size = task.end - task.begin;
+        RangeInfo info;
+        scanRange(refs, task.begin, task.end, parallel, info);
+        for (int k = 0; k < 3; ++k) {
+            node.boundsMin[k] = info.bounds.lo[k];
+            node.boundsMax[k] = info.bounds.hi[k];
+        }
+        node.start = task.begin;
+        node.count = size;
+        if (size <= MaxLeafSize) {
+            return -1;
+        }
+
+        // Split along the longest side of the centroid bounds
+        int axis = 0;
+        float extent[3];
+        for (int k = 0; k < 3; ++k) {
+            extent[k] = info.centroidBounds.hi[k] - info.centroidBounds.lo[k];
+            if (extent[k] > extent[axis]) {
+                axis = k;
+            }
+        }
+
+        PrimitiveRef* data = refs.data();
+        int middle = -1;
+
+        if (extent[axis] <= 0.0f || task.depth >= MedianDepth) {
+            // All centroids in one spot (or the tree is getting deep): just cut the range in half
+            if (size <= ForceSplitSize && extent[axis] <= 0.0f) {
+                return -1;
+            }
+            middle = task.begin + size / 2;
+            std::nth_element(data + task.begin, data + middle, data + task.end,
+                             [axis](const PrimitiveRef& a, const PrimitiveRef& b) {
+                                 return a.centroid[axis] < b.centroid[axis];
+                             });
+        } else {
+            float low = info.centroidBounds.lo[axis];
+            float scale = BinCount / extent[axis] * 0.9999f;
+
+            if (parallel) {
+                std::vector<std::vector<Bin>> partial(Parallel::threadCount(), std::vector<Bin>(BinCount));
+                for (std::vector<Bin>& bins : partial) {
+                    for (Bin& bin : bins) {
+                        bin.bounds.reset();
+                        bin.count = 0;
+                    }
+                }
+                Parallel::forChunks(size, [&](qint64 from, qint64 to, int thread) {
+                    collectBins(data, task.begin + from, task.begin + to, axis, low, scale, partial[thread].data());
+                });
+                for (int b = 0; b < BinCount; ++b) {
+                    info.bins[b] = partial[0][b];
+                    for (size_t t = 1; t < partial.size(); ++t) {
+                        info.bins[b].bounds.grow(partial[t][b].bounds);
+                        info.bins[b].count += partial[t][b].count;
+                    }
+                }
+            } else {
+                collectBins(data, task.begin, task.end, axis, low, scale, info.bins);
+            }
+
+            // Surface area heuristic: cost of each of the BinCount - 1 split planes
+            float rightArea[BinCount];
+            int rightCount[BinCount];
+            Box box;
+            box.reset();
+            int running = 0;
+            for (int b = BinCount - 1; b > 0; --b) {
+                box.grow(info.bins[b].bounds);
+                running += info.bins[b].count;
+                rightArea[b] = box.area();
+                rightCount[b] = running;
+            }
+
+            box.reset();
+            running = 0;
+            int bestSplit = -1;
+            float bestCost = FLT_MAX;
+            for (int b = 1; b < BinCount; ++b) {
+                box.grow(info.bins[b - 1].bounds);
+                running += info.bins[b - 1].count;
+                if (running == 0 || rightCount[b] == 0) {
+                    continue;
+                }
+                float cost = box.area() * running + rightArea[b] * rightCount[b];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = b;
+                }
+            }
+
+            float leafCost = info.bounds.area() * size;
+            float splitCost = info.bounds.area() + bestCost;   // One extra node visit plus the children
+            if (bestSplit < 0 || (size <= ForceSplitSize && leafCost <= splitCost)) {
+                if (size <= ForceSplitSize) {
+                    return -1;
+                }
+                middle = task.begin + size / 2;
+                std::nth_element(data + task.begin, data + middle, data + task.end,
+                                 [axis](const PrimitiveRef& a, const PrimitiveRef& b) {
+                                     return a.centroid[axis] < b.centroid[axis];
+                                 });
+            } else {
+                PrimitiveRef* split = std::partition(data + task.begin, data + task.end,
+                    [=](const PrimitiveRef& ref) { return binOf(ref.centroid[axis], low, scale) < bestSplit; });
+                middle = int(split - data);
+            }
+        }
+
+        node.count = 0;
+        return middle;
+    };
+
+    nodes.clear();
+    nodes.reserve(size_t(count / MaxLeafSize) * 2 + 1);
+    nodes.push_back(Node());
+
+    // Top of the tree on this thread; ranges small enough to be one thread's work are set aside
+    const int subtreeSize = qMax(4096, count / (threads * 8));
+    std::vector<BuildTask> pending;
+    std::vector<BuildTask> subtrees;
+    pending.push_back({ 0, 0, count, 0 });
+
+    while (!pending.empty()) {
+        BuildTask task = pending.back();
+        pending.pop_back();
+
+        if (threads > 1 && task.end - task.begin <= subtreeSize) {
+            subtrees.push_back(task);
+            continue;
+        }
+
+        Node node;
+        int middle = splitTask(task, node, task.end - task.begin >= parallelScanSize);
+        if (middle >= 0) {
+            int left = int(nodes.size());
+            node.start = left;
+            nodes.push_back(Node());
+            nodes.push_back(Node());
+            pending.push_back({ left, task.begin, middle, task.depth + 1 });
+            pending.push_back({ left + 1, middle, task.end, task.depth + 1 });
+        }
+        nodes[task.node] = node;
+    }
+
+    // Build the set-aside subtrees on all cores, each into its own node list
+    std::vector<std::vector<Node>> built(subtrees.size());
+    Parallel::forBlocks(int(subtrees.size()), 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 s = begin; s < end; ++s) {
+            std::vector<Node>& local = built[s];
+            local.push_back(Node());
+            std::vector<BuildTask> stack;
+            stack.reserve(StackSize);
+            stack.push_back({ 0, subtrees[s].begin, subtrees[s].end, subtrees[s].depth });
+
+            while (!stack.empty()) {
+                BuildTask task = stack.back();
+                stack.pop_back();
+
+                Node node;
+                int middle = splitTask(task, node, false);
+                if (middle >= 0) {
+                    int left = int(local.size());
+                    node.start = left;
+                    local.push_back(Node());
+                    local.push_back(Node());
+                    stack.push_back({ left, task.begin, middle, task.depth + 1 });
+                    stack.push_back({ left + 1, middle, task.end, task.depth + 1 });
+                }
+                local[task.node] = node;
+            }
+        }
+    });
+
+    // Splice the subtrees into the main list: local node i >= 1 moves to offset + i - 1
+    for (size_t s = 0; s < subtrees.size(); ++s) {
+        std::vector<Node>& local = built[s];
+        int offset = int(nodes.size()) - 1;
+        for (Node& node : local) {
+            if (node.count == 0) {
+                node.start += offset;
+            }
+        }
+        nodes[subtrees[s].node] = local[0];
+        nodes.insert(nodes.end(), local.begin() + 1, local.end());
+        std::vector<Node>().swap(local);
+    }
+}
+
+}
+
+MeshBVH::MeshBVH()
+    : laneStride(0)
+    , triangleCount(0)
+{
+}
+
+void MeshBVH::clear()
+{
+    nodes.clear();
+    corners.clear();
+    leafCorners.clear();
+    leafTriangles.clear();
+    leafLanes.clear();
+    laneStride = 0;
+    faceNormals.clear();
+    cornerVertexNormals.clear();
+    cornerEdgeNormals.clear();
+    triangleCount = 0;
+}
+
+QVector3D MeshBVH::getBoundsMin() const
+{
+    return nodes.empty() ? QVector3D() : QVector3D(nodes[0].boundsMin[0], nodes[0].boundsMin[1], nodes[0].boundsMin[2]);
+}
+
+QVector3D MeshBVH::getBoundsMax() const
+{
+    return nodes.empty() ? QVector3D() : QVector3D(nodes[0].boundsMax[0], nodes[0].boundsMax[1], nodes[0].boundsMax[2]);
+}
+
+QVector3D MeshBVH::triangleNormal(int triangle) const
+{
+    if (!faceNormals.empty()) {
+        return faceNormals[triangle];
+    }
+    const QVector3D* c = &corners[size_t(triangle) * 3];
+    return QVector3D::crossProduct(c[1] - c[0], c[2] - c[0]).normalized();
+}
+
+QVector3D MeshBVH::vertexNormal(int triangle, int k) const
+{
+    if (cornerVertexNormals.empty()) {
+        return triangleNormal(triangle);
+    }
+    return cornerVertexNormals[size_t(triangle) * 3 + k].normalized();
+}
+
+float MeshBVH::distanceToTriangle(const QVector3D& point, int triangle) const
+{
+    const QVector3D* c = &corners[size_t(triangle) * 3];
+    Feature feature;
+    return (closestOnTriangle(point, c[0], c[1], c[2], feature) - point).length();
+}
+
+void MeshBVH::build(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                    float displayScale, const QVector3D& displayOffset)
+{
+    clear();
+
+    int vertexCount = vertexData.size() / 6;
+    bool indexed = !indices.isEmpty();
+    triangleCount = indexed ? indices.size() / 3 : vertexCount / 3;
+    if (triangleCount == 0 || displayScale <= 0.0f) {
+        triangleCount = 0;
+        qWarning() << "MeshBVH: no triangles to build from";
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Corners in file units, plus one build reference per triangle
+    corners.resize(size_t(triangleCount) * 3);
+    std::vector<PrimitiveRef> refs(triangleCount);
+    const float* source = vertexData.constData();
+    const unsigned int* indexData = indices.constData();
+    QVector3D* cornerData = corners.data();
+    Parallel::forEach(triangleCount, [&](qint64 t) {
+        PrimitiveRef& ref = refs[t];
+        for (int k = 0; k < 3; ++k) {
+            qint64 v = indexed ? qint64(indexData[t * 3 + k]) : t * 3 + k;
+            QVector3D p = QVector3D(source[v * 6], source[v * 6 + 1], source[v * 6 + 2]) / displayScale - displayOffset;
+            cornerData[t * 3 + k] = p;
+            for (int axis = 0; axis < 3; ++axis) {
+                ref.boundsMin[axis] = (k == 0) ? p[axis] : qMin(ref.boundsMin[axis], p[axis]);
+                ref.boundsMax[axis] = (k == 0) ? p[axis] : qMax(ref.boundsMax[axis], p[axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            ref.centroid[axis] = 0.5f * (ref.boundsMin[axis] + ref.boundsMax[axis]);
+        }
+        ref.triangle = int(t);
+    });
+
+    buildTree(refs, nodes);
+
+    // Store the corners again in leaf order so a leaf's triangles sit next to each other in memory
+    leafTriangles.resize(triangleCount);
+    leafCorners.resize(size_t(triangleCount) * 3);
+    Parallel::forEach(triangleCount, [&](qint64 slot) {
+        int t = refs[slot].triangle;
+        leafTriangles[slot] = t;
+        leafCorners[slot * 3] = cornerData[size_t(t) * 3];
+        leafCorners[slot * 3 + 1] = cornerData[size_t(t) * 3 + 1];
+        leafCorners[slot * 3 + 2] = cornerData[size_t(t) * 3 + 2];
+    });
+
+    // The distance kernel reads 4 slots at a time, so the arrays get 3 slots of padding
+    laneStride = size_t(triangleCount) + 3;
+    leafLanes.assign(laneStride * 9, 0.0f);
+    float* lanes = leafLanes.data();
+    const size_t stride = laneStride;
+    Parallel::forEach(triangleCount, [&](qint64 slot) {
+        for (int k = 0; k < 3; ++k) {
+            const QVector3D& corner = leafCorners[slot * 3 + k];
+            lanes[(k * 3) * stride + slot] = corner.x();
+            lanes[(k * 3 + 1) * stride + slot] = corner.y();
+            lanes[(k * 3 + 2) * stride + slot] = corner.z();
+        }
+    });
+
+    if (indexed) {
+        computePseudoNormals(indices);
+    }
+
+    qDebug() << "MeshBVH: built" << nodes.size() << "nodes over" << triangleCount << "triangles in"
+             << timer.elapsed() << "ms";
+}
+
+
+void MeshBVH::computePseudoNormals(const QVector<unsigned int>& indices)
+{
+    // Angle-weighted pseudo-normals (Baerentzen & Aanaes): the sign of (p - closest) against the
+    // pseudo-normal of the closest vertex, edge or face tells inside from outside
+    const int cornerCount = triangleCount * 3;
+    faceNormals.resize(triangleCount);
+    std::vector<QVector3D> cornerWeighted(cornerCount);
+
+    Parallel::forEach(triangleCount, [&](qint64 t) {
+        const QVector3D* c = &corners[size_t(t) * 3];
+        QVector3D normal = QVector3D::crossProduct(c[1] - c[0], c[2] - c[0]).normalized();
+        faceNormals[t] = normal;
+        for (int k = 0; k < 3; ++k) {
+            QVector3D toNext = (c[(k + 1) % 3] - c[k]).normalized();
+            QVector3D toPrevious = (c[(k + 2) % 3] - c[k]).normalized();
+            float cosine = qBound(-1.0f, QVector3D::dotProduct(toNext, toPrevious), 1.0f);
+            cornerWeighted[t * 3 + k] = normal * std::acos(cosine);
+        }
+    });
+
+    // Gather per vertex and per edge (a plain sum; this is a small part of the build)
+    unsigned int vertexCount = 0;
+    for (unsigned int index : indices) {
+        vertexCount = qMax(vertexCount, index + 1);
+    }
+    std::vector<QVector3D> vertexNormals(vertexCount);
+    for (int c = 0; c < cornerCount; ++c) {
+        vertexNormals[indices[c]] += cornerWeighted[c];
+    }
+
+    MeshTopology topology;
+    topology.build(indices);
+    std::vector<QVector3D> edgeNormals(topology.getEdgeCount());
+    for (int c = 0; c < cornerCount; ++c) {
+        edgeNormals[topology.edgeOfCorner(c)] += faceNormals[c / 3];
+    }
+
+    cornerVertexNormals.resize(cornerCount);
+    cornerEdgeNormals.resize(cornerCount);
+    Parallel::forEach(cornerCount, [&](qint64 c) {
+        cornerVertexNormals[c] = vertexNormals[indices[int(c)]];
+        cornerEdgeNormals[c] = edgeNormals[topology.edgeOfCorner(int(c))];
+    });
+}
+
+QVector3D MeshBVH::pseudoNormal(const Hit& hit) const
+{
+    int base = hit.triangle * 3;
+    switch (hit.feature) {
+    case Vertex0: return cornerVertexNormals[base];
+    case Vertex1: return cornerVertexNormals[base + 1];
+    case Vertex2: return cornerVertexNormals[base + 2];
+    case Edge01: return cornerEdgeNormals[base];
+    case Edge12: return cornerEdgeNormals[base + 1];
+    case Edge20: return cornerEdgeNormals[base + 2];
+    case Face:
+    default: return faceNormals[hit.triangle];
+    }
+}
+
+bool MeshBVH::closestPoint(const QVector3D& point, Hit& hit, float maxDistance) const
+{
+    hit = Hit();
+    if (nodes.empty()) {
+        return false;
+    }
+
+    float best = (maxDistance < FLT_MAX) ? maxDistance * maxDistance : FLT_MAX;
+    int bestSlot = -1;
+
+    int stack[StackSize];
+    int top = 0;
+    if (boxDistanceSquared(nodes[0].boundsMin, nodes[0].boundsMax, point) > best) {
+        return false;
+    }
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        if (node.count > 0) {
+            // Distances for 4 triangles at a time; the exact closest point is only worked out
+            // once, for the winning triangle, after the search
+            const int end = node.start + node.count;
+            for (int group = node.start; group < end; group += 4) {
+                float lane[4];
+                distanceSquared4(leafLanes.data(), laneStride, group, point, lane);
+                for (int i = 0; i < 4 && group + i < end; ++i) {
+                    if (lane[i] < best || (lane[i] == best && bestSlot < 0)) {
+                        best = lane[i];
+                        bestSlot = group + i;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so the search radius shrinks quickly
+        int left = node.start;
+        float dLeft = boxDistanceSquared(nodes[left].boundsMin, nodes[left].boundsMax, point);
+        float dRight = boxDistanceSquared(nodes[left + 1].boundsMin, nodes[left + 1].boundsMax, point);
+        int nearChild = left, farChild = left + 1;
+        if (dRight < dLeft) {
+            std::swap(dLeft, dRight);
+            std::swap(nearChild, farChild);
+        }
+        if (dRight <= best && top < StackSize) {
+            stack[top++] = farChild;
+        }
+        if (dLeft <= best && top < StackSize) {
+            stack[top++] = nearChild;
+        }
+    }
+
+    if (bestSlot < 0) {
+        return false;
+    }
+    const QVector3D* c = &leafCorners[size_t(bestSlot) * 3];
+    hit.triangle = leafTriangles[bestSlot];
+    hit.point = closestOnTriangle(point, c[0], c[1], c[2], hit.feature);
+    hit.distance = (hit.point - point).length();
+    return true;
+}
+
+bool MeshBVH::signedDistance(const QVector3D& point, Hit& hit, float maxDistance) const
+{
+    if (!closestPoint(point, hit, maxDistance)) {
+        return false;
+    }
+    if (hasPseudoNormals() && QVector3D::dotProduct(point - hit.point, pseudoNormal(hit)) < 0.0f) {
+        hit.distance = -hit.distance;
+    }
+    return true;
+}
+
+bool MeshBVH::raycast(const QVector3D& origin, const QVector3D& direction, RayHit& hit,
+                      float maxDistance, int ignoreTriangle) const
+{
+    hit = RayHit();
+    float length = direction.length();
+    if (nodes.empty() || !(length > 0.0f)) {
+        return false;
+    }
+
+    QVector3D dir = direction / length;
+    QVector3D inverse(1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z());
+    float best = maxDistance;
+    int bestSlot = -1;
+
+    int stack[StackSize];
+    int top = 0;
+    float entry;
+    if (!rayBox(nodes[0].boundsMin, nodes[0].boundsMax, origin, inverse, best, entry)) {
+        return false;
+    }
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        if (node.count > 0) {
+            for (int slot = node.start; slot < node.start + node.count; ++slot) {
+                if (leafTriangles[slot] == ignoreTriangle) {
+                    continue;
+                }
+                // Moller-Trumbore ray/triangle intersection
+                const QVector3D* c = &leafCorners[size_t(slot) * 3];
+                QVector3D e1 = c[1] - c[0];
+                QVector3D e2 = c[2] - c[0];
+                QVector3D p = QVector3D::crossProduct(dir, e2);
+                float det = QVector3D::dotProduct(e1, p);
+                if (det == 0.0f) {
+                    continue;
+                }
+                float inverseDet = 1.0f / det;
+                QVector3D s = origin - c[0];
+                float u = QVector3D::dotProduct(s, p) * inverseDet;
+                if (u < -BarycentricSlack || u > 1.0f + BarycentricSlack) {
+                    continue;
+                }
+                QVector3D q = QVector3D::crossProduct(s, e1);
+                float v = QVector3D::dotProduct(dir, q) * inverseDet;
+                if (v < -BarycentricSlack || u + v > 1.0f + BarycentricSlack) {
+                    continue;
+                }
+                float t = QVector3D::dotProduct(e2, q) * inverseDet;
+                if (t >= 0.0f && t < best) {
+                    best = t;
+                    bestSlot = slot;
+                    hit.frontFace = det < 0.0f;   // The ray runs against the triangle's normal
+                }
+            }
+            continue;
+        }
+
+        int left = node.start;
+        float entryLeft, entryRight;
+        bool hitLeft = rayBox(nodes[left].boundsMin, nodes[left].boundsMax, origin, inverse, best, entryLeft);
+        bool hitRight = rayBox(nodes[left + 1].boundsMin, nodes[left + 1].boundsMax, origin, inverse, best, entryRight);
+        if (hitLeft && hitRight) {
+            // Nearer box on top of the stack
+            bool leftFirst = entryLeft <= entryRight;
+            if (top + 2 <= StackSize) {
+                stack[top++] = leftFirst ? left + 1 : left;
+                stack[top++] = leftFirst ? left : left + 1;
+            }
+        } else if ((hitLeft || hitRight) && top < StackSize) {
+            stack[top++] = hitLeft ? left : left + 1;
+        }
+    }
+
+    if (bestSlot < 0) {
+        return false;
+    }
+    hit.triangle = leafTriangles[bestSlot];
+    hit.distance = best;
+    hit.point = origin + dir * best;
+    return true;
+}
+
+bool MeshBVH::closestPair(const MeshBVH& other, PairHit& hit, float maxDistance) const
+{
+    hit = PairHit();
+    if (nodes.empty() || other.nodes.empty()) {
+        return false;
+    }
+
+    typedef std::pair<int, int> NodePair;   // Node on this tree, node on the other tree
+    std::atomic<float> bound((maxDistance < FLT_MAX) ? maxDistance * maxDistance : FLT_MAX);
+    if (boxBoxDistanceSquared(nodes[0], other.nodes[0]) > bound.load()) {
+        return false;
+    }
+
+    // Of two inner nodes, open the bigger one; a leaf can only be paired with the other's children
+    auto splitThis = [&](const Node& a, const Node& b) {
+        return b.count > 0 || (a.count == 0 && boxSize(a) >= boxSize(b));
+    };
+
+    // Open the root pair breadth first until there are enough pairs to keep every core busy
+    std::vector<NodePair> frontier(1, NodePair(0, 0));
+    const size_t wanted = size_t(Parallel::threadCount()) * 16;
+    bool expanded = true;
+    while (frontier.size() < wanted && expanded) {
+        expanded = false;
+        std::vector<NodePair> next;
+        next.reserve(frontier.size() * 2);
+        for (const NodePair& pair : frontier) {
+            const Node& a = nodes[pair.first];
+            const Node& b = other.nodes[pair.second];
+            if (a.count > 0 && b.count > 0) {
+                next.push_back(pair);
+            } else if (splitThis(a, b)) {
+                next.push_back(NodePair(a.start, pair.second));
+                next.push_back(NodePair(a.start + 1, pair.second));
+                expanded = true;
+            } else {
+                next.push_back(NodePair(pair.first, b.start));
+                next.push_back(NodePair(pair.first, b.start + 1));
+                expanded = true;
+            }
+        }
+        frontier.swap(next);
+    }
+
+    // Nearest pairs first, so the shared bound shrinks early and prunes the rest
+    std::vector<float> frontierDistance(frontier.size());
+    for (size_t i = 0; i < frontier.size(); ++i) {
+        frontierDistance[i] = boxBoxDistanceSquared(nodes[frontier[i].first], other.nodes[frontier[i].second]);
+    }
+    std::vector<int> order(frontier.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = int(i);
+    }
+    std::sort(order.begin(), order.end(), [&](int x, int y) { return frontierDistance[x] < frontierDistance[y]; });
+
+    struct PairResult {
+        float distanceSquared = FLT_MAX;
+        int slot = -1;
+        int otherSlot = -1;
+        QVector3D point;
+        QVector3D otherPoint;
+    };
+    std::vector<PairResult> results(Parallel::threadCount());
+
+    Parallel::forBlocks(qint64(order.size()), 1, [&](qint64 begin, qint64 end, int thread) {
+        PairResult local = results[thread];
+        std::vector<NodePair> stack;
+        stack.reserve(StackSize);
+
+        for (qint64 f = begin; f < end; ++f) {
+            stack.push_back(frontier[order[f]]);
+            while (!stack.empty()) {
+                NodePair pair = stack.back();
+                stack.pop_back();
+                const Node& a = nodes[pair.first];
+                const Node& b = other.nodes[pair.second];
+                if (boxBoxDistanceSquared(a, b) > bound.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+
+                if (a.count > 0 && b.count > 0) {
+                    for (int slot = a.start; slot < a.start + a.count; ++slot) {
+                        const QVector3D* s = &leafCorners[size_t(slot) * 3];
+                        for (int otherSlot = b.start; otherSlot < b.start + b.count; ++otherSlot) {
+                            const QVector3D* t = &other.leafCorners[size_t(otherSlot) * 3];
+
+                            // Cheap test on the two triangles' boxes before the exact distance
+                            float gap = 0.0f;
+                            for (int k = 0; k < 3; ++k) {
+                                float lowS = qMin(qMin(s[0][k], s[1][k]), s[2][k]);
+                                float highS = qMax(qMax(s[0][k], s[1][k]), s[2][k]);
+                                float lowT = qMin(qMin(t[0][k], t[1][k]), t[2][k]);
+                                float highT = qMax(qMax(t[0][k], t[1][k]), t[2][k]);
+                                float g = qMax(qMax(lowS - highT, lowT - highS), 0.0f);
+                                gap += g * g;
+                            }
+                            if (gap > bound.load(std::memory_order_relaxed)) {
+                                continue;
+                            }
+
+                            QVector3D onS, onT;
+                            float d2 = triangleTriangle(s, t, onS, onT);
+                            if (d2 < local.distanceSquared && d2 <= bound.load(std::memory_order_relaxed)) {
+                                local.distanceSquared = d2;
+                                local.slot = slot;
+                                local.otherSlot = otherSlot;
+                                local.point = onS;
+                                local.otherPoint = onT;
+                                atomicMin(bound, d2);
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                NodePair first, second;
+                if (splitThis(a, b)) {
+                    first = NodePair(a.start, pair.second);
+                    second = NodePair(a.start + 1, pair.second);
+                } else {
+                    first = NodePair(pair.first, b.start);
+                    second = NodePair(pair.first, b.start + 1);
+                }
+                // Nearer pair on top of the stack
+                if (boxBoxDistanceSquared(nodes[first.first], other.nodes[first.second]) >
+                    boxBoxDistanceSquared(nodes[second.first], other.nodes[second.second])) {
+                    std::swap(first, second);
+                }
+                stack.push_back(second);
+                stack.push_back(first);
+            }
+        }
+        results[thread] = local;
+    });
+
+    const PairResult* best = nullptr;
+    for (const PairResult& result : results) {
+        if (result.slot >= 0 && (!best || result.distanceSquared < best->distanceSquared)) {
+            best = &result;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+    hit.triangle = leafTriangles[best->slot];
+    hit.otherTriangle = other.leafTriangles[best->otherSlot];
+    hit.distance = std::sqrt(best->distanceSquared);
+    hit.point = best->point;
+    hit.otherPoint = best->otherPoint;
+    return true;
+}
+
+QVector<MeshBVH::Hit> MeshBVH::closestPoints(const QVector<QVector3D>& points, bool signedResult, float maxDistance) const
+{
+    QVector<Hit> hits(points.size());
+    Hit* output = hits.data();
+    const QVector3D* input = points.constData();
+    Parallel::forBlocks(points.size(), 256, [&](qint64 begin, qint64 end, int) {
+        for (qint64 i = begin; i < end; ++i) {
+            if (signedResult) {
+                signedDistance(input[i], output[i], maxDistance);
+            } else {
+                closestPoint(input[i], output[i], maxDistance);
+            }
+        }
+    });
+    return hits;
+}
@@ -0,0 +1,119 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <QVector>
+#include <QVector3D>
+#include <cfloat>
+#include <vector>
+
+// Bounding volume hierarchy over the triangles of a mesh, for fast closest-point, distance
+// and ray queries. Built with binned surface-area splits; the top of the tree is split on the
+// calling thread and the subtrees below are built on all cores.
+// Queries are read-only, so any number of threads may run them on the same tree at once.
+class MeshBVH
+{
+public:
+    // Which part of a triangle the closest point landed on
+    enum Feature {
+        Face = 0,
+        Vertex0, Vertex1, Vertex2,   // A corner
+        Edge01, Edge12, Edge20       // The edge from one corner to the next
+    };
+
+    // Result of a closest-point query
+    struct Hit {
+        int triangle = -1;           // Triangle index in the input mesh (-1 = nothing found)
+        float distance = FLT_MAX;    // Distance from the query point (signed for signedDistance)
+        QVector3D point;             // Closest point on the surface
+        Feature feature = Face;
+    };
+
+    // Result of a ray query
+    struct RayHit {
+        int triangle = -1;           // Triangle that was hit (-1 = none)
+        float distance = FLT_MAX;    // Distance along the (normalized) ray
+        QVector3D point;             // Where the ray hit
+        bool frontFace = false;      // Did the ray hit the outward-facing side?
+    };
+
+    // Result of a closest-pair query between two surfaces
+    struct PairHit {
+        int triangle = -1;           // Triangle on this surface (-1 = nothing found)
+        int otherTriangle = -1;      // Triangle on the other surface
+        float distance = FLT_MAX;    // Smallest gap (0 where the surfaces touch or cross)
+        QVector3D point;             // Closest point on this surface
+        QVector3D otherPoint;        // Closest point on the other surface
+    };
+
+    MeshBVH();
+
+    // Build from the loader's buffers (6 floats per vertex, 3 indices per triangle; without indices,
+    // every 3 consecutive vertices form a triangle). Positions are converted back to file units
+    // (display = (file + offset) * scale). Welded meshes also get the pseudo-normals signedDistance() needs.
+    void build(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+               float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(0, 0, 0));
+    void clear();
+
+    bool isEmpty() const { return nodes.empty(); }
+    int getTriangleCount() const { return triangleCount; }
+    int getNodeCount() const { return int(nodes.size()); }
+    QVector3D getBoundsMin() const;
+    QVector3D getBoundsMax() const;
+    bool hasPseudoNormals() const { return !faceNormals.empty(); }
+
+    // Corner k (0..2) of a triangle, in file units
+    QVector3D triangleCorner(int triangle, int k) const { return corners[size_t(triangle) * 3 + k]; }
+    QVector3D triangleNormal(int triangle) const;
+    // Angle-weighted normal of the vertex at corner k (the face normal if there are no pseudo-normals)
+    QVector3D vertexNormal(int triangle, int k) const;
+
+    // Distance from a point to one particular triangle
+    float distanceToTriangle(const QVector3D& point, int triangle) const;
+
+    // Closest point on the surface to a point; only looks up to maxDistance away
+    bool closestPoint(const QVector3D& point, Hit& hit, float maxDistance = FLT_MAX) const;
+
+    // Like closestPoint, but the distance is negative inside the model. The sign comes from the
+    // angle-weighted pseudo-normal of the closest feature, so it needs a closed, consistently wound mesh.
+    bool signedDistance(const QVector3D& point, Hit& hit, float maxDistance = FLT_MAX) const;
+
+    // First triangle hit by a ray (direction need not be normalized). ignoreTriangle lets a ray
+    // start on a triangle without hitting it straight away.
+    bool raycast(const QVector3D& origin, const QVector3D& direction, RayHit& hit,
+                 float maxDistance = FLT_MAX, int ignoreTriangle = -1) const;
+
+    // Closest points for many probes at once, spread over all cores
+    QVector<Hit> closestPoints(const QVector<QVector3D>& points, bool signedResult = false,
+                               float maxDistance = FLT_MAX) const;
+
+    // Smallest distance between this surface and another one (both in the same units), found by
+    // walking the two trees together. The top node pairs are shared out over all cores.
+    bool closestPair(const MeshBVH& other, PairHit& hit, float maxDistance = FLT_MAX) const;
+
+    // One tree node (32 bytes). Inner nodes keep their two children next to each other.
+    struct Node {
+        float boundsMin[3];
+        int start;       // Leaf: first slot in leaf order. Inner: index of the left child (right = start + 1)
+        float boundsMax[3];
+        int count;       // Leaf: number of triangles. Inner: 0
+    };
+
+private:
+    void computePseudoNormals(const QVector<unsigned int>& indices);
+    QVector3D pseudoNormal(const Hit& hit) const;
+
+    std::vector<Node> nodes;
+    std::vector<QVector3D> corners;        // 3 corners per triangle, in input order
+    std::vector<QVector3D> leafCorners;    // Same corners, stored in leaf order for cache-friendly queries
+    std::vector<int> leafTriangles;        // Input triangle index of every leaf slot
+    std::vector<float> leafLanes;          // Leaf corners again as 9 coordinate arrays, for the 4-wide distance kernel
+    size_t laneStride;                     // Length of each of those arrays (slots plus padding)
+    int triangleCount;
+
+    // Pseudo-normals for signed distance (only for welded meshes)
+    std::vector<QVector3D> faceNormals;    // Unit normal per triangle
+    std::vector<QVector3D> cornerVertexNormals;  // Angle-weighted normal of each corner's vertex
+    std::vector<QVector3D> cornerEdgeNormals;    // Sum of face normals along the edge starting at each corner
+};
+
+#endif // MESHBVH_H
@@ -0,0 +1,697 @@
+#include "meshcodec.h"
+#include <cstring>
+
+namespace {
+
+// Vertices the reorderings assume a GPU keeps around
+const unsigned int CacheSize = 16;
+
+// Index codec (EXT_meshopt_compression "TRIANGLES", version 1)
+const unsigned char IndexHeader = 0xe1;
+const int IndexFifoSize = 16;
+// Vertex indices 1..12 in the recent-vertex FIFO get a short code; 13 and 14 mean last - 1 / last + 1
+const int RecentVertexCodes = 13;
+
+// Pairs of vertex codes the decoder knows by number, so a whole new triangle fits in one byte
+const unsigned char CodeAuxTable[16] = {
+    0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69,
+    0, 0  // Never used for encoding, written only as padding
+};
+
+// Corner order for rotating a triangle by 0, 1 or 2 places
+const unsigned int TriangleRotation[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
+
+// Vertex codec (EXT_meshopt_compression "ATTRIBUTES", version 0)
+const unsigned char VertexHeader = 0xa0;
+const size_t VertexBlockBytes = 8192;
+const size_t VertexBlockMaxSize = 256;
+const size_t ByteGroupSize = 16;
+const size_t TailMinSize = 32;
+
+// The last 16 edges and vertices written, as the decoder will see them
+struct IndexFifos {
+    unsigned int edges[IndexFifoSize][2];
+    unsigned int vertices[IndexFifoSize];
+    size_t edgeOffset = 0;
+    size_t vertexOffset = 0;
+
+    IndexFifos()
+    {
+        std::memset(edges, -1, sizeof(edges));
+        std::memset(vertices, -1, sizeof(vertices));
+    }
+
+    // (age << 2) | rotation of the newest edge that the triangle starts with, or -1
+    int findEdge(unsigned int a, unsigned int b, unsigned int c) const
+    {
+        for (int i = 0; i < IndexFifoSize; ++i) {
+            const size_t index = (edgeOffset - 1 - i) & (IndexFifoSize - 1);
+            const unsigned int e0 = edges[index][0];
+            const unsigned int e1 = edges[index][1];
+            if (e0 == a && e1 == b) {
+                return (i << 2) | 0;
+            }
+            if (e0 == b && e1 == c) {
+                return (i << 2) | 1;
+            }
+            if (e0 == c && e1 == a) {
+                return (i << 2) | 2;
+            }
+        }
+        return -1;
+    }
+
+    void pushEdge(unsigned int a, unsigned int b)
+    {
+        edges[edgeOffset][0] = a;
+        edges[edgeOffset][1] = b;
+        edgeOffset = (edgeOffset + 1) & (IndexFifoSize - 1);
+    }
+
+    int findVertex(unsigned int v) const
+    {
+        for (int i = 0; i < IndexFifoSize; ++i) {
+            if (vertices[(vertexOffset - 1 - i) & (IndexFifoSize - 1)] == v) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void pushVertex(unsigned int v)
+    {
+        vertices[vertexOffset] = v;
+        vertexOffset = (vertexOffset + 1) & (IndexFifoSize - 1);
+    }
+};
+
+// 7 bits per byte, lowest first, top bit set while more follow
+void encodeVByte(unsigned char *&data, unsigned int v)
+{
+    do {
+        *data++ = static_cast<unsigned char>((v & 127) | (v > 127 ? 128 : 0));
+        v >>= 7;
+    } while (v);
+}
+
+// Indices the FIFOs can't name are stored as zigzag differences from the last one stored
+void encodeIndex(unsigned char *&data, unsigned int index, unsigned int last)
+{
+    const unsigned int d = index - last;
+    encodeVByte(data, (d << 1) ^ static_cast<unsigned int>(static_cast<int>(d) >> 31));
+}
+
+int codeAuxIndex(unsigned char v)
+{
+    for (int i = 0; i < 16; ++i) {
+        if (CodeAuxTable[i] == v) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t vertexBlockSize(size_t vertexSize)
+{
+    size_t result = VertexBlockBytes / vertexSize;
+    result &= ~(ByteGroupSize - 1);
+    return result < VertexBlockMaxSize ? result : VertexBlockMaxSize;
+}
+
+inline unsigned char zigzag8(unsigned char v)
+{
+    return static_cast<unsigned char>((static_cast<signed char>(v) >> 7) ^ (v << 1));
+}
+
+// Bytes a group of 16 deltas takes when packed with the given bits per value (0, 2, 4 or 8).
+// Values that don't fit are stored whole after the packed bits.
+size_t groupSize(const unsigned char *group, int bits)
+{
+    if (bits == 0) {
+        for (size_t i = 0; i < ByteGroupSize; ++i) {
+            if (group[i]) {
+                return size_t(-1);
+            }
+        }
+        return 0;
+    }
+    if (bits == 8) {
+        return ByteGroupSize;
+    }
+    size_t result = ByteGroupSize * bits / 8;
+    const unsigned char sentinel = static_cast<unsigned char>((1 << bits) - 1);
+    for (size_t i = 0; i < ByteGroupSize; ++i) {
+        result += group[i] >= sentinel;
+    }
+    return result;
+}
+
+unsigned char *encodeGroup(unsigned char *data, const unsigned char *group, int bits)
+{
+    if (bits == 0) {
+        return data;
+    }
+    if (bits == 8) {
+        std::memcpy(data, group, ByteGroupSize);
+        return data + ByteGroupSize;
+    }
+
+    // Packed values come first, highest bits first, then the values that didn't fit
+    const size_t perByte = 8 / bits;
+    const unsigned char sentinel = static_cast<unsigned char>((1 << bits) - 1);
+    for (size_t i = 0; i < ByteGroupSize; i += perByte) {
+        unsigned char byte = 0;
+        for (size_t k = 0; k < perByte; ++k) {
+            const unsigned char value = group[i + k] >= sentinel ? sentinel : group[i + k];
+            byte = static_cast<unsigned char>((byte << bits) | value);
+        }
+        *data++ = byte;
+    }
+    for (size_t i = 0; i < ByteGroupSize; ++i) {
+        if (group[i] >= sentinel) {
+            *data++ = group[i];
+        }
+    }
+    return data;
+}
+
+// A header of 2 bits per group (the packing chosen) followed by the groups
+unsigned char *encodeBytes(unsigned char *data, const unsigned char *buffer, size_t bufferSize)
+{
+    unsigned char *header = data;
+    const size_t headerSize = (bufferSize / ByteGroupSize + 3) / 4;
+    std::memset(header, 0, headerSize);
+    data += headerSize;
+
+    for (size_t i = 0; i < bufferSize; i += ByteGroupSize) {
+        static const int choices[4] = {0, 2, 4, 8};
+        int best = 3;
+        size_t bestSize = groupSize(buffer + i, 8);
+        for (int choice = 0; choice < 3; ++choice) {
+            const size_t size = groupSize(buffer + i, choices[choice]);
+            if (size < bestSize) {
+                best = choice;
+                bestSize = size;
+            }
+        }
+        const size_t group = i / ByteGroupSize;
+        header[group / 4] |= static_cast<unsigned char>(best << ((group % 4) * 2));
+        data = encodeGroup(data, buffer + i, choices[best]);
+    }
+    return data;
+}
+
+// One block of vertices, byte column by byte column: each byte as the zigzag difference from the
+// same byte of the previous vertex
+unsigned char *encodeVertexBlock(unsigned char *data, const unsigned char *vertices, size_t count, size_t vertexSize,
+                                 unsigned char lastVertex[256])
+{
+    unsigned char buffer[VertexBlockMaxSize];
+    std::memset(buffer, 0, sizeof(buffer));
+    const size_t alignedCount = (count + ByteGroupSize - 1) & ~(ByteGroupSize - 1);
+
+    for (size_t k = 0; k < vertexSize; ++k) {
+        unsigned char previous = lastVertex[k];
+        size_t offset = k;
+        for (size_t i = 0; i < count; ++i) {
+            buffer[i] = zigzag8(static_cast<unsigned char>(vertices[offset] - previous));
+            previous = vertices[offset];
+            offset += vertexSize;
+        }
+        data = encodeBytes(data, buffer, alignedCount);
+    }
+    std::memcpy(lastVertex, vertices + vertexSize * (count - 1), vertexSize);
+    return data;
+}
+
+// Read one encodeVByte value (at most 5 bytes, so damaged data can't run on)
+unsigned int decodeVByte(const unsigned char *&data)
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const unsigned char byte = *data++;
+        result |= unsigned(byte & 127) << shift;
+        if (!(byte & 128)) {
+            break;
+        }
+    }
+    return result;
+}
+
+unsigned int decodeIndex(const unsigned char *&data, unsigned int last)
+{
+    const unsigned int v = decodeVByte(data);
+    return last + ((v >> 1) ^ (0u - (v & 1)));
+}
+
+inline unsigned char unzigzag8(unsigned char v)
+{
+    return static_cast<unsigned char>((v >> 1) ^ (0u - (v & 1)));
+}
+
+// Undo encodeGroup for 16 values
+const unsigned char *decodeGroup(const unsigned char *data, unsigned char *group, int bits)
+{
+    if (bits == 0) {
+        std::memset(group, 0, ByteGroupSize);
+        return data;
+    }
+    if (bits == 8) {
+        std::memcpy(group, data, ByteGroupSize);
+        return data + ByteGroupSize;
+    }
+
+    // Written out for each width, and without branches on the sentinel, since this is the hot loop
+    const unsigned char *extra;
+    if (bits == 2) {
+        extra = data + 4;
+        for (size_t i = 0; i < ByteGroupSize; ++i) {
+            const unsigned char value = (data[i / 4] >> (6 - 2 * (i % 4))) & 3;
+            const unsigned char whole = *extra;
+            group[i] = value == 3 ? whole : value;
+            extra += value == 3;
+        }
+    } else {
+        extra = data + 8;
+        for (size_t i = 0; i < ByteGroupSize; ++i) {
+            const unsigned char value = (data[i / 2] >> (4 - 4 * (i % 2))) & 15;
+            const unsigned char whole = *extra;
+            group[i] = value == 15 ? whole : value;
+            extra += value == 15;
+        }
+    }
+    return extra;
+}
+
+// Undo encodeBytes. end is where the tail starts; returns nullptr if the groups run past it.
+const unsigned char *decodeBytes(const unsigned char *data, const unsigned char *end, unsigned char *buffer,
+                                 size_t bufferSize)
+{
+    const size_t headerSize = (bufferSize / ByteGroupSize + 3) / 4;
+    if (size_t(end - data) < headerSize) {
+        return nullptr;
+    }
+    const unsigned char *header = data;
+    data += headerSize;
+
+    static const int choices[4] = {0, 2, 4, 8};
+    for (size_t i = 0; i < bufferSize; i += ByteGroupSize) {
+        // A group reads at most 24 bytes, and the 32 byte tail after end keeps that inside the buffer
+        if (data > end) {
+            return nullptr;
+        }
+        const size_t group = i / ByteGroupSize;
+        const int choice = (header[group / 4] >> ((group % 4) * 2)) & 3;
+        data = decodeGroup(data, buffer + i, choices[choice]);
+    }
+    return data;
+}
+
+} // namespace
+
+namespace MeshCodec {
+
+std::vector<unsigned int> optimizeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount)
+{
+    const size_t triangleCount = indexCount / 3;
+
+    // Triangles around every vertex
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        offsets[indices[i] + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<unsigned int> adjacency(indexCount);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) {
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    // Tipsify (Sander, Nehab, Barczak 2007): emit all triangles around one vertex, then move on to
+    // the candidate that will still be in the cache when its remaining triangles are emitted
+    std::vector<unsigned int> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    deadEnds.reserve(triangleCount * 3);
+
+    unsigned int time = CacheSize + 1;
+    size_t cursor = 0;
+    long long fan = -1;
+    while (cursor < vertexCount && live[cursor] == 0) {
+        cursor++;
+    }
+    if (cursor < vertexCount) {
+        fan = static_cast<long long>(cursor);
+    }
+
+    while (fan >= 0) {
+        candidates.clear();
+        for (unsigned int j = offsets[fan]; j < offsets[fan + 1]; ++j) {
+            const unsigned int t = adjacency[j];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = 1;
+            for (int k = 0; k < 3; ++k) {
+                const unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - timestamp[v] > CacheSize) {
+                    timestamp[v] = time++;
+                }
+            }
+        }
+
+        fan = -1;
+        unsigned int bestPriority = 0;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            unsigned int priority = 0;
+            if (time - timestamp[v] + 2 * live[v] <= CacheSize) {
+                priority = time - timestamp[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fan = v;
+            }
+        }
+
+        // Nothing good nearby: go back to a recently used vertex with triangles left, or the next one in order
+        while (fan < 0 && !deadEnds.empty()) {
+            const unsigned int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v] > 0) {
+                fan = v;
+            }
+        }
+        while (fan < 0 && cursor < vertexCount) {
+            if (live[cursor] > 0) {
+                fan = static_cast<long long>(cursor);
+            } else {
+                cursor++;
+            }
+        }
+    }
+    return result;
+}
+
+size_t optimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int> &remap)
+{
+    remap.assign(vertexCount, ~0u);
+    unsigned int next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        unsigned int &target = remap[indices[i]];
+        if (target == ~0u) {
+            target = next++;
+        }
+        indices[i] = target;
+    }
+    return next;
+}
+
+std::vector<unsigned char> encodeIndexBuffer(const unsigned int *indices, size_t indexCount)
+{
+    // One code byte per triangle plus at most 16 bytes of extra data, and the table at the end
+    const size_t triangleCount = indexCount / 3;
+    std::vector<unsigned char> buffer(1 + triangleCount * 17 + 16);
+    buffer[0] = IndexHeader;
+
+    IndexFifos fifo;
+    unsigned int next = 0;
+    unsigned int last = 0;
+    unsigned char *code = buffer.data() + 1;
+    unsigned char *data = code + triangleCount;
+
+    for (size_t i = 0; i < indexCount; i += 3) {
+        const int edge = fifo.findEdge(indices[i], indices[i + 1], indices[i + 2]);
+        if (edge >= 0 && (edge >> 2) < 15) {
+            // Shares an edge with a recent triangle: name the edge and the third vertex
+            const unsigned int *order = TriangleRotation[edge & 3];
+            const unsigned int a = indices[i + order[0]];
+            const unsigned int b = indices[i + order[1]];
+            const unsigned int c = indices[i + order[2]];
+
+            const int fc = fifo.findVertex(c);
+            int fec = (fc >= 1 && fc < RecentVertexCodes) ? fc : (c == next) ? (next++, 0) : 15;
+            if (fec == 15 && c + 1 == last) {
+                fec = 13;
+                last = c;
+            }
+            if (fec == 15 && c == last + 1) {
+                fec = 14;
+                last = c;
+            }
+            *code++ = static_cast<unsigned char>(((edge >> 2) << 4) | fec);
+            if (fec == 15) {
+                encodeIndex(data, c, last);
+                last = c;
+            }
+            if (fec == 0 || fec >= RecentVertexCodes) {
+                fifo.pushVertex(c);
+            }
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+        } else {
+            // A new triangle: rotate so it starts with the next new vertex if it has one
+            const int rotation = (indices[i + 1] == next) ? 1 : (indices[i + 2] == next) ? 2 : 0;
+            const unsigned int *order = TriangleRotation[rotation];
+            const unsigned int a = indices[i + order[0]];
+            const unsigned int b = indices[i + order[1]];
+            const unsigned int c = indices[i + order[2]];
+
+            // 0, 1, 2 after other vertices means the numbering starts over (several meshes in one list)
+            bool reset = false;
+            if (a == 0 && b == 1 && c == 2 && next > 0) {
+                reset = true;
+                next = 0;
+                std::memset(fifo.vertices, -1, sizeof(fifo.vertices));
+            }
+
+            const int fb = fifo.findVertex(b);
+            const int fc = fifo.findVertex(c);
+            const int fea = (a == next) ? (next++, 0) : 15;
+            const int feb = (fb >= 0 && fb < 14) ? (fb + 1) : (b == next) ? (next++, 0) : 15;
+            const int fec = (fc >= 0 && fc < 14) ? (fc + 1) : (c == next) ? (next++, 0) : 15;
+
+            const unsigned char codeAux = static_cast<unsigned char>((feb << 4) | fec);
+            const int auxIndex = codeAuxIndex(codeAux);
+            if (fea == 0 && auxIndex >= 0 && auxIndex < 14 && !reset) {
+                *code++ = static_cast<unsigned char>((15 << 4) | auxIndex);
+            } else {
+                *code++ = static_cast<unsigned char>((15 << 4) | 14 | fea);
+                *data++ = codeAux;
+            }
+
+            if (fea == 15) {
+                encodeIndex(data, a, last);
+                last = a;
+            }
+            if (feb == 15) {
+                encodeIndex(data, b, last);
+                last = b;
+            }
+            if (fec == 15) {
+                encodeIndex(data, c, last);
+                last = c;
+            }
+            if (fea == 0 || fea == 15) {
+                fifo.pushVertex(a);
+            }
+            if (feb == 0 || feb == 15) {
+                fifo.pushVertex(b);
+            }
+            if (fec == 0 || fec == 15) {
+                fifo.pushVertex(c);
+            }
+            fifo.pushEdge(b, a);
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+        }
+    }
+
+    // The table doubles as padding, so the decoder may read 16 bytes ahead without checks
+    std::memcpy(data, CodeAuxTable, 16);
+    data += 16;
+    buffer.resize(size_t(data - buffer.data()));
+    return buffer;
+}
+
+std::vector<unsigned char> encodeVertexBuffer(const void *vertices, size_t vertexCount, size_t vertexSize)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(vertices);
+    const size_t blockSize = vertexBlockSize(vertexSize);
+    const size_t blockCount = (vertexCount + blockSize - 1) / blockSize;
+    const size_t blockHeaderSize = (blockSize / ByteGroupSize + 3) / 4;
+    const size_t tailSize = vertexSize < TailMinSize ? TailMinSize : vertexSize;
+    std::vector<unsigned char> buffer(1 + blockCount * vertexSize * (blockHeaderSize + blockSize) + tailSize);
+
+    unsigned char *data = buffer.data();
+    *data++ = VertexHeader;
+
+    unsigned char firstVertex[256] = {};
+    if (vertexCount > 0) {
+        std::memcpy(firstVertex, bytes, vertexSize);
+    }
+    unsigned char lastVertex[256];
+    std::memcpy(lastVertex, firstVertex, sizeof(lastVertex));
+
+    for (size_t offset = 0; offset < vertexCount; offset += blockSize) {
+        const size_t count = offset + blockSize < vertexCount ? blockSize : vertexCount - offset;
+        data = encodeVertexBlock(data, bytes + offset * vertexSize, count, vertexSize, lastVertex);
+    }
+
+    // The first vertex goes at the end, padded to 32 bytes, which also keeps the decoder's reads in bounds
+    if (vertexSize < tailSize) {
+        std::memset(data, 0, tailSize - vertexSize);
+        data += tailSize - vertexSize;
+    }
+    std::memcpy(data, firstVertex, vertexSize);
+    data += vertexSize;
+    buffer.resize(size_t(data - buffer.data()));
+    return buffer;
+}
+
+bool decodeIndexBuffer(unsigned int *indices, size_t indexCount, const unsigned char *buffer, size_t bufferSize)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (indexCount % 3 != 0 || bufferSize < 1 + triangleCount + 16 || buffer[0] != IndexHeader) {
+        return false;
+    }
+
+    IndexFifos fifo;
+    unsigned int next = 0;
+    unsigned int last = 0;
+    const unsigned char *code = buffer + 1;
+    const unsigned char *data = code + triangleCount;
+    const unsigned char *table = buffer + bufferSize - 16;
+
+    for (size_t i = 0; i < indexCount; i += 3) {
+        // A triangle reads at most 16 bytes of extra data, which the table keeps inside the buffer
+        if (data > table) {
+            return false;
+        }
+        const unsigned char triangleCode = *code++;
+        if (triangleCode < 0xf0) {
+            // Recent edge plus a third vertex
+            const unsigned int *edge = fifo.edges[(fifo.edgeOffset - 1 - (triangleCode >> 4)) & (IndexFifoSize - 1)];
+            const unsigned int a = edge[0];
+            const unsigned int b = edge[1];
+            const int fec = triangleCode & 15;
+            unsigned int c;
+            if (fec == 0) {
+                c = next++;
+                fifo.pushVertex(c);
+            } else if (fec < RecentVertexCodes) {
+                c = fifo.vertices[(fifo.vertexOffset - 1 - fec) & (IndexFifoSize - 1)];
+            } else {
+                c = fec == 13 ? last - 1 : fec == 14 ? last + 1 : decodeIndex(data, last);
+                last = c;
+                fifo.pushVertex(c);
+            }
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+            indices[i] = a;
+            indices[i + 1] = b;
+            indices[i + 2] = c;
+        } else {
+            // New triangle, its vertex codes either from the table or in the data
+            int fea = 0;
+            unsigned char codeAux;
+            if (triangleCode < 0xfe) {
+                codeAux = table[triangleCode & 15];
+            } else {
+                codeAux = *data++;
+                fea = triangleCode == 0xfe ? 0 : 15;
+                if (codeAux == 0 && fea == 0) {
+                    next = 0;  // Numbering starts over
+                }
+            }
+            const int feb = codeAux >> 4;
+            const int fec = codeAux & 15;
+
+            unsigned int a = fea == 0 ? next++ : 0;
+            unsigned int b = feb == 0 ? next++ : feb < 15 ? fifo.vertices[(fifo.vertexOffset - feb) & (IndexFifoSize - 1)] : 0;
+            unsigned int c = fec == 0 ? next++ : fec < 15 ? fifo.vertices[(fifo.vertexOffset - fec) & (IndexFifoSize - 1)] : 0;
+            if (fea == 15) {
+                a = last = decodeIndex(data, last);
+            }
+            if (feb == 15) {
+                b = last = decodeIndex(data, last);
+            }
+            if (fec == 15) {
+                c = last = decodeIndex(data, last);
+            }
+
+            fifo.pushVertex(a);
+            if (feb == 0 || feb == 15) {
+                fifo.pushVertex(b);
+            }
+            if (fec == 0 || fec == 15) {
+                fifo.pushVertex(c);
+            }
+            fifo.pushEdge(b, a);
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+            indices[i] = a;
+            indices[i + 1] = b;
+            indices[i + 2] = c;
+        }
+    }
+    return data <= table;
+}
+
+bool decodeVertexBuffer(void *vertices, size_t vertexCount, size_t vertexSize, const unsigned char *buffer,
+                        size_t bufferSize)
+{
+    if (vertexSize == 0 || vertexSize % 4 != 0 || vertexSize > VertexBlockMaxSize) {
+        return false;
+    }
+    const size_t tailSize = vertexSize < TailMinSize ? TailMinSize : vertexSize;
+    if (bufferSize < 1 + tailSize || buffer[0] != VertexHeader) {
+        return false;
+    }
+
+    unsigned char *output = static_cast<unsigned char *>(vertices);
+    const unsigned char *data = buffer + 1;
+    const unsigned char *tail = buffer + bufferSize - tailSize;
+    const size_t blockSize = vertexBlockSize(vertexSize);
+    unsigned char lastVertex[256];
+    std::memcpy(lastVertex, buffer + bufferSize - vertexSize, vertexSize);
+    unsigned char deltas[VertexBlockMaxSize];
+
+    for (size_t offset = 0; offset < vertexCount; offset += blockSize) {
+        const size_t count = offset + blockSize < vertexCount ? blockSize : vertexCount - offset;
+        const size_t alignedCount = (count + ByteGroupSize - 1) & ~(ByteGroupSize - 1);
+        unsigned char *block = output + offset * vertexSize;
+        for (size_t k = 0; k < vertexSize; ++k) {
+            data = decodeBytes(data, tail, deltas, alignedCount);
+            if (!data) {
+                return false;
+            }
+            unsigned char value = lastVertex[k];
+            unsigned char *target = block + k;
+            for (size_t i = 0; i < count; ++i) {
+                value = static_cast<unsigned char>(value + unzigzag8(deltas[i]));
+                *target = value;
+                target += vertexSize;
+            }
+        }
+        std::memcpy(lastVertex, block + vertexSize * (count - 1), vertexSize);
+    }
+    return data == tail;
+}
+
+} // namespace MeshCodec
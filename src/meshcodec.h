@@ -0,0 +1,42 @@
+#ifndef MESHCODEC_H
+#define MESHCODEC_H
+
+#include <cstddef>
+#include <vector>
+
+// Reordering and compression of indexed triangle meshes for files that are meant to be small and
+// quick to unpack (glTF for web viewers, mesh archives).
+//
+// The encoders write the vertex and index bitstreams of the glTF EXT_meshopt_compression extension
+// (vertex codec version 0, index codec version 1), so browsers decode them with the standard
+// meshopt decoder. Both work best on a mesh that went through optimizeVertexCache and then
+// optimizeVertexFetch: triangles then reuse recent vertices and vertices appear in the order they
+// are first used, which is what the codecs predict.
+namespace MeshCodec {
+
+// Reorder triangles so neighbouring triangles share vertices (Tipsify, with a 16 entry cache).
+// Triangle winding is kept. Returns the new index list.
+std::vector<unsigned int> optimizeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount);
+
+// Number vertices in the order the index list first uses them. Fills remap (old -> new, ~0u for
+// vertices no triangle uses), rewrites indices in place and returns the number of vertices kept.
+size_t optimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount,
+                           std::vector<unsigned int> &remap);
+
+// Compress a triangle list (three indices per triangle)
+std::vector<unsigned char> encodeIndexBuffer(const unsigned int *indices, size_t indexCount);
+
+// Compress vertexCount records of vertexSize bytes each (a multiple of 4, at most 256)
+std::vector<unsigned char> encodeVertexBuffer(const void *vertices, size_t vertexCount, size_t vertexSize);
+
+// Undo encodeIndexBuffer. Returns false if the data is damaged; indices are not range checked,
+// a damaged stream can name any vertex.
+bool decodeIndexBuffer(unsigned int *indices, size_t indexCount, const unsigned char *buffer, size_t bufferSize);
+
+// Undo encodeVertexBuffer into vertexCount * vertexSize bytes. Returns false if the data is damaged.
+bool decodeVertexBuffer(void *vertices, size_t vertexCount, size_t vertexSize, const unsigned char *buffer,
+                        size_t bufferSize);
+
+} // namespace MeshCodec
+
+#endif // MESHCODEC_H
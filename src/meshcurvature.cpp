@@ -0,0 +1,182 @@
+#include "meshcurvature.h"
+#include "meshtopology.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// What the triangles around one vertex add up to
+struct VertexSums {
+    QVector3D laplacian;    // Sum of cot weights * (vertex - neighbour)
+    QVector3D normal;       // Area-weighted face normals, to tell convex from concave
+    float area = 0.0f;      // Mixed Voronoi area
+    float angles = 0.0f;    // Sum of the corner angles at the vertex
+};
+
+float cotangent(const QVector3D& a, const QVector3D& b)
+{
+    float sine = QVector3D::crossProduct(a, b).length();
+    return sine > 1e-20f ? QVector3D::dotProduct(a, b) / sine : 0.0f;
+}
+
+// Value below which `fraction` of the magnitudes lie (a robust colour range that ignores spikes)
+float magnitudePercentile(const QVector<float>& values, const std::vector<unsigned char>& skip, float fraction)
+{
+    std::vector<float> magnitudes;
+    magnitudes.reserve(values.size());
+    for (int i = 0; i < values.size(); ++i) {
+        if (!skip[i]) {
+            magnitudes.push_back(std::fabs(values[i]));
+        }
+    }
+    if (magnitudes.empty()) {
+        return 0.0f;
+    }
+    size_t n = qMin(magnitudes.size() - 1, size_t(fraction * magnitudes.size()));
+    std::nth_element(magnitudes.begin(), magnitudes.begin() + n, magnitudes.end());
+    return magnitudes[n];
+}
+
+} // namespace
+
+MeshCurvature::Report MeshCurvature::compute(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                                             QVector<float>& meanCurvature, QVector<float>& gaussianCurvature,
+                                             float displayScale, const QVector3D& displayOffset)
+{
+    Report report;
+    meanCurvature.clear();
+    gaussianCurvature.clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const int vertexCount = vertexData.size() / 6;
+    const int triangleCount = indices.size() / 3;
+    if (vertexCount == 0 || triangleCount == 0 || displayScale <= 0.0f) {
+        qWarning() << "MeshCurvature: needs a welded mesh with triangles";
+        return report;
+    }
+
+    // Positions back in file units
+    std::vector<QVector3D> positions(vertexCount);
+    const float* source = vertexData.constData();
+    Parallel::forEach(vertexCount, [&](qint64 v) {
+        positions[v] = QVector3D(source[v * 6], source[v * 6 + 1], source[v * 6 + 2]) / displayScale - displayOffset;
+    });
+
+    // Gather every triangle's share into its three vertices. Each thread owns a range of vertices and
+    // only adds the corners that land in it, so one shared array is enough and no atomics or locks
+    // are needed. A thread still reads all the indices, but skips triangles outside its range before
+    // doing any maths; a triangle is worked out at most three times (once per range it touches).
+    std::vector<VertexSums> sums(vertexCount);
+    const unsigned int* indexData = indices.constData();
+
+    Parallel::forChunks(vertexCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 t = 0; t < triangleCount; ++t) {
+            unsigned int id[3] = { indexData[t * 3], indexData[t * 3 + 1], indexData[t * 3 + 2] };
+            bool mine[3];
+            for (int k = 0; k < 3; ++k) {
+                mine[k] = id[k] >= begin && id[k] < end;
+            }
+            if (!mine[0] && !mine[1] && !mine[2]) {
+                continue;
+            }
+            if (id[0] >= unsigned(vertexCount) || id[1] >= unsigned(vertexCount) || id[2] >= unsigned(vertexCount)) {
+                continue;
+            }
+            const QVector3D p[3] = { positions[id[0]], positions[id[1]], positions[id[2]] };
+            QVector3D faceNormal = QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+            float area = 0.5f * faceNormal.length();
+            if (!(area > 0.0f)) {
+                continue;
+            }
+
+            // Angle and cotangent at every corner
+            float angle[3];
+            float cot[3];
+            for (int k = 0; k < 3; ++k) {
+                QVector3D toNext = p[(k + 1) % 3] - p[k];
+                QVector3D toPrevious = p[(k + 2) % 3] - p[k];
+                float cosine = QVector3D::dotProduct(toNext.normalized(), toPrevious.normalized());
+                angle[k] = std::acos(qBound(-1.0f, cosine, 1.0f));
+                cot[k] = cotangent(toNext, toPrevious);
+            }
+            const float halfPi = 1.57079632679f;
+            bool obtuse = angle[0] > halfPi || angle[1] > halfPi || angle[2] > halfPi;
+
+            for (int k = 0; k < 3; ++k) {
+                if (!mine[k]) {
+                    continue;
+                }
+                int next = (k + 1) % 3;
+                int previous = (k + 2) % 3;
+                QVector3D toNext = p[next] - p[k];
+                QVector3D toPrevious = p[previous] - p[k];
+
+                // The edge to `next` is opposite the angle at `previous`, and the other way round
+                VertexSums& s = sums[id[k]];
+                s.laplacian -= cot[previous] * toNext + cot[next] * toPrevious;
+                s.normal += faceNormal;
+                s.angles += angle[k];
+
+                // Mixed area: the Voronoi region for non-obtuse triangles, otherwise a fixed share
+                if (!obtuse) {
+                    s.area += 0.125f * (toNext.lengthSquared() * cot[previous] + toPrevious.lengthSquared() * cot[next]);
+                } else {
+                    s.area += angle[k] > halfPi ? 0.5f * area : 0.25f * area;
+                }
+            }
+        }
+    }, 4096);
+
+    // Open edges: the angle defect and Laplacian are not meaningful on the border
+    MeshTopology topology;
+    topology.build(indices);
+    std::vector<unsigned char> boundary(vertexCount, 0);
+    for (int e = 0; e < topology.getEdgeCount(); ++e) {
+        if (topology.edgeFaceCount(e) != 2) {
+            boundary[topology.edgeStart(e)] = 1;
+            boundary[topology.edgeEnd(e)] = 1;
+        }
+    }
+
+    meanCurvature.resize(vertexCount);
+    gaussianCurvature.resize(vertexCount);
+    float* meanData = meanCurvature.data();
+    float* gaussianData = gaussianCurvature.data();
+    std::vector<int> boundaryPerThread(Parallel::threadCount(), 0);
+
+    Parallel::forChunks(vertexCount, [&](qint64 begin, qint64 end, int thread) {
+        for (qint64 v = begin; v < end; ++v) {
+            const VertexSums& s = sums[v];
+
+            if (boundary[v] || !(s.area > 0.0f)) {
+                meanData[v] = 0.0f;
+                gaussianData[v] = 0.0f;
+                boundaryPerThread[thread] += boundary[v];
+                continue;
+            }
+
+            // The cotangent sum is 2A times the mean curvature normal 2 H n; project on the normal to keep the sign
+            meanData[v] = 0.25f * QVector3D::dotProduct(s.laplacian, s.normal.normalized()) / s.area;
+            gaussianData[v] = (2.0f * 3.14159265359f - s.angles) / s.area;
+        }
+    });
+
+    for (int count : boundaryPerThread) {
+        report.boundaryVertices += count;
+    }
+    report.vertices = vertexCount;
+    report.meanRange = magnitudePercentile(meanCurvature, boundary, 0.98f);
+    report.gaussianRange = magnitudePercentile(gaussianCurvature, boundary, 0.98f);
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshCurvature:" << report.vertices << "vertices in" << report.milliseconds << "ms,"
+             << report.boundaryVertices << "on the boundary, 98% of |H| below" << report.meanRange
+             << "and |K| below" << report.gaussianRange;
+    return report;
+}
@@ -0,0 +1,30 @@
+#ifndef MESHCURVATURE_H
+#define MESHCURVATURE_H
+
+#include <QVector>
+#include <QVector3D>
+
+// Discrete curvature at every vertex of a welded mesh (Meyer et al., "Discrete
+// Differential-Geometry Operators for Triangulated 2-Manifolds"):
+//  - mean curvature from the cotangent Laplacian, positive where the surface bulges outwards
+//  - Gaussian curvature from the angle defect (2 pi minus the angles around the vertex)
+// Both are divided by the vertex's mixed Voronoi area. Works in file units, so the results are
+// in 1/length (mean) and 1/length^2 (Gaussian).
+class MeshCurvature
+{
+public:
+    struct Report {
+        int vertices = 0;              // Vertices with a value
+        int boundaryVertices = 0;      // Vertices on open edges (set to 0, curvature is undefined there)
+        float meanRange = 0.0f;        // 98% of the vertices have |mean curvature| below this
+        float gaussianRange = 0.0f;    // Same for |Gaussian curvature|
+        qint64 milliseconds = 0;       // Time spent
+    };
+
+    // One value per vertex in each output. Needs indices (the loader's merged layout).
+    static Report compute(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                          QVector<float>& meanCurvature, QVector<float>& gaussianCurvature,
+                          float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(0, 0, 0));
+};
+
+#endif // MESHCURVATURE_H
@@ -0,0 +1,131 @@
+#include "meshdeviation.h"
+#include "meshbvh.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Running totals, one per thread
+struct PartialStatistics {
+    float maxAbs = 0.0f;
+    float minSigned = FLT_MAX;
+    float maxSigned = -FLT_MAX;
+    double sumSquares = 0.0;
+    double sum = 0.0;
+    int points = 0;
+};
+
+} // namespace
+
+MeshDeviation::Statistics MeshDeviation::vertexDistances(const QVector<float>& vertexData, float displayScale,
+                                                         const QVector3D& displayOffset, const MeshBVH& surface,
+                                                         bool signedResult, QVector<float>& distances)
+{
+    Statistics statistics;
+    const int vertexCount = vertexData.size() / 6;
+    distances.resize(vertexCount);
+    if (vertexCount == 0 || surface.isEmpty() || displayScale <= 0.0f) {
+        return statistics;
+    }
+    signedResult = signedResult && surface.hasPseudoNormals();
+
+    const float* source = vertexData.constData();
+    float* output = distances.data();
+    std::vector<PartialStatistics> partial(Parallel::threadCount());
+
+    Parallel::forBlocks(vertexCount, 512, [&](qint64 begin, qint64 end, int thread) {
+        PartialStatistics stats = partial[thread];
+
+        // Neighbouring vertices in the buffer are usually close together, so the last distance
+        // plus the step to the next vertex is a safe search radius that prunes most of the tree
+        QVector3D previousPoint;
+        float previousDistance = FLT_MAX;
+
+        for (qint64 v = begin; v < end; ++v) {
+            QVector3D point = QVector3D(source[v * 6], source[v * 6 + 1], source[v * 6 + 2]) / displayScale - displayOffset;
+            float radius = FLT_MAX;
+            if (previousDistance < FLT_MAX) {
+                radius = previousDistance + (point - previousPoint).length();
+                radius += radius * 1e-5f + 1e-12f;
+            }
+
+            MeshBVH::Hit hit;
+            bool found = signedResult ? surface.signedDistance(point, hit, radius) : surface.closestPoint(point, hit, radius);
+            if (!found) {
+                // Rounding left the bound a hair too small; search without it
+                found = signedResult ? surface.signedDistance(point, hit) : surface.closestPoint(point, hit);
+            }
+            float distance = found ? hit.distance : 0.0f;
+            output[v] = distance;
+            previousPoint = point;
+            previousDistance = std::fabs(distance);
+
+            stats.maxAbs = qMax(stats.maxAbs, std::fabs(distance));
+            stats.minSigned = qMin(stats.minSigned, distance);
+            stats.maxSigned = qMax(stats.maxSigned, distance);
+            stats.sumSquares += double(distance) * distance;
+            stats.sum += distance;
+            ++stats.points;
+        }
+        partial[thread] = stats;
+    });
+
+    PartialStatistics total;
+    for (const PartialStatistics& stats : partial) {
+        total.maxAbs = qMax(total.maxAbs, stats.maxAbs);
+        total.minSigned = qMin(total.minSigned, stats.minSigned);
+        total.maxSigned = qMax(total.maxSigned, stats.maxSigned);
+        total.sumSquares += stats.sumSquares;
+        total.sum += stats.sum;
+        total.points += stats.points;
+    }
+
+    statistics.points = total.points;
+    if (total.points > 0) {
+        statistics.hausdorff = total.maxAbs;
+        statistics.rms = float(std::sqrt(total.sumSquares / total.points));
+        statistics.mean = float(total.sum / total.points);
+        statistics.minSigned = total.minSigned;
+        statistics.maxSigned = total.maxSigned;
+    }
+    return statistics;
+}
+
+MeshDeviation::Report MeshDeviation::compare(const QVector<float>& comparedVertexData, float comparedScale,
+                                             const QVector3D& comparedOffset, const MeshBVH& comparedSurface,
+                                             const QVector<float>& referenceVertexData, float referenceScale,
+                                             const QVector3D& referenceOffset, const MeshBVH& referenceSurface,
+                                             QVector<float>& deviation)
+{
+    Report report;
+    QElapsedTimer timer;
+    timer.start();
+
+    if (comparedSurface.isEmpty() || referenceSurface.isEmpty()) {
+        qWarning() << "MeshDeviation: both meshes are needed";
+        deviation.clear();
+        return report;
+    }
+
+    report.signedDistances = referenceSurface.hasPseudoNormals();
+    report.forward = vertexDistances(comparedVertexData, comparedScale, comparedOffset,
+                                     referenceSurface, true, deviation);
+
+    // The other direction only contributes to the statistics
+    QVector<float> backwardDistances;
+    report.backward = vertexDistances(referenceVertexData, referenceScale, referenceOffset,
+                                      comparedSurface, true, backwardDistances);
+
+    report.symmetricHausdorff = qMax(report.forward.hausdorff, report.backward.hausdorff);
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshDeviation:" << report.forward.points << "compared and" << report.backward.points
+             << "reference vertices in" << report.milliseconds << "ms, Hausdorff" << report.forward.hausdorff
+             << "/" << report.backward.hausdorff << "(symmetric" << report.symmetricHausdorff << "), RMS"
+             << report.forward.rms;
+    return report;
+}
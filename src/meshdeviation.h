@@ -0,0 +1,45 @@
+#ifndef MESHDEVIATION_H
+#define MESHDEVIATION_H
+
+#include <QVector>
+#include <QVector3D>
+
+class MeshBVH;
+
+// Deviation between two versions of a part (for example a scan against the CAD model):
+// the distance from every vertex of one mesh to the surface of the other. Both meshes must be in
+// the same coordinate system; distances are in file units.
+class MeshDeviation
+{
+public:
+    // Distances from the vertices of one mesh to the other surface
+    struct Statistics {
+        int points = 0;              // Vertices measured
+        float hausdorff = 0.0f;      // Largest distance (one-sided Hausdorff distance)
+        float rms = 0.0f;            // Root mean square distance
+        float mean = 0.0f;           // Average signed distance (positive = outside the other surface)
+        float minSigned = 0.0f;      // Furthest inside
+        float maxSigned = 0.0f;      // Furthest outside
+    };
+
+    struct Report {
+        Statistics forward;              // Compared mesh -> reference surface (the colour map)
+        Statistics backward;             // Reference mesh -> compared surface
+        float symmetricHausdorff = 0.0f; // Larger of the two one-sided distances
+        bool signedDistances = false;    // False when the reference is not welded and only sizes are known
+        qint64 milliseconds = 0;         // Time spent
+    };
+
+    // Distance from every vertex in a loader buffer (6 floats per vertex, display = (file + offset) * scale)
+    // to a surface. Fills one value per vertex.
+    static Statistics vertexDistances(const QVector<float>& vertexData, float displayScale, const QVector3D& displayOffset,
+                                      const MeshBVH& surface, bool signedResult, QVector<float>& distances);
+
+    // Both directions at once. `deviation` gets the signed distance of every compared vertex.
+    static Report compare(const QVector<float>& comparedVertexData, float comparedScale, const QVector3D& comparedOffset,
+                          const MeshBVH& comparedSurface,
+                          const QVector<float>& referenceVertexData, float referenceScale, const QVector3D& referenceOffset,
+                          const MeshBVH& referenceSurface, QVector<float>& deviation);
+};
+
+#endif // MESHDEVIATION_H
@@ -0,0 +1,397 @@
+#include "meshdistancefield.h"
+#include "meshbvh.h"
+#include "parallel.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtEndian>
+#include <qfloat16.h>
+#include <cmath>
+#include <vector>
+
+// Binary layout written by save() (all little endian):
+//   char[4]   magic "SDF1"
+//   quint32   version (2)
+//   qint32    sizeX, sizeY, sizeZ
+//   float     originX, originY, originZ   (position of grid point 0,0,0 in file units)
+//   float     voxelSize                  (spacing between grid points)
+//   float     bandWidth                  (distances up to this are exact)
+//   quint32   flags                      (bit 0: narrow band, values are clamped to +/- bandWidth)
+//   quint16   sizeX * sizeY * sizeZ half-precision floats, X fastest, then Y, then Z. They hold
+//             distances in voxels: multiply by voxelSize for file units. (Version 1 stored file
+//             units, which overflow half precision at 65504 in models measured in microns.)
+
+namespace {
+
+const char FileMagic[4] = { 'S', 'D', 'F', '1' };
+const quint32 FileVersion = 2;
+const quint32 FlagNarrowBand = 1;
+
+} // namespace
+
+MeshDistanceField::MeshDistanceField()
+    : sizeX(0)
+    , sizeY(0)
+    , sizeZ(0)
+    , bricksX(0)
+    , bricksY(0)
+    , voxelSize(0.0f)
+    , bandWidth(0.0f)
+    , mode(NarrowBand)
+{
+}
+
+void MeshDistanceField::clear()
+{
+    values.clear();
+    values.squeeze();
+    std::vector<int>().swap(brickSlots);
+    sizeX = sizeY = sizeZ = 0;
+    bricksX = bricksY = 0;
+    origin = QVector3D();
+    voxelSize = 0.0f;
+    bandWidth = 0.0f;
+}
+
+QVector3D MeshDistanceField::pointPosition(int x, int y, int z) const
+{
+    return origin + QVector3D(float(x), float(y), float(z)) * voxelSize;
+}
+
+float MeshDistanceField::sample(const QVector3D& position) const
+{
+    if (isEmpty()) {
+        return 0.0f;
+    }
+
+    // Grid coordinates, clamped so points outside the grid read its border
+    QVector3D g = (position - origin) / voxelSize;
+    float gx = qBound(0.0f, g.x(), float(sizeX - 1));
+    float gy = qBound(0.0f, g.y(), float(sizeY - 1));
+    float gz = qBound(0.0f, g.z(), float(sizeZ - 1));
+    int x0 = qMin(int(gx), sizeX - 2 < 0 ? 0 : sizeX - 2);
+    int y0 = qMin(int(gy), sizeY - 2 < 0 ? 0 : sizeY - 2);
+    int z0 = qMin(int(gz), sizeZ - 2 < 0 ? 0 : sizeZ - 2);
+    int x1 = qMin(x0 + 1, sizeX - 1);
+    int y1 = qMin(y0 + 1, sizeY - 1);
+    int z1 = qMin(z0 + 1, sizeZ - 1);
+    float fx = gx - x0;
+    float fy = gy - y0;
+    float fz = gz - z0;
+
+    float c00 = value(x0, y0, z0) * (1 - fx) + value(x1, y0, z0) * fx;
+    float c10 = value(x0, y1, z0) * (1 - fx) + value(x1, y1, z0) * fx;
+    float c01 = value(x0, y0, z1) * (1 - fx) + value(x1, y0, z1) * fx;
+    float c11 = value(x0, y1, z1) * (1 - fx) + value(x1, y1, z1) * fx;
+    float c0 = c00 * (1 - fy) + c10 * fy;
+    float c1 = c01 * (1 - fy) + c11 * fy;
+    return c0 * (1 - fz) + c1 * fz;
+}
+
+MeshDistanceField::Report MeshDistanceField::build(const MeshBVH& bvh, int resolution, Mode buildMode, int bandVoxels,
+                                                   QString* errorMessage)
+{
+    Report report;
+    clear();
+    mode = buildMode;
+
+    auto fail = [&](const QString& message) {
+        qWarning() << "MeshDistanceField:" << message;
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        clear();
+        return Report();
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (bvh.isEmpty()) {
+        return fail("Nothing to sample");
+    }
+    if (!bvh.hasPseudoNormals()) {
+        qWarning() << "MeshDistanceField: mesh is not welded, inside/outside signs may be wrong";
+    }
+    resolution = qBound(1, resolution, int(MaxResolution));
+    bandVoxels = qMax(1, bandVoxels);
+
+    QVector3D low = bvh.getBoundsMin();
+    QVector3D extent = bvh.getBoundsMax() - low;
+    float longest = qMax(extent.x(), qMax(extent.y(), extent.z()));
+    if (!(longest > 0.0f)) {
+        return fail("The model has no size");
+    }
+
+    // Pad by the band plus one point, so the whole band around the surface fits in the grid
+    int padding = bandVoxels + 1;
+    voxelSize = longest / resolution;
+    bandWidth = bandVoxels * voxelSize;
+    origin = low - QVector3D(padding, padding, padding) * voxelSize;
+    sizeX = int(std::ceil(extent.x() / voxelSize)) + 2 * padding + 1;
+    sizeY = int(std::ceil(extent.y() / voxelSize)) + 2 * padding + 1;
+    sizeZ = int(std::ceil(extent.z() / voxelSize)) + 2 * padding + 1;
+    qint64 pointCount = qint64(sizeX) * sizeY * sizeZ;
+
+    bricksX = (sizeX + BrickSize - 1) / BrickSize;
+    bricksY = (sizeY + BrickSize - 1) / BrickSize;
+    int bricksZ = (sizeZ + BrickSize - 1) / BrickSize;
+    qint64 brickCount = qint64(bricksX) * bricksY * bricksZ;
+
+    // A full field keeps every point, plus two triangle ids per point while jump flooding
+    bool full = (mode == Full);
+    if (full && pointCount * qint64(sizeof(float) + 2 * sizeof(int)) > MaxBytes) {
+        return fail(QString("A full field of %1 x %2 x %3 points needs more than %4 MB; "
+                            "use a lower resolution or a narrow band")
+                        .arg(sizeX).arg(sizeY).arg(sizeZ).arg(MaxBytes >> 20));
+    }
+
+    // Pass 1: one BVH query at the centre of each brick decides whether the surface can come
+    // within the band of any point in it. Only those bricks get exact per-point queries.
+    std::vector<MeshBVH::Hit> centerHits(static_cast<size_t>(brickCount));
+    std::vector<unsigned char> farBrick(size_t(brickCount), 0);
+    auto brickBounds = [&](qint64 b, int& x0, int& x1, int& y0, int& y1, int& z0, int& z1) {
+        int bx = int(b % bricksX);
+        int by = int((b / bricksX) % bricksY);
+        int bz = int(b / (qint64(bricksX) * bricksY));
+        x0 = bx * BrickSize, x1 = qMin(x0 + BrickSize, sizeX) - 1;
+        y0 = by * BrickSize, y1 = qMin(y0 + BrickSize, sizeY) - 1;
+        z0 = bz * BrickSize, z1 = qMin(z0 + BrickSize, sizeZ) - 1;
+    };
+    auto halfDiagonal = [&](int x0, int x1, int y0, int y1, int z0, int z1) {
+        return QVector3D(x1 - x0, y1 - y0, z1 - z0).length() * 0.5f * voxelSize;
+    };
+    Parallel::forBlocks(brickCount, 64, [&](qint64 begin, qint64 end, int) {
+        for (qint64 b = begin; b < end; ++b) {
+            int x0, x1, y0, y1, z0, z1;
+            brickBounds(b, x0, x1, y0, y1, z0, z1);
+            QVector3D center = origin + QVector3D(x0 + x1, y0 + y1, z0 + z1) * (0.5f * voxelSize);
+            bvh.signedDistance(center, centerHits[size_t(b)]);
+            farBrick[size_t(b)] = std::fabs(centerHits[size_t(b)].distance) -
+                                  halfDiagonal(x0, x1, y0, y1, z0, z1) > bandWidth;
+        }
+    });
+
+    // Now we know how much to keep: every point for a full field, the near bricks for a band.
+    // Far bricks of a band only remember which side of the surface they are on.
+    if (full) {
+        values.resize(int(pointCount));
+    } else {
+        brickSlots.resize(size_t(brickCount));
+        int stored = 0;
+        for (qint64 b = 0; b < brickCount; ++b) {
+            if (farBrick[size_t(b)]) {
+                brickSlots[size_t(b)] = centerHits[size_t(b)].distance < 0.0f ? FarInside : FarOutside;
+            } else {
+                brickSlots[size_t(b)] = stored++;
+            }
+        }
+        if (qint64(stored) * BrickPoints * qint64(sizeof(float)) > MaxBytes) {
+            return fail(QString("The band around the surface needs more than %1 MB; "
+                                "use a lower resolution or a narrower band").arg(MaxBytes >> 20));
+        }
+        values.resize(stored * BrickPoints);
+    }
+
+    // In full mode every point remembers which triangle its distance was measured to,
+    // so jump flooding can offer that triangle to the neighbours
+    std::vector<int> closest(full ? size_t(pointCount) : 0, -1);
+
+    float* valueData = values.data();
+    int* closestData = closest.data();
+    std::vector<qint64> exactPerThread(Parallel::threadCount(), 0);
+
+    Parallel::forBlocks(brickCount, 4, [&](qint64 begin, qint64 end, int thread) {
+        qint64 exact = 0;
+        for (qint64 b = begin; b < end; ++b) {
+            int x0, x1, y0, y1, z0, z1;
+            brickBounds(b, x0, x1, y0, y1, z0, z1);
+            const MeshBVH::Hit& centerHit = centerHits[size_t(b)];
+
+            if (farBrick[size_t(b)]) {
+                if (!full) {
+                    continue;  // Nothing stored: the brick slot says which side it is on
+                }
+                // No surface inside the brick, so every point shares the centre's sign
+                float sign = centerHit.distance < 0.0f ? -1.0f : 1.0f;
+                for (int z = z0; z <= z1; ++z) {
+                    for (int y = y0; y <= y1; ++y) {
+                        for (int x = x0; x <= x1; ++x) {
+                            int i = index(x, y, z);
+                            closestData[i] = centerHit.triangle;
+                            valueData[i] = sign * bvh.distanceToTriangle(pointPosition(x, y, z), centerHit.triangle);
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // No point of the brick can be further from the surface than the centre plus the
+            // half diagonal, which lets the BVH skip most of the tree
+            float searchRadius = std::fabs(centerHit.distance) + halfDiagonal(x0, x1, y0, y1, z0, z1) +
+                                 1e-3f * voxelSize;
+            float* brickValues = full ? nullptr : valueData + qint64(brickSlots[size_t(b)]) * BrickPoints;
+            for (int z = z0; z <= z1; ++z) {
+                for (int y = y0; y <= y1; ++y) {
+                    for (int x = x0; x <= x1; ++x) {
+                        MeshBVH::Hit hit;
+                        bvh.signedDistance(pointPosition(x, y, z), hit, searchRadius);
+                        if (full) {
+                            int i = index(x, y, z);
+                            closestData[i] = hit.triangle;
+                            valueData[i] = hit.distance;
+                        } else {
+                            brickValues[inBrick(x, y, z)] = qBound(-bandWidth, hit.distance, bandWidth);
+                        }
+                        ++exact;
+                    }
+                }
+            }
+        }
+        exactPerThread[thread] += exact;
+    });
+    for (qint64 count : exactPerThread) {
+        report.exactPoints += count;
+    }
+
+    // Pass 2 (full mode): jump flooding. Each point in a far brick looks at its six neighbours
+    // `step` points away and takes over their triangle if it is closer. The brick-centre seeds
+    // are already good guesses, so a few passes with shrinking steps are enough.
+    // Triangle ids are double buffered so a pass only ever reads the previous pass's results.
+    if (full) {
+        std::vector<int> nextClosest(closest);
+        const unsigned char* farData = farBrick.data();
+
+        for (int step = BrickSize / 2; step >= 1; step /= 2) {
+            const int* readIds = closest.data();
+            int* writeIds = nextClosest.data();
+
+            Parallel::forBlocks(qint64(sizeY) * sizeZ, 16, [&](qint64 begin, qint64 end, int) {
+                for (qint64 row = begin; row < end; ++row) {
+                    int y = int(row % sizeY);
+                    int z = int(row / sizeY);
+                    qint64 brickRow = (qint64(z / BrickSize) * bricksY + y / BrickSize) * bricksX;
+
+                    for (int x = 0; x < sizeX; ++x) {
+                        int i = index(x, y, z);
+                        if (!farData[brickRow + x / BrickSize]) {
+                            continue;
+                        }
+
+                        QVector3D p = pointPosition(x, y, z);
+                        int best = readIds[i];
+                        float bestDistance = std::fabs(valueData[i]);
+                        const int neighbours[6][3] = {
+                            { x - step, y, z }, { x + step, y, z },
+                            { x, y - step, z }, { x, y + step, z },
+                            { x, y, z - step }, { x, y, z + step }
+                        };
+                        for (const int* n : neighbours) {
+                            if (n[0] < 0 || n[0] >= sizeX || n[1] < 0 || n[1] >= sizeY || n[2] < 0 || n[2] >= sizeZ) {
+                                continue;
+                            }
+                            int candidate = readIds[index(n[0], n[1], n[2])];
+                            if (candidate == best || candidate < 0) {
+                                continue;
+                            }
+                            float d = bvh.distanceToTriangle(p, candidate);
+                            if (d < bestDistance) {
+                                bestDistance = d;
+                                best = candidate;
+                            }
+                        }
+
+                        writeIds[i] = best;
+                        valueData[i] = valueData[i] < 0.0f ? -bestDistance : bestDistance;
+                    }
+                }
+            });
+            closest.swap(nextClosest);
+        }
+        report.propagatedPoints = pointCount - report.exactPoints;
+    }
+
+    report.sizeX = sizeX;
+    report.sizeY = sizeY;
+    report.sizeZ = sizeZ;
+    report.voxelSize = voxelSize;
+    report.bandWidth = bandWidth;
+    report.bytes = qint64(values.size()) * qint64(sizeof(float)) + qint64(brickSlots.size()) * qint64(sizeof(int));
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshDistanceField:" << sizeX << "x" << sizeY << "x" << sizeZ << "points,"
+             << report.exactPoints << "exact," << report.propagatedPoints << "propagated,"
+             << report.bytes << "bytes in" << report.milliseconds << "ms";
+    return report;
+}
+
+bool MeshDistanceField::save(const QString& fileName, QString* errorMessage) const
+{
+    if (isEmpty()) {
+        if (errorMessage) {
+            *errorMessage = "No distance field to save";
+        }
+        return false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + file.errorString();
+        }
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream.writeRawData(FileMagic, 4);
+    stream << FileVersion;
+    stream << qint32(sizeX) << qint32(sizeY) << qint32(sizeZ);
+    stream << origin.x() << origin.y() << origin.z() << voxelSize << bandWidth;
+    stream << quint32(mode == NarrowBand ? FlagNarrowBand : 0);
+
+    // Convert to half floats in parallel, one Z layer at a time so a narrow band is never
+    // expanded into a full grid in memory. Dividing by the voxel size first keeps the numbers
+    // within a few grid sizes (at most MaxResolution), whatever units the model is in; half
+    // precision keeps about 3 significant digits of them and halves the file size.
+    QVector<qfloat16> layer(sizeX * sizeY);
+    qfloat16* layerData = layer.data();
+    const float toVoxels = 1.0f / voxelSize;
+    const qint64 layerBytes = qint64(layer.size()) * 2;
+    qint64 total = 0;
+    for (int z = 0; z < sizeZ && stream.status() == QDataStream::Ok; ++z) {
+        Parallel::forChunks(sizeY, [&](qint64 begin, qint64 end, int) {
+            std::vector<float> row(static_cast<size_t>(sizeX));
+            for (qint64 y = begin; y < end; ++y) {
+                for (int x = 0; x < sizeX; ++x) {
+                    row[size_t(x)] = value(x, int(y), z) * toVoxels;
+                }
+                qfloat16* out = layerData + y * sizeX;
+                qFloatToFloat16(out, row.data(), sizeX);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+                quint16* bits = reinterpret_cast<quint16*>(out);
+                for (int x = 0; x < sizeX; ++x) {
+                    bits[x] = qToLittleEndian(bits[x]);
+                }
+#endif
+            }
+        }, 16);
+        if (file.write(reinterpret_cast<const char*>(layer.constData()), layerBytes) != layerBytes) {
+            break;
+        }
+        total += layerBytes;
+    }
+
+    if (stream.status() != QDataStream::Ok || total != layerBytes * sizeZ) {
+        if (errorMessage) {
+            *errorMessage = "Error while writing: " + file.errorString();
+        }
+        return false;
+    }
+    file.close();
+
+    qDebug() << "MeshDistanceField: wrote" << fileName << "(" << (total + 48) << "bytes )";
+    return true;
+}
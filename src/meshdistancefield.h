@@ -0,0 +1,110 @@
+#ifndef MESHDISTANCEFIELD_H
+#define MESHDISTANCEFIELD_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include <vector>
+
+class MeshBVH;
+
+// A signed distance field sampled on a regular grid: every grid point stores the distance to
+// the nearest point of the surface, negative inside the model. Works in file units.
+//
+// Grid points are grouped into 8x8x8 bricks. Bricks close to the surface get exact distances
+// from BVH closest-point queries; bricks further away either get clamped to the band width
+// (narrow band) or have their distances spread in from neighbouring points with a few
+// parallel jump-flood passes (full field). A narrow band only stores the bricks near the
+// surface; the others are just "outside" or "inside".
+class MeshDistanceField
+{
+public:
+    enum Mode {
+        NarrowBand,   // Exact inside the band, clamped to +/- band width outside it
+        Full          // Exact inside the band, propagated everywhere else
+    };
+
+    static const int BrickSize = 8;        // Grid points per brick along each axis
+    static const int BrickPoints = BrickSize * BrickSize * BrickSize;
+    static const int MaxResolution = 1024;
+    static const qint64 MaxBytes = qint64(2) << 30;  // Largest grid build() will allocate
+
+    // What the builder made and how long it took
+    struct Report {
+        int sizeX = 0;                   // Grid points along each axis
+        int sizeY = 0;
+        int sizeZ = 0;
+        float voxelSize = 0.0f;          // Spacing between grid points in file units
+        float bandWidth = 0.0f;          // Distances up to this are exact
+        qint64 exactPoints = 0;          // Points computed with a BVH query
+        qint64 propagatedPoints = 0;     // Points filled in by jump flooding (full mode)
+        qint64 bytes = 0;                // Memory used by the grid (stored bricks only for a narrow band)
+        qint64 milliseconds = 0;         // Time spent
+    };
+
+    MeshDistanceField();
+    void clear();
+    bool isEmpty() const { return sizeX == 0; }
+
+    // Sample the field with `resolution` grid steps along the longest side of the model.
+    // The grid is padded by bandVoxels + 1 points on every side. Fails (leaving the field empty)
+    // if the model has no size or the grid would need more than MaxBytes.
+    Report build(const MeshBVH& bvh, int resolution, Mode mode, int bandVoxels = 4,
+                 QString* errorMessage = nullptr);
+
+    // Grid geometry (point (0,0,0) sits at origin, point (x,y,z) at origin + (x,y,z) * voxelSize)
+    int getSizeX() const { return sizeX; }
+    int getSizeY() const { return sizeY; }
+    int getSizeZ() const { return sizeZ; }
+    QVector3D getOrigin() const { return origin; }
+    float getVoxelSize() const { return voxelSize; }
+    float getBandWidth() const { return bandWidth; }
+    Mode getMode() const { return mode; }
+    QVector3D pointPosition(int x, int y, int z) const;
+
+    // Distance stored at one grid point, and a trilinear sample anywhere inside the grid
+    float value(int x, int y, int z) const
+    {
+        if (brickSlots.empty()) {
+            return values[index(x, y, z)];
+        }
+        const int slot = brickSlots[size_t(brick(x, y, z))];
+        if (slot < 0) {
+            return slot == FarInside ? -bandWidth : bandWidth;
+        }
+        return values[slot * BrickPoints + inBrick(x, y, z)];
+    }
+    float sample(const QVector3D& position) const;
+
+    // Write the field as a compact binary file: a small header followed by half-precision
+    // distances in voxels.
+    // See meshdistancefield.cpp for the layout.
+    bool save(const QString& fileName, QString* errorMessage = nullptr) const;
+
+private:
+    // Brick slots of the bricks a narrow band does not store
+    static const int FarOutside = -1;
+    static const int FarInside = -2;
+
+    int index(int x, int y, int z) const { return (z * sizeY + y) * sizeX + x; }
+    qint64 brick(int x, int y, int z) const
+    {
+        return (qint64(z / BrickSize) * bricksY + y / BrickSize) * bricksX + x / BrickSize;
+    }
+    int inBrick(int x, int y, int z) const
+    {
+        return ((z % BrickSize) * BrickSize + y % BrickSize) * BrickSize + x % BrickSize;
+    }
+
+    QVector<float> values;          // Full field: X fastest, then Y, then Z.
+                                    // Narrow band: BrickPoints per stored brick, in brickSlots order
+    std::vector<int> brickSlots;    // Narrow band: stored brick number, FarOutside or FarInside
+    int sizeX, sizeY, sizeZ;
+    int bricksX, bricksY;
+    QVector3D origin;
+    float voxelSize;
+    float bandWidth;
+    Mode mode;
+};
+
+#endif // MESHDISTANCEFIELD_H
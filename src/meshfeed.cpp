@@ -0,0 +1,334 @@
+#include "meshfeed.h"
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#if defined(Q_OS_UNIX)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MESHFEED_HAS_SHARED_MEMORY
+#endif
+
+namespace {
+
+const char Magic[8] = {'M', 'E', 'S', 'H', 'F', 'E', 'E', 'D'};
+const quint32 Version = 1;
+const qint64 HeaderBytes = 64;      // Header, and each slot's own header, padded to a cache line
+const int MaxSlots = 64;
+const int FloatsPerVertex = 6;
+
+enum ProducerState : quint32 {
+    Running = 1,
+    Finished = 2
+};
+
+// The two processes agree on these through the layout described in meshfeed.h. The counters are
+// atomics so each side sees the other's writes in the right order.
+struct FeedHeader {
+    char magic[8];
+    quint32 version;
+    quint32 slotCount;
+    quint64 slotBytes;                  // Data bytes per slot, after the slot header
+    std::atomic<quint64> latest;        // Newest complete frame, 0 before the first
+    std::atomic<quint32> state;
+};
+
+struct SlotHeader {
+    std::atomic<quint64> stamp;         // 2n once frame n is complete, odd while being written
+    quint32 vertexCount;
+    quint32 indexCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+static_assert(sizeof(FeedHeader) <= HeaderBytes && sizeof(SlotHeader) <= HeaderBytes, "headers must fit their padding");
+static_assert(std::atomic<quint64>::is_always_lock_free && std::atomic<quint32>::is_always_lock_free,
+              "counters shared between processes must not need a lock");
+
+// POSIX names are one path component with a leading slash
+QString sharedMemoryName(const QString &name)
+{
+    return name.startsWith('/') ? name : "/" + name;
+}
+
+qint64 slotOffset(quint64 slotBytes, quint64 slot)
+{
+    return HeaderBytes + qint64(slot * (quint64(HeaderBytes) + slotBytes));
+}
+
+} // namespace
+
+MeshFeed::MeshFeed()
+    : mapping(nullptr)
+    , mappedBytes(0)
+{
+}
+
+MeshFeed::~MeshFeed()
+{
+    close();
+}
+
+bool MeshFeed::open(const QString &name, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    close();
+#if defined(MESHFEED_HAS_SHARED_MEMORY)
+    const QString sharedName = sharedMemoryName(name);
+    int fd = ::shm_open(sharedName.toLocal8Bit().constData(), O_RDONLY, 0);
+    if (fd < 0) {
+        return fail(QString("No feed named %1 (%2); is the producer running?").arg(sharedName, QString::fromLocal8Bit(std::strerror(errno))));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size < HeaderBytes) {
+        ::close(fd);
+        return fail(QString("%1 is not a mesh feed").arg(sharedName));
+    }
+    void *address = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);    // The mapping keeps the memory alive
+    if (address == MAP_FAILED) {
+        return fail(QString("Cannot map %1: %2").arg(sharedName, QString::fromLocal8Bit(std::strerror(errno))));
+    }
+    mapping = static_cast<const char *>(address);
+    mappedBytes = qint64(info.st_size);
+
+    // Check everything the offsets are computed from, so a bad header cannot send reads outside
+    const FeedHeader *header = reinterpret_cast<const FeedHeader *>(mapping);
+    if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version) {
+        close();
+        return fail(QString("%1 is not a version %2 mesh feed").arg(sharedName).arg(Version));
+    }
+    if (header->slotCount < 1 || header->slotCount > quint32(MaxSlots) || header->slotBytes % 64 != 0
+        || header->slotBytes > quint64(mappedBytes)
+        || slotOffset(header->slotBytes, header->slotCount) > mappedBytes) {
+        close();
+        return fail(QString("%1 has a damaged header").arg(sharedName));
+    }
+    qDebug() << "MeshFeed: opened" << sharedName << "with" << header->slotCount << "slots of" << header->slotBytes << "bytes";
+    return true;
+#else
+    Q_UNUSED(name);
+    return fail("Live feeds use POSIX shared memory, which this system does not have");
+#endif
+}
+
+void MeshFeed::close()
+{
+#if defined(MESHFEED_HAS_SHARED_MEMORY)
+    if (mapping) {
+        ::munmap(const_cast<char *>(mapping), size_t(mappedBytes));
+    }
+#endif
+    mapping = nullptr;
+    mappedBytes = 0;
+}
+
+bool MeshFeed::latestFrame(Frame &frame) const
+{
+    if (!mapping) {
+        return false;
+    }
+    const FeedHeader *header = reinterpret_cast<const FeedHeader *>(mapping);
+    const quint64 number = header->latest.load(std::memory_order_acquire);
+    if (number == 0) {
+        return false;
+    }
+    const char *slot = mapping + slotOffset(header->slotBytes, (number - 1) % header->slotCount);
+    const SlotHeader *slotHeader = reinterpret_cast<const SlotHeader *>(slot);
+    if (slotHeader->stamp.load(std::memory_order_acquire) != number * 2) {
+        return false;    // Already being overwritten by a newer frame; try again on the next repaint
+    }
+
+    // The producer is another program: check the counts fit the slot before pointing at the data
+    const quint64 vertexBytes = quint64(slotHeader->vertexCount) * FloatsPerVertex * sizeof(float);
+    const quint64 indexBytes = quint64(slotHeader->indexCount) * sizeof(quint32);
+    if (vertexBytes + indexBytes > header->slotBytes || slotHeader->indexCount % 3 != 0) {
+        return false;
+    }
+    frame.number = number;
+    frame.vertexCount = int(slotHeader->vertexCount);
+    frame.indexCount = int(slotHeader->indexCount);
+    frame.vertexData = reinterpret_cast<const float *>(slot + HeaderBytes);
+    frame.indices = reinterpret_cast<const quint32 *>(slot + HeaderBytes + vertexBytes);
+    frame.boundsMin = QVector3D(slotHeader->boundsMin[0], slotHeader->boundsMin[1], slotHeader->boundsMin[2]);
+    frame.boundsMax = QVector3D(slotHeader->boundsMax[0], slotHeader->boundsMax[1], slotHeader->boundsMax[2]);
+
+    // An index past the vertices would make the graphics card read outside the buffer
+    const quint32 *end = frame.indices + frame.indexCount;
+    if (std::any_of(frame.indices, end, [&frame](quint32 index) { return index >= quint32(frame.vertexCount); })) {
+        return false;
+    }
+    return true;
+}
+
+bool MeshFeed::isIntact(const Frame &frame) const
+{
+    if (!mapping || frame.number == 0) {
+        return false;
+    }
+    // Everything read from the slot before this point happened before the stamp is looked at again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const FeedHeader *header = reinterpret_cast<const FeedHeader *>(mapping);
+    const SlotHeader *slotHeader = reinterpret_cast<const SlotHeader *>(
+        mapping + slotOffset(header->slotBytes, (frame.number - 1) % header->slotCount));
+    return slotHeader->stamp.load(std::memory_order_relaxed) == frame.number * 2;
+}
+
+quint64 MeshFeed::latestNumber() const
+{
+    return mapping ? reinterpret_cast<const FeedHeader *>(mapping)->latest.load(std::memory_order_acquire) : 0;
+}
+
+bool MeshFeed::producerFinished() const
+{
+    return mapping && reinterpret_cast<const FeedHeader *>(mapping)->state.load(std::memory_order_acquire) == Finished;
+}
+
+MeshFeedWriter::MeshFeedWriter()
+    : mapping(nullptr)
+    , mappedBytes(0)
+    , frameNumber(0)
+{
+}
+
+MeshFeedWriter::~MeshFeedWriter()
+{
+    close();
+}
+
+bool MeshFeedWriter::create(const QString &name, int slotCount, int maxVertices, int maxIndices, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    close();
+    if (slotCount < 1 || slotCount > MaxSlots || maxVertices < 0 || maxIndices < 0) {
+        return fail("Invalid feed size");
+    }
+#if defined(MESHFEED_HAS_SHARED_MEMORY)
+    const quint64 dataBytes = quint64(maxVertices) * FloatsPerVertex * sizeof(float) + quint64(maxIndices) * sizeof(quint32);
+    const quint64 slotBytes = (dataBytes + 63) / 64 * 64;
+    const qint64 totalBytes = slotOffset(slotBytes, quint64(slotCount));
+
+    sharedName = sharedMemoryName(name);
+    int fd = ::shm_open(sharedName.toLocal8Bit().constData(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        return fail(QString("Cannot create %1: %2").arg(sharedName, QString::fromLocal8Bit(std::strerror(errno))));
+    }
+    // Shrinking to nothing first clears whatever an earlier producer left behind
+    if (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, off_t(totalBytes)) != 0) {
+        int error = errno;
+        ::close(fd);
+        ::shm_unlink(sharedName.toLocal8Bit().constData());
+        return fail(QString("Cannot size %1: %2").arg(sharedName, QString::fromLocal8Bit(std::strerror(error))));
+    }
+    void *address = ::mmap(nullptr, size_t(totalBytes), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        ::shm_unlink(sharedName.toLocal8Bit().constData());
+        return fail(QString("Cannot map %1: %2").arg(sharedName, QString::fromLocal8Bit(std::strerror(errno))));
+    }
+    mapping = static_cast<char *>(address);
+    mappedBytes = totalBytes;
+    frameNumber = 0;
+
+    // The fresh memory is zero, which is already "no frame yet" for every slot
+    FeedHeader *header = new (mapping) FeedHeader;
+    std::memcpy(header->magic, Magic, sizeof(Magic));
+    header->version = Version;
+    header->slotCount = quint32(slotCount);
+    header->slotBytes = slotBytes;
+    for (int i = 0; i < slotCount; ++i) {
+        new (mapping + slotOffset(slotBytes, quint64(i))) SlotHeader;
+    }
+    header->latest.store(0, std::memory_order_relaxed);
+    header->state.store(Running, std::memory_order_release);
+    return true;
+#else
+    Q_UNUSED(name);
+    return fail("Live feeds use POSIX shared memory, which this system does not have");
+#endif
+}
+
+bool MeshFeedWriter::publish(const float *vertexData, int vertexCount, const quint32 *indices, int indexCount,
+                             QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    if (!mapping) {
+        return fail("The feed is not open");
+    }
+    FeedHeader *header = reinterpret_cast<FeedHeader *>(mapping);
+    const quint64 vertexBytes = quint64(qMax(vertexCount, 0)) * FloatsPerVertex * sizeof(float);
+    const quint64 indexBytes = quint64(qMax(indexCount, 0)) * sizeof(quint32);
+    if (vertexBytes + indexBytes > header->slotBytes) {
+        return fail(QString("Frame of %1 vertices and %2 indices does not fit the feed").arg(vertexCount).arg(indexCount));
+    }
+
+    const quint64 number = ++frameNumber;
+    char *slot = mapping + slotOffset(header->slotBytes, (number - 1) % header->slotCount);
+    SlotHeader *slotHeader = reinterpret_cast<SlotHeader *>(slot);
+
+    // Odd stamp first, so a reader still busy with this slot's old frame will see it changed
+    slotHeader->stamp.store(number * 2 - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+    for (int v = 0; v < vertexCount; ++v) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const float value = vertexData[v * FloatsPerVertex + axis];
+            boundsMin[axis] = v == 0 ? value : qMin(boundsMin[axis], value);
+            boundsMax[axis] = v == 0 ? value : qMax(boundsMax[axis], value);
+        }
+    }
+    slotHeader->vertexCount = quint32(qMax(vertexCount, 0));
+    slotHeader->indexCount = quint32(qMax(indexCount, 0));
+    std::memcpy(slotHeader->boundsMin, boundsMin, sizeof(boundsMin));
+    std::memcpy(slotHeader->boundsMax, boundsMax, sizeof(boundsMax));
+    if (vertexBytes > 0) {
+        std::memcpy(slot + HeaderBytes, vertexData, size_t(vertexBytes));
+    }
+    if (indexBytes > 0) {
+        std::memcpy(slot + HeaderBytes + vertexBytes, indices, size_t(indexBytes));
+    }
+
+    // Complete, then newest: a reader that sees the number also sees the whole frame
+    slotHeader->stamp.store(number * 2, std::memory_order_release);
+    header->latest.store(number, std::memory_order_release);
+    return true;
+}
+
+void MeshFeedWriter::close()
+{
+    if (!mapping) {
+        return;
+    }
+    reinterpret_cast<FeedHeader *>(mapping)->state.store(Finished, std::memory_order_release);
+#if defined(MESHFEED_HAS_SHARED_MEMORY)
+    ::munmap(mapping, size_t(mappedBytes));
+    ::shm_unlink(sharedName.toLocal8Bit().constData());
+#endif
+    mapping = nullptr;
+    mappedBytes = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef MESHFEED_H
+#define MESHFEED_H
+
+#include <QString>
+#include <QVector3D>
+#include <QtGlobal>
+
+// A live mesh handed over by another process through shared memory, for watching a running
+// simulation or scanner without writing any files.
+//
+// The producer creates a named block of POSIX shared memory (shm_open; /dev/shm/<name> on Linux)
+// holding a small header and a ring of frame slots. It writes each frame into the next slot and
+// then publishes the frame's number. The viewer maps the block read-only and uploads the newest
+// frame to the graphics card straight out of the shared memory. Every slot carries a stamp that is
+// odd while the producer is writing it, so a reader that was overtaken in the middle of an upload
+// notices and drops that frame instead of showing a torn one.
+//
+// Layout (native byte order, offsets in bytes):
+//   0    header: "MESHFEED", version (1), slot count, slot data size, newest frame number
+//        (0 before the first), producer state (1 running, 2 finished)
+//   64   slot i starts at 64 + i * (64 + slot data size):
+//        stamp (2n once frame n is complete, odd while being written), vertex count,
+//        index count, bounds min xyz, bounds max xyz; 64 bytes in, the data:
+//        vertexCount * 6 floats (x y z nx ny nz), then indexCount 32-bit indices
+// Frame n goes into slot (n - 1) % slot count. MeshFeedWriter below is a complete producer.
+class MeshFeed
+{
+public:
+    struct Frame {
+        quint64 number = 0;                     // Counts up from 1
+        const float *vertexData = nullptr;      // Points into the shared memory, 6 floats per vertex
+        const quint32 *indices = nullptr;       // Three per triangle
+        int vertexCount = 0;
+        int indexCount = 0;
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+    };
+
+    MeshFeed();
+    ~MeshFeed();
+
+    bool open(const QString &name, QString *errorMessage = nullptr);
+    void close();
+    bool isOpen() const { return mapping != nullptr; }
+
+    // The newest complete frame, if there is one. The producer may overwrite it while it is being
+    // read, so check isIntact() afterwards before trusting what was read.
+    bool latestFrame(Frame &frame) const;
+    bool isIntact(const Frame &frame) const;
+
+    // Number of the newest complete frame (0 before the first), a cheap check for something new
+    quint64 latestNumber() const;
+
+    // The producer has said it will not publish any more frames
+    bool producerFinished() const;
+
+private:
+    const char *mapping;
+    qint64 mappedBytes;
+};
+
+// The producer side: what a simulation links in (or copies) to feed the viewer
+class MeshFeedWriter
+{
+public:
+    MeshFeedWriter();
+    ~MeshFeedWriter();
+
+    // Create (or replace) the shared memory, with room for frames of up to maxVertices vertices
+    // and maxIndices indices
+    bool create(const QString &name, int slotCount, int maxVertices, int maxIndices, QString *errorMessage = nullptr);
+
+    // Write a frame into the next slot and make it the newest. vertexData has 6 floats per vertex.
+    bool publish(const float *vertexData, int vertexCount, const quint32 *indices, int indexCount,
+                 QString *errorMessage = nullptr);
+
+    // Tell readers no more frames are coming and remove the name (open mappings stay valid)
+    void close();
+
+private:
+    char *mapping;
+    qint64 mappedBytes;
+    QString sharedName;
+    quint64 frameNumber;
+};
+
+#endif // MESHFEED_H
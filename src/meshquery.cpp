@@ -0,0 +1,231 @@
+#include "meshquery.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Union-find root with path halving
+unsigned int findRoot(std::vector<unsigned int>& parent, unsigned int v)
+{
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+} // namespace
+
+bool MeshQuery::readProbes(const QString& fileName, QVector<QVector3D>& points, QString* errorMessage)
+{
+    points.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot open file: " + file.errorString();
+        }
+        return false;
+    }
+
+    QByteArray content = file.readAll();
+    QList<QByteArray> lines = content.split('\n');
+    bool headerSkipped = false;
+    for (int lineNumber = 0; lineNumber < lines.size(); ++lineNumber) {
+        QByteArray line = lines[lineNumber];
+        line.replace(',', ' ').replace(';', ' ').replace('\t', ' ');
+        line = line.simplified();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        QList<QByteArray> fields = line.split(' ');
+        float value[3];
+        bool ok = fields.size() >= 3;
+        for (int k = 0; k < 3 && ok; ++k) {
+            value[k] = fields[k].toFloat(&ok);
+        }
+        if (!ok) {
+            // The first line that is not a number is taken as column names
+            if (!headerSkipped && points.isEmpty()) {
+                headerSkipped = true;
+                continue;
+            }
+            if (errorMessage) {
+                *errorMessage = QString("Line %1 is not an x y z point").arg(lineNumber + 1);
+            }
+            points.clear();
+            return false;
+        }
+        points.append(QVector3D(value[0], value[1], value[2]));
+    }
+
+    if (points.isEmpty()) {
+        if (errorMessage) {
+            *errorMessage = "The file contains no points";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool MeshQuery::writeProbeResults(const QString& fileName, const QVector<QVector3D>& points,
+                                  const QVector<MeshBVH::Hit>& hits, QString* errorMessage)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + file.errorString();
+        }
+        return false;
+    }
+
+    QByteArray out("x,y,z,distance,closest_x,closest_y,closest_z,triangle\n");
+    out.reserve(out.size() + points.size() * 96);
+    for (int i = 0; i < points.size() && i < hits.size(); ++i) {
+        const QVector3D& p = points[i];
+        const MeshBVH::Hit& hit = hits[i];
+        out.append(QByteArray::number(p.x(), 'g', 9)).append(',');
+        out.append(QByteArray::number(p.y(), 'g', 9)).append(',');
+        out.append(QByteArray::number(p.z(), 'g', 9)).append(',');
+        if (hit.triangle < 0) {
+            out.append(",,,,-1\n");   // Nothing within reach
+            continue;
+        }
+        out.append(QByteArray::number(hit.distance, 'g', 9)).append(',');
+        out.append(QByteArray::number(hit.point.x(), 'g', 9)).append(',');
+        out.append(QByteArray::number(hit.point.y(), 'g', 9)).append(',');
+        out.append(QByteArray::number(hit.point.z(), 'g', 9)).append(',');
+        out.append(QByteArray::number(hit.triangle)).append('\n');
+    }
+
+    if (file.write(out) != out.size()) {
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+MeshQuery::ProbeReport MeshQuery::probe(const MeshBVH& surface, const QVector<QVector3D>& points, bool signedResult,
+                                        QVector<MeshBVH::Hit>& hits)
+{
+    ProbeReport report;
+    report.probes = points.size();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    signedResult = signedResult && surface.hasPseudoNormals();
+    hits = surface.closestPoints(points, signedResult);
+
+    float minimum = FLT_MAX;
+    float maximum = -FLT_MAX;
+    double sum = 0.0;
+    for (const MeshBVH::Hit& hit : hits) {
+        if (hit.triangle < 0) {
+            continue;
+        }
+        minimum = qMin(minimum, hit.distance);
+        maximum = qMax(maximum, hit.distance);
+        sum += hit.distance;
+        report.found++;
+    }
+    if (report.found > 0) {
+        report.minDistance = minimum;
+        report.maxDistance = maximum;
+        report.averageDistance = float(sum / report.found);
+    }
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshQuery:" << report.probes << "probes in" << report.milliseconds << "ms, distance"
+             << report.minDistance << "to" << report.maxDistance << "(average" << report.averageDistance << ")";
+    return report;
+}
+
+QVector<QVector<unsigned int>> MeshQuery::splitParts(const QVector<unsigned int>& indices)
+{
+    QVector<QVector<unsigned int>> parts;
+    const int triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return parts;
+    }
+
+    unsigned int vertexCount = 0;
+    for (unsigned int index : indices) {
+        vertexCount = qMax(vertexCount, index + 1);
+    }
+
+    // Join the three corners of every triangle
+    std::vector<unsigned int> parent(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; ++v) {
+        parent[v] = v;
+    }
+    for (int t = 0; t < triangleCount; ++t) {
+        unsigned int root = findRoot(parent, indices[t * 3]);
+        for (int k = 1; k < 3; ++k) {
+            unsigned int other = findRoot(parent, indices[t * 3 + k]);
+            if (other != root) {
+                parent[other] = root;
+            }
+        }
+    }
+
+    // Number the parts in order of first appearance, then hand out the triangles
+    std::vector<int> partOfRoot(vertexCount, -1);
+    std::vector<int> partOfTriangle(triangleCount);
+    std::vector<int> partSize;
+    for (int t = 0; t < triangleCount; ++t) {
+        unsigned int root = findRoot(parent, indices[t * 3]);
+        if (partOfRoot[root] < 0) {
+            partOfRoot[root] = int(partSize.size());
+            partSize.push_back(0);
+        }
+        partOfTriangle[t] = partOfRoot[root];
+        partSize[partOfRoot[root]]++;
+    }
+
+    std::vector<int> order(partSize.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = int(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return partSize[a] > partSize[b]; });
+    std::vector<int> rank(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        rank[order[i]] = int(i);
+    }
+
+    parts.resize(int(partSize.size()));
+    for (size_t p = 0; p < partSize.size(); ++p) {
+        parts[rank[p]].reserve(partSize[p] * 3);
+    }
+    for (int t = 0; t < triangleCount; ++t) {
+        QVector<unsigned int>& part = parts[rank[partOfTriangle[t]]];
+        part.append(indices[t * 3]);
+        part.append(indices[t * 3 + 1]);
+        part.append(indices[t * 3 + 2]);
+    }
+    return parts;
+}
+
+MeshQuery::PartReport MeshQuery::partDistance(const MeshBVH& first, const MeshBVH& second)
+{
+    PartReport report;
+    QElapsedTimer timer;
+    timer.start();
+
+    report.found = first.closestPair(second, report.pair);
+    report.milliseconds = timer.elapsed();
+
+    if (report.found) {
+        qDebug() << "MeshQuery: parts are" << report.pair.distance << "apart (triangles" << report.pair.triangle
+                 << "and" << report.pair.otherTriangle << "), found in" << report.milliseconds << "ms";
+    }
+    return report;
+}
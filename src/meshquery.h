@@ -0,0 +1,52 @@
+#ifndef MESHQUERY_H
+#define MESHQUERY_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include "meshbvh.h"
+
+// Measurement queries on a mesh: distance from probe points to the surface (with the closest
+// point on it), and the smallest gap between two parts. Everything is in file units. The
+// queries run on a MeshBVH and are used by the Tools menu and by the command-line mode.
+class MeshQuery
+{
+public:
+    // Summary of a batch of probe queries
+    struct ProbeReport {
+        int probes = 0;                // Points asked about
+        int found = 0;                 // Points with a closest point (all of them unless the mesh is empty)
+        float minDistance = 0.0f;      // Smallest distance (signed if the query was signed)
+        float maxDistance = 0.0f;      // Largest distance
+        float averageDistance = 0.0f;  // Average distance
+        qint64 milliseconds = 0;       // Time spent on the queries
+    };
+
+    // Smallest gap between two parts
+    struct PartReport {
+        bool found = false;
+        MeshBVH::PairHit pair;         // Distance and the closest point on each part
+        qint64 milliseconds = 0;
+    };
+
+    // Read probe points from a text file: one point per line as "x y z", separated by spaces,
+    // tabs, commas or semicolons. Empty lines, lines starting with # and a header line are skipped.
+    static bool readProbes(const QString& fileName, QVector<QVector3D>& points, QString* errorMessage = nullptr);
+
+    // Save probe results as CSV: probe, distance, closest point and triangle number per line
+    static bool writeProbeResults(const QString& fileName, const QVector<QVector3D>& points,
+                                  const QVector<MeshBVH::Hit>& hits, QString* errorMessage = nullptr);
+
+    // Closest point on the surface for every probe, spread over all cores
+    static ProbeReport probe(const MeshBVH& surface, const QVector<QVector3D>& points, bool signedResult,
+                             QVector<MeshBVH::Hit>& hits);
+
+    // Split a welded mesh into parts: groups of triangles joined through shared vertices.
+    // Each part is a list of indices into the same vertex buffer; the biggest part comes first.
+    static QVector<QVector<unsigned int>> splitParts(const QVector<unsigned int>& indices);
+
+    // Smallest distance between two surfaces
+    static PartReport partDistance(const MeshBVH& first, const MeshBVH& second);
+};
+
+#endif // MESHQUERY_H
@@ -0,0 +1,782 @@
+#include "meshrepair.h"
+#include "meshtopology.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <utility>
+#include <climits>
+#include <vector>
+
+namespace {
+
+// A triangle's corners sorted ascending, plus which way round they were listed
+struct CanonicalTriangle {
+    unsigned int a, b, c;  // a < b < c
+    int winding;           // 0 or 1 - two triangles with equal corners but different winding face opposite ways
+
+    bool operator==(const CanonicalTriangle& other) const {
+        return a == other.a && b == other.b && c == other.c;
+    }
+};
+
+CanonicalTriangle canonicalTriangle(const unsigned int* corners)
+{
+    // Rotate the smallest index to the front (keeps the winding), then look at the other two
+    unsigned int i0 = corners[0], i1 = corners[1], i2 = corners[2];
+    if (i1 < i0 && i1 < i2) {
+        std::swap(i0, i1);   // (i1, i2, i0)
+        std::swap(i1, i2);
+    } else if (i2 < i0 && i2 < i1) {
+        std::swap(i0, i2);   // (i2, i0, i1)
+        std::swap(i1, i2);
+    }
+
+    CanonicalTriangle result;
+    result.a = i0;
+    result.b = qMin(i1, i2);
+    result.c = qMax(i1, i2);
+    result.winding = (i1 < i2) ? 0 : 1;
+    return result;
+}
+
+quint64 hashTriangle(const CanonicalTriangle& triangle)
+{
+    // splitmix64 finaliser over the packed corner indices
+    quint64 h = (quint64(triangle.a) << 32) ^ (quint64(triangle.b) << 16) ^ quint64(triangle.c) ^ (quint64(triangle.c) << 48);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// Atomically lower target to value if value is smaller
+void atomicMin(std::atomic<int>& target, int value)
+{
+    int current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// A hole patch while it is being built. Points 0 .. loopSize-1 are the loop's own vertices
+// (never moved); points after that are new vertices added by fairing.
+struct HolePatch {
+    std::vector<QVector3D> points;
+    std::vector<int> triangles;     // 3 point numbers per triangle
+    int loopSize = 0;
+    bool filled = false;
+};
+
+float triangleArea(const QVector3D& a, const QVector3D& b, const QVector3D& c)
+{
+    return 0.5f * QVector3D::crossProduct(b - a, c - a).length();
+}
+
+float cornerAngle(const QVector3D& corner, const QVector3D& a, const QVector3D& b)
+{
+    float cosine = QVector3D::dotProduct((a - corner).normalized(), (b - corner).normalized());
+    return std::acos(qBound(-1.0f, cosine, 1.0f));
+}
+
+// Minimum-area triangulation of a closed polygon: the cheapest way to cut every sub-polygon
+// i..j is found from the smaller ones (dynamic programming, O(n^3) time, O(n^2) memory).
+// Triangles follow the loop order, so they get the winding the loop was walked in.
+void triangulateMinimumArea(HolePatch& patch)
+{
+    const int n = patch.loopSize;
+    const std::vector<QVector3D>& p = patch.points;
+    std::vector<float> cost(size_t(n) * n, 0.0f);
+    std::vector<int> split(size_t(n) * n, -1);
+
+    for (int gap = 2; gap < n; ++gap) {
+        for (int i = 0; i + gap < n; ++i) {
+            int j = i + gap;
+            float best = FLT_MAX;
+            int bestK = i + 1;
+            for (int k = i + 1; k < j; ++k) {
+                float c = cost[size_t(i) * n + k] + cost[size_t(k) * n + j] + triangleArea(p[i], p[k], p[j]);
+                if (c < best) {
+                    best = c;
+                    bestK = k;
+                }
+            }
+            cost[size_t(i) * n + j] = best;
+            split[size_t(i) * n + j] = bestK;
+        }
+    }
+
+    // Walk the chosen splits back from the whole polygon
+    std::vector<std::pair<int, int>> pending(1, std::make_pair(0, n - 1));
+    while (!pending.empty()) {
+        std::pair<int, int> range = pending.back();
+        pending.pop_back();
+        if (range.second - range.first < 2) {
+            continue;
+        }
+        int k = split[size_t(range.first) * n + range.second];
+        patch.triangles.push_back(range.first);
+        patch.triangles.push_back(k);
+        patch.triangles.push_back(range.second);
+        pending.push_back(std::make_pair(range.first, k));
+        pending.push_back(std::make_pair(k, range.second));
+    }
+}
+
+// Split triangles bigger than maxArea at their centroid (1 -> 3). Returns how many were split.
+int splitLargeTriangles(HolePatch& patch, float maxArea, int maxPoints)
+{
+    int splits = 0;
+    int triangleCount = int(patch.triangles.size() / 3);
+    for (int t = 0; t < triangleCount && int(patch.points.size()) < maxPoints; ++t) {
+        int a = patch.triangles[t * 3];
+        int b = patch.triangles[t * 3 + 1];
+        int c = patch.triangles[t * 3 + 2];
+        if (triangleArea(patch.points[a], patch.points[b], patch.points[c]) <= maxArea) {
+            continue;
+        }
+
+        int m = int(patch.points.size());
+        patch.points.push_back((patch.points[a] + patch.points[b] + patch.points[c]) / 3.0f);
+        patch.triangles[t * 3 + 2] = m;
+        const int more[6] = { b, c, m, c, a, m };
+        patch.triangles.insert(patch.triangles.end(), more, more + 6);
+        ++splits;
+    }
+    return splits;
+}
+
+// Flip inner edges whose two opposite angles add up to more than 180 degrees (the Delaunay
+// rule), which turns the slivers left by splitting into rounder triangles. Returns the flips made.
+int flipPatchEdges(HolePatch& patch)
+{
+    std::map<std::pair<int, int>, int> edgeTriangle;   // Directed edge -> triangle
+    int triangleCount = int(patch.triangles.size() / 3);
+    for (int t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            edgeTriangle[std::make_pair(patch.triangles[t * 3 + k], patch.triangles[t * 3 + (k + 1) % 3])] = t;
+        }
+    }
+
+    // Each triangle takes part in at most one flip per pass, so stale map entries are never followed
+    std::vector<unsigned char> changed(triangleCount, 0);
+    int flips = 0;
+    const float pi = 3.14159265f;
+    for (int t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3 && !changed[t]; ++k) {
+            int* tri = &patch.triangles[t * 3];
+            int a = tri[k], b = tri[(k + 1) % 3], c = tri[(k + 2) % 3];
+
+            auto twin = edgeTriangle.find(std::make_pair(b, a));
+            if (twin == edgeTriangle.end() || twin->second == t || changed[twin->second]) {
+                continue;   // Loop edge, or the neighbour already changed this pass
+            }
+            int u = twin->second;
+            int* other = &patch.triangles[u * 3];
+            int d = -1;
+            for (int j = 0; j < 3; ++j) {
+                if (other[j] == b && other[(j + 1) % 3] == a) {
+                    d = other[(j + 2) % 3];
+                }
+            }
+            if (d < 0 || d == c || edgeTriangle.count(std::make_pair(c, d)) || edgeTriangle.count(std::make_pair(d, c))) {
+                continue;
+            }
+
+            const std::vector<QVector3D>& p = patch.points;
+            if (cornerAngle(p[c], p[a], p[b]) + cornerAngle(p[d], p[a], p[b]) <= pi + 1e-4f) {
+                continue;
+            }
+
+            // (a, b, c) + (b, a, d) -> (a, d, c) + (d, b, c)
+            tri[0] = a; tri[1] = d; tri[2] = c;
+            other[0] = d; other[1] = b; other[2] = c;
+            edgeTriangle[std::make_pair(d, c)] = t;
+            edgeTriangle[std::make_pair(c, d)] = u;
+            changed[t] = 1;
+            changed[u] = 1;
+            ++flips;
+        }
+    }
+    return flips;
+}
+
+// Move every new vertex to the average of its neighbours a number of times (umbrella smoothing),
+// with the loop held fixed. The patch relaxes into a smooth membrane across the hole.
+void smoothPatch(HolePatch& patch, int iterations)
+{
+    std::vector<std::vector<int>> neighbours(patch.points.size());
+    for (size_t t = 0; t < patch.triangles.size(); t += 3) {
+        for (int k = 0; k < 3; ++k) {
+            int a = patch.triangles[t + k];
+            int b = patch.triangles[t + (k + 1) % 3];
+            if (std::find(neighbours[a].begin(), neighbours[a].end(), b) == neighbours[a].end()) {
+                neighbours[a].push_back(b);
+                neighbours[b].push_back(a);
+            }
+        }
+    }
+
+    std::vector<QVector3D> next(patch.points);
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        for (size_t v = patch.loopSize; v < patch.points.size(); ++v) {
+            if (neighbours[v].empty()) {
+                continue;
+            }
+            QVector3D sum;
+            for (int n : neighbours[v]) {
+                sum += patch.points[n];
+            }
+            next[v] = sum / float(neighbours[v].size());
+        }
+        patch.points.swap(next);
+        // Keep the fixed loop points in the other buffer too
+        std::copy(patch.points.begin(), patch.points.begin() + patch.loopSize, next.begin());
+    }
+}
+
+// Refine the patch to roughly the edge length of its loop, then smooth the new vertices
+void fairPatch(HolePatch& patch)
+{
+    float loopLength = 0.0f;
+    for (int i = 0; i < patch.loopSize; ++i) {
+        loopLength += (patch.points[(i + 1) % patch.loopSize] - patch.points[i]).length();
+    }
+    float edgeLength = loopLength / patch.loopSize;
+    float maxArea = 2.0f * 0.4330127f * edgeLength * edgeLength;   // Twice an equilateral triangle
+    int maxPoints = patch.loopSize * 50 + 64;
+
+    for (int round = 0; round < 10; ++round) {
+        int splits = splitLargeTriangles(patch, maxArea, maxPoints);
+        for (int pass = 0; pass < 10 && flipPatchEdges(patch) > 0; ++pass) {
+        }
+        if (splits == 0) {
+            break;
+        }
+    }
+
+    smoothPatch(patch, 40);
+    for (int pass = 0; pass < 10 && flipPatchEdges(patch) > 0; ++pass) {
+    }
+}
+
+}
+
+MeshRepair::DuplicateReport MeshRepair::removeDuplicateFacets(QVector<unsigned int>& indices,
+                                                              QVector<unsigned char>* keptTriangles)
+{
+    DuplicateReport report;
+    QElapsedTimer timer;
+    timer.start();
+
+    int triangleCount = indices.size() / 3;
+    if (keptTriangles) {
+        keptTriangles->fill(1, triangleCount);
+    }
+    if (triangleCount == 0) {
+        return report;
+    }
+
+    const unsigned int* triangleIndices = indices.constData();
+
+    // Open-addressing hash set of triangle ids, filled by all threads at once.
+    // Each slot holds the first triangle that claimed it; later equal triangles join its group.
+    quint64 capacity = 1;
+    while (capacity < quint64(triangleCount) * 2) {
+        capacity <<= 1;
+    }
+    const quint64 mask = capacity - 1;
+    std::unique_ptr<std::atomic<int>[]> hashSlots(new std::atomic<int>[capacity]);
+    Parallel::forEach(qint64(capacity), [&](qint64 i) {
+        hashSlots[i].store(-1, std::memory_order_relaxed);
+    });
+
+    // Per group (indexed by its first triangle): how many members have each winding,
+    // and the lowest triangle id of each winding (the one we keep if that winding wins)
+    std::vector<int> groupOf(triangleCount);
+    std::unique_ptr<std::atomic<int>[]> windingCount[2];
+    std::unique_ptr<std::atomic<int>[]> firstWithWinding[2];
+    for (int w = 0; w < 2; ++w) {
+        windingCount[w].reset(new std::atomic<int>[triangleCount]);
+        firstWithWinding[w].reset(new std::atomic<int>[triangleCount]);
+    }
+    Parallel::forEach(triangleCount, [&](qint64 t) {
+        for (int w = 0; w < 2; ++w) {
+            windingCount[w][t].store(0, std::memory_order_relaxed);
+            firstWithWinding[w][t].store(INT_MAX, std::memory_order_relaxed);
+        }
+    });
+
+    Parallel::forEach(triangleCount, [&](qint64 index) {
+        int triangle = int(index);
+        const unsigned int* corners = triangleIndices + triangle * 3;
+        CanonicalTriangle key = canonicalTriangle(corners);
+
+        // Collapsed triangles (a corner used twice) are left alone
+        if (key.a == key.b || key.b == key.c) {
+            groupOf[triangle] = -1;
+            return;
+        }
+
+        quint64 slot = hashTriangle(key) & mask;
+        for (;;) {
+            int owner = hashSlots[slot].load(std::memory_order_acquire);
+            if (owner < 0) {
+                int expected = -1;
+                if (hashSlots[slot].compare_exchange_strong(expected, triangle, std::memory_order_acq_rel)) {
+                    owner = triangle;
+                } else {
+                    owner = expected;
+                }
+            }
+            if (owner == triangle || canonicalTriangle(triangleIndices + owner * 3) == key) {
+                groupOf[triangle] = owner;
+                windingCount[key.winding][owner].fetch_add(1, std::memory_order_relaxed);
+                atomicMin(firstWithWinding[key.winding][owner], triangle);
+                return;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }, 1024);
+
+    // Decide who survives: equal numbers of both windings cancel out completely,
+    // otherwise the first triangle with the winning winding stays
+    std::vector<unsigned char> keep(triangleCount, 1);
+    const int threads = Parallel::threadCount();
+    std::vector<DuplicateReport> perThread(threads);
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int thread) {
+        for (qint64 t = begin; t < end; ++t) {
+            int group = groupOf[t];
+            if (group < 0) {
+                continue;
+            }
+            int forward = windingCount[0][group].load(std::memory_order_relaxed);
+            int backward = windingCount[1][group].load(std::memory_order_relaxed);
+            if (forward + backward == 1) {
+                continue;
+            }
+
+            int winner = (forward == backward) ? -1 : (forward > backward ? 0 : 1);
+            keep[t] = (winner >= 0 && firstWithWinding[winner][group].load(std::memory_order_relaxed) == int(t)) ? 1 : 0;
+
+            // Count each group once, when visiting its first triangle
+            if (group == int(t)) {
+                int removed = forward + backward - (winner >= 0 ? 1 : 0);
+                int opposing = 2 * qMin(forward, backward);
+                perThread[thread].opposingTriangles += opposing;
+                perThread[thread].duplicateTriangles += removed - opposing;
+                perThread[thread].removedTriangles += removed;
+            }
+        }
+    });
+
+    for (const DuplicateReport& partial : perThread) {
+        report.duplicateTriangles += partial.duplicateTriangles;
+        report.opposingTriangles += partial.opposingTriangles;
+        report.removedTriangles += partial.removedTriangles;
+    }
+
+    if (report.removedTriangles > 0) {
+        // Compact: count survivors per slice, turn counts into offsets, then copy slices in parallel
+        int slices = threads;
+        std::vector<int> sliceStart(slices + 1);
+        for (int s = 0; s <= slices; ++s) {
+            sliceStart[s] = int(qint64(triangleCount) * s / slices);
+        }
+        std::vector<int> sliceOffset(slices + 1, 0);
+        Parallel::forEach(slices, [&](qint64 s) {
+            int kept = 0;
+            for (int t = sliceStart[s]; t < sliceStart[s + 1]; ++t) {
+                kept += keep[t];
+            }
+            sliceOffset[s + 1] = kept;
+        }, 1);
+        for (int s = 0; s < slices; ++s) {
+            sliceOffset[s + 1] += sliceOffset[s];
+        }
+
+        QVector<unsigned int> compacted(sliceOffset[slices] * 3);
+        unsigned int* output = compacted.data();
+        Parallel::forEach(slices, [&](qint64 s) {
+            int written = sliceOffset[s];
+            for (int t = sliceStart[s]; t < sliceStart[s + 1]; ++t) {
+                if (keep[t]) {
+                    output[written * 3] = triangleIndices[t * 3];
+                    output[written * 3 + 1] = triangleIndices[t * 3 + 1];
+                    output[written * 3 + 2] = triangleIndices[t * 3 + 2];
+                    written++;
+                }
+            }
+        }, 1);
+
+        if (keptTriangles) {
+            unsigned char* flags = keptTriangles->data();
+            Parallel::forEach(triangleCount, [&](qint64 t) {
+                flags[t] = keep[t];
+            });
+        }
+
+        indices.swap(compacted);
+    }
+
+    report.bytesRemoved = qint64(report.removedTriangles) * 3 * qint64(sizeof(unsigned int));
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "Duplicate facet check done in" << report.milliseconds << "ms:" << report.duplicateTriangles
+             << "duplicates," << report.opposingTriangles << "opposing," << report.removedTriangles
+             << "triangles removed (" << report.bytesRemoved << "bytes)";
+
+    return report;
+}
+
+MeshRepair::OrientationReport MeshRepair::orientFacets(const QVector<float>& vertexData,
+                                                       QVector<unsigned int>& indices,
+                                                       QVector<unsigned char>* flippedTriangles)
+{
+    MeshTopology topology;
+    topology.build(indices);
+    return orientFacets(vertexData, indices, topology, flippedTriangles);
+}
+
+MeshRepair::OrientationReport MeshRepair::orientFacets(const QVector<float>& vertexData,
+                                                       QVector<unsigned int>& indices,
+                                                       const MeshTopology& topology,
+                                                       QVector<unsigned char>* flippedTriangles)
+{
+    OrientationReport report;
+    QElapsedTimer timer;
+    timer.start();
+
+    int triangleCount = indices.size() / 3;
+    if (flippedTriangles) {
+        flippedTriangles->fill(0, triangleCount);
+    }
+    if (triangleCount == 0 || topology.getTriangleCount() != triangleCount) {
+        qWarning() << "Cannot orient facets - edge topology does not match the index buffer";
+        return report;
+    }
+    report.nonManifoldEdges = topology.getNonManifoldEdgeCount();
+    report.boundaryEdges = topology.getBoundaryEdgeCount();
+
+    // Detach once up front; worker threads only ever touch the raw arrays
+    unsigned int* triangleIndices = indices.data();
+    unsigned char* flippedFlags = flippedTriangles ? flippedTriangles->data() : nullptr;
+
+    // Per triangle: 0 = not reached yet, otherwise bit 0 = reached, bit 1 = needs flipping
+    std::unique_ptr<std::atomic<unsigned char>[]> state(new std::atomic<unsigned char>[triangleCount]);
+    Parallel::forEach(triangleCount, [&](qint64 t) {
+        state[t].store(0, std::memory_order_relaxed);
+    });
+
+    // Triangles in the order they were reached; every shell is one contiguous run of this list
+    std::vector<int> order(triangleCount);
+    std::vector<int> shellStarts;
+    int orderSize = 0;
+    std::atomic<int> inconsistentEdges(0);
+
+    const int threads = Parallel::threadCount();
+    std::vector<std::vector<int>> nextFrontiers(threads);
+
+    for (int seed = 0; seed < triangleCount; ++seed) {
+        if (state[seed].load(std::memory_order_relaxed) != 0) {
+            continue;
+        }
+
+        // Start a new shell: the seed keeps its winding and everything reachable follows it
+        shellStarts.push_back(orderSize);
+        state[seed].store(1, std::memory_order_relaxed);
+        order[orderSize++] = seed;
+        int frontierBegin = orderSize - 1;
+        int frontierEnd = orderSize;
+
+        // Breadth-first, one level at a time; each level's frontier is expanded in parallel
+        while (frontierBegin < frontierEnd) {
+            Parallel::forChunks(frontierEnd - frontierBegin, [&](qint64 begin, qint64 end, int thread) {
+                std::vector<int>& next = nextFrontiers[thread];
+                for (qint64 i = frontierBegin + begin; i < frontierBegin + end; ++i) {
+                    int triangle = order[i];
+                    unsigned char flip = (state[triangle].load(std::memory_order_relaxed) >> 1) & 1;
+
+                    for (int k = 0; k < 3; ++k) {
+                        int corner = triangle * 3 + k;
+                        int neighbor = topology.neighborOfCorner(corner);
+                        if (neighbor < 0) {
+                            continue;
+                        }
+
+                        // A neighbor walking the shared edge the same way must have the opposite flip
+                        unsigned char wanted = flip ^ (topology.isWindingMismatch(corner) ? 1 : 0);
+                        unsigned char expected = 0;
+                        unsigned char desired = static_cast<unsigned char>(1 | (wanted << 1));
+                        if (state[neighbor].compare_exchange_strong(expected, desired, std::memory_order_relaxed)) {
+                            next.push_back(neighbor);
+                        } else if (((expected >> 1) & 1) != wanted && triangle < neighbor) {
+                            // Already claimed with the other winding: this part of the mesh is non-orientable
+                            inconsistentEdges.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            }, 512);
+
+            // Append the new level to the order list
+            for (std::vector<int>& next : nextFrontiers) {
+                for (int triangle : next) {
+                    order[orderSize++] = triangle;
+                }
+                next.clear();
+            }
+            frontierBegin = frontierEnd;
+            frontierEnd = orderSize;
+        }
+    }
+
+    report.shells = int(shellStarts.size());
+    report.inconsistentEdges = inconsistentEdges.load();
+    shellStarts.push_back(orderSize);
+
+    // Measure each shell's signed volume (relative to the model's middle so open shells behave too).
+    // Shells enclosing negative volume are inside-out and get turned around as a whole.
+    QVector3D reference(0, 0, 0);
+    int vertexCount = vertexData.size() / 6;
+    if (vertexCount > 0) {
+        QVector3D low = position(vertexData, 0);
+        QVector3D high = low;
+        for (int v = 1; v < vertexCount; ++v) {
+            QVector3D p = position(vertexData, v);
+            low = QVector3D(qMin(low.x(), p.x()), qMin(low.y(), p.y()), qMin(low.z(), p.z()));
+            high = QVector3D(qMax(high.x(), p.x()), qMax(high.y(), p.y()), qMax(high.z(), p.z()));
+        }
+        reference = (low + high) * 0.5f;
+    }
+
+    // Shells are contiguous runs of the order list, so every chunk only sums a handful of runs
+    auto shellAt = [&](qint64 orderPosition) {
+        return int(std::upper_bound(shellStarts.begin(), shellStarts.end(), int(orderPosition)) - shellStarts.begin()) - 1;
+    };
+
+    std::vector<std::vector<std::pair<int, double>>> partialVolumes(threads);
+    Parallel::forChunks(orderSize, [&](qint64 begin, qint64 end, int thread) {
+        std::vector<std::pair<int, double>>& partial = partialVolumes[thread];
+        int shell = shellAt(begin);
+        double volume = 0.0;
+        for (qint64 i = begin; i < end; ++i) {
+            if (i >= shellStarts[shell + 1]) {
+                partial.emplace_back(shell, volume);
+                volume = 0.0;
+                shell = shellAt(i);
+            }
+            int triangle = order[i];
+            QVector3D a = position(vertexData, triangleIndices[triangle * 3]) - reference;
+            QVector3D b = position(vertexData, triangleIndices[triangle * 3 + 1]) - reference;
+            QVector3D c = position(vertexData, triangleIndices[triangle * 3 + 2]) - reference;
+            double tetra = QVector3D::dotProduct(a, QVector3D::crossProduct(b, c));
+            volume += ((state[triangle].load(std::memory_order_relaxed) >> 1) & 1) ? -tetra : tetra;
+        }
+        partial.emplace_back(shell, volume);
+    });
+
+    std::vector<double> shellVolumes(report.shells, 0.0);
+    for (const std::vector<std::pair<int, double>>& partial : partialVolumes) {
+        for (const std::pair<int, double>& entry : partial) {
+            shellVolumes[entry.first] += entry.second;
+        }
+    }
+
+    std::vector<unsigned char> shellFlip(report.shells, 0);
+    for (int s = 0; s < report.shells; ++s) {
+        if (shellVolumes[s] < 0.0) {
+            shellFlip[s] = 1;
+            report.invertedShells++;
+        }
+    }
+
+    // Finally flip the triangles in place by swapping their second and third index
+    std::vector<int> flippedPerThread(threads, 0);
+    Parallel::forChunks(orderSize, [&](qint64 begin, qint64 end, int thread) {
+        int shell = shellAt(begin);
+        for (qint64 i = begin; i < end; ++i) {
+            while (i >= shellStarts[shell + 1]) {
+                shell++;
+            }
+            int triangle = order[i];
+            unsigned char flip = ((state[triangle].load(std::memory_order_relaxed) >> 1) & 1) ^ shellFlip[shell];
+            if (flip) {
+                std::swap(triangleIndices[triangle * 3 + 1], triangleIndices[triangle * 3 + 2]);
+                if (flippedFlags) {
+                    flippedFlags[triangle] = 1;
+                }
+                flippedPerThread[thread]++;
+            }
+        }
+    });
+
+    for (int count : flippedPerThread) {
+        report.flippedTriangles += count;
+    }
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "Facet orientation repaired in" << report.milliseconds << "ms:" << report.shells << "shells,"
+             << report.invertedShells << "turned outward," << report.flippedTriangles << "triangles flipped,"
+             << report.inconsistentEdges << "inconsistent edges";
+
+    return report;
+}
+
+QVector<MeshRepair::BoundaryLoop> MeshRepair::findBoundaryLoops(const QVector<float>& vertexData,
+                                                                const QVector<unsigned int>& indices)
+{
+    QVector<BoundaryLoop> loops;
+    MeshTopology topology;
+    topology.build(indices);
+    if (topology.getBoundaryEdgeCount() == 0) {
+        return loops;
+    }
+
+    // Every open edge, turned around: a patch has to walk it the other way from the triangle beside it
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    edges.reserve(topology.getBoundaryEdgeCount());
+    for (int c = 0; c < indices.size(); ++c) {
+        if (topology.edgeFaceCount(topology.edgeOfCorner(c)) == 1) {
+            unsigned int from = indices[c];
+            unsigned int to = indices[(c / 3) * 3 + (c % 3 + 1) % 3];
+            edges.push_back(std::make_pair(to, from));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // Chain edges end to start until we are back where we began
+    std::vector<unsigned char> used(edges.size(), 0);
+    for (size_t first = 0; first < edges.size(); ++first) {
+        if (used[first]) {
+            continue;
+        }
+
+        BoundaryLoop loop;
+        unsigned int start = edges[first].first;
+        size_t edge = first;
+        bool closed = false;
+        while (true) {
+            used[edge] = 1;
+            unsigned int from = edges[edge].first;
+            unsigned int to = edges[edge].second;
+            loop.vertices.append(from);
+            loop.perimeter += (position(vertexData, to) - position(vertexData, from)).length();
+            if (to == start) {
+                closed = true;
+                break;
+            }
+
+            // Next unused edge leaving `to` (a vertex where two holes touch has more than one)
+            auto next = std::lower_bound(edges.begin(), edges.end(), std::make_pair(to, 0u));
+            while (next != edges.end() && next->first == to && used[next - edges.begin()]) {
+                ++next;
+            }
+            if (next == edges.end() || next->first != to) {
+                break;   // Dead end (non-manifold surroundings), not a usable loop
+            }
+            edge = size_t(next - edges.begin());
+        }
+
+        if (closed && loop.vertices.size() >= 3) {
+            loops.append(loop);
+        }
+    }
+    return loops;
+}
+
+MeshRepair::HoleFillReport MeshRepair::fillHoles(QVector<float>& vertexData, QVector<unsigned int>& indices,
+                                                 float maxPerimeter, bool fair)
+{
+    HoleFillReport report;
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<BoundaryLoop> loops = findBoundaryLoops(vertexData, indices);
+    report.boundaryLoops = loops.size();
+    if (loops.isEmpty()) {
+        report.milliseconds = timer.elapsed();
+        return report;
+    }
+
+    // Patch the holes independently; every loop only reads the shared buffers
+    std::vector<HolePatch> patches(loops.size());
+    const QVector<float>& positions = vertexData;
+    Parallel::forBlocks(loops.size(), 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 l = begin; l < end; ++l) {
+            const BoundaryLoop& loop = loops[int(l)];
+            if (loop.perimeter > maxPerimeter || loop.vertices.size() > MaxHoleVertices) {
+                continue;
+            }
+
+            HolePatch& patch = patches[l];
+            patch.loopSize = loop.vertices.size();
+            patch.points.reserve(patch.loopSize);
+            for (unsigned int v : loop.vertices) {
+                patch.points.push_back(position(positions, v));
+            }
+
+            triangulateMinimumArea(patch);
+            if (fair && patch.loopSize > 3) {
+                fairPatch(patch);
+            }
+            patch.filled = true;
+        }
+    });
+
+    // Append the patches in loop order, so the result does not depend on which thread finished first
+    int newVertices = 0;
+    int newIndices = 0;
+    for (const HolePatch& patch : patches) {
+        if (patch.filled) {
+            newVertices += int(patch.points.size()) - patch.loopSize;
+            newIndices += int(patch.triangles.size());
+        }
+    }
+    vertexData.reserve(vertexData.size() + newVertices * 6);
+    indices.reserve(indices.size() + newIndices);
+
+    for (int l = 0; l < loops.size(); ++l) {
+        const HolePatch& patch = patches[l];
+        if (!patch.filled) {
+            report.skippedHoles++;
+            continue;
+        }
+
+        // New vertices get the average normal of the patch triangles around them
+        unsigned int base = unsigned(vertexData.size() / 6);
+        std::vector<QVector3D> normals(patch.points.size());
+        for (size_t t = 0; t < patch.triangles.size(); t += 3) {
+            const QVector3D& a = patch.points[patch.triangles[t]];
+            QVector3D normal = QVector3D::crossProduct(patch.points[patch.triangles[t + 1]] - a,
+                                                       patch.points[patch.triangles[t + 2]] - a);
+            for (int k = 0; k < 3; ++k) {
+                normals[patch.triangles[t + k]] += normal;
+            }
+        }
+        for (size_t v = patch.loopSize; v < patch.points.size(); ++v) {
+            QVector3D normal = normals[v].normalized();
+            vertexData << patch.points[v].x() << patch.points[v].y() << patch.points[v].z()
+                       << normal.x() << normal.y() << normal.z();
+        }
+
+        for (int id : patch.triangles) {
+            indices.append(id < patch.loopSize ? loops[l].vertices[id] : base + unsigned(id - patch.loopSize));
+        }
+
+        report.filledHoles++;
+        report.addedTriangles += int(patch.triangles.size() / 3);
+        report.addedVertices += int(patch.points.size()) - patch.loopSize;
+    }
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "Filled" << report.filledHoles << "of" << report.boundaryLoops << "holes in" << report.milliseconds
+             << "ms:" << report.addedTriangles << "triangles and" << report.addedVertices << "vertices added,"
+             << report.skippedHoles << "skipped";
+    return report;
+}
@@ -0,0 +1,90 @@
+#ifndef MESHREPAIR_H
+#define MESHREPAIR_H
+
+#include <QVector>
+#include <QVector3D>
+
+class MeshTopology;
+
+// Fixes common problems in welded triangle meshes (6 floats per vertex: position + normal,
+// 3 indices per triangle). All repairs work in place on the loader's buffers.
+class MeshRepair
+{
+public:
+    // What the winding repair found and changed
+    struct OrientationReport {
+        int shells = 0;               // Groups of triangles connected through shared edges
+        int invertedShells = 0;       // Shells that were inside-out and got turned around
+        int flippedTriangles = 0;     // Triangles whose winding was reversed
+        int inconsistentEdges = 0;    // Edges that could not be made consistent (non-orientable parts)
+        int nonManifoldEdges = 0;     // Edges shared by 3+ triangles (ignored while propagating)
+        int boundaryEdges = 0;        // Edges used by only one triangle (0 together with the above: closed)
+        qint64 milliseconds = 0;      // Time spent
+    };
+
+    // What the duplicate facet removal found and dropped
+    struct DuplicateReport {
+        int duplicateTriangles = 0;   // Exact copies of another triangle (same corners, same winding)
+        int opposingTriangles = 0;    // Triangles cancelled by a coincident copy facing the other way
+        int removedTriangles = 0;     // Total triangles dropped
+        qint64 bytesRemoved = 0;      // Bytes saved (index buffer here; the loader adds its own per-triangle data)
+        qint64 milliseconds = 0;      // Time spent
+    };
+
+    // One closed chain of open edges: a hole, or the rim of an open surface
+    struct BoundaryLoop {
+        QVector<unsigned int> vertices;   // In order; walking them follows the winding a patch needs
+        float perimeter = 0.0f;           // Sum of the edge lengths
+    };
+
+    // What the hole filling found and added
+    struct HoleFillReport {
+        int boundaryLoops = 0;        // Closed loops of open edges
+        int filledHoles = 0;          // Loops that got patched
+        int skippedHoles = 0;         // Loops over the perimeter limit or too complex to patch
+        int addedTriangles = 0;       // New triangles appended to the index buffer
+        int addedVertices = 0;        // New vertices appended by fairing
+        qint64 milliseconds = 0;      // Time spent
+    };
+
+    // Largest loop (in vertices) the minimum-area triangulation will take on; it costs O(n^3)
+    static const int MaxHoleVertices = 1000;
+
+    // Follow the open edges (used by one triangle only) into closed loops
+    static QVector<BoundaryLoop> findBoundaryLoops(const QVector<float>& vertexData,
+                                                   const QVector<unsigned int>& indices);
+
+    // Patch every loop whose perimeter is at most maxPerimeter with a minimum-area triangulation.
+    // With fair = true, patches are refined to about the size of their border edges and the new
+    // vertices are smoothed into a gentle surface. Loops are patched in parallel; new triangles
+    // (and vertices) are appended to the end of the buffers, existing data is left alone.
+    static HoleFillReport fillHoles(QVector<float>& vertexData, QVector<unsigned int>& indices,
+                                    float maxPerimeter, bool fair);
+
+    // Drop triangles that use exactly the same three welded vertices as another one.
+    // Copies with the same winding collapse to one; coincident pairs facing opposite ways
+    // (zero-thickness walls) cancel each other out. The index buffer is compacted in place;
+    // if keptTriangles is given, it receives one flag per original triangle telling which survived.
+    static DuplicateReport removeDuplicateFacets(QVector<unsigned int>& indices,
+                                                 QVector<unsigned char>* keptTriangles = nullptr);
+
+    // Give every shell one consistent winding, pointing outward (positive signed volume).
+    // Triangles are flipped by swapping two of their indices; if flippedTriangles is given,
+    // it receives one flag per triangle telling which ones were reversed.
+    static OrientationReport orientFacets(const QVector<float>& vertexData,
+                                          QVector<unsigned int>& indices,
+                                          QVector<unsigned char>* flippedTriangles = nullptr);
+
+    // Same as above but reuses edge tables the caller already built for these indices
+    static OrientationReport orientFacets(const QVector<float>& vertexData,
+                                          QVector<unsigned int>& indices,
+                                          const MeshTopology& topology,
+                                          QVector<unsigned char>* flippedTriangles = nullptr);
+
+private:
+    static QVector3D position(const QVector<float>& vertexData, unsigned int index) {
+        return QVector3D(vertexData[index * 6], vertexData[index * 6 + 1], vertexData[index * 6 + 2]);
+    }
+};
+
+#endif // MESHREPAIR_H
@@ -0,0 +1,441 @@
+#include "meshscanner.h"
+#include "parallel.h"
+#include "stlloader.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+QString number(double value)
+{
+    return QString::number(value, 'g', 9);
+}
+
+// Quote a CSV field if it needs it; line breaks become spaces so every record stays on one line
+QString csvField(QString text)
+{
+    text.replace('\n', ' ');
+    text.replace('\r', ' ');
+    if (!text.contains(',') && !text.contains('"')) {
+        return text;
+    }
+    text.replace("\"", "\"\"");
+    return "\"" + text + "\"";
+}
+
+QString jsonString(const QString &text)
+{
+    QString escaped = "\"";
+    for (QChar c : text) {
+        if (c == QChar('"')) {
+            escaped += "\\\"";
+        } else if (c == QChar('\\')) {
+            escaped += "\\\\";
+        } else if (c == QChar('\n')) {
+            escaped += "\\n";
+        } else if (c == QChar('\r')) {
+            escaped += "\\r";
+        } else if (c == QChar('\t')) {
+            escaped += "\\t";
+        } else if (c.unicode() < 0x20) {
+            escaped += QString("\\u%1").arg(int(c.unicode()), 4, 16, QChar('0'));
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+// The first field of a CSV record, quotes undone
+QString firstCsvField(const QString &line)
+{
+    if (!line.startsWith('"')) {
+        int comma = line.indexOf(',');
+        return comma >= 0 ? line.left(comma) : line;
+    }
+    QString field;
+    for (int i = 1; i < line.size(); ++i) {
+        if (line[i] == QChar('"')) {
+            if (i + 1 < line.size() && line[i + 1] == QChar('"')) {
+                field += QChar('"');
+                ++i;
+                continue;
+            }
+            break;
+        }
+        field += line[i];
+    }
+    return field;
+}
+
+// The "file" value of a JSON record written by toJson (it is always the first member)
+QString jsonFile(const QString &line)
+{
+    const QString key = "{\"file\":\"";
+    if (!line.startsWith(key)) {
+        return QString();
+    }
+    QString file;
+    for (int i = key.size(); i < line.size(); ++i) {
+        QChar c = line[i];
+        if (c == QChar('"')) {
+            return file;
+        }
+        if (c == QChar('\\') && i + 1 < line.size()) {
+            QChar next = line[++i];
+            if (next == QChar('n')) {
+                file += QChar('\n');
+            } else if (next == QChar('r')) {
+                file += QChar('\r');
+            } else if (next == QChar('t')) {
+                file += QChar('\t');
+            } else if (next == QChar('u') && i + 4 < line.size()) {
+                file += QChar(ushort(line.mid(i + 1, 4).toUInt(nullptr, 16)));
+                i += 4;
+            } else {
+                file += next;
+            }
+            continue;
+        }
+        file += c;
+    }
+    return QString();    // No closing quote: the record was cut off
+}
+
+} // namespace
+
+bool MeshScanner::measureFile(const QString &fileName, FileStats &stats)
+{
+    QElapsedTimer timer;
+    timer.start();
+    stats.bytes = QFileInfo(fileName).size();
+
+    STLLoader loader;
+    configureLoader(loader);
+    if (loader.loadFile(fileName) != STLLoader::Success) {
+        stats.ok = false;
+        stats.error = loader.getErrorString();
+        stats.milliseconds = timer.elapsed();
+        return false;
+    }
+    measureLoaded(loader, stats);
+    stats.milliseconds = timer.elapsed();
+    return true;
+}
+
+void MeshScanner::configureLoader(STLLoader &loader)
+{
+    // File units, with the same clean-up the viewer does, so the counts say what it had to fix
+    loader.setAutoCenter(false);
+    loader.setAutoNormalize(false);
+    loader.setRemoveDuplicateFacets(true);
+    loader.setRepairOrientation(true);   // Outward winding, so the volume comes out positive
+}
+
+void MeshScanner::measureLoaded(const STLLoader &loader, FileStats &stats)
+{
+    const QVector<float> &vertexData = loader.getVertexData();
+    const QVector<unsigned int> &indices = loader.getIndices();
+    stats.format = loader.getFormatString();
+    stats.triangles = indices.size() / 3;
+    stats.vertices = vertexData.size() / 6;
+    stats.degenerateFacets = loader.getDegenerateTriangleCount();
+    stats.duplicateFacets = loader.getDuplicateReport().removedTriangles;
+    stats.flippedFacets = loader.getOrientationReport().flippedTriangles;
+    stats.shells = loader.getOrientationReport().shells;
+
+    auto position = [&vertexData](unsigned int index) {
+        return QVector3D(vertexData[index * 6], vertexData[index * 6 + 1], vertexData[index * 6 + 2]);
+    };
+    if (stats.vertices > 0) {
+        stats.boundsMin = stats.boundsMax = position(0);
+        for (int v = 1; v < stats.vertices; ++v) {
+            QVector3D p = position(v);
+            stats.boundsMin = QVector3D(qMin(stats.boundsMin.x(), p.x()), qMin(stats.boundsMin.y(), p.y()),
+                                        qMin(stats.boundsMin.z(), p.z()));
+            stats.boundsMax = QVector3D(qMax(stats.boundsMax.x(), p.x()), qMax(stats.boundsMax.y(), p.y()),
+                                        qMax(stats.boundsMax.z(), p.z()));
+        }
+    }
+
+    // Area, and volume as the sum of the tetrahedra from the origin to every triangle.
+    // Summed in doubles: a million small signed terms lose too much in floats.
+    double area = 0.0;
+    double volume = 0.0;
+    for (int t = 0; t < stats.triangles; ++t) {
+        QVector3D a = position(indices[t * 3]);
+        QVector3D b = position(indices[t * 3 + 1]);
+        QVector3D c = position(indices[t * 3 + 2]);
+        area += 0.5 * double(QVector3D::crossProduct(b - a, c - a).length());
+        volume += double(QVector3D::dotProduct(a, QVector3D::crossProduct(b, c))) / 6.0;
+    }
+    stats.area = area;
+    stats.volume = volume;
+
+    // The orientation repair has already worked out which triangles share which edges; flipping
+    // triangles does not change that, so its counts are used instead of building the edges again
+    const MeshRepair::OrientationReport &orientation = loader.getOrientationReport();
+    stats.boundaryEdges = orientation.boundaryEdges;
+    stats.nonManifoldEdges = orientation.nonManifoldEdges;
+    stats.watertight = stats.triangles > 0 && stats.boundaryEdges == 0 && stats.nonManifoldEdges == 0;
+    stats.ok = true;
+}
+
+QString MeshScanner::csvHeader()
+{
+    return "file,bytes,ok,error,format,triangles,vertices,min_x,min_y,min_z,max_x,max_y,max_z,area,volume,"
+           "watertight,shells,boundary_edges,non_manifold_edges,degenerate_facets,duplicate_facets,flipped_facets,"
+           "milliseconds";
+}
+
+QString MeshScanner::toCsv(const FileStats &stats)
+{
+    QStringList fields;
+    fields << csvField(stats.file) << QString::number(stats.bytes) << (stats.ok ? "1" : "0") << csvField(stats.error)
+           << csvField(stats.format) << QString::number(stats.triangles) << QString::number(stats.vertices)
+           << number(stats.boundsMin.x()) << number(stats.boundsMin.y()) << number(stats.boundsMin.z())
+           << number(stats.boundsMax.x()) << number(stats.boundsMax.y()) << number(stats.boundsMax.z())
+           << number(stats.area) << number(stats.volume) << (stats.watertight ? "1" : "0")
+           << QString::number(stats.shells) << QString::number(stats.boundaryEdges)
+           << QString::number(stats.nonManifoldEdges) << QString::number(stats.degenerateFacets)
+           << QString::number(stats.duplicateFacets) << QString::number(stats.flippedFacets)
+           << QString::number(stats.milliseconds);
+    return fields.join(',');
+}
+
+QString MeshScanner::toJson(const FileStats &stats)
+{
+    // "file" has to come first: finishedFiles() looks for it there
+    QString json = "{\"file\":" + jsonString(stats.file) + ",\"bytes\":" + QString::number(stats.bytes)
+                   + ",\"ok\":" + (stats.ok ? "true" : "false");
+    if (!stats.ok) {
+        return json + ",\"error\":" + jsonString(stats.error) + ",\"milliseconds\":"
+               + QString::number(stats.milliseconds) + "}";
+    }
+    json += ",\"format\":" + jsonString(stats.format);
+    json += ",\"triangles\":" + QString::number(stats.triangles);
+    json += ",\"vertices\":" + QString::number(stats.vertices);
+    json += ",\"min\":[" + number(stats.boundsMin.x()) + "," + number(stats.boundsMin.y()) + ","
+            + number(stats.boundsMin.z()) + "]";
+    json += ",\"max\":[" + number(stats.boundsMax.x()) + "," + number(stats.boundsMax.y()) + ","
+            + number(stats.boundsMax.z()) + "]";
+    json += ",\"area\":" + number(stats.area);
+    json += ",\"volume\":" + number(stats.volume);
+    json += QString(",\"watertight\":") + (stats.watertight ? "true" : "false");
+    json += ",\"shells\":" + QString::number(stats.shells);
+    json += ",\"boundaryEdges\":" + QString::number(stats.boundaryEdges);
+    json += ",\"nonManifoldEdges\":" + QString::number(stats.nonManifoldEdges);
+    json += ",\"degenerateFacets\":" + QString::number(stats.degenerateFacets);
+    json += ",\"duplicateFacets\":" + QString::number(stats.duplicateFacets);
+    json += ",\"flippedFacets\":" + QString::number(stats.flippedFacets);
+    json += ",\"milliseconds\":" + QString::number(stats.milliseconds) + "}";
+    return json;
+}
+
+QSet<QString> MeshScanner::finishedFiles(const QByteArray &output, OutputFormat format)
+{
+    QSet<QString> files;
+    const QStringList lines = QString::fromUtf8(output.constData(), output.size()).split('\n');
+    // The last piece has no line break after it: either empty or a record cut off half way
+    for (int i = 0; i + 1 < lines.size(); ++i) {
+        QString line = lines[i];
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        if (line.isEmpty() || (format == Csv && line == csvHeader())) {
+            continue;
+        }
+        QString file = format == Csv ? firstCsvField(line) : jsonFile(line);
+        if (!file.isEmpty()) {
+            files.insert(file);
+        }
+    }
+    return files;
+}
+
+bool MeshScanner::scan(const QString &folder, const QString &outputFile, const Options &options, Report &report,
+                       std::function<void(const FileStats &stats, const Report &soFar)> progress,
+                       QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    report = Report();
+
+    QDir root(folder);
+    if (!root.exists()) {
+        return fail(folder + ": folder not found");
+    }
+
+    // Pick up where an earlier run stopped: drop a record it was cut off in, skip what it finished
+    QFile output(outputFile);
+    QSet<QString> finished;
+    if (options.resume) {
+        if (!output.open(QIODevice::ReadWrite)) {
+            return fail(outputFile + ": " + output.errorString());
+        }
+        QByteArray existing = output.readAll();
+        qint64 complete = existing.lastIndexOf('\n') + 1;
+        if (complete < existing.size() && !output.resize(complete)) {
+            return fail(outputFile + ": cannot remove the unfinished last record");
+        }
+        finished = finishedFiles(existing.left(int(complete)), options.format);
+        output.seek(complete);
+        if (complete == 0 && options.format == Csv) {
+            output.write((csvHeader() + "\n").toUtf8());
+        }
+    } else {
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return fail(outputFile + ": " + output.errorString());
+        }
+        if (options.format == Csv) {
+            output.write((csvHeader() + "\n").toUtf8());
+        }
+    }
+    output.flush();
+
+    QSet<QString> suffixes;
+    for (const STLLoader::FileFormat &fileFormat : STLLoader::formats()) {
+        for (const QString &suffix : fileFormat.suffixes) {
+            suffixes.insert(suffix.toLower());
+        }
+    }
+
+    struct Job {
+        QString path;
+        QString file;
+        qint64 bytes = 0;
+        qint64 ticket = 0;
+    };
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Job> queue;
+    bool walkDone = false;
+    qint64 nextTicket = 0;      // Handed out as jobs leave the queue
+    qint64 admitTicket = 0;     // The job whose turn it is to start loading
+    qint64 bytesInFlight = 0;
+    bool writeFailed = false;
+    const qint64 budget = qMax<qint64>(1, options.maxBytesInFlight);
+
+    // Each worker gets its share of the cores for the loader's own parallel loops
+    const int threadCount = options.threads > 0 ? options.threads : Parallel::threadCount();
+    const int nestedThreads = qMax(1, Parallel::threadCount() / threadCount);
+    auto worker = [&]() {
+        Parallel::ThreadLimit limit(nestedThreads);
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return !queue.empty() || walkDone; });
+                if (queue.empty()) {
+                    return;
+                }
+                job = std::move(queue.front());
+                queue.pop_front();
+                job.ticket = nextTicket++;
+                // Start in queue order, once the file fits in the budget (or nothing else is loading)
+                changed.wait(lock, [&]() {
+                    return job.ticket == admitTicket && (bytesInFlight == 0 || bytesInFlight + job.bytes <= budget);
+                });
+                ++admitTicket;
+                bytesInFlight += job.bytes;
+                report.peakBytesInFlight = qMax(report.peakBytesInFlight, bytesInFlight);
+            }
+            changed.notify_all();
+
+            FileStats stats;
+            stats.file = job.file;
+            try {
+                measureFile(job.path, stats);
+            } catch (const std::exception &e) {
+                stats.ok = false;
+                stats.error = QString("Failed: %1").arg(e.what());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                bytesInFlight -= job.bytes;
+                QByteArray line = ((options.format == Csv ? toCsv(stats) : toJson(stats)) + "\n").toUtf8();
+                if (output.write(line) != line.size() || !output.flush()) {
+                    writeFailed = true;
+                }
+                report.bytes += stats.bytes;
+                if (stats.ok) {
+                    report.measured++;
+                    report.triangles += stats.triangles;
+                } else {
+                    report.failed++;
+                }
+                if (progress) {
+                    progress(stats, report);
+                }
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back(worker);
+    }
+
+    // Walk on this thread while the workers already measure what has been found
+    QDirIterator it(root.absolutePath(), QDir::Files,
+                    options.recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+    while (it.hasNext()) {
+        QString path = it.next();
+        QFileInfo info(path);
+        if (!suffixes.contains(info.suffix().toLower()) || info.absoluteFilePath() == QFileInfo(outputFile).absoluteFilePath()) {
+            continue;
+        }
+        Job job;
+        job.path = path;
+        job.file = root.relativeFilePath(path);
+        job.bytes = info.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            report.files++;
+            if (finished.contains(job.file)) {
+                report.skipped++;
+                continue;
+            }
+            queue.push_back(std::move(job));
+        }
+        changed.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        walkDone = true;
+    }
+    changed.notify_all();
+
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    output.close();
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshScanner:" << report.measured << "measured," << report.failed << "failed," << report.skipped
+             << "skipped of" << report.files << "files in" << report.milliseconds << "ms";
+    if (writeFailed) {
+        return fail(outputFile + ": could not write all records");
+    }
+    return true;
+}
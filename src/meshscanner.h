@@ -0,0 +1,99 @@
+#ifndef MESHSCANNER_H
+#define MESHSCANNER_H
+
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+#include <QVector3D>
+#include <functional>
+
+class STLLoader;
+
+// Measures every model file under a folder, without a window, for data-quality audits of large
+// collections (100k+ STL files on a file server).
+//
+// One thread walks the folder tree and queues the files; one worker per CPU core takes the next
+// file off the queue, loads it and measures it. Big and small files mix freely because each
+// worker asks for new work as soon as it is done. So that a handful of huge files cannot use up
+// all the memory, the bytes of the files being loaded at once are kept under a budget; files are
+// let in in the order they were queued, so a big one is never starved by a stream of small ones.
+//
+// Each result is written to the output file (CSV, or JSON with one object per line) as soon as
+// it is known and flushed straight away. If a scan is interrupted, running it again with resume
+// on skips every file already in the output and adds the rest to the end.
+class MeshScanner
+{
+public:
+    enum OutputFormat {
+        Csv,            // One header line, then one line per file
+        JsonLines       // One JSON object per line (easy to append to and to stream)
+    };
+
+    // What was measured for one file. Geometry is in file units.
+    struct FileStats {
+        QString file;                 // Relative to the scanned folder, with / between folders
+        qint64 bytes = 0;             // File size
+        bool ok = false;              // False if the file could not be read (see error)
+        QString error;
+        QString format;               // "Binary STL", "Wavefront OBJ", ...
+        int triangles = 0;            // Kept after dropping degenerate and duplicate facets
+        int vertices = 0;             // After welding corners that share a position
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+        double area = 0.0;            // Surface area
+        double volume = 0.0;          // Enclosed volume, outward winding; only meaningful when watertight
+        bool watertight = false;      // Every edge shared by exactly two triangles
+        int shells = 0;               // Separate connected pieces
+        int boundaryEdges = 0;        // Edges of holes and open rims
+        int nonManifoldEdges = 0;     // Edges shared by three or more triangles
+        int degenerateFacets = 0;     // Zero-area triangles in the file
+        int duplicateFacets = 0;      // Repeated triangles and coincident pairs facing opposite ways
+        int flippedFacets = 0;        // Triangles wound the wrong way round in the file
+        qint64 milliseconds = 0;      // Loading and measuring
+    };
+
+    struct Options {
+        bool recursive = true;                           // Include subfolders
+        int threads = 0;                                 // Workers; 0 = one per CPU core
+        qint64 maxBytesInFlight = 2LL * 1024 * 1024 * 1024;  // File bytes being loaded at once
+        bool resume = false;                             // Keep the output and skip files already in it
+        OutputFormat format = Csv;
+    };
+
+    struct Report {
+        int files = 0;                // Model files found
+        int skipped = 0;              // Already in the output from an earlier run
+        int measured = 0;
+        int failed = 0;               // Could not be read (they are in the output with their error)
+        qint64 triangles = 0;         // Over all measured files
+        qint64 bytes = 0;             // File bytes loaded
+        qint64 peakBytesInFlight = 0; // Most file bytes being loaded at once
+        qint64 milliseconds = 0;
+    };
+
+    // Load one file and measure it; false (with stats.error set) if it could not be read
+    static bool measureFile(const QString &fileName, FileStats &stats);
+
+    // The loader settings measureFile uses: file units, duplicate facets dropped, outward winding
+    static void configureLoader(STLLoader &loader);
+
+    // Measure what a loader set up with configureLoader() has just loaded (all but file and bytes)
+    static void measureLoaded(const STLLoader &loader, FileStats &stats);
+
+    // Walk the folder and write one record per model file to outputFile. progress is called for
+    // every finished file, one call at a time, from whichever worker finished it.
+    static bool scan(const QString &folder, const QString &outputFile, const Options &options, Report &report,
+                     std::function<void(const FileStats &stats, const Report &soFar)> progress = nullptr,
+                     QString *errorMessage = nullptr);
+
+    // The records, one line each (without the line break)
+    static QString csvHeader();
+    static QString toCsv(const FileStats &stats);
+    static QString toJson(const FileStats &stats);
+
+    // The files an earlier scan already wrote to this output. A record cut off half way by the
+    // interruption is not counted.
+    static QSet<QString> finishedFiles(const QByteArray &output, OutputFormat format);
+};
+
+#endif // MESHSCANNER_H
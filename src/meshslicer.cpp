@@ -0,0 +1,353 @@
+#include "meshslicer.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+float SliceContour::signedArea() const
+{
+    // Shoelace formula over the outline, projected onto the XY plane
+    double area = 0.0;
+    for (int i = 0; i < points.size(); ++i) {
+        const QVector3D& a = points[i];
+        const QVector3D& b = points[(i + 1) % points.size()];
+        area += double(a.x()) * b.y() - double(b.x()) * a.y();
+    }
+    return float(area * 0.5);
+}
+
+MeshSlicer::MeshSlicer()
+    : minZ(0.0f)
+    , maxZ(0.0f)
+{
+}
+
+void MeshSlicer::clear()
+{
+    positions.clear();
+    indices.clear();
+    topology.clear();
+    triangleOrder.clear();
+    orderedMinZ.clear();
+    orderedMaxZ.clear();
+    minZ = maxZ = 0.0f;
+}
+
+void MeshSlicer::setMesh(const QVector<float>& vertexData, const QVector<unsigned int>& meshIndices,
+                         float displayScale, const QVector3D& displayOffset)
+{
+    clear();
+
+    int vertexCount = vertexData.size() / 6;
+    int triangleCount = meshIndices.size() / 3;
+    if (vertexCount == 0 || triangleCount == 0 || displayScale <= 0.0f) {
+        qWarning() << "MeshSlicer: nothing to slice";
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Bring the vertices back to file units (the viewer may have centered and scaled them)
+    positions.resize(vertexCount);
+    QVector3D* positionData = positions.data();
+    const float* source = vertexData.constData();
+    Parallel::forEach(vertexCount, [&](qint64 v) {
+        positionData[v] = QVector3D(source[v * 6], source[v * 6 + 1], source[v * 6 + 2]) / displayScale - displayOffset;
+    });
+
+    indices = meshIndices;
+    topology.build(indices);
+
+    // Sort triangles by their lowest point so a sweep upward only ever adds from the front of the list
+    const unsigned int* triangleIndices = indices.constData();
+    std::vector<std::pair<float, int>> byMinZ(triangleCount);
+    Parallel::forEach(triangleCount, [&](qint64 t) {
+        float z0 = positionData[triangleIndices[t * 3]].z();
+        float z1 = positionData[triangleIndices[t * 3 + 1]].z();
+        float z2 = positionData[triangleIndices[t * 3 + 2]].z();
+        byMinZ[t] = std::make_pair(qMin(z0, qMin(z1, z2)), int(t));
+    });
+    Parallel::sort(byMinZ.begin(), byMinZ.end());
+
+    triangleOrder.resize(triangleCount);
+    orderedMinZ.resize(triangleCount);
+    orderedMaxZ.resize(triangleCount);
+    Parallel::forEach(triangleCount, [&](qint64 i) {
+        int t = byMinZ[i].second;
+        float z0 = positionData[triangleIndices[t * 3]].z();
+        float z1 = positionData[triangleIndices[t * 3 + 1]].z();
+        float z2 = positionData[triangleIndices[t * 3 + 2]].z();
+        triangleOrder[i] = t;
+        orderedMinZ[i] = byMinZ[i].first;
+        orderedMaxZ[i] = qMax(z0, qMax(z1, z2));
+    });
+
+    minZ = orderedMinZ.front();
+    maxZ = *std::max_element(orderedMaxZ.begin(), orderedMaxZ.end());
+
+    qDebug() << "MeshSlicer: prepared" << triangleCount << "triangles in" << timer.elapsed()
+             << "ms, Z range" << minZ << "to" << maxZ;
+}
+
+SliceLayer MeshSlicer::sliceAt(float z) const
+{
+    QVector<SliceLayer> layers = sliceLayers(z, 1.0f, 1);
+    return layers.isEmpty() ? SliceLayer() : layers.first();
+}
+
+QVector<SliceLayer> MeshSlicer::sliceUniform(float layerHeight) const
+{
+    if (isEmpty() || layerHeight <= 0.0f) {
+        return QVector<SliceLayer>();
+    }
+
+    int layerCount = qMax(1, int(std::ceil((maxZ - minZ) / layerHeight)));
+    return sliceLayers(minZ + layerHeight * 0.5f, layerHeight, layerCount);
+}
+
+QVector<SliceLayer> MeshSlicer::sliceLayers(float firstZ, float layerHeight, int layerCount) const
+{
+    QVector<SliceLayer> layers;
+    if (isEmpty() || layerCount <= 0) {
+        return layers;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    layers.resize(layerCount);
+    SliceLayer* output = layers.data();
+
+    // Every thread sweeps its own run of consecutive layers
+    Parallel::forChunks(layerCount, [&](qint64 begin, qint64 end, int) {
+        sweepLayers(firstZ, layerHeight, int(begin), int(end), output);
+    }, 1);
+
+    if (layerCount > 1) {
+        qDebug() << "MeshSlicer: cut" << layerCount << "layers in" << timer.elapsed() << "ms";
+    }
+    return layers;
+}
+
+void MeshSlicer::sweepLayers(float firstZ, float layerHeight, int firstLayer, int lastLayer,
+                             SliceLayer* layers) const
+{
+    // A triangle is cut by the plane at z when it has a corner below (< z) and one at or above (>= z).
+    // Counting "exactly on the plane" as above keeps every cut unambiguous.
+    const int triangleCount = int(triangleOrder.size());
+    std::vector<int> active;
+    int next = 0;
+
+    for (int layer = firstLayer; layer < lastLayer; ++layer) {
+        float z = firstZ + layerHeight * layer;
+
+        // Add every triangle that now starts below the plane
+        while (next < triangleCount && orderedMinZ[next] < z) {
+            if (orderedMaxZ[next] >= z) {
+                active.push_back(next);
+            }
+            ++next;
+        }
+
+        // Drop the triangles that ended below the plane
+        active.erase(std::remove_if(active.begin(), active.end(), [&](int i) {
+            return orderedMaxZ[i] < z;
+        }), active.end());
+
+        SliceLayer& result = layers[layer];
+        result.z = z;
+        cutTriangles(z, active, result);
+    }
+}
+
+void MeshSlicer::cutTriangles(float z, const std::vector<int>& active, SliceLayer& layer) const
+{
+    const unsigned int* triangleIndices = indices.constData();
+
+    // Each cut triangle gives one segment, running from the edge where the surface goes down through
+    // the plane to the edge where it comes back up. With outward-facing triangles this makes outer
+    // outlines counter-clockwise and holes clockwise when seen from above.
+    std::vector<Segment> segments;
+    segments.reserve(active.size());
+    for (int i : active) {
+        int triangle = triangleOrder[i];
+        Segment segment = { -1, -1 };
+        for (int k = 0; k < 3; ++k) {
+            int corner = triangle * 3 + k;
+            bool startBelow = positions[triangleIndices[corner]].z() < z;
+            bool endBelow = positions[triangleIndices[triangle * 3 + (k + 1) % 3]].z() < z;
+            if (startBelow && !endBelow) {
+                segment.endEdge = topology.edgeOfCorner(corner);
+            } else if (!startBelow && endBelow) {
+                segment.startEdge = topology.edgeOfCorner(corner);
+            }
+        }
+        if (segment.startEdge >= 0 && segment.endEdge >= 0) {
+            segments.push_back(segment);
+        }
+    }
+
+    if (segments.empty()) {
+        return;
+    }
+
+    // Look-up tables: which segment starts (or ends) at a given edge
+    int segmentCount = int(segments.size());
+    std::vector<std::pair<int, int>> byStart(segmentCount);
+    std::vector<std::pair<int, int>> byEnd(segmentCount);
+    for (int s = 0; s < segmentCount; ++s) {
+        byStart[s] = std::make_pair(segments[s].startEdge, s);
+        byEnd[s] = std::make_pair(segments[s].endEdge, s);
+    }
+    std::sort(byStart.begin(), byStart.end());
+    std::sort(byEnd.begin(), byEnd.end());
+
+    std::vector<unsigned char> used(segmentCount, 0);
+    auto findUnused = [&used](const std::vector<std::pair<int, int>>& table, int edge) {
+        auto it = std::lower_bound(table.begin(), table.end(), std::make_pair(edge, -1));
+        for (; it != table.end() && it->first == edge; ++it) {
+            if (!used[it->second]) {
+                return it->second;
+            }
+        }
+        return -1;
+    };
+
+    for (int seed = 0; seed < segmentCount; ++seed) {
+        if (used[seed]) {
+            continue;
+        }
+
+        // On a broken mesh the chain may be open, so first walk back to where it begins
+        int first = seed;
+        for (int steps = 0; steps < segmentCount; ++steps) {
+            int previous = findUnused(byEnd, segments[first].startEdge);
+            if (previous < 0 || previous == seed) {
+                break;
+            }
+            first = previous;
+        }
+
+        // Then follow the chain forward, one welded edge at a time
+        // (a plane through a vertex cuts several edges in the same spot, so skip repeated points)
+        SliceContour contour;
+        auto addPoint = [&contour](const QVector3D& point) {
+            if (contour.points.isEmpty() || contour.points.last() != point) {
+                contour.points.append(point);
+            }
+        };
+
+        int current = first;
+        while (current >= 0) {
+            used[current] = 1;
+            addPoint(edgeCrossing(segments[current].startEdge, z));
+
+            int endEdge = segments[current].endEdge;
+            if (endEdge == segments[first].startEdge) {
+                contour.closed = true;
+                if (contour.points.size() > 1 && contour.points.last() == contour.points.first()) {
+                    contour.points.removeLast();
+                }
+                break;
+            }
+            current = findUnused(byStart, endEdge);
+            if (current < 0) {
+                addPoint(edgeCrossing(endEdge, z));
+            }
+        }
+
+        if (contour.points.size() >= 2) {
+            layer.contours.append(contour);
+        }
+    }
+}
+
+QVector3D MeshSlicer::edgeCrossing(int edge, float z) const
+{
+    // Always interpolate from the edge's lower vertex index so both triangles sharing
+    // the edge produce exactly the same point
+    const QVector3D& a = positions[topology.edgeStart(edge)];
+    const QVector3D& b = positions[topology.edgeEnd(edge)];
+    float dz = b.z() - a.z();
+    float t = qFuzzyIsNull(dz) ? 0.0f : (z - a.z()) / dz;
+    t = qBound(0.0f, t, 1.0f);
+    return QVector3D(a.x() + (b.x() - a.x()) * t, a.y() + (b.y() - a.y()) * t, z);
+}
+
+bool MeshSlicer::exportCLI(const QString& fileName, const QVector<SliceLayer>& layers, QString* errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + file.errorString();
+        }
+        return false;
+    }
+
+    QByteArray header;
+    header.append("$$HEADERSTART\n$$ASCII\n$$UNITS/1.000000\n$$VERSION/200\n$$LAYERS/");
+    header.append(QByteArray::number(layers.size()));
+    header.append("\n$$HEADEREND\n$$GEOMETRYSTART\n");
+    file.write(header);
+
+    // Format the layers in parallel (text formatting is the slow part), then write them in order
+    const int batchSize = 256;
+    std::vector<QByteArray> text(qMin(batchSize, layers.size()));
+    for (int batchStart = 0; batchStart < layers.size(); batchStart += batchSize) {
+        int batchEnd = qMin(batchStart + batchSize, layers.size());
+
+        Parallel::forEach(batchEnd - batchStart, [&](qint64 i) {
+            const SliceLayer& layer = layers[batchStart + int(i)];
+            QByteArray& out = text[i];
+            out.clear();
+            out.append("$$LAYER/");
+            out.append(QByteArray::number(layer.z, 'f', 5));
+            out.append('\n');
+
+            for (int c = 0; c < layer.contours.size(); ++c) {
+                const SliceContour& contour = layer.contours[c];
+                // Direction code: 1 = outer (counter-clockwise), 0 = hole (clockwise), 2 = open line
+                int direction = !contour.closed ? 2 : (contour.signedArea() >= 0.0f ? 1 : 0);
+                int pointCount = contour.points.size() + (contour.closed ? 1 : 0);
+
+                out.append("$$POLYLINE/");
+                out.append(QByteArray::number(c));
+                out.append(',');
+                out.append(QByteArray::number(direction));
+                out.append(',');
+                out.append(QByteArray::number(pointCount));
+                for (int p = 0; p < pointCount; ++p) {
+                    const QVector3D& point = contour.points[p % contour.points.size()];
+                    out.append(',');
+                    out.append(QByteArray::number(point.x(), 'f', 5));
+                    out.append(',');
+                    out.append(QByteArray::number(point.y(), 'f', 5));
+                }
+                out.append('\n');
+            }
+        }, 1);
+
+        for (int i = 0; i < batchEnd - batchStart; ++i) {
+            if (file.write(text[i]) != text[i].size()) {
+                if (errorMessage) {
+                    *errorMessage = "Error while writing: " + file.errorString();
+                }
+                return false;
+            }
+        }
+    }
+
+    file.write("$$GEOMETRYEND\n");
+    file.close();
+
+    qDebug() << "MeshSlicer: exported" << layers.size() << "layers to" << fileName << "in" << timer.elapsed() << "ms";
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef MESHSLICER_H
+#define MESHSLICER_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include <vector>
+#include "meshtopology.h"
+
+// One closed (or, on broken meshes, open) outline where a plane cuts the model
+struct SliceContour {
+    QVector<QVector3D> points;  // Outline corners in order (first point is not repeated at the end)
+    bool closed;                // Does the outline come back to where it started?
+
+    SliceContour() : closed(false) {}
+
+    // Area enclosed in the XY plane: positive for outer outlines (counter-clockwise), negative for holes
+    float signedArea() const;
+};
+
+// All outlines at one height
+struct SliceLayer {
+    float z;                          // Height of the cutting plane
+    QVector<SliceContour> contours;   // Outlines found at this height
+
+    SliceLayer() : z(0.0f) {}
+};
+
+// Cuts a welded triangle mesh with horizontal planes and chains the cut segments into outlines.
+// Segments are joined through welded edge ids, so outlines close exactly without comparing floats.
+// Heights and outline points are in file units: the slicer undoes the centering/scaling the loader
+// applied (display = (file + offset) * scale) so exported contours match the original part.
+class MeshSlicer
+{
+public:
+    MeshSlicer();
+
+    // Take a copy of the mesh (6 floats per vertex, 3 indices per triangle) and prepare it for slicing
+    void setMesh(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                 float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(0, 0, 0));
+    void clear();
+    bool isEmpty() const { return triangleOrder.empty(); }
+
+    // Height range of the model in file units
+    float getMinZ() const { return minZ; }
+    float getMaxZ() const { return maxZ; }
+
+    // Cut the model at one height
+    SliceLayer sliceAt(float z) const;
+
+    // Cut the model at firstZ, firstZ + layerHeight, ... (layerCount layers), spread over all cores
+    QVector<SliceLayer> sliceLayers(float firstZ, float layerHeight, int layerCount) const;
+
+    // Cut the whole model into layers of the given thickness, each cut through the middle of its layer
+    QVector<SliceLayer> sliceUniform(float layerHeight) const;
+
+    // Write layers as a Common Layer Interface (CLI) ASCII file, the usual additive manufacturing slice format
+    static bool exportCLI(const QString& fileName, const QVector<SliceLayer>& layers, QString* errorMessage = nullptr);
+
+private:
+    // One cut through a triangle: enters through one edge, leaves through another
+    struct Segment {
+        int startEdge;
+        int endEdge;
+    };
+
+    void sweepLayers(float firstZ, float layerHeight, int firstLayer, int lastLayer, SliceLayer* layers) const;
+    void cutTriangles(float z, const std::vector<int>& active, SliceLayer& layer) const;
+    QVector3D edgeCrossing(int edge, float z) const;
+
+    QVector<QVector3D> positions;        // Vertex positions in file units
+    QVector<unsigned int> indices;       // 3 vertex indices per triangle
+    MeshTopology topology;               // Welded edge ids used to join segments
+    std::vector<int> triangleOrder;      // Triangle ids sorted by their lowest Z
+    std::vector<float> orderedMinZ;      // Lowest Z of each triangle in triangleOrder
+    std::vector<float> orderedMaxZ;      // Highest Z of each triangle in triangleOrder
+    float minZ;                          // Bottom of the model
+    float maxZ;                          // Top of the model
+};
+
+#endif // MESHSLICER_H
@@ -0,0 +1,137 @@
+#include "meshthickness.h"
+#include "meshbvh.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QVector3D>
+#include <cfloat>
+#include <vector>
+
+namespace {
+
+// Running statistics, one per thread so the ray loop never shares anything
+struct PartialStats {
+    float minimum = FLT_MAX;
+    float maximum = 0.0f;
+    double sum = 0.0;
+    int hits = 0;
+    int missed = 0;
+    int thin = 0;
+};
+
+} // namespace
+
+MeshThickness::Report MeshThickness::measure(const MeshBVH& bvh, const QVector<unsigned int>& indices, int vertexCount,
+                                             Sampling sampling, QVector<float>& thickness, float thinLimit)
+{
+    Report report;
+    report.thinLimit = thinLimit;
+    thickness.clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (bvh.isEmpty()) {
+        qWarning() << "MeshThickness: nothing to measure";
+        return report;
+    }
+    if (sampling == Vertices && (indices.isEmpty() || vertexCount <= 0)) {
+        qWarning() << "MeshThickness: vertex sampling needs a welded mesh, using facets";
+        sampling = Facets;
+    }
+
+    // Vertex samples start from one of the corners that use the vertex
+    std::vector<int> vertexCorner;
+    if (sampling == Vertices) {
+        vertexCorner.assign(vertexCount, -1);
+        for (int c = 0; c < indices.size(); ++c) {
+            unsigned int v = indices[c];
+            if (v < unsigned(vertexCount) && vertexCorner[v] < 0) {
+                vertexCorner[v] = c;
+            }
+        }
+    }
+
+    // Rays from a vertex start a hair inside the surface, so they do not hit the triangles
+    // around their own vertex; the offset is added back to the measured distance
+    QVector3D extent = bvh.getBoundsMax() - bvh.getBoundsMin();
+    const float startOffset = extent.length() * 1e-5f;
+
+    int sampleCount = (sampling == Vertices) ? vertexCount : bvh.getTriangleCount();
+    thickness.resize(sampleCount);
+    float* thicknessData = thickness.data();
+    const int* cornerData = vertexCorner.data();
+    std::vector<PartialStats> partial(Parallel::threadCount());
+
+    Parallel::forBlocks(sampleCount, 256, [&](qint64 begin, qint64 end, int thread) {
+        PartialStats stats = partial[thread];
+        for (qint64 s = begin; s < end; ++s) {
+            QVector3D origin;
+            QVector3D inward;
+            int ignore = -1;
+            float offset = 0.0f;
+
+            if (sampling == Vertices) {
+                int corner = cornerData[s];
+                if (corner < 0) {
+                    // Vertex not used by any triangle
+                    thicknessData[s] = NoHit;
+                    continue;
+                }
+                inward = -bvh.vertexNormal(corner / 3, corner % 3);
+                origin = bvh.triangleCorner(corner / 3, corner % 3) + inward * startOffset;
+                offset = startOffset;
+            } else {
+                int t = int(s);
+                origin = (bvh.triangleCorner(t, 0) + bvh.triangleCorner(t, 1) + bvh.triangleCorner(t, 2)) / 3.0f;
+                inward = -bvh.triangleNormal(t);
+                ignore = t;
+            }
+
+            MeshBVH::RayHit hit;
+            if (inward.isNull() || !bvh.raycast(origin, inward, hit, FLT_MAX, ignore)) {
+                thicknessData[s] = NoHit;
+                ++stats.missed;
+                continue;
+            }
+
+            float value = hit.distance + offset;
+            thicknessData[s] = value;
+            stats.minimum = qMin(stats.minimum, value);
+            stats.maximum = qMax(stats.maximum, value);
+            stats.sum += value;
+            ++stats.hits;
+            if (value < thinLimit) {
+                ++stats.thin;
+            }
+        }
+        partial[thread] = stats;
+    });
+
+    // Combine the per-thread results
+    PartialStats total;
+    for (const PartialStats& stats : partial) {
+        total.minimum = qMin(total.minimum, stats.minimum);
+        total.maximum = qMax(total.maximum, stats.maximum);
+        total.sum += stats.sum;
+        total.hits += stats.hits;
+        total.missed += stats.missed;
+        total.thin += stats.thin;
+    }
+
+    report.samples = sampleCount;
+    report.missed = total.missed;
+    report.thinSamples = total.thin;
+    if (total.hits > 0) {
+        report.minThickness = total.minimum;
+        report.maxThickness = total.maximum;
+        report.averageThickness = float(total.sum / total.hits);
+    }
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshThickness:" << report.samples << (sampling == Vertices ? "vertices" : "facets") << "in"
+             << report.milliseconds << "ms, thickness" << report.minThickness << "to" << report.maxThickness
+             << "(average" << report.averageThickness << ")," << report.thinSamples << "thin,"
+             << report.missed << "missed";
+    return report;
+}
@@ -0,0 +1,40 @@
+#ifndef MESHTHICKNESS_H
+#define MESHTHICKNESS_H
+
+#include <QVector>
+
+class MeshBVH;
+
+// Wall thickness analysis: from every sample on the surface a ray is cast straight into the
+// material (against the outward normal), and the distance to the wall on the other side is the
+// local thickness. Rays run on all cores against a shared BVH. Works in file units.
+class MeshThickness
+{
+public:
+    enum Sampling {
+        Vertices,   // One ray per welded vertex, along the reversed vertex normal
+        Facets      // One ray per triangle, from its centroid along the reversed face normal
+    };
+
+    // Summary of one analysis
+    struct Report {
+        int samples = 0;              // Rays cast
+        int missed = 0;               // Rays that left the model without hitting a wall (open surface)
+        int thinSamples = 0;          // Samples thinner than the thin-wall limit
+        float thinLimit = 0.0f;       // The limit they were counted against
+        float minThickness = 0.0f;    // Over the samples that hit something
+        float maxThickness = 0.0f;
+        float averageThickness = 0.0f;
+        qint64 milliseconds = 0;      // Time spent
+    };
+
+    // Value stored for samples whose ray hit nothing
+    static constexpr float NoHit = -1.0f;
+
+    // Fill `thickness` with one value per sample: per vertex (vertexCount values, needs indices)
+    // or per triangle. Samples below thinLimit are counted as thin.
+    static Report measure(const MeshBVH& bvh, const QVector<unsigned int>& indices, int vertexCount,
+                          Sampling sampling, QVector<float>& thickness, float thinLimit = 0.0f);
+};
+
+#endif // MESHTHICKNESS_H
@@ -0,0 +1,109 @@
+#include "meshtopology.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+
+namespace {
+
+// One triangle corner, keyed by the (unordered) pair of vertices of the edge it starts
+struct CornerKey {
+    quint64 key;   // smaller vertex index in the high 32 bits, larger one in the low 32 bits
+    int corner;    // which corner (3 * triangle + 0..2) this edge came from
+
+    bool operator<(const CornerKey& other) const {
+        return key < other.key || (key == other.key && corner < other.corner);
+    }
+};
+
+}
+
+MeshTopology::MeshTopology()
+    : boundaryEdges(0)
+    , nonManifoldEdges(0)
+{
+}
+
+void MeshTopology::clear()
+{
+    cornerEdges.clear();
+    cornerNeighbors.clear();
+    cornerMismatch.clear();
+    edgeFaces.clear();
+    edgeVertices.clear();
+    boundaryEdges = 0;
+    nonManifoldEdges = 0;
+}
+
+void MeshTopology::build(const QVector<unsigned int>& indices)
+{
+    clear();
+
+    int cornerCount = indices.size() - indices.size() % 3;
+    if (cornerCount == 0) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Write one key per corner, then sort so that corners sharing an edge end up next to each other
+    std::vector<CornerKey> keys(cornerCount);
+    Parallel::forEach(cornerCount, [&](qint64 c) {
+        int corner = int(c);
+        int next = corner - corner % 3 + (corner % 3 + 1) % 3;
+        quint64 a = indices[corner];
+        quint64 b = indices[next];
+        keys[corner].key = (a < b) ? ((a << 32) | b) : ((b << 32) | a);
+        keys[corner].corner = corner;
+    });
+    Parallel::sort(keys.begin(), keys.end());
+
+    cornerEdges.resize(cornerCount);
+    cornerNeighbors.fill(-1, cornerCount);
+    cornerMismatch.fill(0, cornerCount);
+    edgeFaces.reserve(cornerCount / 2 + 1);
+    edgeVertices.reserve(cornerCount + 2);
+
+    // Walk the runs of equal keys: every run is one unique edge
+    int runStart = 0;
+    while (runStart < cornerCount) {
+        int runEnd = runStart + 1;
+        while (runEnd < cornerCount && keys[runEnd].key == keys[runStart].key) {
+            ++runEnd;
+        }
+
+        int edge = edgeFaces.size();
+        int faces = runEnd - runStart;
+        quint64 key = keys[runStart].key;
+        edgeFaces.append(faces);
+        edgeVertices.append(static_cast<unsigned int>(key >> 32));
+        edgeVertices.append(static_cast<unsigned int>(key & 0xffffffffu));
+
+        for (int k = runStart; k < runEnd; ++k) {
+            cornerEdges[keys[k].corner] = edge;
+        }
+
+        if (faces == 1) {
+            boundaryEdges++;
+        } else if (faces == 2) {
+            int c0 = keys[runStart].corner;
+            int c1 = keys[runStart + 1].corner;
+            // Skip collapsed edges (both ends welded into the same vertex)
+            if ((key >> 32) != (key & 0xffffffffu)) {
+                cornerNeighbors[c0] = c1 / 3;
+                cornerNeighbors[c1] = c0 / 3;
+                // Consistently wound neighbors walk a shared edge in opposite directions
+                unsigned char mismatch = (indices[c0] == indices[c1]) ? 1 : 0;
+                cornerMismatch[c0] = mismatch;
+                cornerMismatch[c1] = mismatch;
+            }
+        } else {
+            nonManifoldEdges++;
+        }
+
+        runStart = runEnd;
+    }
+
+    qDebug() << "Edge topology built in" << timer.elapsed() << "ms:" << edgeFaces.size() << "edges,"
+             << boundaryEdges << "boundary," << nonManifoldEdges << "non-manifold";
+}
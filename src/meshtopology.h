@@ -0,0 +1,50 @@
+#ifndef MESHTOPOLOGY_H
+#define MESHTOPOLOGY_H
+
+#include <QVector>
+
+// Which triangles share which edges in an indexed (welded) triangle mesh.
+// Every triangle t has three "corners" 3t, 3t+1, 3t+2. Corner c stands for the edge that
+// starts at indices[c] and ends at the next corner of the same triangle.
+class MeshTopology
+{
+public:
+    MeshTopology();
+
+    // Build the edge tables from an index buffer (3 indices per triangle)
+    void build(const QVector<unsigned int>& indices);
+    void clear();
+
+    // Unique edge id of the edge that starts at this corner
+    int edgeOfCorner(int corner) const { return cornerEdges[corner]; }
+
+    // The triangle on the other side of this corner's edge, or -1 for boundary and non-manifold edges
+    int neighborOfCorner(int corner) const { return cornerNeighbors[corner]; }
+
+    // True when both triangles walk the shared edge the same way round (their windings disagree)
+    bool isWindingMismatch(int corner) const { return cornerMismatch[corner] != 0; }
+
+    // How many triangles use this edge: 1 = boundary, 2 = manifold, more = non-manifold
+    int edgeFaceCount(int edge) const { return edgeFaces[edge]; }
+
+    // Both vertex indices of an edge (smaller index first)
+    unsigned int edgeStart(int edge) const { return edgeVertices[edge * 2]; }
+    unsigned int edgeEnd(int edge) const { return edgeVertices[edge * 2 + 1]; }
+
+    int getTriangleCount() const { return cornerEdges.size() / 3; }
+    int getEdgeCount() const { return edgeFaces.size(); }
+    int getBoundaryEdgeCount() const { return boundaryEdges; }
+    int getNonManifoldEdgeCount() const { return nonManifoldEdges; }
+    bool isClosed() const { return boundaryEdges == 0 && nonManifoldEdges == 0; }
+
+private:
+    QVector<int> cornerEdges;              // Edge id for every corner
+    QVector<int> cornerNeighbors;          // Triangle across every corner's edge (-1 if none)
+    QVector<unsigned char> cornerMismatch; // 1 when the neighbor walks the edge in the same direction
+    QVector<int> edgeFaces;                // Number of triangles using each edge
+    QVector<unsigned int> edgeVertices;    // Two vertex indices per edge
+    int boundaryEdges;                     // Edges used by a single triangle
+    int nonManifoldEdges;                  // Edges used by three or more triangles
+};
+
+#endif // MESHTOPOLOGY_H
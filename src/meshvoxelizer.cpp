@@ -0,0 +1,683 @@
+#include "meshvoxelizer.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// One triangle that overlaps one brick (or one column of bricks, for the solid fill)
+struct BinnedTriangle {
+    quint64 key;
+    int triangle;
+
+    bool operator<(const BinnedTriangle& other) const {
+        return key < other.key || (key == other.key && triangle < other.triangle);
+    }
+};
+
+// Voxels along one axis whose boxes touch [low, high], clamped to the grid.
+// A tiny pad keeps triangles lying exactly on a voxel face in both neighbours.
+void voxelSpan(float low, float high, float origin, float voxelSize, int count, int& first, int& last)
+{
+    const float pad = 1e-4f;
+    first = qMax(0, int(std::floor((low - origin) / voxelSize - pad)));
+    last = qMin(count - 1, int(std::floor((high - origin) / voxelSize + pad)));
+}
+
+// Separating axis test between one triangle and many equally sized cubes.
+// The 13 axes and the triangle's extent along them are worked out once in setup(),
+// so each cube only costs one dot product per axis.
+class TriangleBoxTest
+{
+public:
+    void setup(const QVector3D* corners, float halfSize)
+    {
+        axisCount = 0;
+        const QVector3D edges[3] = {
+            corners[1] - corners[0], corners[2] - corners[1], corners[0] - corners[2]
+        };
+        const QVector3D unitAxes[3] = { QVector3D(1, 0, 0), QVector3D(0, 1, 0), QVector3D(0, 0, 1) };
+
+        for (const QVector3D& axis : unitAxes) {
+            addAxis(axis, corners, halfSize);
+        }
+        addAxis(QVector3D::crossProduct(edges[0], edges[1]), corners, halfSize);
+        for (const QVector3D& edge : edges) {
+            for (const QVector3D& axis : unitAxes) {
+                addAxis(QVector3D::crossProduct(axis, edge), corners, halfSize);
+            }
+        }
+    }
+
+    bool overlaps(const QVector3D& center) const
+    {
+        for (int i = 0; i < axisCount; ++i) {
+            float d = axes[i][0] * center.x() + axes[i][1] * center.y() + axes[i][2] * center.z();
+            if (minProjection[i] - d > radius[i] || maxProjection[i] - d < -radius[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    void addAxis(const QVector3D& axis, const QVector3D* corners, float halfSize)
+    {
+        // Edges parallel to a box axis give a zero cross product: nothing to test
+        float extent = std::fabs(axis.x()) + std::fabs(axis.y()) + std::fabs(axis.z());
+        if (extent <= FLT_MIN) {
+            return;
+        }
+
+        float p0 = QVector3D::dotProduct(axis, corners[0]);
+        float p1 = QVector3D::dotProduct(axis, corners[1]);
+        float p2 = QVector3D::dotProduct(axis, corners[2]);
+
+        axes[axisCount][0] = axis.x();
+        axes[axisCount][1] = axis.y();
+        axes[axisCount][2] = axis.z();
+        minProjection[axisCount] = qMin(p0, qMin(p1, p2));
+        maxProjection[axisCount] = qMax(p0, qMax(p1, p2));
+        // Slightly grow the box so touching counts as overlapping (conservative voxelization)
+        radius[axisCount] = halfSize * extent * 1.0001f;
+        axisCount++;
+    }
+
+    float axes[13][3];
+    float minProjection[13];
+    float maxProjection[13];
+    float radius[13];
+    int axisCount = 0;
+};
+
+// Which side of the edge a -> b the point (y, z) is on, in the YZ plane: +1 left, -1 right.
+// Points exactly on the line are nudged by a fixed tiny offset (+y first, then +z), and the edge is
+// always evaluated in the same direction, so two triangles sharing an edge never both claim or both
+// miss a ray that hits the edge. Returns 0 only if a and b coincide in YZ.
+int edgeSide(const QVector3D& start, const QVector3D& end, double y, double z)
+{
+    bool swapped = start.y() > end.y() || (start.y() == end.y() && start.z() > end.z());
+    const QVector3D& a = swapped ? end : start;
+    const QVector3D& b = swapped ? start : end;
+
+    double dy = double(b.y()) - a.y();
+    double dz = double(b.z()) - a.z();
+    double w = dy * (z - a.z()) - dz * (y - a.y());
+    if (w == 0.0) {
+        w = -dz;
+    }
+    if (w == 0.0) {
+        w = dy;
+    }
+    if (w == 0.0) {
+        return 0;
+    }
+
+    int side = w > 0.0 ? 1 : -1;
+    return swapped ? -side : side;
+}
+
+// Where the line along X through (y, z) passes through the triangle. The sign is +1 when the
+// triangle faces +X and -1 when it faces -X, so summing signs along the ray gives the winding number.
+bool rayCrossing(const QVector3D* corners, double y, double z, float& x, int& sign)
+{
+    int s0 = edgeSide(corners[0], corners[1], y, z);
+    if (s0 == 0 || s0 != edgeSide(corners[1], corners[2], y, z) || s0 != edgeSide(corners[2], corners[0], y, z)) {
+        return false;
+    }
+
+    const QVector3D& a = corners[0];
+    double ux = double(corners[1].x()) - a.x(), uy = double(corners[1].y()) - a.y(), uz = double(corners[1].z()) - a.z();
+    double vx = double(corners[2].x()) - a.x(), vy = double(corners[2].y()) - a.y(), vz = double(corners[2].z()) - a.z();
+    double nx = uy * vz - uz * vy;
+    double ny = uz * vx - ux * vz;
+    double nz = ux * vy - uy * vx;
+    if (nx == 0.0) {
+        return false;
+    }
+
+    x = float(a.x() - (ny * (y - a.y()) + nz * (z - a.z())) / nx);
+    sign = s0;
+    return true;
+}
+
+// Collect the per-thread bins into one list sorted by key
+std::vector<BinnedTriangle> mergeBins(std::vector<std::vector<BinnedTriangle>>& perThread)
+{
+    size_t total = 0;
+    for (const std::vector<BinnedTriangle>& bin : perThread) {
+        total += bin.size();
+    }
+
+    std::vector<BinnedTriangle> merged;
+    merged.reserve(total);
+    for (std::vector<BinnedTriangle>& bin : perThread) {
+        merged.insert(merged.end(), bin.begin(), bin.end());
+        std::vector<BinnedTriangle>().swap(bin);
+    }
+    Parallel::sort(merged.begin(), merged.end());
+    return merged;
+}
+
+// Start of every run of equal keys, plus the end of the list as the last entry
+std::vector<int> findRuns(const std::vector<BinnedTriangle>& binned)
+{
+    std::vector<int> runs;
+    for (int i = 0; i < int(binned.size()); ++i) {
+        if (i == 0 || binned[i].key != binned[i - 1].key) {
+            runs.push_back(i);
+        }
+    }
+    runs.push_back(int(binned.size()));
+    return runs;
+}
+
+// Set bits [first, last) of a row, a whole word at a time where possible
+void setBitRange(quint64* row, int first, int last)
+{
+    while (first < last) {
+        int bit = first % 64;
+        int count = qMin(64 - bit, last - first);
+        quint64 mask = (count == 64) ? ~quint64(0) : (((quint64(1) << count) - 1) << bit);
+        row[first / 64] |= mask;
+        first += count;
+    }
+}
+
+bool allWordsFull(const quint64* words)
+{
+    for (int w = 0; w < VoxelGrid::BrickWords; ++w) {
+        if (words[w] != ~quint64(0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool allWordsEmpty(const quint64* words)
+{
+    for (int w = 0; w < VoxelGrid::BrickWords; ++w) {
+        if (words[w] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+VoxelGrid::VoxelGrid()
+    : fullBricks(0)
+    , sizeX(0)
+    , sizeY(0)
+    , sizeZ(0)
+    , voxelSize(0.0f)
+{
+}
+
+void VoxelGrid::clear()
+{
+    brickKeys.clear();
+    brickOffsets.clear();
+    words.clear();
+    fullBricks = 0;
+    sizeX = sizeY = sizeZ = 0;
+    origin = QVector3D(0, 0, 0);
+    voxelSize = 0.0f;
+}
+
+QVector3D VoxelGrid::voxelCenter(int x, int y, int z) const
+{
+    return origin + QVector3D(x + 0.5f, y + 0.5f, z + 0.5f) * voxelSize;
+}
+
+int VoxelGrid::findBrick(quint64 key) const
+{
+    auto it = std::lower_bound(brickKeys.constBegin(), brickKeys.constEnd(), key);
+    if (it == brickKeys.constEnd() || *it != key) {
+        return -1;
+    }
+    return int(it - brickKeys.constBegin());
+}
+
+bool VoxelGrid::isSet(int x, int y, int z) const
+{
+    if (x < 0 || y < 0 || z < 0 || x >= sizeX || y >= sizeY || z >= sizeZ) {
+        return false;
+    }
+
+    int brick = findBrick(makeBrickKey(x / BrickSize, y / BrickSize, z / BrickSize));
+    if (brick < 0) {
+        return false;
+    }
+
+    int offset = brickOffsets[brick];
+    if (offset < 0) {
+        return true;
+    }
+    quint64 word = words[offset * BrickWords + z % BrickSize];
+    return (word >> ((y % BrickSize) * BrickSize + x % BrickSize)) & 1;
+}
+
+const quint64* VoxelGrid::brickWords(int brick) const
+{
+    int offset = brickOffsets[brick];
+    return offset < 0 ? nullptr : words.constData() + offset * BrickWords;
+}
+
+qint64 VoxelGrid::countVoxels() const
+{
+    std::vector<qint64> partial(Parallel::threadCount(), 0);
+    const quint64* bits = words.constData();
+    Parallel::forChunks(words.size(), [&](qint64 begin, qint64 end, int thread) {
+        qint64 count = 0;
+        for (qint64 i = begin; i < end; ++i) {
+            count += qPopulationCount(bits[i]);
+        }
+        partial[thread] = count;
+    });
+
+    qint64 total = qint64(fullBricks) * BrickSize * BrickSize * BrickSize;
+    for (qint64 count : partial) {
+        total += count;
+    }
+    return total;
+}
+
+qint64 VoxelGrid::getMemoryBytes() const
+{
+    return qint64(brickKeys.size()) * sizeof(quint64) + qint64(brickOffsets.size()) * sizeof(int)
+         + qint64(words.size()) * sizeof(quint64);
+}
+
+MeshVoxelizer::Report MeshVoxelizer::voxelize(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                                              int resolution, Mode mode, VoxelGrid& grid,
+                                              float displayScale, const QVector3D& displayOffset)
+{
+    Report report;
+    grid.clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int vertexCount = vertexData.size() / 6;
+    int triangleCount = indices.isEmpty() ? vertexCount / 3 : indices.size() / 3;
+    if (triangleCount == 0 || displayScale <= 0.0f) {
+        qWarning() << "MeshVoxelizer: nothing to voxelize";
+        return report;
+    }
+    resolution = qBound(1, resolution, int(MaxResolution));
+
+    // Gather the three corners of every triangle, back in file units
+    QVector<QVector3D> corners(triangleCount * 3);
+    QVector3D* cornerData = corners.data();
+    const float* source = vertexData.constData();
+    const unsigned int* indexData = indices.constData();
+    bool indexed = !indices.isEmpty();
+    Parallel::forEach(triangleCount * 3, [&](qint64 c) {
+        qint64 v = indexed ? qint64(indexData[c]) : c;
+        cornerData[c] = QVector3D(source[v * 6], source[v * 6 + 1], source[v * 6 + 2]) / displayScale - displayOffset;
+    });
+
+    // Bounding box, one partial box per thread
+    int threads = Parallel::threadCount();
+    std::vector<QVector3D> partialMin(threads, QVector3D(FLT_MAX, FLT_MAX, FLT_MAX));
+    std::vector<QVector3D> partialMax(threads, QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    Parallel::forChunks(corners.size(), [&](qint64 begin, qint64 end, int thread) {
+        QVector3D low = partialMin[thread];
+        QVector3D high = partialMax[thread];
+        for (qint64 c = begin; c < end; ++c) {
+            const QVector3D& p = cornerData[c];
+            low = QVector3D(qMin(low.x(), p.x()), qMin(low.y(), p.y()), qMin(low.z(), p.z()));
+            high = QVector3D(qMax(high.x(), p.x()), qMax(high.y(), p.y()), qMax(high.z(), p.z()));
+        }
+        partialMin[thread] = low;
+        partialMax[thread] = high;
+    });
+    QVector3D low = partialMin[0];
+    QVector3D high = partialMax[0];
+    for (int t = 1; t < threads; ++t) {
+        low = QVector3D(qMin(low.x(), partialMin[t].x()), qMin(low.y(), partialMin[t].y()), qMin(low.z(), partialMin[t].z()));
+        high = QVector3D(qMax(high.x(), partialMax[t].x()), qMax(high.y(), partialMax[t].y()), qMax(high.z(), partialMax[t].z()));
+    }
+
+    QVector3D extent = high - low;
+    float longest = qMax(extent.x(), qMax(extent.y(), extent.z()));
+    if (!(longest > 0.0f)) {
+        qWarning() << "MeshVoxelizer: model has no size";
+        return report;
+    }
+
+    // One empty voxel of padding on every side, so rows along X start and end outside the model
+    grid.voxelSize = longest / resolution;
+    grid.origin = low - QVector3D(grid.voxelSize, grid.voxelSize, grid.voxelSize);
+    grid.sizeX = int(std::ceil(extent.x() / grid.voxelSize)) + 2;
+    grid.sizeY = int(std::ceil(extent.y() / grid.voxelSize)) + 2;
+    grid.sizeZ = int(std::ceil(extent.z() / grid.voxelSize)) + 2;
+
+    voxelizeSurface(corners, grid);
+    report.surfaceVoxels = grid.countVoxels();
+
+    if (mode == Solid) {
+        report.leakyRows = fillSolid(corners, grid);
+        report.filledVoxels = grid.countVoxels();
+    } else {
+        report.filledVoxels = report.surfaceVoxels;
+    }
+
+    report.sizeX = grid.sizeX;
+    report.sizeY = grid.sizeY;
+    report.sizeZ = grid.sizeZ;
+    report.voxelSize = grid.voxelSize;
+    report.bricks = grid.getBrickCount();
+    report.fullBricks = grid.getFullBrickCount();
+    report.bytes = grid.getMemoryBytes();
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "MeshVoxelizer:" << report.sizeX << "x" << report.sizeY << "x" << report.sizeZ << "grid,"
+             << report.surfaceVoxels << "surface voxels," << report.filledVoxels << "filled,"
+             << report.bricks << "bricks (" << report.fullBricks << "full )," << report.bytes << "bytes in"
+             << report.milliseconds << "ms";
+    if (report.leakyRows > 0) {
+        qWarning() << "MeshVoxelizer:" << report.leakyRows << "rows not filled because the surface is open";
+    }
+    return report;
+}
+
+void MeshVoxelizer::voxelizeSurface(const QVector<QVector3D>& corners, VoxelGrid& grid)
+{
+    const int triangleCount = corners.size() / 3;
+    const QVector3D* cornerData = corners.constData();
+    const float voxelSize = grid.voxelSize;
+    const QVector3D origin = grid.origin;
+    const int brick = VoxelGrid::BrickSize;
+
+    // Pass 1: list which bricks every triangle touches (coarse test against the whole brick)
+    std::vector<std::vector<BinnedTriangle>> perThread(Parallel::threadCount());
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int thread) {
+        std::vector<BinnedTriangle>& bin = perThread[thread];
+        TriangleBoxTest test;
+        for (qint64 t = begin; t < end; ++t) {
+            const QVector3D* tri = cornerData + t * 3;
+            int x0, x1, y0, y1, z0, z1;
+            voxelSpan(qMin(tri[0].x(), qMin(tri[1].x(), tri[2].x())), qMax(tri[0].x(), qMax(tri[1].x(), tri[2].x())),
+                      origin.x(), voxelSize, grid.sizeX, x0, x1);
+            voxelSpan(qMin(tri[0].y(), qMin(tri[1].y(), tri[2].y())), qMax(tri[0].y(), qMax(tri[1].y(), tri[2].y())),
+                      origin.y(), voxelSize, grid.sizeY, y0, y1);
+            voxelSpan(qMin(tri[0].z(), qMin(tri[1].z(), tri[2].z())), qMax(tri[0].z(), qMax(tri[1].z(), tri[2].z())),
+                      origin.z(), voxelSize, grid.sizeZ, z0, z1);
+            x0 /= brick; x1 /= brick;
+            y0 /= brick; y1 /= brick;
+            z0 /= brick; z1 /= brick;
+
+            bool single = (x0 == x1 && y0 == y1 && z0 == z1);
+            if (!single) {
+                test.setup(tri, voxelSize * brick * 0.5f);
+            }
+            for (int bz = z0; bz <= z1; ++bz) {
+                for (int by = y0; by <= y1; ++by) {
+                    for (int bx = x0; bx <= x1; ++bx) {
+                        QVector3D center = origin + QVector3D(bx + 0.5f, by + 0.5f, bz + 0.5f) * (voxelSize * brick);
+                        if (single || test.overlaps(center)) {
+                            bin.push_back({ VoxelGrid::makeBrickKey(bx, by, bz), int(t) });
+                        }
+                    }
+                }
+            }
+        }
+    }, 256);
+
+    std::vector<BinnedTriangle> binned = mergeBins(perThread);
+    std::vector<int> runs = findRuns(binned);
+    int runCount = int(runs.size()) - 1;
+
+    // Pass 2: every brick tests its own voxels against the triangles binned to it, so no two
+    // threads ever write the same bits
+    std::vector<quint64> runWords(size_t(qMax(0, runCount)) * VoxelGrid::BrickWords, 0);
+    Parallel::forBlocks(runCount, 64, [&](qint64 begin, qint64 end, int) {
+        TriangleBoxTest test;
+        for (qint64 r = begin; r < end; ++r) {
+            quint64 key = binned[runs[r]].key;
+            int baseX = VoxelGrid::brickKeyX(key) * brick;
+            int baseY = VoxelGrid::brickKeyY(key) * brick;
+            int baseZ = VoxelGrid::brickKeyZ(key) * brick;
+            quint64* out = runWords.data() + r * VoxelGrid::BrickWords;
+
+            for (int i = runs[r]; i < runs[r + 1]; ++i) {
+                const QVector3D* tri = cornerData + binned[i].triangle * 3;
+                int x0, x1, y0, y1, z0, z1;
+                voxelSpan(qMin(tri[0].x(), qMin(tri[1].x(), tri[2].x())), qMax(tri[0].x(), qMax(tri[1].x(), tri[2].x())),
+                          origin.x(), voxelSize, grid.sizeX, x0, x1);
+                voxelSpan(qMin(tri[0].y(), qMin(tri[1].y(), tri[2].y())), qMax(tri[0].y(), qMax(tri[1].y(), tri[2].y())),
+                          origin.y(), voxelSize, grid.sizeY, y0, y1);
+                voxelSpan(qMin(tri[0].z(), qMin(tri[1].z(), tri[2].z())), qMax(tri[0].z(), qMax(tri[1].z(), tri[2].z())),
+                          origin.z(), voxelSize, grid.sizeZ, z0, z1);
+                x0 = qMax(x0, baseX); x1 = qMin(x1, baseX + brick - 1);
+                y0 = qMax(y0, baseY); y1 = qMin(y1, baseY + brick - 1);
+                z0 = qMax(z0, baseZ); z1 = qMin(z1, baseZ + brick - 1);
+
+                test.setup(tri, voxelSize * 0.5f);
+                for (int z = z0; z <= z1; ++z) {
+                    for (int y = y0; y <= y1; ++y) {
+                        for (int x = x0; x <= x1; ++x) {
+                            quint64 bit = quint64(1) << ((y - baseY) * brick + (x - baseX));
+                            if (!(out[z - baseZ] & bit) && test.overlaps(grid.voxelCenter(x, y, z))) {
+                                out[z - baseZ] |= bit;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Keep the bricks that really got voxels
+    for (int r = 0; r < runCount; ++r) {
+        const quint64* bits = runWords.data() + size_t(r) * VoxelGrid::BrickWords;
+        if (allWordsEmpty(bits)) {
+            continue;
+        }
+        grid.brickKeys.append(binned[runs[r]].key);
+        if (allWordsFull(bits)) {
+            grid.brickOffsets.append(-1);
+            grid.fullBricks++;
+        } else {
+            grid.brickOffsets.append(grid.words.size() / VoxelGrid::BrickWords);
+            for (int w = 0; w < VoxelGrid::BrickWords; ++w) {
+                grid.words.append(bits[w]);
+            }
+        }
+    }
+}
+
+int MeshVoxelizer::fillSolid(const QVector<QVector3D>& corners, VoxelGrid& grid)
+{
+    const int triangleCount = corners.size() / 3;
+    const QVector3D* cornerData = corners.constData();
+    const float voxelSize = grid.voxelSize;
+    const QVector3D origin = grid.origin;
+    const int brick = VoxelGrid::BrickSize;
+
+    // Bin triangles into columns of 8x8 rows (one brick wide in Y and Z, the whole grid long in X).
+    // Uses the same spans as the surface pass, so every column holding a surface brick gets visited.
+    std::vector<std::vector<BinnedTriangle>> perThread(Parallel::threadCount());
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int thread) {
+        std::vector<BinnedTriangle>& bin = perThread[thread];
+        for (qint64 t = begin; t < end; ++t) {
+            const QVector3D* tri = cornerData + t * 3;
+            int y0, y1, z0, z1;
+            voxelSpan(qMin(tri[0].y(), qMin(tri[1].y(), tri[2].y())), qMax(tri[0].y(), qMax(tri[1].y(), tri[2].y())),
+                      origin.y(), voxelSize, grid.sizeY, y0, y1);
+            voxelSpan(qMin(tri[0].z(), qMin(tri[1].z(), tri[2].z())), qMax(tri[0].z(), qMax(tri[1].z(), tri[2].z())),
+                      origin.z(), voxelSize, grid.sizeZ, z0, z1);
+            for (int bz = z0 / brick; bz <= z1 / brick; ++bz) {
+                for (int by = y0 / brick; by <= y1 / brick; ++by) {
+                    bin.push_back({ VoxelGrid::makeBrickKey(0, by, bz), int(t) });
+                }
+            }
+        }
+    }, 256);
+
+    std::vector<BinnedTriangle> binned = mergeBins(perThread);
+    std::vector<int> runs = findRuns(binned);
+    int columnCount = int(runs.size()) - 1;
+
+    // Every column produces its own bricks; they are joined in column order afterwards,
+    // which keeps the brick keys sorted
+    struct ColumnBricks {
+        std::vector<quint64> keys;
+        std::vector<unsigned char> full;
+        std::vector<quint64> words;
+    };
+    std::vector<ColumnBricks> columns(qMax(0, columnCount));
+    std::atomic<int> leakyRows(0);
+
+    const int bricksX = (grid.sizeX + brick - 1) / brick;
+    const int wordsPerRow = (grid.sizeX + 63) / 64;
+    const quint64* surfaceKeys = grid.brickKeys.constData();
+    const int surfaceCount = grid.brickKeys.size();
+
+    Parallel::forBlocks(columnCount, 4, [&](qint64 begin, qint64 end, int) {
+        std::vector<quint64> rowBits(size_t(brick) * brick * wordsPerRow);
+        std::vector<std::pair<float, int>> crossings;
+
+        for (qint64 c = begin; c < end; ++c) {
+            quint64 columnKey = binned[runs[c]].key;
+            int by = VoxelGrid::brickKeyY(columnKey);
+            int bz = VoxelGrid::brickKeyZ(columnKey);
+            std::fill(rowBits.begin(), rowBits.end(), 0);
+
+            // Cast one ray along X through the voxel centers of every row and fill where the winding number is not zero
+            for (int lz = 0; lz < brick; ++lz) {
+                int z = bz * brick + lz;
+                if (z >= grid.sizeZ) {
+                    break;
+                }
+                double zc = origin.z() + (z + 0.5) * voxelSize;
+
+                for (int ly = 0; ly < brick; ++ly) {
+                    int y = by * brick + ly;
+                    if (y >= grid.sizeY) {
+                        break;
+                    }
+                    double yc = origin.y() + (y + 0.5) * voxelSize;
+
+                    crossings.clear();
+                    for (int i = runs[c]; i < runs[c + 1]; ++i) {
+                        const QVector3D* tri = cornerData + binned[i].triangle * 3;
+                        if (yc < qMin(tri[0].y(), qMin(tri[1].y(), tri[2].y())) || yc > qMax(tri[0].y(), qMax(tri[1].y(), tri[2].y()))
+                            || zc < qMin(tri[0].z(), qMin(tri[1].z(), tri[2].z())) || zc > qMax(tri[0].z(), qMax(tri[1].z(), tri[2].z()))) {
+                            continue;
+                        }
+                        float x;
+                        int sign;
+                        if (rayCrossing(tri, yc, zc, x, sign)) {
+                            crossings.push_back(std::make_pair(x, sign));
+                        }
+                    }
+                    if (crossings.size() < 2) {
+                        if (!crossings.empty()) {
+                            leakyRows++;
+                        }
+                        continue;
+                    }
+                    std::sort(crossings.begin(), crossings.end());
+
+                    // A ray that leaves the model a different number of times than it enters went through a hole
+                    int total = 0;
+                    for (const std::pair<float, int>& crossing : crossings) {
+                        total += crossing.second;
+                    }
+                    if (total != 0) {
+                        leakyRows++;
+                        continue;
+                    }
+
+                    quint64* row = rowBits.data() + size_t(ly + lz * brick) * wordsPerRow;
+                    int winding = 0;
+                    for (size_t k = 0; k + 1 < crossings.size(); ++k) {
+                        winding += crossings[k].second;
+                        if (winding == 0) {
+                            continue;
+                        }
+                        // Voxels whose centers lie between this crossing and the next one
+                        int first = qMax(0, int(std::ceil((crossings[k].first - origin.x()) / voxelSize - 0.5f)));
+                        int last = qMin(grid.sizeX, int(std::ceil((crossings[k + 1].first - origin.x()) / voxelSize - 0.5f)));
+                        setBitRange(row, first, last);
+                    }
+                }
+            }
+
+            // Surface bricks of this column, already in X order
+            quint64 columnStart = VoxelGrid::makeBrickKey(0, by, bz);
+            int surface = int(std::lower_bound(surfaceKeys, surfaceKeys + surfaceCount, columnStart) - surfaceKeys);
+
+            // Cut the rows into bricks and merge in the surface voxels
+            ColumnBricks& out = columns[c];
+            for (int bx = 0; bx < bricksX; ++bx) {
+                quint64 bits[VoxelGrid::BrickWords];
+                for (int lz = 0; lz < brick; ++lz) {
+                    quint64 word = 0;
+                    for (int ly = 0; ly < brick; ++ly) {
+                        quint64 rowWord = rowBits[size_t(ly + lz * brick) * wordsPerRow + bx / 8];
+                        word |= ((rowWord >> ((bx % 8) * 8)) & 0xff) << (ly * brick);
+                    }
+                    bits[lz] = word;
+                }
+
+                quint64 key = VoxelGrid::makeBrickKey(bx, by, bz);
+                if (surface < surfaceCount && surfaceKeys[surface] == key) {
+                    int offset = grid.brickOffsets[surface];
+                    for (int w = 0; w < VoxelGrid::BrickWords; ++w) {
+                        bits[w] |= offset < 0 ? ~quint64(0) : grid.words[offset * VoxelGrid::BrickWords + w];
+                    }
+                    surface++;
+                }
+
+                if (allWordsEmpty(bits)) {
+                    continue;
+                }
+                out.keys.push_back(key);
+                if (allWordsFull(bits)) {
+                    out.full.push_back(1);
+                } else {
+                    out.full.push_back(0);
+                    out.words.insert(out.words.end(), bits, bits + VoxelGrid::BrickWords);
+                }
+            }
+        }
+    });
+
+    // Replace the surface-only bricks with the filled ones
+    QVector<quint64> keys;
+    QVector<int> offsets;
+    QVector<quint64> words;
+    int fullBricks = 0;
+    for (ColumnBricks& column : columns) {
+        size_t nextWord = 0;
+        for (size_t i = 0; i < column.keys.size(); ++i) {
+            keys.append(column.keys[i]);
+            if (column.full[i]) {
+                offsets.append(-1);
+                fullBricks++;
+            } else {
+                offsets.append(words.size() / VoxelGrid::BrickWords);
+                for (int w = 0; w < VoxelGrid::BrickWords; ++w) {
+                    words.append(column.words[nextWord++]);
+                }
+            }
+        }
+        column = ColumnBricks();
+    }
+
+    grid.brickKeys = keys;
+    grid.brickOffsets = offsets;
+    grid.words = words;
+    grid.fullBricks = fullBricks;
+    return leakyRows;
+}
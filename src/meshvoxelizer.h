@@ -0,0 +1,105 @@
+#ifndef MESHVOXELIZER_H
+#define MESHVOXELIZER_H
+
+#include <QVector>
+#include <QVector3D>
+
+// A sparse voxel grid: only 8x8x8 bricks that contain set voxels are stored.
+// Bricks that are completely filled (the inside of a solid) cost just their key,
+// so large grids (2048^3 and up) fit in memory without a dense array.
+class VoxelGrid
+{
+public:
+    static const int BrickSize = 8;        // Voxels per brick along each axis
+    static const int BrickWords = 8;       // 64-bit words per brick: one per Z slice, 8 rows of 8 bits
+
+    VoxelGrid();
+    void clear();
+    bool isEmpty() const { return brickKeys.isEmpty(); }
+
+    // Grid geometry (voxel (0,0,0) spans origin .. origin + voxelSize)
+    int getSizeX() const { return sizeX; }
+    int getSizeY() const { return sizeY; }
+    int getSizeZ() const { return sizeZ; }
+    QVector3D getOrigin() const { return origin; }
+    float getVoxelSize() const { return voxelSize; }
+    QVector3D voxelCenter(int x, int y, int z) const;
+
+    // Is the voxel at (x, y, z) filled? Coordinates outside the grid are empty.
+    bool isSet(int x, int y, int z) const;
+
+    // Number of filled voxels
+    qint64 countVoxels() const;
+
+    // Bricks are kept sorted by key, so neighbouring bricks along X sit next to each other
+    int getBrickCount() const { return brickKeys.size(); }
+    int getFullBrickCount() const { return fullBricks; }
+    quint64 brickKey(int brick) const { return brickKeys[brick]; }
+    bool isBrickFull(int brick) const { return brickOffsets[brick] < 0; }
+    const quint64* brickWords(int brick) const;   // nullptr for full bricks
+    qint64 getMemoryBytes() const;
+
+    // Brick coordinates are packed 21 bits per axis: z in the high bits, then y, then x
+    static quint64 makeBrickKey(int brickX, int brickY, int brickZ) {
+        return (quint64(brickZ) << 42) | (quint64(brickY) << 21) | quint64(brickX);
+    }
+    static int brickKeyX(quint64 key) { return int(key & 0x1fffff); }
+    static int brickKeyY(quint64 key) { return int((key >> 21) & 0x1fffff); }
+    static int brickKeyZ(quint64 key) { return int(key >> 42); }
+
+private:
+    friend class MeshVoxelizer;
+
+    int findBrick(quint64 key) const;
+
+    QVector<quint64> brickKeys;    // Sorted keys of the stored bricks
+    QVector<int> brickOffsets;     // Where each brick's words start in words (in bricks), -1 = completely full
+    QVector<quint64> words;        // Bit storage for partially filled bricks
+    int fullBricks;
+    int sizeX, sizeY, sizeZ;
+    QVector3D origin;
+    float voxelSize;
+};
+
+// Turns a triangle mesh into voxels. Surface mode marks every voxel the surface touches
+// (conservative: triangle/box overlap, so thin walls never fall between voxels). Solid mode
+// also fills the inside by casting one ray along X per voxel row.
+// Works in file units: the loader's centering/scaling (display = (file + offset) * scale) is undone.
+class MeshVoxelizer
+{
+public:
+    enum Mode {
+        Surface,    // Only voxels touched by the triangles
+        Solid       // Surface voxels plus everything inside
+    };
+
+    // Largest number of voxels along the longest side
+    static const int MaxResolution = 65536;
+
+    // What the voxelizer made and how long it took
+    struct Report {
+        int sizeX = 0;                // Grid size in voxels
+        int sizeY = 0;
+        int sizeZ = 0;
+        float voxelSize = 0.0f;       // Edge length of one voxel in file units
+        qint64 surfaceVoxels = 0;     // Voxels touched by the surface
+        qint64 filledVoxels = 0;      // All set voxels (surface + inside in solid mode)
+        int bricks = 0;               // Stored 8x8x8 bricks
+        int fullBricks = 0;           // Bricks stored without bits because every voxel is set
+        int leakyRows = 0;            // Rows left unfilled because the surface has holes along them
+        qint64 bytes = 0;             // Memory used by the grid
+        qint64 milliseconds = 0;      // Time spent
+    };
+
+    // Voxelize with `resolution` voxels along the longest side of the model. Without indices,
+    // every 3 consecutive vertices form a triangle (the loader's unmerged layout).
+    static Report voxelize(const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                           int resolution, Mode mode, VoxelGrid& grid,
+                           float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(0, 0, 0));
+
+private:
+    static void voxelizeSurface(const QVector<QVector3D>& corners, VoxelGrid& grid);
+    static int fillSolid(const QVector<QVector3D>& corners, VoxelGrid& grid);
+};
+
+#endif // MESHVOXELIZER_H
@@ -0,0 +1,267 @@
+#include "modelprefetcher.h"
+#include "modelreloader.h"
+#include "stlloader.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <exception>
+#include <memory>
+
+#if defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ModelPrefetcher::ModelPrefetcher()
+    : stopping(false)
+    , budget(512LL * 1024 * 1024)
+{
+}
+
+ModelPrefetcher::~ModelPrefetcher()
+{
+    pause();
+    join();
+}
+
+qint64 ModelPrefetcher::Model::memoryBytes() const
+{
+    return qint64(vertexData.size() + vertexColors.size()) * qint64(sizeof(float))
+           + qint64(indices.size()) * qint64(sizeof(unsigned int));
+}
+
+void ModelPrefetcher::setMemoryBudget(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = qMax<qint64>(0, bytes);
+}
+
+qint64 ModelPrefetcher::memoryBudget() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+}
+
+void ModelPrefetcher::prefetch(const QStringList &files)
+{
+    pause();
+    join();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = ready.begin(); it != ready.end();) {
+            if (files.contains(it->first)) {
+                ++it;
+            } else {
+                it = ready.erase(it);
+            }
+        }
+        stopping = false;
+    }
+    if (!files.isEmpty()) {
+        worker = std::thread(&ModelPrefetcher::run, this, files);
+    }
+}
+
+void ModelPrefetcher::pause()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+}
+
+void ModelPrefetcher::join()
+{
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool ModelPrefetcher::take(const QString &fileName, Model &model)
+{
+    bool found = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this, &fileName]() { return parsing != fileName; });
+        auto it = ready.find(fileName);
+        if (it != ready.end()) {
+            model = std::move(it->second);
+            ready.erase(it);
+            found = true;
+        }
+    }
+    // Checked outside the lock: it asks the file system
+    found = found && isCurrent(model);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (found) {
+        ++counters.hits;
+    } else {
+        ++counters.misses;
+    }
+    return found;
+}
+
+ModelPrefetcher::Stats ModelPrefetcher::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats current = counters;
+    current.readyModels = int(ready.size());
+    current.readyBytes = 0;
+    for (const auto &entry : ready) {
+        current.readyBytes += entry.second.memoryBytes();
+    }
+    return current;
+}
+
+qint64 ModelPrefetcher::warmPageCache(const QString &fileName)
+{
+#if defined(Q_OS_UNIX)
+    int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    const qint64 size = qint64(info.st_size);
+#if defined(Q_OS_LINUX)
+    // The kernel starts reading the whole file in the background and returns straight away
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#else
+    // No fadvise here (macOS): map the file and say its pages will be needed soon
+    if (size > 0) {
+        void *mapping = ::mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            ::madvise(mapping, size_t(size), MADV_WILLNEED);
+            ::munmap(mapping, size_t(size));
+        }
+    }
+#endif
+    ::close(fd);
+    return size;
+#else
+    // Nothing to ask the system for: reading the file once leaves it in the cache
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const qint64 chunkSize = 1024 * 1024;
+    std::unique_ptr<char[]> chunk(new char[chunkSize]);
+    while (file.read(chunk.get(), chunkSize) > 0) {
+    }
+    return file.size();
+#endif
+}
+
+bool ModelPrefetcher::isCurrent(const Model &model)
+{
+    QFileInfo info(model.fileName);
+    return info.exists() && info.size() == model.fileSize
+           && info.lastModified().toMSecsSinceEpoch() == model.modifiedMSecs;
+}
+
+bool ModelPrefetcher::makeRoom(const QStringList &files, int position, qint64 bytes)
+{
+    qint64 used = 0;
+    for (const auto &entry : ready) {
+        used += entry.second.memoryBytes();
+    }
+    // Drop the least likely models, but never one the user is more likely to open than this one
+    for (int i = files.size() - 1; i > position && used + bytes > budget; --i) {
+        auto it = ready.find(files[i]);
+        if (it != ready.end()) {
+            used -= it->second.memoryBytes();
+            ready.erase(it);
+        }
+    }
+    return used + bytes <= budget;
+}
+
+void ModelPrefetcher::run(const QStringList &files)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Pass 1: page cache. Cheap, so every file gets it, in order of likelihood.
+    for (const QString &fileName : files) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return;
+            }
+        }
+        qint64 bytes = warmPageCache(fileName);
+        if (bytes >= 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++counters.warmedFiles;
+            counters.warmedBytes += bytes;
+        }
+    }
+
+    // Pass 2: parse as many as the memory budget allows
+    for (int i = 0; i < files.size(); ++i) {
+        const QString &fileName = files[i];
+        QFileInfo info(fileName);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return;
+            }
+            auto it = ready.find(fileName);
+            if (it != ready.end()) {
+                if (it->second.fileSize == info.size()
+                    && it->second.modifiedMSecs == info.lastModified().toMSecsSinceEpoch()) {
+                    continue;
+                }
+                ready.erase(it);    // Changed on disk since it was parsed
+            }
+            // The file size is a fair guess at the parsed size (binary STL parses a bit smaller)
+            if (!info.exists() || !makeRoom(files, i, info.size())) {
+                continue;
+            }
+            parsing = fileName;
+        }
+
+        Model model;
+        model.fileName = fileName;
+        model.fileSize = info.size();
+        model.modifiedMSecs = info.lastModified().toMSecsSinceEpoch();
+        bool ok = false;
+        try {
+            STLLoader loader;
+            ModelReloader::configureLoader(loader);
+            if (loader.loadFile(fileName) == STLLoader::Success && !loader.getVertexData().isEmpty()) {
+                model.vertexData = loader.getVertexData();
+                model.indices = loader.getIndices();
+                if (loader.hasVertexColors()) {
+                    model.vertexColors = loader.getVertexColors();
+                }
+                model.triangleCount = loader.getTriangleCount();
+                model.modelScale = loader.getModelScale();
+                model.modelOffset = loader.getModelOffset();
+                ok = true;
+            }
+        } catch (const std::exception &e) {
+            qWarning() << "ModelPrefetcher:" << fileName << "could not be parsed:" << e.what();
+        }
+
+        {
+            // Kept even if a pause came in meanwhile: the viewer may be waiting for exactly this file
+            std::lock_guard<std::mutex> lock(mutex);
+            parsing.clear();
+            if (ok && makeRoom(files, i, model.memoryBytes())) {
+                ready[fileName] = std::move(model);
+            }
+        }
+        wake.notify_all();
+    }
+
+    Stats done = stats();
+    qDebug() << "ModelPrefetcher: warmed" << done.warmedFiles << "files, holding" << done.readyModels << "parsed models ("
+             << done.readyBytes / (1024 * 1024) << "MB) after" << timer.elapsed() << "ms";
+}
@@ -0,0 +1,92 @@
+#ifndef MODELPREFETCHER_H
+#define MODELPREFETCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVector3D>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Gets the models the user is likely to open next ready while the viewer is idle, so that opening
+// one from the recent files list does not start from a cold disk.
+//
+// Given a list of files (most likely first), a background thread does two passes:
+//   1. Warm: ask the operating system to pull every file into its page cache (posix_fadvise on
+//      Linux, madvise on other Unix systems, a plain read-through elsewhere). This costs no memory
+//      of our own, and a later load reads from RAM instead of the disk.
+//   2. Parse: load the files in order with the viewer's own loader settings and keep the results,
+//      ready to upload, as long as they fit in the memory budget. Files further down the list are
+//      dropped to make room for ones further up.
+// take() hands a parsed model over if the file has not changed since it was parsed.
+class ModelPrefetcher
+{
+public:
+    // A parsed model, the same data a fresh File > Open would upload
+    struct Model {
+        QString fileName;
+        qint64 fileSize = 0;              // The file as it was parsed, to notice later changes
+        qint64 modifiedMSecs = 0;
+        QVector<float> vertexData;        // Position + normal per vertex
+        QVector<unsigned int> indices;
+        QVector<float> vertexColors;      // Empty if the file has none
+        int triangleCount = 0;
+        float modelScale = 1.0f;
+        QVector3D modelOffset;
+
+        qint64 memoryBytes() const;
+    };
+
+    struct Stats {
+        int warmedFiles = 0;              // Files handed to the page cache
+        qint64 warmedBytes = 0;
+        int readyModels = 0;              // Parsed models being held
+        qint64 readyBytes = 0;            // Memory they use
+        int hits = 0;                     // Opens served from a parsed model
+        int misses = 0;                   // Opens that had to load the file
+    };
+
+    ModelPrefetcher();
+    ~ModelPrefetcher();
+
+    void setMemoryBudget(qint64 bytes);   // For parsed models; 0 only warms the page cache
+    qint64 memoryBudget() const;
+
+    // Start preparing these files in the background, most likely first. Replaces an earlier list;
+    // parsed models that are not on the new list are dropped.
+    void prefetch(const QStringList &files);
+
+    // Ask the background work to stop after the file it is on (e.g. because the viewer is about
+    // to load a file itself); parsed models stay
+    void pause();
+
+    // Hand over the parsed model for a file, if there is one and the file is unchanged. If the
+    // file is being parsed right now, waits for it: that is quicker than starting over.
+    // The model is removed from the prefetcher either way.
+    bool take(const QString &fileName, Model &model);
+
+    Stats stats() const;
+
+    // Ask the operating system to read a whole file into its page cache. Returns the file size
+    // in bytes, or -1 if the file could not be opened.
+    static qint64 warmPageCache(const QString &fileName);
+
+private:
+    void run(const QStringList &files);
+    void join();
+    static bool isCurrent(const Model &model);
+    bool makeRoom(const QStringList &files, int position, qint64 bytes);   // Call with the mutex held
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    qint64 budget;
+    QString parsing;                      // The file the worker is parsing now, if any
+    std::map<QString, Model> ready;
+    Stats counters;
+};
+
+#endif // MODELPREFETCHER_H
@@ -0,0 +1,193 @@
+#include "modelreloader.h"
+#include "parallel.h"
+#include "stlloader.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <cstring>
+
+namespace {
+
+// A fast 64-bit hash over whole words; only used to tell blocks apart, not for security
+quint64 hashBytes(const char *data, size_t size)
+{
+    quint64 hash = 0x9E3779B97F4A7C15ull ^ quint64(size);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        quint64 word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ quint8(data[i])) * 0xC4CEB9FE1A85EC53ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+} // namespace
+
+ModelReloader::ModelReloader()
+    : busy(false)
+    , hasResult(false)
+{
+}
+
+ModelReloader::~ModelReloader()
+{
+    stop();
+}
+
+void ModelReloader::configureLoader(STLLoader &loader)
+{
+    loader.setAutoCenter(true);
+    loader.setAutoNormalize(true);
+    loader.setRemoveDuplicateFacets(true);  // Doubled facets cause z-fighting
+    loader.setRepairOrientation(true);      // Mixed winding would make culled triangles vanish
+}
+
+void ModelReloader::start(const QString &fileName, const Current &current, std::function<void()> done)
+{
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy = true;
+        hasResult = false;
+    }
+    doneCallback = std::move(done);
+    // The current data is shared, not copied: the viewer replaces its vectors rather than changing them
+    worker = std::thread(&ModelReloader::reload, this, fileName, current);
+}
+
+bool ModelReloader::takeResult(Result &reloaded)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hasResult) {
+        return false;
+    }
+    reloaded = std::move(result);
+    result = Result();
+    hasResult = false;
+    return true;
+}
+
+bool ModelReloader::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busy;
+}
+
+void ModelReloader::stop()
+{
+    // A load cannot be interrupted half way; wait for it and forget what it found
+    if (worker.joinable()) {
+        worker.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    busy = false;
+    hasResult = false;
+    result = Result();
+}
+
+QVector<quint64> ModelReloader::blockHashes(const QVector<float> &vertexData, int floatsPerVertex)
+{
+    const qint64 vertexCount = vertexData.size() / qMax(1, floatsPerVertex);
+    const qint64 blockCount = (vertexCount + BlockVertices - 1) / BlockVertices;
+    QVector<quint64> hashes(int(blockCount), 0);
+    const size_t vertexBytes = size_t(floatsPerVertex) * sizeof(float);
+    const char *data = reinterpret_cast<const char *>(vertexData.constData());
+
+    // Blocks are independent, so big models hash on every core
+    Parallel::forChunks(blockCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 block = begin; block < end; ++block) {
+            const qint64 first = block * BlockVertices;
+            const qint64 count = qMin<qint64>(BlockVertices, vertexCount - first);
+            hashes[int(block)] = hashBytes(data + size_t(first) * vertexBytes, size_t(count) * vertexBytes);
+        }
+    }, 64);
+    return hashes;
+}
+
+QVector<ModelReloader::Range> ModelReloader::changedRanges(const QVector<quint64> &before, const QVector<quint64> &after,
+                                                            int vertexCount)
+{
+    QVector<Range> ranges;
+    for (int block = 0; block < after.size(); ++block) {
+        if (block < before.size() && before[block] == after[block]) {
+            continue;
+        }
+        const int first = block * BlockVertices;
+        const int count = qMin(BlockVertices, vertexCount - first);
+        if (!ranges.isEmpty() && ranges.last().firstVertex + ranges.last().vertexCount == first) {
+            ranges.last().vertexCount += count;
+        } else {
+            Range range;
+            range.firstVertex = first;
+            range.vertexCount = count;
+            ranges.append(range);
+        }
+    }
+    return ranges;
+}
+
+void ModelReloader::reload(const QString &fileName, const Current &current)
+{
+    QElapsedTimer timer;
+    timer.start();
+    Result reloaded;
+    reloaded.fileName = fileName;
+
+    try {
+        STLLoader loader;
+        configureLoader(loader);
+        if (loader.loadFile(fileName) != STLLoader::Success) {
+            reloaded.errorMessage = loader.getErrorString();
+        } else if (loader.getVertexData().isEmpty()) {
+            reloaded.errorMessage = "The file has no triangles";
+        } else {
+            reloaded.ok = true;
+            reloaded.vertexData = loader.getVertexData();
+            reloaded.indices = loader.getIndices();
+            if (loader.hasVertexColors()) {
+                reloaded.vertexColors = loader.getVertexColors();
+            }
+            reloaded.triangleCount = loader.getTriangleCount();
+            reloaded.modelScale = loader.getModelScale();
+            reloaded.modelOffset = loader.getModelOffset();
+
+            // Same welded triangles: the index buffer stays, and only changed vertex blocks are sent.
+            // The cheap size checks come first; the index lists are only compared when they match.
+            const int vertexCount = reloaded.vertexData.size() / 6;
+            reloaded.blockHashes = blockHashes(reloaded.vertexData, 6);
+            reloaded.sameTopology = reloaded.vertexData.size() == current.vertexData.size()
+                                    && reloaded.indices.size() == current.indices.size()
+                                    && reloaded.indices == current.indices;
+            if (reloaded.sameTopology) {
+                // The hashes of what is on screen normally come from the previous reload
+                const bool haveHashes = current.blockHashes.size() == reloaded.blockHashes.size();
+                reloaded.changedRanges = changedRanges(haveHashes ? current.blockHashes : blockHashes(current.vertexData, 6),
+                                                       reloaded.blockHashes, vertexCount);
+                for (const Range &range : reloaded.changedRanges) {
+                    reloaded.changedVertices += range.vertexCount;
+                }
+            } else {
+                reloaded.changedVertices = vertexCount;
+            }
+        }
+    } catch (const std::exception &e) {
+        reloaded.ok = false;
+        reloaded.errorMessage = QString("Reload failed: %1").arg(e.what());
+    }
+    reloaded.milliseconds = timer.elapsed();
+    qDebug() << "ModelReloader:" << fileName << (reloaded.ok ? "reloaded" : "failed") << "in" << reloaded.milliseconds << "ms,"
+             << reloaded.changedVertices << "vertices changed";
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = std::move(reloaded);
+        hasResult = true;
+        busy = false;
+    }
+    if (doneCallback) {
+        doneCallback();
+    }
+}
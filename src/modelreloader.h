@@ -0,0 +1,85 @@
+#ifndef MODELRELOADER_H
+#define MODELRELOADER_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class STLLoader;
+
+// Reads a model file again after it changed on disk (a CAD program re-exported it) and works out
+// how little of what is on the graphics card has to be replaced.
+//
+// The file is loaded on a background thread with the viewer's own settings. If the welded
+// triangles are the same as before (same index list), the vertex data is compared block by block:
+// every BlockVertices vertices are hashed, and only blocks whose hashes differ are reported as
+// changed, so the viewer rewrites just those ranges of its vertex buffer. Anything else (triangles
+// added or removed, vertices renumbered) needs a full upload. The hashes of each reload are handed
+// back, so the next reload only has to hash the new file.
+class ModelReloader
+{
+public:
+    static const int BlockVertices = 1024;    // 24 KB of position + normal data per hashed block
+
+    struct Range {
+        int firstVertex = 0;
+        int vertexCount = 0;
+    };
+
+    // What the viewer shows now; the reload is compared against it
+    struct Current {
+        QVector<float> vertexData;        // Position + normal per vertex, as uploaded
+        QVector<unsigned int> indices;
+        QVector<quint64> blockHashes;     // Of vertexData, from the previous Result (empty: hashed here)
+    };
+
+    struct Result {
+        bool ok = false;
+        QString fileName;
+        QString errorMessage;
+        QVector<float> vertexData;
+        QVector<unsigned int> indices;
+        QVector<float> vertexColors;      // Empty if the file has none
+        int triangleCount = 0;
+        float modelScale = 1.0f;
+        QVector3D modelOffset;
+        bool sameTopology = false;        // Same index list: only vertex data needs replacing
+        QVector<Range> changedRanges;     // With sameTopology: the vertices to rewrite
+        QVector<quint64> blockHashes;     // Of vertexData; hand back in Current for the next reload
+        int changedVertices = 0;
+        qint64 milliseconds = 0;          // Loading and comparing
+    };
+
+    ModelReloader();
+    ~ModelReloader();
+
+    // The loader settings the viewer uses for models it shows, so a reload matches a fresh open
+    static void configureLoader(STLLoader &loader);
+
+    // Start reloading on a background thread; done is called on that thread once a result is ready
+    void start(const QString &fileName, const Current &current, std::function<void()> done);
+    bool takeResult(Result &reloaded);     // False if no result is ready
+    bool isBusy() const;
+    void stop();                           // Wait for a running reload and drop its result
+
+    // One hash per BlockVertices vertices of floatsPerVertex floats each
+    static QVector<quint64> blockHashes(const QVector<float> &vertexData, int floatsPerVertex);
+
+    // The vertices covered by blocks whose hashes differ, with neighbouring blocks joined
+    static QVector<Range> changedRanges(const QVector<quint64> &before, const QVector<quint64> &after, int vertexCount);
+
+private:
+    void reload(const QString &fileName, const Current &current);
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    bool busy;
+    bool hasResult;
+    Result result;
+    std::function<void()> doneCallback;
+};
+
+#endif // MODELRELOADER_H
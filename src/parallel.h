@@ -0,0 +1,223 @@
+// Small helpers for spreading mesh work across all CPU cores
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QThread>
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+// Per-thread cap on threadCount(), 0 means no cap. Set it with ThreadLimit.
+inline int &threadLimit()
+{
+    thread_local int limit = 0;
+    return limit;
+}
+
+// How many worker threads we should use (always at least one)
+inline int threadCount()
+{
+    int count = qMax(1, QThread::idealThreadCount());
+    return threadLimit() > 0 ? qMin(count, threadLimit()) : count;
+}
+
+// Caps threadCount() on the current thread while in scope. Code that already runs on one of several
+// worker threads uses this so the helpers below don't each start a full set of threads on top.
+class ThreadLimit
+{
+public:
+    explicit ThreadLimit(int limit) : previous(threadLimit()) { threadLimit() = qMax(1, limit); }
+    ~ThreadLimit() { threadLimit() = previous; }
+    ThreadLimit(const ThreadLimit&) = delete;
+    ThreadLimit& operator=(const ThreadLimit&) = delete;
+
+private:
+    int previous;
+};
+
+// Remembers the first exception thrown by any worker so it can be re-thrown on the calling thread
+class ErrorTrap
+{
+public:
+    template<typename Func>
+    void run(Func&& func)
+    {
+        try {
+            func();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    void rethrow()
+    {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::exception_ptr error;
+};
+
+// Split [0, count) into one contiguous chunk per thread and call func(begin, end, threadIndex).
+// Jobs smaller than minChunkSize stay on the calling thread since starting threads would cost more.
+// The threadIndex is always below threadCount(), so callers can keep per-thread results in an array.
+template<typename Func>
+void forChunks(qint64 count, Func func, qint64 minChunkSize = 4096)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    qint64 maxThreads = (count + minChunkSize - 1) / qMax<qint64>(1, minChunkSize);
+    int threads = int(qMin<qint64>(threadCount(), maxThreads));
+    if (threads <= 1) {
+        func(qint64(0), count, 0);
+        return;
+    }
+
+    qint64 chunk = (count + threads - 1) / threads;
+    ErrorTrap trap;
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for (int t = 1; t < threads; ++t) {
+        qint64 begin = t * chunk;
+        qint64 end = qMin(count, begin + chunk);
+        if (begin >= end) {
+            break;
+        }
+        workers.emplace_back([&trap, &func, begin, end, t]() {
+            trap.run([&]() { func(begin, end, t); });
+        });
+    }
+
+    // The calling thread does the first chunk itself instead of waiting idle
+    trap.run([&]() { func(qint64(0), qMin(count, chunk), 0); });
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    trap.rethrow();
+}
+
+// Like forChunks, but threads keep grabbing blocks of blockSize items until everything is done.
+// Use this when items take very different amounts of time (ray casts, per-layer work, ...).
+template<typename Func>
+void forBlocks(qint64 count, qint64 blockSize, Func func)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    blockSize = qMax<qint64>(1, blockSize);
+    qint64 blockCount = (count + blockSize - 1) / blockSize;
+    int threads = int(qMin<qint64>(threadCount(), blockCount));
+    if (threads <= 1) {
+        func(qint64(0), count, 0);
+        return;
+    }
+
+    std::atomic<qint64> nextBlock(0);
+    ErrorTrap trap;
+
+    auto worker = [&](int threadIndex) {
+        trap.run([&]() {
+            for (;;) {
+                qint64 block = nextBlock.fetch_add(1, std::memory_order_relaxed);
+                if (block >= blockCount) {
+                    break;
+                }
+                qint64 begin = block * blockSize;
+                func(begin, qMin(count, begin + blockSize), threadIndex);
+            }
+        });
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; ++t) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    trap.rethrow();
+}
+
+// Call func(i) for every i in [0, count), split evenly across threads
+template<typename Func>
+void forEach(qint64 count, Func func, qint64 minChunkSize = 4096)
+{
+    forChunks(count, [&func](qint64 begin, qint64 end, int) {
+        for (qint64 i = begin; i < end; ++i) {
+            func(i);
+        }
+    }, minChunkSize);
+}
+
+// Sort a random-access range in parallel: every thread sorts one slice,
+// then neighbouring slices are merged pairwise (also in parallel) until one run is left
+template<typename Iterator, typename Compare>
+void sort(Iterator first, Iterator last, Compare less)
+{
+    qint64 count = last - first;
+    const qint64 minSliceSize = 1 << 15;
+
+    int slices = int(qMin<qint64>(threadCount(), count / minSliceSize));
+    if (slices <= 1) {
+        std::sort(first, last, less);
+        return;
+    }
+
+    std::vector<qint64> bounds(slices + 1);
+    for (int s = 0; s <= slices; ++s) {
+        bounds[s] = count * s / slices;
+    }
+
+    forChunks(slices, [&](qint64 begin, qint64 end, int) {
+        for (qint64 s = begin; s < end; ++s) {
+            std::sort(first + bounds[s], first + bounds[s + 1], less);
+        }
+    }, 1);
+
+    // Merge runs of width 1, 2, 4, ... slices until the whole range is sorted
+    for (int width = 1; width < slices; width *= 2) {
+        int pairs = (slices + 2 * width - 1) / (2 * width);
+        forChunks(pairs, [&](qint64 begin, qint64 end, int) {
+            for (qint64 p = begin; p < end; ++p) {
+                int left = int(p) * 2 * width;
+                int middle = qMin(left + width, slices);
+                int right = qMin(left + 2 * width, slices);
+                if (middle < right) {
+                    std::inplace_merge(first + bounds[left], first + bounds[middle], first + bounds[right], less);
+                }
+            }
+        }, 1);
+    }
+}
+
+template<typename Iterator>
+void sort(Iterator first, Iterator last)
+{
+    Parallel::sort(first, last, std::less<typename std::iterator_traits<Iterator>::value_type>());
+}
+
+} // namespace Parallel
+
+#endif // PARALLEL_H
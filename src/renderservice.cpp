@@ -0,0 +1,1016 @@
+#include "renderservice.h"
+#include "meshscanner.h"
+#include "parallel.h"
+#include "stlloader.h"
+#include <QBuffer>
+#include <QByteArray>
+#include <QColor>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOffscreenSurface>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QSurfaceFormat>
+#include <QVector>
+#include <QVector3D>
+#include <QtMath>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(Q_OS_UNIX)
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int MinImageSize = 16;
+const int MaxImageSize = 8192;
+const int MaxRequestBytes = 64 * 1024;     // Longest request line accepted
+const int MaxConnections = 64;
+const int PollMilliseconds = 200;          // How often waiting threads look for a stop request
+
+std::atomic<bool> stopRequested(false);    // Set from the SIGINT/SIGTERM handler
+
+// A parsed mesh as the cache keeps it, measured once when it was loaded
+struct CachedMesh {
+    quint64 id = 0;                        // New for every load, so the GPU copy can tell it is stale
+    qint64 fileSize = 0;
+    qint64 modifiedMSecs = 0;
+    QVector<float> vertexData;             // File units, position + normal per vertex
+    QVector<unsigned int> indices;
+    MeshScanner::FileStats stats;
+
+    qint64 memoryBytes() const
+    {
+        return qint64(vertexData.size()) * qint64(sizeof(float)) + qint64(indices.size()) * qint64(sizeof(unsigned int));
+    }
+};
+
+// The most recently used meshes, within a memory budget. Shared by all job threads; a mesh that
+// is dropped while a job still uses it stays alive until that job is done with it.
+class MeshCache
+{
+public:
+    explicit MeshCache(qint64 budget)
+        : budget(budget)
+    {
+    }
+
+    // The mesh of this file, loaded now if it is not cached or has changed on disk since
+    std::shared_ptr<const CachedMesh> get(const QString &requestedName, QString *errorMessage)
+    {
+        QFileInfo info(requestedName);
+        if (!info.isFile()) {
+            *errorMessage = "File not found: " + requestedName;
+            return nullptr;
+        }
+        const QString fileName = info.absoluteFilePath();
+        const qint64 size = info.size();
+        const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(fileName);
+            if (it != entries.end() && it->second.mesh->fileSize == size && it->second.mesh->modifiedMSecs == modified) {
+                it->second.lastUse = ++useClock;
+                ++hits;
+                return it->second.mesh;
+            }
+        }
+
+        // Loaded outside the lock so other jobs are not held up
+        QElapsedTimer timer;
+        timer.start();
+        auto mesh = std::make_shared<CachedMesh>();
+        try {
+            STLLoader loader;
+            MeshScanner::configureLoader(loader);
+            if (loader.loadFile(fileName) != STLLoader::Success) {
+                *errorMessage = requestedName + ": " + loader.getErrorString();
+                return nullptr;
+            }
+            mesh->vertexData = loader.getVertexData();
+            mesh->indices = loader.getIndices();
+            MeshScanner::measureLoaded(loader, mesh->stats);
+        } catch (const std::exception &e) {
+            *errorMessage = QString("%1: failed: %2").arg(requestedName, e.what());
+            return nullptr;
+        }
+        mesh->fileSize = size;
+        mesh->modifiedMSecs = modified;
+        mesh->stats.file = fileName;
+        mesh->stats.bytes = size;
+        mesh->stats.milliseconds = timer.elapsed();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        mesh->id = nextId++;
+        ++loads;
+        auto it = entries.find(fileName);
+        if (it != entries.end()) {
+            used -= it->second.mesh->memoryBytes();
+            entries.erase(it);
+        }
+        entries[fileName] = Entry{mesh, ++useClock};
+        used += mesh->memoryBytes();
+
+        // Drop the least recently used meshes, but never the one just loaded
+        while (used > budget && entries.size() > 1) {
+            auto oldest = entries.end();
+            for (auto e = entries.begin(); e != entries.end(); ++e) {
+                if (e->first != fileName && (oldest == entries.end() || e->second.lastUse < oldest->second.lastUse)) {
+                    oldest = e;
+                }
+            }
+            used -= oldest->second.mesh->memoryBytes();
+            entries.erase(oldest);
+        }
+        return mesh;
+    }
+
+    QString statusJson() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return QString("\"meshes\":%1,\"meshBytes\":%2,\"meshHits\":%3,\"meshLoads\":%4")
+            .arg(int(entries.size()))
+            .arg(used)
+            .arg(hits)
+            .arg(loads);
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const CachedMesh> mesh;
+        quint64 lastUse = 0;
+    };
+
+    mutable std::mutex mutex;
+    qint64 budget;
+    qint64 used = 0;
+    quint64 nextId = 1;
+    quint64 useClock = 0;
+    qint64 hits = 0;
+    qint64 loads = 0;
+    std::map<QString, Entry> entries;
+};
+
+enum JobKind {
+    RenderJob,      // Needs the OpenGL context: runs on the render thread
+    MeasureJob      // CPU only: runs on the measure threads
+};
+
+struct Job {
+    JobKind kind = RenderJob;
+    RenderService::Request request;
+    qint64 received = 0;                   // Service clock, milliseconds
+    qint64 deadline = 0;
+    quint64 sequence = 0;                  // Breaks deadline ties in arrival order
+    bool done = false;
+    QString error;
+    QImage image;                          // Render result; made into a PNG by the connection thread
+    QByteArray json;                       // Measure result
+};
+
+// The shared state of a running service: the job queue and what the status request reports
+class Service
+{
+public:
+    explicit Service(const RenderService::Options &options)
+        : options(options)
+        , meshes(options.meshCacheBytes)
+    {
+        clock.start();
+    }
+
+    const RenderService::Options options;
+    QElapsedTimer clock;
+    MeshCache meshes;
+
+    bool isStopping()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stopping;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+    }
+
+    void submit(const std::shared_ptr<Job> &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->sequence = nextSequence++;
+            queue.push_back(job);
+        }
+        changed.notify_all();
+    }
+
+    // The queued job of this kind with the earliest deadline; nullptr once the service stops.
+    // Jobs whose deadline has already passed are answered with an error on the way.
+    std::shared_ptr<Job> take(JobKind kind)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            if (stopRequested) {
+                stopping = true;
+                changed.notify_all();
+            }
+            if (stopping) {
+                return nullptr;
+            }
+            auto next = queue.end();
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                if ((*it)->kind == kind
+                    && (next == queue.end() || (*it)->deadline < (*next)->deadline
+                        || ((*it)->deadline == (*next)->deadline && (*it)->sequence < (*next)->sequence))) {
+                    next = it;
+                }
+            }
+            if (next == queue.end()) {
+                changed.wait_for(lock, std::chrono::milliseconds(PollMilliseconds));
+                continue;
+            }
+            std::shared_ptr<Job> job = *next;
+            queue.erase(next);
+            const qint64 now = clock.elapsed();
+            if (now > job->deadline) {
+                job->error = QString("Deadline passed after %1 ms in the queue").arg(now - job->received);
+                job->done = true;
+                ++missedDeadlines;
+                changed.notify_all();
+                continue;
+            }
+            return job;
+        }
+    }
+
+    void finish(const std::shared_ptr<Job> &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->done = true;
+            if (!job->error.isEmpty()) {
+                ++failed;
+            } else if (job->kind == RenderJob) {
+                ++rendered;
+            } else {
+                ++measured;
+            }
+        }
+        changed.notify_all();
+    }
+
+    // Wait for a submitted job; false if the service stopped first
+    bool waitFor(const std::shared_ptr<Job> &job)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this, &job]() { return job->done || stopping; });
+        return job->done;
+    }
+
+    void countGpu(bool hit)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hit) {
+            ++gpuHits;
+        } else {
+            ++gpuUploads;
+        }
+    }
+
+    void countConnection(int change)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connections += change;
+    }
+
+    QString statusJson()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return QString("{\"uptimeMs\":%1,\"connections\":%2,\"queued\":%3,\"rendered\":%4,\"measured\":%5,"
+                       "\"failed\":%6,\"missedDeadlines\":%7,\"gpuHits\":%8,\"gpuUploads\":%9,")
+                   .arg(clock.elapsed())
+                   .arg(connections)
+                   .arg(int(queue.size()))
+                   .arg(rendered)
+                   .arg(measured)
+                   .arg(failed)
+                   .arg(missedDeadlines)
+                   .arg(gpuHits)
+                   .arg(gpuUploads)
+               + meshes.statusJson() + "}";
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::shared_ptr<Job>> queue;
+    quint64 nextSequence = 0;
+    bool stopping = false;
+    int connections = 0;
+    qint64 rendered = 0;
+    qint64 measured = 0;
+    qint64 failed = 0;
+    qint64 missedDeadlines = 0;
+    qint64 gpuHits = 0;
+    qint64 gpuUploads = 0;
+};
+
+bool intValue(const RenderService::Request &request, const QString &key, int fallback, int minimum, int maximum,
+              int &value, QString *errorMessage)
+{
+    value = fallback;
+    if (!request.values.contains(key)) {
+        return true;
+    }
+    bool ok = false;
+    value = request.values.value(key).toInt(&ok);
+    if (!ok || value < minimum || value > maximum) {
+        *errorMessage = QString("%1 must be a whole number from %2 to %3").arg(key).arg(minimum).arg(maximum);
+        return false;
+    }
+    return true;
+}
+
+bool floatValue(const RenderService::Request &request, const QString &key, float fallback, float minimum,
+                float maximum, float &value, QString *errorMessage)
+{
+    value = fallback;
+    if (!request.values.contains(key)) {
+        return true;
+    }
+    bool ok = false;
+    value = request.values.value(key).toFloat(&ok);
+    if (!ok || value < minimum || value > maximum) {
+        *errorMessage = QString("%1 must be a number from %2 to %3").arg(key).arg(minimum).arg(maximum);
+        return false;
+    }
+    return true;
+}
+
+bool colorValue(const RenderService::Request &request, const QString &key, const QColor &fallback, QColor &value,
+                QString *errorMessage)
+{
+    value = request.values.contains(key) ? QColor(request.values.value(key)) : fallback;
+    if (!value.isValid()) {
+        *errorMessage = key + " must be a colour like #c0c0c0";
+        return false;
+    }
+    return true;
+}
+
+// Owns the offscreen OpenGL context and everything on the graphics card. Only the render thread
+// (the one that created it) may call it.
+class Renderer : protected QOpenGLFunctions
+{
+public:
+    explicit Renderer(qint64 gpuBudget)
+        : gpuBudget(gpuBudget)
+        , gpuBytes(0)
+        , useClock(0)
+        , fboSamples(-1)
+    {
+    }
+
+    ~Renderer()
+    {
+        if (context.isValid() && context.makeCurrent(&surface)) {
+            for (auto &entry : gpuMeshes) {
+                entry.second.vertexBuffer.destroy();
+                entry.second.indexBuffer.destroy();
+            }
+            fbo.reset();
+            vao.destroy();
+            context.doneCurrent();
+        }
+    }
+
+    bool initialize(QString *errorMessage)
+    {
+        QSurfaceFormat format;
+        format.setDepthBufferSize(24);
+        format.setVersion(3, 3);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+        surface.setFormat(format);
+        surface.create();
+        context.setFormat(format);
+        if (!surface.isValid() || !context.create() || !context.makeCurrent(&surface)) {
+            *errorMessage = "Could not create an offscreen OpenGL 3.3 context";
+            return false;
+        }
+        initializeOpenGLFunctions();
+
+        // Flat shading from the screen-space derivatives: no trust in file normals needed
+        const char *vertexShaderSource = R"(
+            #version 330 core
+            layout (location = 0) in vec3 a_position;
+            uniform mat4 u_modelViewMatrix;
+            uniform mat4 u_projectionMatrix;
+            out vec3 v_viewPos;
+            void main()
+            {
+                vec4 viewPos = u_modelViewMatrix * vec4(a_position, 1.0);
+                v_viewPos = viewPos.xyz;
+                gl_Position = u_projectionMatrix * viewPos;
+            }
+        )";
+        const char *fragmentShaderSource = R"(
+            #version 330 core
+            in vec3 v_viewPos;
+            uniform vec3 u_color;
+            out vec4 fragColor;
+            void main()
+            {
+                vec3 normal = normalize(cross(dFdx(v_viewPos), dFdy(v_viewPos)));
+                float facing = abs(normal.z);            // Headlight from the camera
+                float highlight = pow(facing, 32.0) * 0.25;
+                fragColor = vec4(u_color * (0.25 + 0.75 * facing) + vec3(highlight), 1.0);
+            }
+        )";
+        if (!program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource)
+            || !program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource) || !program.link()) {
+            *errorMessage = "Render shaders failed to compile: " + program.log();
+            return false;
+        }
+        vao.create();
+        qDebug() << "RenderService: OpenGL" << reinterpret_cast<const char *>(glGetString(GL_VERSION)) << "on"
+                 << reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+        return true;
+    }
+
+    bool render(const CachedMesh &mesh, const RenderService::Request &request, QImage &image, bool &gpuHit,
+                QString *errorMessage)
+    {
+        int width, height, samples;
+        float zoom, fov, azimuth, elevation;
+        QColor color, background;
+        if (!intValue(request, "width", 800, MinImageSize, MaxImageSize, width, errorMessage)
+            || !intValue(request, "height", 600, MinImageSize, MaxImageSize, height, errorMessage)
+            || !intValue(request, "samples", 4, 0, 8, samples, errorMessage)
+            || !floatValue(request, "zoom", 1.0f, 0.01f, 100.0f, zoom, errorMessage)
+            || !floatValue(request, "fov", 30.0f, 1.0f, 120.0f, fov, errorMessage)
+            || !colorValue(request, "color", QColor(200, 200, 205), color, errorMessage)
+            || !colorValue(request, "background", QColor(255, 255, 255), background, errorMessage)) {
+            return false;
+        }
+
+        // Named views, which azimuth and elevation can still adjust
+        const QString view = request.values.value("view", "iso");
+        float viewAzimuth = 45.0f;
+        float viewElevation = 35.264f;
+        if (view == "front") {
+            viewAzimuth = 0.0f;
+            viewElevation = 0.0f;
+        } else if (view == "right") {
+            viewAzimuth = 90.0f;
+            viewElevation = 0.0f;
+        } else if (view == "back") {
+            viewAzimuth = 180.0f;
+            viewElevation = 0.0f;
+        } else if (view == "left") {
+            viewAzimuth = 270.0f;
+            viewElevation = 0.0f;
+        } else if (view == "top") {
+            viewAzimuth = 0.0f;
+            viewElevation = 90.0f;
+        } else if (view == "bottom") {
+            viewAzimuth = 0.0f;
+            viewElevation = -90.0f;
+        } else if (view != "iso") {
+            *errorMessage = "view must be iso, front, back, left, right, top or bottom";
+            return false;
+        }
+        if (!floatValue(request, "azimuth", viewAzimuth, -360.0f, 360.0f, azimuth, errorMessage)
+            || !floatValue(request, "elevation", viewElevation, -90.0f, 90.0f, elevation, errorMessage)) {
+            return false;
+        }
+
+        GpuMesh &gpu = upload(mesh, gpuHit);
+
+        if (!fbo || fbo->width() != width || fbo->height() != height || fboSamples != samples) {
+            QOpenGLFramebufferObjectFormat fboFormat;
+            fboFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+            fboFormat.setSamples(samples);
+            fbo.reset(new QOpenGLFramebufferObject(width, height, fboFormat));
+            fboSamples = samples;
+            if (!fbo->isValid()) {
+                fbo.reset();
+                *errorMessage = QString("Could not create a %1 x %2 render target").arg(width).arg(height);
+                return false;
+            }
+        }
+
+        // Fit the bounding sphere into the narrower of the two fields of view
+        const QVector3D center = (mesh.stats.boundsMin + mesh.stats.boundsMax) * 0.5f;
+        const float radius = qMax(1e-6f, (mesh.stats.boundsMax - mesh.stats.boundsMin).length() * 0.5f);
+        const float aspect = float(width) / float(height);
+        float halfFov = qDegreesToRadians(fov) * 0.5f;
+        if (aspect < 1.0f) {
+            halfFov = qAtan(qTan(halfFov) * aspect);
+        }
+        const float distance = radius / qSin(halfFov) / zoom;
+        const float a = qDegreesToRadians(azimuth);
+        const float e = qDegreesToRadians(elevation);
+        const QVector3D direction(qSin(a) * qCos(e), qSin(e), qCos(a) * qCos(e));
+        const QVector3D up = qAbs(elevation) > 89.9f ? QVector3D(qSin(a), 0.0f, qCos(a)) * (elevation > 0 ? -1.0f : 1.0f)
+                                                     : QVector3D(0.0f, 1.0f, 0.0f);
+        QMatrix4x4 viewMatrix;
+        viewMatrix.lookAt(center + direction * distance, center, up);
+        QMatrix4x4 projection;
+        projection.perspective(fov, aspect, qMax(distance - radius * 1.5f, distance * 0.001f), distance + radius * 1.5f);
+
+        fbo->bind();
+        glViewport(0, 0, width, height);
+        glClearColor(background.redF(), background.greenF(), background.blueF(), 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+
+        program.bind();
+        program.setUniformValue("u_modelViewMatrix", viewMatrix);
+        program.setUniformValue("u_projectionMatrix", projection);
+        program.setUniformValue("u_color", QVector3D(color.redF(), color.greenF(), color.blueF()));
+        vao.bind();
+        gpu.vertexBuffer.bind();
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        gpu.indexBuffer.bind();
+        const bool wireframe = request.values.value("wireframe") == "1";
+        if (wireframe) {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        }
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(gpu.indexCount), GL_UNSIGNED_INT, 0);
+        if (wireframe) {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        }
+        vao.release();
+        program.release();
+
+        image = fbo->toImage();
+        fbo->release();
+        return true;
+    }
+
+    int gpuMeshCount() const { return int(gpuMeshes.size()); }
+
+private:
+    struct GpuMesh {
+        quint64 meshId = 0;
+        QOpenGLBuffer vertexBuffer{QOpenGLBuffer::VertexBuffer};
+        QOpenGLBuffer indexBuffer{QOpenGLBuffer::IndexBuffer};
+        int indexCount = 0;
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    // The mesh's buffers on the graphics card, uploading them if they are missing or stale
+    GpuMesh &upload(const CachedMesh &mesh, bool &hit)
+    {
+        const QString &key = mesh.stats.file;
+        auto it = gpuMeshes.find(key);
+        hit = it != gpuMeshes.end() && it->second.meshId == mesh.id;
+        if (hit) {
+            it->second.lastUse = ++useClock;
+            return it->second;
+        }
+        if (it != gpuMeshes.end()) {
+            gpuBytes -= it->second.bytes;
+            it->second.vertexBuffer.destroy();
+            it->second.indexBuffer.destroy();
+            gpuMeshes.erase(it);
+        }
+
+        GpuMesh &gpu = gpuMeshes[key];
+        gpu.meshId = mesh.id;
+        gpu.indexCount = mesh.indices.size();
+        gpu.bytes = mesh.memoryBytes();
+        gpu.lastUse = ++useClock;
+        gpu.vertexBuffer.create();
+        gpu.vertexBuffer.bind();
+        gpu.vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        gpu.vertexBuffer.allocate(mesh.vertexData.constData(), mesh.vertexData.size() * int(sizeof(float)));
+        gpu.indexBuffer.create();
+        gpu.indexBuffer.bind();
+        gpu.indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        gpu.indexBuffer.allocate(mesh.indices.constData(), mesh.indices.size() * int(sizeof(unsigned int)));
+        gpuBytes += gpu.bytes;
+
+        // Make room on the card by dropping the least recently drawn meshes
+        while (gpuBytes > gpuBudget && gpuMeshes.size() > 1) {
+            auto oldest = gpuMeshes.end();
+            for (auto e = gpuMeshes.begin(); e != gpuMeshes.end(); ++e) {
+                if (e->first != key && (oldest == gpuMeshes.end() || e->second.lastUse < oldest->second.lastUse)) {
+                    oldest = e;
+                }
+            }
+            gpuBytes -= oldest->second.bytes;
+            oldest->second.vertexBuffer.destroy();
+            oldest->second.indexBuffer.destroy();
+            gpuMeshes.erase(oldest);
+        }
+        return gpuMeshes[key];
+    }
+
+    qint64 gpuBudget;
+    qint64 gpuBytes;
+    quint64 useClock;
+    QOffscreenSurface surface;
+    QOpenGLContext context;
+    QOpenGLShaderProgram program;
+    QOpenGLVertexArrayObject vao;
+    std::unique_ptr<QOpenGLFramebufferObject> fbo;
+    int fboSamples;
+    std::map<QString, GpuMesh> gpuMeshes;
+};
+
+QByteArray errorResponse(QString message)
+{
+    message.replace('\n', ' ');
+    return ("error " + message + "\n").toUtf8();
+}
+
+QByteArray okResponse(const QString &contentType, const QByteArray &payload)
+{
+    return (QString("ok %1 %2\n").arg(contentType).arg(payload.size())).toUtf8() + payload;
+}
+
+#if defined(Q_OS_UNIX)
+
+void handleStopSignal(int)
+{
+    stopRequested = true;
+}
+
+bool writeAll(int fd, const QByteArray &data)
+{
+    qint64 written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.constData() + written, size_t(data.size() - written));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+// Answer one request line. Render and measure jobs go through the queue; the rest is answered here.
+QByteArray handleRequest(Service &service, const QString &line)
+{
+    RenderService::Request request;
+    QString error;
+    if (!RenderService::parseRequest(line, request, &error)) {
+        return errorResponse(error);
+    }
+    if (request.command == "ping") {
+        return okResponse("text/plain", "pong");
+    }
+    if (request.command == "status") {
+        return okResponse("application/json", service.statusJson().toUtf8());
+    }
+    if (request.command != "render" && request.command != "measure") {
+        return errorResponse("Unknown command \"" + request.command + "\" (render, measure, status or ping)");
+    }
+    if (request.values.value("file").isEmpty()) {
+        return errorResponse("file=... is missing");
+    }
+
+    auto job = std::make_shared<Job>();
+    job->kind = request.command == "render" ? RenderJob : MeasureJob;
+    job->request = request;
+    job->received = service.clock.elapsed();
+    qint64 deadline = service.options.defaultDeadline;
+    if (request.values.contains("deadline")) {
+        bool ok = false;
+        deadline = request.values.value("deadline").toLongLong(&ok);
+        if (!ok || deadline <= 0) {
+            return errorResponse("deadline must be a positive number of milliseconds");
+        }
+    }
+    job->deadline = job->received + deadline;
+    service.submit(job);
+    if (!service.waitFor(job)) {
+        return errorResponse("The service is shutting down");
+    }
+    if (!job->error.isEmpty()) {
+        return errorResponse(job->error);
+    }
+    if (job->kind == MeasureJob) {
+        return okResponse("application/json", job->json);
+    }
+
+    // PNG compression is slow next to drawing, so it happens here rather than on the render thread
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    if (!job->image.save(&buffer, "PNG")) {
+        return errorResponse("Could not encode the image");
+    }
+    return okResponse("image/png", png);
+}
+
+struct Connection {
+    std::thread thread;
+    std::atomic<bool> finished{false};
+};
+
+void serveConnection(Service &service, int fd, Connection *connection)
+{
+    service.countConnection(1);
+    QByteArray pending;
+    char chunk[16384];
+    while (!service.isStopping()) {
+        int lineEnd = pending.indexOf('\n');
+        if (lineEnd < 0) {
+            if (pending.size() > MaxRequestBytes) {
+                writeAll(fd, errorResponse("Request line too long"));
+                break;
+            }
+            struct pollfd readable = {fd, POLLIN, 0};
+            int ready = ::poll(&readable, 1, PollMilliseconds);
+            if (ready < 0 && errno != EINTR) {
+                break;
+            }
+            if (ready <= 0) {
+                continue;
+            }
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;    // The client hung up
+            }
+            pending.append(chunk, int(n));
+            continue;
+        }
+
+        QString line = QString::fromUtf8(pending.constData(), lineEnd).trimmed();
+        pending.remove(0, lineEnd + 1);
+        if (line.isEmpty()) {
+            continue;
+        }
+        if (!writeAll(fd, handleRequest(service, line))) {
+            break;
+        }
+    }
+    ::close(fd);
+    service.countConnection(-1);
+    connection->finished = true;
+}
+
+// Accept clients until the service stops; every client gets its own thread
+void acceptConnections(Service &service, int listenFd)
+{
+    std::list<std::unique_ptr<Connection>> connections;
+    while (!service.isStopping()) {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if ((*it)->finished) {
+                (*it)->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        struct pollfd readable = {listenFd, POLLIN, 0};
+        if (::poll(&readable, 1, PollMilliseconds) <= 0) {
+            continue;
+        }
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        if (int(connections.size()) >= MaxConnections) {
+            writeAll(fd, errorResponse("Too many connections"));
+            ::close(fd);
+            continue;
+        }
+        connections.emplace_back(new Connection);
+        Connection *connection = connections.back().get();
+        connection->thread = std::thread(serveConnection, std::ref(service), fd, connection);
+    }
+    for (auto &connection : connections) {
+        connection->thread.join();
+    }
+}
+
+#endif // Q_OS_UNIX
+
+} // namespace
+
+QString RenderService::defaultSocketPath()
+{
+    QString runtime = qEnvironmentVariable("XDG_RUNTIME_DIR");
+    if (!runtime.isEmpty() && QFileInfo(runtime).isDir()) {
+        return runtime + "/stlviewer-render.sock";
+    }
+#if defined(Q_OS_UNIX)
+    return QDir::tempPath() + QString("/stlviewer-render-%1.sock").arg(uint(::getuid()));
+#else
+    return QDir::tempPath() + "/stlviewer-render.sock";
+#endif
+}
+
+bool RenderService::parseRequest(const QString &line, Request &request, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+    request = Request();
+    int i = 0;
+    const int size = line.size();
+    auto skipSpaces = [&]() {
+        while (i < size && line[i].isSpace()) {
+            ++i;
+        }
+    };
+
+    skipSpaces();
+    while (i < size && !line[i].isSpace()) {
+        request.command += line[i++];
+    }
+    if (request.command.isEmpty()) {
+        return fail("Empty request");
+    }
+
+    for (;;) {
+        skipSpaces();
+        if (i >= size) {
+            return true;
+        }
+        QString key;
+        while (i < size && line[i] != QChar('=') && !line[i].isSpace()) {
+            key += line[i++];
+        }
+        if (i >= size || line[i] != QChar('=') || key.isEmpty()) {
+            return fail("Expected key=value, found \"" + key + "\"");
+        }
+        ++i;
+
+        QString value;
+        if (i < size && line[i] == QChar('"')) {
+            ++i;
+            bool closed = false;
+            while (i < size) {
+                QChar c = line[i++];
+                if (c == QChar('"')) {
+                    closed = true;
+                    break;
+                }
+                if (c == QChar('\\') && i < size) {
+                    c = line[i++];
+                }
+                value += c;
+            }
+            if (!closed) {
+                return fail("Missing closing quote after " + key + "=");
+            }
+        } else {
+            while (i < size && !line[i].isSpace()) {
+                value += line[i++];
+            }
+        }
+        request.values.insert(key, value);
+    }
+}
+
+bool RenderService::run(const Options &options, QString *errorMessage)
+{
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return false;
+    };
+
+#if defined(Q_OS_UNIX)
+    const QString socketPath = options.socketPath.isEmpty() ? defaultSocketPath() : options.socketPath;
+    const QByteArray pathBytes = QFile::encodeName(socketPath);
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (size_t(pathBytes.size()) >= sizeof(address.sun_path)) {
+        return fail(socketPath + ": socket path too long");
+    }
+    std::memcpy(address.sun_path, pathBytes.constData(), size_t(pathBytes.size()));
+
+    // The context, shaders and render thread first: a service that cannot draw should not listen
+    Renderer renderer(options.gpuCacheBytes);
+    QString error;
+    if (!renderer.initialize(&error)) {
+        return fail(error);
+    }
+
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        return fail(QString("socket: ") + std::strerror(errno));
+    }
+    // A socket file left behind by a crashed service is removed; a live one is not taken over
+    if (::connect(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+        ::close(listenFd);
+        return fail(socketPath + ": another service is already listening there");
+    }
+    ::close(listenFd);
+    ::unlink(pathBytes.constData());
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t oldMask = ::umask(0177);    // Only this user may connect
+    int bound = ::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    ::umask(oldMask);
+    if (bound != 0 || ::listen(listenFd, 64) != 0) {
+        QString reason = std::strerror(errno);
+        ::close(listenFd);
+        return fail(socketPath + ": " + reason);
+    }
+
+    stopRequested = false;
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+    std::signal(SIGPIPE, SIG_IGN);    // A client that hangs up early must not end the service
+
+    Service service(options);
+    std::thread acceptor(acceptConnections, std::ref(service), listenFd);
+    std::vector<std::thread> measurers;
+    const int measureThreads = options.measureThreads > 0 ? options.measureThreads : Parallel::threadCount();
+    for (int t = 0; t < measureThreads; ++t) {
+        measurers.emplace_back([&service]() {
+            while (std::shared_ptr<Job> job = service.take(MeasureJob)) {
+                QString loadError;
+                std::shared_ptr<const CachedMesh> mesh = service.meshes.get(job->request.values.value("file"), &loadError);
+                if (mesh) {
+                    MeshScanner::FileStats stats = mesh->stats;
+                    stats.file = job->request.values.value("file");    // As the client named it
+                    job->json = MeshScanner::toJson(stats).toUtf8();
+                } else {
+                    job->error = loadError;
+                }
+                service.finish(job);
+            }
+        });
+    }
+    qDebug() << "RenderService: listening on" << socketPath << "with" << measureThreads << "measure threads";
+
+    // This thread owns the OpenGL context, so it runs the render jobs
+    while (std::shared_ptr<Job> job = service.take(RenderJob)) {
+        QString jobError;
+        std::shared_ptr<const CachedMesh> mesh = service.meshes.get(job->request.values.value("file"), &jobError);
+        bool gpuHit = false;
+        if (mesh && renderer.render(*mesh, job->request, job->image, gpuHit, &jobError)) {
+            service.countGpu(gpuHit);
+        } else {
+            job->error = jobError;
+        }
+        service.finish(job);
+    }
+
+    service.stop();
+    acceptor.join();
+    for (std::thread &thread : measurers) {
+        thread.join();
+    }
+    ::close(listenFd);
+    ::unlink(pathBytes.constData());
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    qDebug() << "RenderService: stopped";
+    return true;
+#else
+    Q_UNUSED(options);
+    return fail("The render service needs Unix domain sockets (Linux or macOS)");
+#endif
+}
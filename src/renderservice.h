@@ -0,0 +1,59 @@
+#ifndef RENDERSERVICE_H
+#define RENDERSERVICE_H
+
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+
+// A long-running render and measure service for other programs on the same machine (a PLM web
+// backend asking for thumbnails), so they do not pay for a viewer start and shader compile on
+// every request.
+//
+// The service keeps one offscreen OpenGL context with its shader program compiled, the most
+// recently used meshes loaded (an LRU cache within a memory budget) and their GPU buffers
+// uploaded. Clients connect to a Unix domain socket and send one request per line:
+//
+//   render file=/models/part.stl width=800 height=600 view=iso deadline=5000
+//   measure file="/models/with space.stl"
+//   status
+//   ping
+//
+// Values with spaces go in double quotes (\" and \\ inside them). Render options: width, height
+// (16 to 8192, default 800 x 600), view (iso, front, back, left, right, top, bottom) or azimuth
+// and elevation in degrees (Y is up, azimuth 0 looks along -Z), zoom (1 fits the model), fov
+// (degrees), wireframe (0/1), color and background (#rrggbb), samples (0, 2, 4 or 8).
+// Every job may give a deadline in milliseconds from when it arrives; jobs are started earliest
+// deadline first, and one that could not be started in time is answered with an error instead.
+//
+// Each answer starts with one line, "ok <content type> <bytes>" followed by exactly that many
+// bytes (a PNG, or JSON for measure and status), or "error <message>". A connection can send any
+// number of requests, one after the other.
+class RenderService
+{
+public:
+    struct Options {
+        QString socketPath;                              // Empty: defaultSocketPath()
+        qint64 meshCacheBytes = 1024LL * 1024 * 1024;    // Parsed meshes kept in memory
+        qint64 gpuCacheBytes = 512LL * 1024 * 1024;      // Uploaded meshes kept on the graphics card
+        int measureThreads = 0;                          // 0 = one per CPU core
+        qint64 defaultDeadline = 30000;                  // Milliseconds, for jobs that do not give one
+    };
+
+    // One parsed request line
+    struct Request {
+        QString command;
+        QHash<QString, QString> values;
+    };
+
+    // $XDG_RUNTIME_DIR/stlviewer-render.sock, or a per-user name in the temp folder
+    static QString defaultSocketPath();
+
+    // Serve until SIGINT or SIGTERM. Needs a QGuiApplication (for the offscreen OpenGL context)
+    // and must run on its thread, which becomes the render thread.
+    static bool run(const Options &options, QString *errorMessage = nullptr);
+
+    // Split "command key=value key="quoted value"" into its parts
+    static bool parseRequest(const QString &line, Request &request, QString *errorMessage = nullptr);
+};
+
+#endif // RENDERSERVICE_H
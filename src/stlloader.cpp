@@ -2,21 +2,711 @@
 #include <QFileInfo>
 #include <QDebug>
 #include <QtMath>
-#include <QRegularExpression>
+#include <QtEndian>
+#include "mesharchive.h"
+#include "parallel.h"
+#include "threemfreader.h"
 #include <algorithm>
+#include <atomic>
 #include <cfloat>
+#include <cmath>
+#include <charconv>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 // These are the magic numbers that define the STL file format
 const char* STLLoader::ASCII_STL_HEADER = "solid";
 const float STLLoader::DEFAULT_VERTEX_TOLERANCE = 1e-6f;
 
+namespace {
+
+// A piece of an OBJ file that one worker reads. The first pass fills in the counts, then every
+// piece is told where its vertices and triangles go in the shared arrays.
+struct ObjChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    qint64 lines = 0;
+    qint64 positions = 0;         // "v" lines
+    qint64 normals = 0;           // "vn" lines
+    qint64 triangles = 0;         // Faces with n corners become n - 2 triangles
+    qint64 firstLine = 0;
+    qint64 firstPosition = 0;
+    qint64 firstNormal = 0;
+    qint64 firstTriangle = 0;
+    qint64 errorLine = -1;        // First line that could not be read (-1 = none)
+    QString error;
+};
+
+enum ObjLineType { ObjOther, ObjPosition, ObjNormal, ObjFace };
+
+inline bool isObjBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Work out what a line holds and move p past the keyword
+ObjLineType objLineType(const char*& p, const char* end)
+{
+    while (p != end && isObjBlank(*p)) {
+        ++p;
+    }
+    if (end - p >= 2 && p[0] == 'v' && isObjBlank(p[1])) {
+        p += 1;
+        return ObjPosition;
+    }
+    if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && isObjBlank(p[2])) {
+        p += 2;
+        return ObjNormal;
+    }
+    if (end - p >= 2 && p[0] == 'f' && isObjBlank(p[1])) {
+        p += 1;
+        return ObjFace;
+    }
+    return ObjOther;  // Comments, texture coordinates, groups, materials, ...
+}
+
+// How many corners a face line lists
+int countFaceCorners(const char* p, const char* end)
+{
+    int corners = 0;
+    while (p != end && *p != '#') {
+        if (isObjBlank(*p)) {
+            ++p;
+            continue;
+        }
+        ++corners;
+        while (p != end && !isObjBlank(*p)) {
+            ++p;
+        }
+    }
+    return corners;
+}
+
+bool parseObjFloats(const char*& p, const char* end, float* values)
+{
+    for (int k = 0; k < 3; ++k) {
+        while (p != end && isObjBlank(*p)) {
+            ++p;
+        }
+        if (p != end && *p == '+') {
+            ++p;  // from_chars does not take a leading plus
+        }
+        std::from_chars_result result = std::from_chars(p, end, values[k]);
+        if (result.ec != std::errc()) {
+            return false;
+        }
+        p = result.ptr;
+    }
+    return true;
+}
+
+// Read one OBJ index: 1 is the first item, -1 the last one defined so far. Gives -1 if there is none.
+bool parseObjIndex(const char*& p, const char* end, qint64 countSoFar, qint64& index)
+{
+    long long value = 0;
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc() || value == 0) {
+        return false;
+    }
+    p = result.ptr;
+    index = value > 0 ? value - 1 : countSoFar + value;
+    return true;
+}
+
+// Run through every line to the end of the chunk; lineFunc(lineStart, lineEnd, lineIndex) returns
+// false to stop early
+template<typename LineFunc>
+void forEachObjLine(const ObjChunk& chunk, LineFunc lineFunc)
+{
+    const char* lineStart = chunk.begin;
+    qint64 line = 0;
+    while (lineStart < chunk.end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', chunk.end - lineStart));
+        if (!lineEnd) {
+            lineEnd = chunk.end;
+        }
+        if (!lineFunc(lineStart, lineEnd, line)) {
+            return;
+        }
+        lineStart = lineEnd + 1;
+        ++line;
+    }
+}
+
+void countObjChunk(ObjChunk& chunk)
+{
+    forEachObjLine(chunk, [&](const char* p, const char* lineEnd, qint64) {
+        chunk.lines++;
+        switch (objLineType(p, lineEnd)) {
+        case ObjPosition: chunk.positions++; break;
+        case ObjNormal: chunk.normals++; break;
+        case ObjFace: chunk.triangles += qMax(0, countFaceCorners(p, lineEnd) - 2); break;
+        default: break;
+        }
+        return true;
+    });
+}
+
+void parseObjChunk(ObjChunk& chunk, STLIndexedMesh& mesh)
+{
+    qint64 positions = chunk.firstPosition;
+    qint64 normals = chunk.firstNormal;
+    qint64 triangle = chunk.firstTriangle;
+    
+    auto fail = [&](qint64 line, const char* what) {
+        chunk.errorLine = chunk.firstLine + line;
+        chunk.error = what;
+        return false;
+    };
+    
+    forEachObjLine(chunk, [&](const char* p, const char* lineEnd, qint64 line) {
+        switch (objLineType(p, lineEnd)) {
+        case ObjPosition:
+            if (!parseObjFloats(p, lineEnd, &mesh.positions[positions * 3])) {
+                return fail(line, "bad vertex");
+            }
+            positions++;
+            break;
+        case ObjNormal:
+            if (!parseObjFloats(p, lineEnd, &mesh.normals[normals * 3])) {
+                return fail(line, "bad normal");
+            }
+            normals++;
+            break;
+        case ObjFace: {
+            // Corners are "v", "v/vt", "v//vn" or "v/vt/vn". Polygons become a fan around the first corner.
+            qint64 first[2] = {-1, -1};
+            qint64 previous[2] = {-1, -1};
+            int corner = 0;
+            while (p != lineEnd && *p != '#') {
+                if (isObjBlank(*p)) {
+                    ++p;
+                    continue;
+                }
+                qint64 position = -1;
+                qint64 normal = -1;
+                qint64 unused = -1;
+                if (!parseObjIndex(p, lineEnd, positions, position)) {
+                    return fail(line, "bad face corner");
+                }
+                if (p != lineEnd && *p == '/') {
+                    ++p;
+                    if (p != lineEnd && *p != '/' && !parseObjIndex(p, lineEnd, 0, unused)) {
+                        return fail(line, "bad texture index");
+                    }
+                    if (p != lineEnd && *p == '/') {
+                        ++p;
+                        if (!parseObjIndex(p, lineEnd, normals, normal)) {
+                            return fail(line, "bad normal index");
+                        }
+                    }
+                }
+                if (p != lineEnd && !isObjBlank(*p)) {
+                    return fail(line, "bad face corner");
+                }
+                
+                if (corner == 0) {
+                    first[0] = position;
+                    first[1] = normal;
+                } else if (corner >= 2) {
+                    qint64* positionOut = &mesh.positionIndices[triangle * 3];
+                    qint64* normalOut = &mesh.normalIndices[triangle * 3];
+                    positionOut[0] = first[0];
+                    positionOut[1] = previous[0];
+                    positionOut[2] = position;
+                    normalOut[0] = first[1];
+                    normalOut[1] = previous[1];
+                    normalOut[2] = normal;
+                    triangle++;
+                }
+                previous[0] = position;
+                previous[1] = normal;
+                corner++;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return true;
+    });
+}
+
+
+// Value types a PLY property can have
+enum PlyType { PlyInvalid, PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64 };
+
+PlyType plyType(const QByteArray& name)
+{
+    if (name == "char" || name == "int8") return PlyInt8;
+    if (name == "uchar" || name == "uint8") return PlyUInt8;
+    if (name == "short" || name == "int16") return PlyInt16;
+    if (name == "ushort" || name == "uint16") return PlyUInt16;
+    if (name == "int" || name == "int32") return PlyInt32;
+    if (name == "uint" || name == "uint32") return PlyUInt32;
+    if (name == "float" || name == "float32") return PlyFloat32;
+    if (name == "double" || name == "float64") return PlyFloat64;
+    return PlyInvalid;
+}
+
+int plyTypeSize(PlyType type)
+{
+    switch (type) {
+    case PlyInt8: case PlyUInt8: return 1;
+    case PlyInt16: case PlyUInt16: return 2;
+    case PlyInt32: case PlyUInt32: case PlyFloat32: return 4;
+    case PlyFloat64: return 8;
+    default: return 0;
+    }
+}
+
+// Read one binary value of any type
+double readPlyValue(const char* p, PlyType type, bool bigEndian)
+{
+    switch (type) {
+    case PlyInt8: return qint8(*p);
+    case PlyUInt8: return quint8(*p);
+    case PlyInt16: return qint16(bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p));
+    case PlyUInt16: return bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+    case PlyInt32: return qint32(bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p));
+    case PlyUInt32: return bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+    case PlyFloat32: {
+        quint32 bits = bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+        float value;
+        std::memcpy(&value, &bits, 4);
+        return value;
+    }
+    case PlyFloat64: {
+        quint64 bits = bigEndian ? qFromBigEndian<quint64>(p) : qFromLittleEndian<quint64>(p);
+        double value;
+        std::memcpy(&value, &bits, 8);
+        return value;
+    }
+    default: return 0.0;
+    }
+}
+
+struct PlyProperty {
+    QByteArray name;
+    PlyType type = PlyInvalid;        // Type of the value, or of the list entries
+    PlyType countType = PlyInvalid;   // Type of the list length (lists only)
+    bool isList = false;
+    int offset = -1;                  // Byte offset inside a binary item without lists
+};
+
+struct PlyElement {
+    QByteArray name;
+    qint64 count = 0;
+    QVector<PlyProperty> properties;
+    int itemSize = 0;                 // Bytes per binary item, -1 if it has lists
+
+    int find(const char* propertyName) const
+    {
+        for (int i = 0; i < properties.size(); ++i) {
+            if (properties[i].name == propertyName) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    
+    // The fewest bytes one item can take up: every value is at least one digit in a text file,
+    // and an empty list is still its length in a binary one
+    qint64 minItemBytes(bool ascii) const
+    {
+        qint64 bytes = 0;
+        for (const PlyProperty& property : properties) {
+            bytes += ascii ? 1 : plyTypeSize(property.isList ? property.countType : property.type);
+        }
+        return bytes;
+    }
+};
+
+struct PlyHeader {
+    bool ascii = false;
+    bool bigEndian = false;
+    QVector<PlyElement> elements;
+    qint64 dataStart = 0;             // First byte after "end_header"
+};
+
+bool parsePlyHeader(const char* data, qint64 size, PlyHeader& header, QString& error)
+{
+    qint64 pos = 0;
+    bool hasFormat = false;
+    for (;;) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+        if (!lineEnd) {
+            error = "The header has no end_header line";
+            return false;
+        }
+        QList<QByteArray> words = QByteArray(data + pos, int(lineEnd - data - pos)).simplified().split(' ');
+        pos = lineEnd - data + 1;
+        const QByteArray& keyword = words[0];
+        
+        if (keyword == "end_header") {
+            break;
+        } else if (keyword == "format" && words.size() >= 2) {
+            header.ascii = words[1] == "ascii";
+            header.bigEndian = words[1] == "binary_big_endian";
+            if (!header.ascii && !header.bigEndian && words[1] != "binary_little_endian") {
+                error = "Unknown PLY format " + QString(words[1]);
+                return false;
+            }
+            hasFormat = true;
+        } else if (keyword == "element" && words.size() >= 3) {
+            PlyElement element;
+            element.name = words[1];
+            bool ok = false;
+            element.count = words[2].toLongLong(&ok);
+            if (!ok || element.count < 0) {
+                error = "Invalid item count for PLY element " + QString(element.name);
+                return false;
+            }
+            header.elements.append(element);
+        } else if (keyword == "property" && !header.elements.isEmpty()) {
+            PlyProperty property;
+            if (words.size() >= 5 && words[1] == "list") {
+                property.isList = true;
+                property.countType = plyType(words[2]);
+                property.type = plyType(words[3]);
+                property.name = words[4];
+            } else if (words.size() >= 3) {
+                property.type = plyType(words[1]);
+                property.name = words[2];
+            }
+            if (property.type == PlyInvalid || (property.isList && property.countType == PlyInvalid)) {
+                error = "Unknown type for PLY property " + QString(words.last());
+                return false;
+            }
+            header.elements.last().properties.append(property);
+        }
+        // "ply", "comment" and "obj_info" lines carry nothing we need
+    }
+    
+    if (!hasFormat) {
+        error = "The header does not say which PLY format is used";
+        return false;
+    }
+    
+    // Items without lists have a fixed size, so every property sits at a known offset
+    for (PlyElement& element : header.elements) {
+        for (PlyProperty& property : element.properties) {
+            if (property.isList) {
+                element.itemSize = -1;
+                break;
+            }
+            property.offset = element.itemSize;
+            element.itemSize += plyTypeSize(property.type);
+        }
+    }
+    header.dataStart = pos;
+    return true;
+}
+
+// One line of a text STL file, split into words that point into the file's bytes
+struct StlTextLine {
+    static const int MaxWords = 8;    // "facet normal x y z" is the longest line we need
+    const char* words[MaxWords];
+    int lengths[MaxWords];
+    int count = 0;
+    
+    static bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+    
+    // Split [p, end) at blanks; words after the first MaxWords are ignored
+    void split(const char* p, const char* end)
+    {
+        count = 0;
+        while (p != end && count < MaxWords) {
+            if (isBlank(*p)) {
+                ++p;
+                continue;
+            }
+            const char* start = p;
+            while (p != end && !isBlank(*p)) {
+                ++p;
+            }
+            words[count] = start;
+            lengths[count] = int(p - start);
+            ++count;
+        }
+    }
+    
+    // Does word i start with `text` (lower case), ignoring upper and lower case
+    bool startsWith(int i, const char* text) const
+    {
+        const int length = int(std::strlen(text));
+        if (i >= count || lengths[i] < length) {
+            return false;
+        }
+        for (int k = 0; k < length; ++k) {
+            if (std::tolower(static_cast<unsigned char>(words[i][k])) != text[k]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Is word i exactly `text` (lower case), ignoring upper and lower case
+    bool is(int i, const char* text) const
+    {
+        return i < count && lengths[i] == int(std::strlen(text)) && startsWith(i, text);
+    }
+    
+    // Read word i as a number; the whole word has to be the number
+    bool number(int i, float& value) const
+    {
+        if (i >= count) {
+            return false;
+        }
+        const char* p = words[i];
+        const char* end = p + lengths[i];
+        if (p != end && *p == '+') {
+            ++p;  // from_chars does not take a leading plus
+        }
+        std::from_chars_result result = std::from_chars(p, end, value);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+    
+    // The line again, for error messages
+    QString text() const
+    {
+        return count > 0 ? QString::fromLatin1(words[0], int(words[count - 1] + lengths[count - 1] - words[0]))
+                         : QString();
+    }
+};
+
+// Reads the numbers of a text PLY file one after the other, across line ends
+struct PlyTextReader {
+    const char* p;
+    const char* end;
+    
+    bool next(double& value)
+    {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            ++p;
+        }
+        if (p != end && *p == '+') {
+            ++p;
+        }
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) {
+            return false;
+        }
+        p = result.ptr;
+        return true;
+    }
+};
+
+// Where a vertex element keeps the values we use (-1 = missing)
+struct PlyVertexLayout {
+    int position[3] = {-1, -1, -1};
+    int normal[3] = {-1, -1, -1};
+    int color[3] = {-1, -1, -1};
+    
+    explicit PlyVertexLayout(const PlyElement& element)
+    {
+        const char* names[3][3] = {{"x", "y", "z"}, {"nx", "ny", "nz"}, {"red", "green", "blue"}};
+        for (int k = 0; k < 3; ++k) {
+            position[k] = element.find(names[0][k]);
+            normal[k] = element.find(names[1][k]);
+            color[k] = element.find(names[2][k]);
+            if (color[k] < 0) {
+                color[k] = element.find(QByteArray("diffuse_").append(names[2][k]).constData());
+            }
+        }
+    }
+    
+    bool hasPositions() const { return position[0] >= 0 && position[1] >= 0 && position[2] >= 0; }
+    bool hasNormals() const { return normal[0] >= 0 && normal[1] >= 0 && normal[2] >= 0; }
+    bool hasColors() const { return color[0] >= 0 && color[1] >= 0 && color[2] >= 0; }
+};
+
+// Colours are 0-255 as integers and 0-1 as floats
+inline float plyColor(double value, PlyType type)
+{
+    return type == PlyFloat32 || type == PlyFloat64 ? float(value) : float(value / 255.0);
+}
+
+// Append the fan triangles of one polygon
+inline void addPlyPolygon(std::vector<qint64>& out, const qint64* corners, qint64 count)
+{
+    for (qint64 k = 2; k < count; ++k) {
+        out.push_back(corners[0]);
+        out.push_back(corners[k - 1]);
+        out.push_back(corners[k]);
+    }
+}
+
+// The first bytes of an open file for the format probes: mapped if possible, copied if not
+class HeaderBytes
+{
+public:
+    HeaderBytes(QFile& file, qint64 size)
+        : file(file)
+        , mapped(size > 0 ? file.map(0, size) : nullptr)
+        , mappedSize(mapped ? size : 0)
+    {
+        if (!mapped) {
+            copy = file.read(size);
+            file.seek(0);
+        }
+    }
+    
+    ~HeaderBytes()
+    {
+        if (mapped) {
+            file.unmap(mapped);
+        }
+    }
+    
+    const char* data() const { return mapped ? reinterpret_cast<const char*>(mapped) : copy.constData(); }
+    qint64 size() const { return mapped ? mappedSize : copy.size(); }
+    
+private:
+    QFile& file;
+    uchar* mapped;
+    qint64 mappedSize;
+    QByteArray copy;
+};
+
+STLLoader::FileHeader makeFileHeader(const QString& fileName, qint64 fileSize, const HeaderBytes& bytes)
+{
+    STLLoader::FileHeader header;
+    header.fileName = fileName;
+    header.suffix = QFileInfo(fileName).suffix().toLower();
+    header.fileSize = fileSize;
+    header.data = bytes.data();
+    header.size = bytes.size();
+    return header;
+}
+
+// Does this read like text? No zero bytes, and hardly any control characters or bytes above 127
+// (a few are fine, for names in other languages). The floats of a binary STL are full of both.
+bool looksLikeText(const char* data, qint64 size)
+{
+    if (size <= 0) {
+        return false;
+    }
+    qint64 unusual = 0;
+    for (qint64 i = 0; i < size; ++i) {
+        const uchar c = uchar(data[i]);
+        if (c == 0) {
+            return false;
+        }
+        if ((c < 0x20 && c != '\n' && c != '\r' && c != '\t') || c >= 0x7f) {
+            ++unusual;
+        }
+    }
+    return unusual * 20 < size;
+}
+
+// Does the text at data start with this lower-case word (in any case)?
+bool matchesWord(const char* data, qint64 size, const char* word)
+{
+    for (qint64 i = 0; word[i]; ++i) {
+        const char c = (i < size) ? data[i] : 0;
+        if ((c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c) != word[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Does the text start with this word, after a byte order mark and blank space?
+bool startsWithWord(const char* data, qint64 size, const char* word)
+{
+    qint64 i = 0;
+    if (size >= 3 && uchar(data[0]) == 0xef && uchar(data[1]) == 0xbb && uchar(data[2]) == 0xbf) {
+        i = 3;
+    }
+    while (i < size && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n')) {
+        ++i;
+    }
+    return matchesWord(data + i, size - i, word);
+}
+
+// Does the word appear anywhere in the text?
+bool containsWord(const char* data, qint64 size, const char* word)
+{
+    for (qint64 i = 0; i < size; ++i) {
+        if (matchesWord(data + i, size - i, word)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Binary STL numbers are little-endian floats, whatever the computer uses
+inline float readLittleEndianFloat(const char* p)
+{
+    quint32 bits = qFromLittleEndian<quint32>(p);
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+// Grid cell of a position for welding (cells are cellSize wide), and for each axis which
+// neighbouring cell is nearer: -1 below, +1 above
+struct WeldCell {
+    qint64 x = 0;
+    qint64 y = 0;
+    qint64 z = 0;
+    int near[3] = {1, 1, 1};
+};
+
+inline qint64 weldCellIndex(float value, double cellSize, int& near)
+{
+    // Clamped so huge coordinates with a tiny tolerance cannot overflow; they just share cells
+    const double limit = 4.0e18;
+    double scaled = double(value) / cellSize;
+    double cell = std::floor(scaled);
+    near = (scaled - cell < 0.5) ? -1 : 1;
+    if (!(cell > -limit)) {
+        return qint64(-limit);
+    }
+    if (!(cell < limit)) {
+        return qint64(limit);
+    }
+    return qint64(cell);
+}
+
+inline WeldCell weldCell(const QVector3D& position, double cellSize)
+{
+    WeldCell cell;
+    cell.x = weldCellIndex(position.x(), cellSize, cell.near[0]);
+    cell.y = weldCellIndex(position.y(), cellSize, cell.near[1]);
+    cell.z = weldCellIndex(position.z(), cellSize, cell.near[2]);
+    return cell;
+}
+
+inline quint64 hashWeldCell(qint64 x, qint64 y, qint64 z)
+{
+    quint64 h = quint64(x) * 0x9E3779B97F4A7C15ULL;
+    h ^= quint64(y) * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+    h ^= quint64(z) * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+    return h ^ (h >> 29);
+}
+
+} // namespace
+
 STLLoader::STLLoader()
-    : format(Unknown)
+    : vertexBufferFromFile(false)
+    , modelScale(1.0f)
+    , format(Unknown)
     , autoCenter(true)          // By default, center the model on screen
     , autoNormalize(false)      // Don't resize by default
     , calculateNormals(false)   // Use normals from file by default
     , mergeVertices(true)       // Combine duplicate points by default
     , vertexTolerance(DEFAULT_VERTEX_TOLERANCE)
+    , repairOrientation(false)  // Keep triangle winding as stored in the file by default
+    , removeDuplicateFacets(false)  // Keep every triangle from the file by default
+    , directIO(false)           // Read through the page cache by default
+    , degenerateTriangles(0)
 {
 }
 
@@ -32,10 +722,21 @@ void STLLoader::clear()
     vertices.clear();
     vertexData.clear();
     indices.clear();
+    fileCorners.clear();
+    fileColors.clear();
+    vertexColors.clear();
+    vertexBufferFromFile = false;
     boundingBox.reset();
+    modelOffset = QVector3D(0, 0, 0);
+    modelScale = 1.0f;
     fileName.clear();
     format = Unknown;
+    formatName.clear();
     errorString.clear();
+    orientationReport = MeshRepair::OrientationReport();
+    duplicateReport = MeshRepair::DuplicateReport();
+    readReport = AsyncFileReader::Report();
+    degenerateTriangles = 0;
 }
 
 STLLoader::LoadResult STLLoader::loadFile(const QString& fileName)
@@ -45,51 +746,59 @@ STLLoader::LoadResult STLLoader::loadFile(const QString& fileName)
     
     qDebug() << "Starting to load STL file:" << fileName;
     
-    // Make sure the file actually exists and we can read it
-    QFileInfo fileInfo(fileName);
-    if (!fileInfo.exists()) {
-        setError("File does not exist: " + fileName);
-        return FileNotFound;
-    }
-    
-    if (!fileInfo.isReadable()) {
-        setError("Cannot read file (check permissions): " + fileName);
+    // Open the file once; finding the format and reading it both use this one handle
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        // Only now ask why, so a normal load does not have to look the file up first
+        QFileInfo fileInfo(fileName);
+        if (!fileInfo.exists()) {
+            setError("File does not exist: " + fileName);
+            return FileNotFound;
+        }
+        if (!fileInfo.isReadable()) {
+            setError("Cannot read file (check permissions): " + fileName);
+            return CannotOpenFile;
+        }
+        setError("Cannot open file: " + file.errorString());
         return CannotOpenFile;
     }
     
-    if (fileInfo.size() == 0) {
+    const qint64 fileSize = file.size();
+    if (fileSize == 0) {
         setError("File is empty: " + fileName);
         return EmptyFile;
     }
     
-    qDebug() << "File looks good, size:" << fileInfo.size() << "bytes";
+    qDebug() << "File looks good, size:" << fileSize << "bytes";
     
-    // Figure out if this is a binary or text STL file
-    format = detectFormat(fileName);
-    if (format == Unknown) {
+    // Every format looks at the same first few KB to decide whether the file is theirs
+    const FileFormat* fileFormat = nullptr;
+    {
+        HeaderBytes bytes(file, qMin(fileSize, qint64(HEADER_PROBE_SIZE)));
+        fileFormat = findFormat(makeFileHeader(fileName, fileSize, bytes));
+    }
+    if (!fileFormat) {
         setError("This doesn't look like a valid STL file");
         return InvalidFormat;
     }
+    format = fileFormat->format;
+    formatName = fileFormat->name;
     
-    qDebug() << "File format detected:" << (format == Binary ? "Binary STL" : "Text STL");
-    
-    // Open the file with the right settings
-    QFile file(fileName);
-    QIODevice::OpenMode openMode = (format == Binary) ? QIODevice::ReadOnly : (QIODevice::ReadOnly | QIODevice::Text);
-    
-    if (!file.open(openMode)) {
-        setError("Cannot open file: " + file.errorString());
-        return CannotOpenFile;
-    }
+    qDebug() << "File format detected:" << getFormatString();
     
     LoadResult result = Success;
     
     // Load the file using the appropriate method
     try {
-        if (format == Binary) {
-            result = loadBinarySTL(file);
-        } else if (format == ASCII) {
-            result = loadASCIISTL(file);
+        switch (format) {
+        case Binary: result = loadBinarySTL(file); break;
+        case ASCII: result = loadASCIISTL(file); break;
+        case OBJ: result = loadOBJ(file); break;
+        case PLY: result = loadPLY(file); break;
+        case ThreeMF: result = loadThreeMF(file); break;
+        case Archive: result = loadMeshArchive(file); break;
+        case Custom: result = loadCustom(file, *fileFormat); break;
+        case Unknown: break;
         }
         
         if (result == Success) {
@@ -111,85 +820,195 @@ STLLoader::LoadResult STLLoader::loadFile(const QString& fileName)
     if (result != Success) {
         clear();  // Something went wrong, throw away partial data
     } else {
-        qDebug() << "Success! Loaded" << triangles.size() << "triangles with" << vertices.size() << "vertices";
+        qDebug() << "Success! Loaded" << getTriangleCount() << "triangles with" << getVertexCount() << "vertices";
     }
     
     return result;
 }
 
-STLLoader::STLFormat STLLoader::detectFormat(const QString& fileName)
+bool STLLoader::isOBJ(const QString& fileName)
 {
-    // Try binary detection first (it's more reliable)
-    if (isBinarySTL(fileName)) {
-        return Binary;
-    } else if (isASCIISTL(fileName)) {
-        return ASCII;
-    }
-    return Unknown;
+    return probeFile(fileName, OBJ) != nullptr;
+}
+
+bool STLLoader::isPLY(const QString& fileName)
+{
+    return probeFile(fileName, PLY) != nullptr;
+}
+
+bool STLLoader::isThreeMF(const QString& fileName)
+{
+    return probeFile(fileName, ThreeMF) != nullptr;
+}
+
+bool STLLoader::isMeshArchive(const QString& fileName)
+{
+    return probeFile(fileName, Archive) != nullptr;
 }
 
 bool STLLoader::isBinarySTL(const QString& fileName)
+{
+    return probeFile(fileName, Binary) != nullptr;
+}
+
+bool STLLoader::isASCIISTL(const QString& fileName)
+{
+    return probeFile(fileName, ASCII) != nullptr;
+}
+
+STLLoader::STLFormat STLLoader::detectFormat(const QString& fileName)
+{
+    const FileFormat* fileFormat = probeFile(fileName);
+    return fileFormat ? fileFormat->format : Unknown;
+}
+
+const STLLoader::FileFormat* STLLoader::probeFile(const QString& fileName, STLFormat only)
 {
     QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return false;
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return nullptr;
     }
-    
-    // Binary STL files have a very specific structure
-    qint64 fileSize = file.size();
-    if (fileSize < BINARY_STL_HEADER_SIZE + 4) { // Need at least header + triangle count
-        file.close();
-        return false;
+    HeaderBytes bytes(file, qMin(file.size(), qint64(HEADER_PROBE_SIZE)));
+    const FileHeader header = makeFileHeader(fileName, file.size(), bytes);
+    if (only == Unknown) {
+        return findFormat(header);
     }
-    
-    // Skip the 80-byte header (it's usually garbage)
-    file.seek(BINARY_STL_HEADER_SIZE);
-    
-    // Read how many triangles the file claims to have
-    QDataStream stream(&file);
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
-    
-    quint32 triangleCount;
-    stream >> triangleCount;
-    
-    // Calculate what the file size should be if this is really binary
-    qint64 expectedSize = BINARY_STL_HEADER_SIZE + 4 + (triangleCount * BINARY_STL_TRIANGLE_SIZE);
-    
-    file.close();
-    
-    // Binary STL files must match the expected size exactly
-    bool isBinary = (fileSize == expectedSize && triangleCount > 0 && triangleCount < 50000000);
-    
-    if (isBinary) {
-        qDebug() << "This looks like binary STL:" << triangleCount << "triangles, expected size matches actual size";
+    for (const FileFormat& fileFormat : registry()) {
+        if (fileFormat.format == only) {
+            return fileFormat.probe(header) ? &fileFormat : nullptr;
+        }
     }
-    
-    return isBinary;
+    return nullptr;
 }
 
-bool STLLoader::isASCIISTL(const QString& fileName)
+const STLLoader::FileFormat* STLLoader::findFormat(const FileHeader& header)
 {
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return false;
-    }
-    
-    // ASCII STL files always start with "solid"
-    QTextStream stream(&file);
-    QString firstLine = stream.readLine().trimmed().toLower();
-    file.close();
-    
-    bool isAscii = firstLine.startsWith("solid");
-    
-    if (isAscii) {
-        qDebug() << "This looks like text STL, first line:" << firstLine;
+    for (const FileFormat& fileFormat : registry()) {
+        if (fileFormat.probe && fileFormat.probe(header)) {
+            return &fileFormat;
+        }
     }
-    
-    return isAscii;
+    return nullptr;
 }
 
-STLLoader::LoadResult STLLoader::loadBinarySTL(QFile& file)
+QVector<STLLoader::FileFormat>& STLLoader::registry()
+{
+    static QVector<FileFormat> list = []() {
+        QVector<FileFormat> builtIn;
+        auto add = [&builtIn](STLFormat format, const QString& name, const QString& suffix,
+                              std::function<bool(const FileHeader&)> probe) {
+            FileFormat fileFormat;
+            fileFormat.format = format;
+            fileFormat.name = name;
+            fileFormat.suffixes = QStringList{suffix};
+            fileFormat.probe = std::move(probe);
+            builtIn.append(fileFormat);
+        };
+        
+        // OBJ files are only recognized by their name, any text could start them
+        add(OBJ, "Wavefront OBJ", "obj", [](const FileHeader& header) {
+            return header.suffix == "obj";
+        });
+        // PLY files always start with the line "ply"
+        add(PLY, "Stanford PLY", "ply", [](const FileHeader& header) {
+            return header.size >= 4 && (std::memcmp(header.data, "ply\n", 4) == 0 || std::memcmp(header.data, "ply\r", 4) == 0);
+        });
+        // 3MF packages are ZIP archives, which start with "PK"
+        add(ThreeMF, "3MF package", "3mf", [](const FileHeader& header) {
+            return header.suffix == "3mf" && header.size >= 2 && header.data[0] == 'P' && header.data[1] == 'K';
+        });
+        // Recognized by the first bytes, so the name does not matter
+        add(Archive, "Mesh archive", "cmesh", [](const FileHeader& header) {
+            return MeshArchive::isArchive(header.data, header.size);
+        });
+        
+        // Binary STL has no signature: an 80-byte header (which some exporters start with "solid",
+        // just like text STL), the triangle count, then 50 bytes per triangle
+        add(Binary, "Binary STL", "stl", [](const FileHeader& header) {
+            if (header.size < BINARY_STL_HEADER_SIZE + 4) {
+                return false;
+            }
+            const quint32 triangleCount = qFromLittleEndian<quint32>(header.data + BINARY_STL_HEADER_SIZE);
+            if (triangleCount == 0 || triangleCount > 50000000) {
+                return false;
+            }
+            const qint64 expectedSize = BINARY_STL_HEADER_SIZE + 4 + qint64(triangleCount) * BINARY_STL_TRIANGLE_SIZE;
+            if (header.fileSize == expectedSize) {
+                // The size fits. Only a text STL whose length happens to fit too is turned away.
+                return !(looksLikeText(header.data, header.size) && containsWord(header.data, header.size, "facet"));
+            }
+            // Extra bytes at the end (some exporters pad) or a cut-off copy: still binary if the
+            // triangles are clearly not text, so a damaged file is reported as damaged
+            const qint64 bodySize = header.size - BINARY_STL_HEADER_SIZE - 4;
+            return bodySize > 0 && !looksLikeText(header.data + BINARY_STL_HEADER_SIZE + 4, bodySize);
+        });
+        // Text STL starts with "solid" and is text all the way
+        add(ASCII, "Text STL", "stl", [](const FileHeader& header) {
+            return startsWithWord(header.data, header.size, "solid") && looksLikeText(header.data, header.size);
+        });
+        return builtIn;
+    }();
+    return list;
+}
+
+void STLLoader::registerFormat(const FileFormat& format)
+{
+    // In front of the STL formats, which would otherwise claim the file first
+    QVector<FileFormat>& list = registry();
+    int position = 0;
+    while (position < list.size() && list[position].format != Binary) {
+        ++position;
+    }
+    FileFormat added = format;
+    added.format = Custom;
+    list.insert(position, added);
+}
+
+const QVector<STLLoader::FileFormat>& STLLoader::formats()
+{
+    return registry();
+}
+
+QString STLLoader::openFileFilter()
+{
+    // Formats sharing their file names (binary and text STL) get one entry
+    QStringList allPatterns;
+    struct Group {
+        QStringList suffixes;
+        QStringList names;    // The formats using these suffixes
+    };
+    QVector<Group> groups;
+    for (const FileFormat& fileFormat : registry()) {
+        int group = 0;
+        while (group < groups.size() && groups[group].suffixes != fileFormat.suffixes) {
+            ++group;
+        }
+        if (group == groups.size()) {
+            groups.append(Group{fileFormat.suffixes, QStringList()});
+        }
+        groups[group].names.append(fileFormat.name);
+        for (const QString& suffix : fileFormat.suffixes) {
+            if (!allPatterns.contains("*." + suffix)) {
+                allPatterns.append("*." + suffix);
+            }
+        }
+    }
+    
+    QStringList filters;
+    filters.append("Models (" + allPatterns.join(' ') + ")");
+    for (const Group& group : groups) {
+        QStringList patterns;
+        for (const QString& suffix : group.suffixes) {
+            patterns.append("*." + suffix);
+        }
+        const QString name = group.names.size() == 1 ? group.names.first() : group.suffixes.value(0).toUpper() + " Files";
+        filters.append(name + " (" + patterns.join(' ') + ")");
+    }
+    filters.append("All Files (*)");
+    return filters.join(";;");
+}
+
+STLLoader::LoadResult STLLoader::loadBinarySTL(QFile& file)
 {
     qDebug() << "Reading binary STL file...";
     
@@ -198,273 +1017,969 @@ STLLoader::LoadResult STLLoader::loadBinarySTL(QFile& file)
         return CorruptedFile;
     }
     
-    QDataStream stream(&file);
-    stream.setByteOrder(QDataStream::LittleEndian);  // STL uses little-endian byte order
-    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    // The file arrives in big pieces from AsyncFileReader while the next pieces are still being
+    // read. A triangle can be cut in two at the end of a piece; its first part waits in "carry".
+    quint32 triangleCount = 0;
+    quint32 nextTriangle = 0;
+    bool haveCount = false;
+    char carry[BINARY_STL_TRIANGLE_SIZE];
+    qint64 carried = 0;
+    LoadResult countResult = Success;
+    
+    auto readTriangle = [&](const char* record) {
+        quint32 i = nextTriangle++;
+        
+        // Each triangle starts with its normal vector (surface direction), then its three corners
+        float values[12];
+        for (int j = 0; j < 12; ++j) {
+            values[j] = readLittleEndianFloat(record + j * 4);
+        }
+        
+        // Make sure the numbers make sense (not corrupted)
+        if (!qIsFinite(values[0]) || !qIsFinite(values[1]) || !qIsFinite(values[2])) {
+            qWarning() << "Triangle" << i << "has invalid normal vector - skipping";
+            return;
+        }
+        for (int j = 3; j < 12; ++j) {
+            if (!qIsFinite(values[j])) {
+                qWarning() << "Triangle" << i << "has corrupted vertex data - skipping";
+                return;
+            }
+        }
+        
+        // The 2-byte "attribute" field after the corners is usually unused, so it is skipped
+        STLTriangle triangle(QVector3D(values[0], values[1], values[2]),
+                             QVector3D(values[3], values[4], values[5]),
+                             QVector3D(values[6], values[7], values[8]),
+                             QVector3D(values[9], values[10], values[11]));
+        
+        // Only keep triangles that actually make sense geometrically
+        if (isValidTriangle(triangle)) {
+            triangles.append(triangle);
+        } else {
+            qWarning() << "Triangle" << i << "is degenerate (zero area) - skipping";
+            degenerateTriangles++;
+        }
+        
+        // Show progress for big files
+        if (i % 10000 == 0 && i > 0) {
+            qDebug() << "Read" << i << "/" << triangleCount << "triangles so far...";
+        }
+    };
     
-    // Jump past the 80-byte header (it's usually meaningless)
-    file.seek(BINARY_STL_HEADER_SIZE);
+    auto readPiece = [&](const char* data, qint64 size, qint64 offset) {
+        Q_UNUSED(offset);
+        const char* p = data;
+        const char* end = data + size;
+        
+        if (!haveCount) {
+            // The first piece is always at least 4 KB (or the whole file), so it holds the
+            // 80-byte header (usually meaningless) and the number of triangles after it
+            triangleCount = qFromLittleEndian<quint32>(data + BINARY_STL_HEADER_SIZE);
+            if (triangleCount == 0) {
+                setError("This STL file contains no triangles");
+                countResult = EmptyFile;
+                return false;
+            }
+            if (triangleCount > 50000000) {
+                setError("This file claims to have an unreasonable number of triangles: " + QString::number(triangleCount));
+                countResult = CorruptedFile;
+                return false;
+            }
+            qDebug() << "File contains" << triangleCount << "triangles";
+            
+            // Make room for all the triangles we're about to read
+            triangles.reserve(triangleCount);
+            haveCount = true;
+            p += BINARY_STL_HEADER_SIZE + 4;
+        }
+        
+        // Finish the triangle cut off at the end of the last piece
+        if (carried > 0) {
+            qint64 take = qMin<qint64>(BINARY_STL_TRIANGLE_SIZE - carried, end - p);
+            std::memcpy(carry + carried, p, size_t(take));
+            carried += take;
+            p += take;
+            if (carried == BINARY_STL_TRIANGLE_SIZE) {
+                readTriangle(carry);
+                carried = 0;
+            }
+        }
+        
+        while (nextTriangle < triangleCount && end - p >= BINARY_STL_TRIANGLE_SIZE) {
+            readTriangle(p);
+            p += BINARY_STL_TRIANGLE_SIZE;
+        }
+        
+        if (nextTriangle < triangleCount && p < end) {
+            carried = end - p;
+            std::memcpy(carry, p, size_t(carried));
+        }
+        
+        // Anything after the last triangle is ignored, so there is no need to read it
+        return nextTriangle < triangleCount;
+    };
+    
+    AsyncFileReader::Options options;
+    options.directIO = directIO;
+    QString readError;
+    bool readOk = AsyncFileReader::readFile(file, readPiece, options, &readReport, &readError);
+    if (countResult != Success) {
+        return countResult;
+    }
+    if (!readOk) {
+        setError(readError);
+        return ReadError;
+    }
+    if (nextTriangle < triangleCount) {
+        setError(QString("Error reading triangle %1 from file").arg(nextTriangle));
+        return ReadError;
+    }
+    
+    qDebug() << "Read" << readReport.bytes << "bytes with" << AsyncFileReader::backendName(readReport.backend)
+             << "at" << readReport.gigabytesPerSecond << "GB/s";
+    
+    if (triangles.isEmpty()) {
+        setError("No valid triangles found in this file");
+        return EmptyFile;
+    }
+    
+    qDebug() << "Successfully read" << triangles.size() << "valid triangles from binary STL";
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::loadASCIISTL(QFile& file)
+{
+    qDebug() << "Reading text STL file...";
     
-    // Read the number of triangles
-    quint32 triangleCount;
-    stream >> triangleCount;
+    // Read the words straight out of a memory map of the file, like the OBJ and PLY readers do,
+    // instead of making a QString for every line. If the file cannot be mapped it is read in.
+    qint64 size = file.size();
+    QByteArray content;
+    const char* data = reinterpret_cast<const char*>(file.map(0, size));
+    if (!data) {
+        content = file.readAll();
+        data = content.constData();
+        size = content.size();
+    }
+    const char* dataEnd = data + size;
+    const char* lineStart = data;
+    int lineNumber = 0;
+    StlTextLine line;
+    
+    // Split the next line into words; false at the end of the file
+    auto readLine = [&]() {
+        if (lineStart >= dataEnd) {
+            return false;
+        }
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', dataEnd - lineStart));
+        if (!lineEnd) {
+            lineEnd = dataEnd;
+        }
+        line.split(lineStart, lineEnd);
+        lineStart = lineEnd + 1;
+        lineNumber++;
+        return true;
+    };
+    
+    // First line should be "solid <optional name>"
+    readLine();
+    if (!line.startsWith(0, "solid")) {
+        setError(QString("Text STL should start with 'solid' but line %1 says: %2").arg(lineNumber).arg(line.text()));
+        return InvalidFormat;
+    }
+    
+    STLTriangle currentTriangle;
+    int vertexCount = 0;
+    bool inFacet = false;     // Are we currently reading a triangle?
+    bool inLoop = false;      // Are we currently reading the triangle's vertices?
+    int trianglesParsed = 0;
+    
+    while (readLine()) {
+        if (line.count == 0 || line.words[0][0] == '#') {
+            continue; // Skip blank lines and comments
+        }
+        
+        if (line.is(0, "facet") && line.count >= 5 && line.is(1, "normal")) {
+            // Starting a new triangle
+            if (inFacet) {
+                setError(QString("Line %1: Found new triangle before finishing previous one").arg(lineNumber));
+                return CorruptedFile;
+            }
+            
+            // Read the surface normal (direction the triangle faces)
+            float nx, ny, nz;
+            if (!line.number(2, nx) || !line.number(3, ny) || !line.number(4, nz)) {
+                qWarning() << "Line" << lineNumber << ": Can't read normal vector, using default";
+                nx = ny = nz = 0.0f;
+            }
+            
+            // Fix any corrupted values
+            if (qIsNaN(nx) || qIsInf(nx)) nx = 0.0f;
+            if (qIsNaN(ny) || qIsInf(ny)) ny = 0.0f;
+            if (qIsNaN(nz) || qIsInf(nz)) nz = 0.0f;
+            
+            currentTriangle.normal = QVector3D(nx, ny, nz);
+            inFacet = true;
+            vertexCount = 0;
+            
+        } else if (line.is(0, "outer") && line.is(1, "loop")) {
+            // Starting to read the triangle's corner points
+            if (!inFacet || inLoop) {
+                setError(QString("Line %1: 'outer loop' in wrong place").arg(lineNumber));
+                return CorruptedFile;
+            }
+            inLoop = true;
+            
+        } else if (line.is(0, "vertex") && line.count >= 4) {
+            // Reading one corner point of the triangle
+            if (!inLoop) {
+                setError(QString("Line %1: Found vertex outside of loop").arg(lineNumber));
+                return CorruptedFile;
+            }
+            
+            float vx, vy, vz;
+            if (!line.number(1, vx) || !line.number(2, vy) || !line.number(3, vz)) {
+                setError(QString("Line %1: Cannot read vertex coordinates").arg(lineNumber));
+                return CorruptedFile;
+            }
+            
+            // Check for corrupted coordinate values
+            if (qIsNaN(vx) || qIsInf(vx) || qIsNaN(vy) || qIsInf(vy) || qIsNaN(vz) || qIsInf(vz)) {
+                setError(QString("Line %1: Vertex has corrupted coordinates").arg(lineNumber));
+                return CorruptedFile;
+            }
+            
+            QVector3D vertex(vx, vy, vz);
+            
+            // Store this vertex in the right position
+            if (vertexCount == 0) {
+                currentTriangle.vertex1 = vertex;
+            } else if (vertexCount == 1) {
+                currentTriangle.vertex2 = vertex;
+            } else if (vertexCount == 2) {
+                currentTriangle.vertex3 = vertex;
+            } else {
+                setError(QString("Line %1: Triangle has too many vertices").arg(lineNumber));
+                return CorruptedFile;
+            }
+            vertexCount++;
+            
+        } else if (line.is(0, "endloop")) {
+            // Finished reading the triangle's vertices
+            if (!inLoop) {
+                setError(QString("Line %1: 'endloop' without matching 'outer loop'").arg(lineNumber));
+                return CorruptedFile;
+            }
+            
+            if (vertexCount != 3) {
+                setError(QString("Line %1: Triangle has %2 vertices but should have exactly 3").arg(lineNumber).arg(vertexCount));
+                return CorruptedFile;
+            }
+            
+            inLoop = false;
+            
+        } else if (line.is(0, "endfacet")) {
+            // Finished reading this triangle completely
+            if (!inFacet || inLoop) {
+                setError(QString("Line %1: 'endfacet' without proper triangle structure").arg(lineNumber));
+                return CorruptedFile;
+            }
+            
+            // Check if this triangle makes geometric sense and save it
+            if (isValidTriangle(currentTriangle)) {
+                triangles.append(currentTriangle);
+                trianglesParsed++;
+                
+                // Show progress for large files
+                if (trianglesParsed % 1000 == 0) {
+                    qDebug() << "Parsed" << trianglesParsed << "triangles so far...";
+                }
+            } else {
+                qWarning() << "Line" << lineNumber << ": Triangle has zero area - skipping";
+                degenerateTriangles++;
+            }
+            
+            inFacet = false;
+            
+        } else if (line.is(0, "endsolid")) {
+            break; // We've reached the end of the model
+        }
+    }
+    
+    if (triangles.isEmpty()) {
+        setError("No valid triangles found in text STL file");
+        return EmptyFile;
+    }
+    
+    qDebug() << "Successfully read" << triangles.size() << "valid triangles from text STL";
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::loadOBJ(QFile& file)
+{
+    qDebug() << "Reading OBJ file...";
+    
+    // Look at the file through a memory map so the parsers read it in place, without copying.
+    // If the system cannot map it we read it into memory instead. The file is opened without
+    // QIODevice::Text, so the bytes read are the bytes on disk; the parsers handle "\r\n" themselves,
+    // and the size is taken from what was actually read.
+    qint64 size = file.size();
+    QByteArray content;
+    const char* data = reinterpret_cast<const char*>(file.map(0, size));
+    if (!data) {
+        content = file.readAll();
+        data = content.constData();
+        size = content.size();
+    }
+    const char* dataEnd = data + size;
+    
+    // Cut the file into pieces at line ends, a few per core
+    int chunkCount = int(qBound<qint64>(1, size / (1 << 20), Parallel::threadCount() * 8));
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* chunkStart = data;
+    for (int c = 0; c < chunkCount; ++c) {
+        const char* chunkEnd = dataEnd;
+        if (c + 1 < chunkCount) {
+            chunkEnd = std::max(chunkStart, data + size * (c + 1) / chunkCount);
+            const char* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', dataEnd - chunkEnd));
+            chunkEnd = newline ? newline + 1 : dataEnd;
+        }
+        chunks[c].begin = chunkStart;
+        chunks[c].end = chunkEnd;
+        chunkStart = chunkEnd;
+    }
+    
+    // First pass: count what every piece holds, so the second pass knows where its items go
+    Parallel::forBlocks(chunkCount, 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 c = begin; c < end; ++c) {
+            countObjChunk(chunks[c]);
+        }
+    });
+    
+    qint64 lineCount = 0, positionCount = 0, normalCount = 0, triangleCount = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.firstLine = lineCount;
+        chunk.firstPosition = positionCount;
+        chunk.firstNormal = normalCount;
+        chunk.firstTriangle = triangleCount;
+        lineCount += chunk.lines;
+        positionCount += chunk.positions;
+        normalCount += chunk.normals;
+        triangleCount += chunk.triangles;
+    }
+    
+    qDebug() << "File contains" << positionCount << "vertices," << normalCount << "normals and"
+             << triangleCount << "triangles";
     
     if (triangleCount == 0) {
-        setError("This STL file contains no triangles");
+        setError("This OBJ file contains no faces");
         return EmptyFile;
     }
     
-    if (triangleCount > 50000000) {
-        setError("This file claims to have an unreasonable number of triangles: " + QString::number(triangleCount));
-        return CorruptedFile;
+    // Second pass: every piece parses straight into its own part of the shared arrays
+    STLIndexedMesh mesh;
+    mesh.positions.resize(size_t(positionCount) * 3);
+    mesh.normals.resize(size_t(normalCount) * 3);
+    mesh.positionIndices.resize(size_t(triangleCount) * 3);
+    mesh.normalIndices.resize(size_t(triangleCount) * 3);
+    Parallel::forBlocks(chunkCount, 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 c = begin; c < end; ++c) {
+            parseObjChunk(chunks[c], mesh);
+        }
+    });
+    
+    for (const ObjChunk& chunk : chunks) {
+        if (chunk.errorLine >= 0) {
+            setError(QString("Line %1 of the OBJ file: %2").arg(chunk.errorLine + 1).arg(chunk.error));
+            return CorruptedFile;
+        }
     }
     
-    qDebug() << "File contains" << triangleCount << "triangles";
+    LoadResult result = addIndexedTriangles(mesh);
+    if (result != Success) {
+        return result;
+    }
     
-    // Make room for all the triangles we're about to read
-    triangles.reserve(triangleCount);
+    qDebug() << "Successfully read" << triangles.size() << "valid triangles from OBJ";
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::loadPLY(QFile& file)
+{
+    qDebug() << "Reading PLY file...";
+    
+    // Map the file so the vertex and face blocks are read in place (or read it in if it cannot be mapped)
+    qint64 size = file.size();
+    QByteArray content;
+    const char* data = reinterpret_cast<const char*>(file.map(0, size));
+    if (!data) {
+        content = file.readAll();
+        data = content.constData();
+        size = content.size();
+    }
     
-    // Read each triangle
-    for (quint32 i = 0; i < triangleCount; ++i) {
-        STLTriangle triangle;
+    PlyHeader header;
+    QString headerError;
+    if (!parsePlyHeader(data, size, header, headerError)) {
+        setError(headerError);
+        return InvalidFormat;
+    }
+    
+    STLIndexedMesh mesh;
+    bool hasVertices = false;
+    bool hasFaces = false;
+    bool hasNormals = false;
+    const bool swap = header.bigEndian;
+    qint64 pos = header.dataStart;
+    PlyTextReader text = {data + pos, data + size};
+    
+    // When the vertices are going to be shared anyway, they are written straight into the vertex
+    // buffer in file order (position and normal side by side, like OpenGL wants them) and the face
+    // list becomes the index list as it is. Only files drawn with one vertex per corner go through
+    // the triangle list.
+    bool direct = false;
+    if (mergeVertices) {
+        for (const PlyElement& element : header.elements) {
+            direct = direct || element.name == "face";
+        }
+    }
+    
+    auto fileEnded = [this]() {
+        setError("The file ends before all vertices and faces were read");
+        return CorruptedFile;
+    };
+    
+    for (const PlyElement& element : header.elements) {
+        const bool isVertex = element.name == "vertex" && !hasVertices;
+        const bool isFace = element.name == "face" && !hasFaces;
+        const qint64 count = element.count;
         
-        // Each triangle starts with its normal vector (surface direction)
-        float nx, ny, nz;
-        stream >> nx >> ny >> nz;
+        // A damaged header can promise more items than the file has room for; check before anything
+        // is sized from the count (dividing, so a huge count cannot overflow)
+        const qint64 remaining = header.ascii ? qint64(text.end - text.p) : size - pos;
+        const qint64 itemBytes = element.minItemBytes(header.ascii);
+        if (itemBytes == 0) {
+            continue;  // No properties: the items take up no room and hold nothing
+        }
+        if (count > remaining / itemBytes) {
+            return fileEnded();
+        }
         
-        // Make sure the numbers make sense (not corrupted)
-        if (qIsNaN(nx) || qIsInf(nx) || qIsNaN(ny) || qIsInf(ny) || qIsNaN(nz) || qIsInf(nz)) {
-            qWarning() << "Triangle" << i << "has invalid normal vector - skipping";
+        if (isVertex) {
+            PlyVertexLayout layout(element);
+            if (!layout.hasPositions()) {
+                setError("The vertices have no x, y and z");
+                return UnsupportedFormat;
+            }
+            // Normals the user asked to recalculate are not read at all
+            hasNormals = layout.hasNormals() && !calculateNormals;
+            
+            // Where each vertex's position and normal go: the vertex buffer (6 numbers per vertex)
+            // or the mesh's separate position and normal lists (3 each)
+            const int outStride = direct ? 6 : 3;
+            float* positionOut = nullptr;
+            float* normalOut = nullptr;
+            if (direct) {
+                if (count > std::numeric_limits<int>::max() / 6) {
+                    setError("The file has more vertices than can be drawn at once");
+                    return UnsupportedFormat;
+                }
+                vertexData.resize(int(count * 6));
+                positionOut = vertexData.data();
+                normalOut = positionOut + 3;
+            } else {
+                mesh.positions.resize(size_t(count) * 3);
+                positionOut = mesh.positions.data();
+                if (hasNormals) {
+                    mesh.normals.resize(size_t(count) * 3);
+                    normalOut = mesh.normals.data();
+                }
+            }
+            if (layout.hasColors()) {
+                mesh.colors.resize(size_t(count) * 3);
+            }
+            const PlyType colorType = layout.hasColors() ? element.properties[layout.color[0]].type : PlyInvalid;
+            hasVertices = true;
+            
+            if (header.ascii) {
+                std::vector<double> values(element.properties.size());
+                for (qint64 v = 0; v < count; ++v) {
+                    for (int k = 0; k < element.properties.size(); ++k) {
+                        if (element.properties[k].isList) {
+                            setError("Vertices with lists are not supported");
+                            return UnsupportedFormat;
+                        }
+                        if (!text.next(values[k])) {
+                            return fileEnded();
+                        }
+                    }
+                    for (int k = 0; k < 3; ++k) {
+                        positionOut[v * outStride + k] = float(values[layout.position[k]]);
+                        if (hasNormals) {
+                            normalOut[v * outStride + k] = float(values[layout.normal[k]]);
+                        }
+                        if (!mesh.colors.empty()) {
+                            mesh.colors[v * 3 + k] = plyColor(values[layout.color[k]], colorType);
+                        }
+                    }
+                }
+                continue;
+            }
+            
+            if (element.itemSize < 0) {
+                setError("Vertices with lists are not supported");
+                return UnsupportedFormat;
+            }
+            const qint64 stride = element.itemSize;
+            if (pos + count * stride > size) {
+                return fileEnded();
+            }
+            const char* block = data + pos;
+            pos += count * stride;
+            
+            // Values stored as floats in the order they are wanted (x, y, z and then nx, ny, nz, the
+            // usual layout) are copied as they are; a block of nothing else is one single copy
+            auto isRawFloat = [&](int property, int offset) {
+                return Q_BYTE_ORDER == Q_LITTLE_ENDIAN && !swap && element.properties[property].type == PlyFloat32 &&
+                       element.properties[property].offset == offset;
+            };
+            const bool rawPositions = isRawFloat(layout.position[0], 0) && isRawFloat(layout.position[1], 4) &&
+                                      isRawFloat(layout.position[2], 8);
+            const bool rawVertex = direct && hasNormals && rawPositions && isRawFloat(layout.normal[0], 12) &&
+                                   isRawFloat(layout.normal[1], 16) && isRawFloat(layout.normal[2], 20);
+            const int rawBytes = rawVertex ? 24 : 12;
+            const bool wholeBlock = rawPositions && stride == rawBytes && outStride * int(sizeof(float)) == rawBytes;
+            if (wholeBlock) {
+                std::memcpy(positionOut, block, size_t(count) * rawBytes);
+            }
+            
+            Parallel::forChunks(count, [&](qint64 begin, qint64 end, int) {
+                for (qint64 v = begin; v < end; ++v) {
+                    const char* item = block + v * stride;
+                    if (rawPositions) {
+                        if (!wholeBlock) {
+                            std::memcpy(positionOut + v * outStride, item, rawBytes);
+                        }
+                    } else {
+                        for (int k = 0; k < 3; ++k) {
+                            const PlyProperty& property = element.properties[layout.position[k]];
+                            positionOut[v * outStride + k] = float(readPlyValue(item + property.offset, property.type, swap));
+                        }
+                    }
+                    for (int k = 0; k < 3 && hasNormals && !rawVertex; ++k) {
+                        const PlyProperty& property = element.properties[layout.normal[k]];
+                        normalOut[v * outStride + k] = float(readPlyValue(item + property.offset, property.type, swap));
+                    }
+                    for (int k = 0; k < 3 && !mesh.colors.empty(); ++k) {
+                        const PlyProperty& property = element.properties[layout.color[k]];
+                        mesh.colors[v * 3 + k] = plyColor(readPlyValue(item + property.offset, property.type, swap),
+                                                          property.type);
+                    }
+                }
+            });
             continue;
         }
         
-        triangle.normal = QVector3D(nx, ny, nz);
-        
-        // Now read the three corners of the triangle
-        float v1x, v1y, v1z, v2x, v2y, v2z, v3x, v3y, v3z;
-        stream >> v1x >> v1y >> v1z;
-        stream >> v2x >> v2y >> v2z;
-        stream >> v3x >> v3y >> v3z;
+        // Faces keep their corners in "vertex_indices" (sometimes "vertex_index")
+        int cornerList = -1;
+        if (isFace) {
+            cornerList = element.find("vertex_indices");
+            if (cornerList < 0) {
+                cornerList = element.find("vertex_index");
+            }
+            if (cornerList < 0 || !element.properties[cornerList].isList) {
+                setError("The faces have no vertex_indices list");
+                return UnsupportedFormat;
+            }
+            hasFaces = true;
+            mesh.positionIndices.reserve(size_t(count) * 3);
+        }
         
-        // Check all coordinates for corruption
-        float coords[] = {v1x, v1y, v1z, v2x, v2y, v2z, v3x, v3y, v3z};
-        bool hasCorruptedData = false;
-        for (int j = 0; j < 9; ++j) {
-            if (qIsNaN(coords[j]) || qIsInf(coords[j])) {
-                hasCorruptedData = true;
-                break;
+        if (isFace && !header.ascii && element.properties.size() == 1) {
+            // Binary faces that are all triangles have a fixed size, so they can be decoded in parallel.
+            // Checking the corner counts is cheap: they sit at a fixed stride until one is not 3.
+            const PlyProperty& list = element.properties[0];
+            const int countSize = plyTypeSize(list.countType);
+            const int indexSize = plyTypeSize(list.type);
+            const qint64 stride = countSize + 3 * indexSize;
+            bool allTriangles = pos + count * stride <= size;
+            for (qint64 f = 0; f < count && allTriangles; ++f) {
+                allTriangles = readPlyValue(data + pos + f * stride, list.countType, swap) == 3.0;
+            }
+            if (allTriangles) {
+                const char* block = data + pos;
+                mesh.positionIndices.resize(size_t(count) * 3);
+                Parallel::forChunks(count, [&](qint64 begin, qint64 end, int) {
+                    for (qint64 f = begin; f < end; ++f) {
+                        const char* item = block + f * stride + countSize;
+                        for (int k = 0; k < 3; ++k) {
+                            mesh.positionIndices[f * 3 + k] = qint64(readPlyValue(item + k * indexSize, list.type, swap));
+                        }
+                    }
+                });
+                pos += count * stride;
+                continue;
             }
         }
         
-        if (hasCorruptedData) {
-            qWarning() << "Triangle" << i << "has corrupted vertex data - skipping";
+        if (!isFace && !header.ascii && element.itemSize >= 0) {
+            // Elements we do not use are skipped in one step when their items have a fixed size
+            pos += count * element.itemSize;
+            if (pos > size) {
+                return fileEnded();
+            }
             continue;
         }
         
-        triangle.vertex1 = QVector3D(v1x, v1y, v1z);
-        triangle.vertex2 = QVector3D(v2x, v2y, v2z);
-        triangle.vertex3 = QVector3D(v3x, v3y, v3z);
-        
-        // Skip the 2-byte "attribute" field (usually unused)
-        quint16 attribute;
-        stream >> attribute;
-        
-        // Make sure we didn't hit any read errors
-        if (stream.status() != QDataStream::Ok) {
-            setError(QString("Error reading triangle %1 from file").arg(i));
-            return ReadError;
+        // Everything else is read item by item: polygons, extra face properties, unknown elements
+        std::vector<qint64> corners;
+        for (qint64 item = 0; item < count; ++item) {
+            for (int k = 0; k < element.properties.size(); ++k) {
+                const PlyProperty& property = element.properties[k];
+                qint64 entries = 1;
+                if (property.isList) {
+                    double listCount = 0.0;
+                    if (header.ascii) {
+                        if (!text.next(listCount)) {
+                            return fileEnded();
+                        }
+                    } else {
+                        if (pos + plyTypeSize(property.countType) > size) {
+                            return fileEnded();
+                        }
+                        listCount = readPlyValue(data + pos, property.countType, swap);
+                        pos += plyTypeSize(property.countType);
+                    }
+                    // Same idea for one list: its entries have to fit in what is left of the file
+                    const qint64 left = header.ascii ? qint64(text.end - text.p) : size - pos;
+                    const qint64 entryBytes = header.ascii ? 1 : plyTypeSize(property.type);
+                    if (!(listCount >= 0.0) || listCount > double(left / entryBytes)) {
+                        return fileEnded();
+                    }
+                    entries = qint64(listCount);
+                }
+                
+                const bool keep = k == cornerList;
+                if (keep) {
+                    corners.resize(size_t(qMax<qint64>(entries, 0)));
+                }
+                for (qint64 e = 0; e < entries; ++e) {
+                    double value = 0.0;
+                    if (header.ascii) {
+                        if (!text.next(value)) {
+                            return fileEnded();
+                        }
+                    } else {
+                        if (pos + plyTypeSize(property.type) > size) {
+                            return fileEnded();
+                        }
+                        value = readPlyValue(data + pos, property.type, swap);
+                        pos += plyTypeSize(property.type);
+                    }
+                    if (keep) {
+                        corners[e] = qint64(value);
+                    }
+                }
+                if (keep) {
+                    addPlyPolygon(mesh.positionIndices, corners.data(), entries);
+                }
+            }
         }
-        
-        // Only keep triangles that actually make sense geometrically
-        if (isValidTriangle(triangle)) {
-            triangles.append(triangle);
-        } else {
-            qWarning() << "Triangle" << i << "is degenerate (zero area) - skipping";
+    }
+    
+    if (!hasVertices || !hasFaces) {
+        setError("A PLY file needs vertex and face elements (point clouds are not supported)");
+        return UnsupportedFormat;
+    }
+    
+    qDebug() << "File contains" << (direct ? vertexData.size() / 6 : int(mesh.positions.size() / 3)) << "vertices and"
+             << mesh.positionIndices.size() / 3 << "triangles" << (mesh.colors.empty() ? "" : "with colours");
+    
+    // PLY normals belong to the vertices, so they are numbered like the positions: normalIndices
+    // stays empty instead of holding a copy of the whole face list
+    
+    LoadResult result = direct ? addIndexedVertices(mesh, hasNormals) : addIndexedTriangles(mesh);
+    if (result != Success) {
+        return result;
+    }
+    
+    qDebug() << "Successfully read" << getTriangleCount() << "valid triangles from PLY";
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::loadThreeMF(QFile& file)
+{
+    qDebug() << "Reading 3MF package...";
+    
+    // The reader opens the archive itself and resolves the build into one mesh
+    STLIndexedMesh mesh;
+    ThreeMFReader::Report report;
+    QString error;
+    if (!ThreeMFReader::read(file, mesh, &report, &error)) {
+        setError("Cannot read 3MF file: " + error);
+        return CorruptedFile;
+    }
+    
+    qDebug() << "3MF build has" << report.instances << "meshes from" << report.objects << "objects in"
+             << report.modelParts << "model parts, units:" << report.unit;
+    
+    // 3MF has no normals; generateVertexBuffer works them out from the corners
+    mesh.normalIndices.assign(mesh.positionIndices.size(), -1);
+    
+    LoadResult result = addIndexedTriangles(mesh);
+    if (result != Success) {
+        return result;
+    }
+    
+    qDebug() << "Successfully read" << triangles.size() << "valid triangles from 3MF";
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::loadMeshArchive(QFile& file)
+{
+    qDebug() << "Reading mesh archive...";
+    
+    QVector<float> archiveVertices;
+    QVector<unsigned int> archiveIndices;
+    MeshArchive::ReadReport report;
+    QString error;
+    if (!MeshArchive::read(file, archiveVertices, archiveIndices, &report, &error)) {
+        setError("Cannot read mesh archive: " + error);
+        return CorruptedFile;
+    }
+    
+    qDebug() << "Mesh archive has" << report.triangles << "triangles in" << report.blocks << "blocks, decoded at"
+             << report.trianglesPerSecond / 1e6 << "million triangles per second";
+    
+    // The archive is already welded, so it goes through the same path as the other indexed formats.
+    // Its normals follow from the corners again, so only the positions are needed.
+    STLIndexedMesh mesh;
+    const qint64 vertexCount = archiveVertices.size() / 6;
+    mesh.positions.resize(size_t(vertexCount) * 3);
+    mesh.positionIndices.resize(size_t(archiveIndices.size()));
+    mesh.normalIndices.assign(size_t(archiveIndices.size()), -1);
+    Parallel::forChunks(vertexCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 v = begin; v < end; ++v) {
+            for (int k = 0; k < 3; ++k) {
+                mesh.positions[size_t(v * 3 + k)] = archiveVertices[int(v * 6 + k)];
+            }
+        }
+    });
+    Parallel::forChunks(archiveIndices.size(), [&](qint64 begin, qint64 end, int) {
+        for (qint64 i = begin; i < end; ++i) {
+            mesh.positionIndices[size_t(i)] = archiveIndices[int(i)];
+        }
+    });
+    
+    LoadResult result = addIndexedTriangles(mesh);
+    if (result != Success) {
+        return result;
+    }
+    
+    qDebug() << "Successfully read" << triangles.size() << "valid triangles from mesh archive";
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::loadCustom(QFile& file, const FileFormat& fileFormat)
+{
+    qDebug() << "Reading" << fileFormat.name << "file...";
+    
+    if (!fileFormat.read) {
+        setError("There is no reader for " + fileFormat.name + " files");
+        return UnsupportedFormat;
+    }
+    
+    STLIndexedMesh mesh;
+    QString error;
+    if (!fileFormat.read(file, mesh, &error)) {
+        setError("Cannot read " + fileFormat.name + " file: " + error);
+        return CorruptedFile;
+    }
+    
+    // Readers that leave out normals get them worked out from the corners, as for 3MF
+    if (mesh.normalIndices.size() != mesh.positionIndices.size()) {
+        mesh.normalIndices.assign(mesh.positionIndices.size(), -1);
+    }
+    
+    LoadResult result = addIndexedTriangles(mesh);
+    if (result != Success) {
+        return result;
+    }
+    
+    qDebug() << "Successfully read" << triangles.size() << "valid triangles from" << fileFormat.name;
+    return Success;
+}
+
+STLLoader::LoadResult STLLoader::addIndexedTriangles(STLIndexedMesh& mesh)
+{
+    // Turn the faces into triangles with a facet normal from the file's vertex normals (or none,
+    // in which case generateVertexBuffer works it out from the corners)
+    const qint64 triangleCount = qint64(mesh.positionIndices.size() / 3);
+    const qint64 positionCount = qint64(mesh.positions.size() / 3);
+    const qint64 normalCount = qint64(mesh.normals.size() / 3);
+    const std::vector<qint64>& normalIndices = mesh.normalIndices.empty() ? mesh.positionIndices : mesh.normalIndices;
+    QVector<STLTriangle> parsed(static_cast<int>(triangleCount));
+    STLTriangle* parsedData = parsed.data();
+    std::vector<char> valid(size_t(triangleCount), 0);
+    std::atomic<bool> badIndex(false);
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 t = begin; t < end; ++t) {
+            QVector3D corner[3];
+            QVector3D normal(0, 0, 0);
+            bool hasNormals = true;
+            for (int k = 0; k < 3; ++k) {
+                qint64 p = mesh.positionIndices[t * 3 + k];
+                if (p < 0 || p >= positionCount) {
+                    badIndex = true;
+                    return;
+                }
+                corner[k] = QVector3D(mesh.positions[p * 3], mesh.positions[p * 3 + 1], mesh.positions[p * 3 + 2]);
+                
+                qint64 n = normalIndices[t * 3 + k];
+                if (n >= 0 && n < normalCount) {
+                    normal += QVector3D(mesh.normals[n * 3], mesh.normals[n * 3 + 1], mesh.normals[n * 3 + 2]);
+                } else {
+                    hasNormals = false;
+                }
+            }
+            parsedData[t] = STLTriangle(hasNormals ? normal.normalized() : QVector3D(0, 0, 0),
+                                        corner[0], corner[1], corner[2]);
+            valid[t] = isValidTriangle(parsedData[t]);
         }
-        
-        // Show progress for big files
-        if (i % 10000 == 0 && i > 0) {
-            qDebug() << "Read" << i << "/" << triangleCount << "triangles so far...";
+    });
+    
+    if (badIndex) {
+        setError("A face uses a vertex that does not exist");
+        return CorruptedFile;
+    }
+    
+    // Keep only triangles that actually make sense geometrically, and remember which file vertices
+    // they use so processTriangles() does not have to search for shared corners
+    triangles.reserve(int(triangleCount));
+    fileCorners.reserve(int(triangleCount) * 3);
+    for (qint64 t = 0; t < triangleCount; ++t) {
+        if (valid[t]) {
+            triangles.append(parsedData[t]);
+            for (int k = 0; k < 3; ++k) {
+                fileCorners.append(static_cast<unsigned int>(mesh.positionIndices[t * 3 + k]));
+            }
         }
     }
+    if (triangles.size() < triangleCount) {
+        degenerateTriangles = int(triangleCount - triangles.size());
+        qWarning() << degenerateTriangles << "degenerate (zero area) triangles skipped";
+    }
     
     if (triangles.isEmpty()) {
         setError("No valid triangles found in this file");
         return EmptyFile;
     }
     
-    qDebug() << "Successfully read" << triangles.size() << "valid triangles from binary STL";
+    // The colours are taken over, not copied; useFileIndices() gives each used vertex its own
+    // while it writes the vertex buffer
+    if (!mesh.colors.empty() && mesh.colors.size() == mesh.positions.size()) {
+        fileColors.swap(mesh.colors);
+    }
     return Success;
 }
 
-STLLoader::LoadResult STLLoader::loadASCIISTL(QFile& file)
+STLLoader::LoadResult STLLoader::addIndexedVertices(STLIndexedMesh& mesh, bool hasNormals)
 {
-    qDebug() << "Reading text STL file...";
-    
-    QTextStream stream(&file);
-    QString line;
-    int lineNumber = 0;
-    
-    // First line should be "solid <optional name>"
-    line = stream.readLine().trimmed();
-    lineNumber++;
+    // The reader already wrote every file vertex into vertexData, so only the faces are left to
+    // check: they become the index list as they are, minus the ones without any area
+    const qint64 triangleCount = qint64(mesh.positionIndices.size() / 3);
+    const qint64 vertexCount = qint64(vertexData.size() / 6);
+    const float* buffer = vertexData.constData();
+    std::vector<char> valid(size_t(triangleCount), 0);
+    std::atomic<bool> badIndex(false);
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 t = begin; t < end; ++t) {
+            QVector3D corner[3];
+            for (int k = 0; k < 3; ++k) {
+                const qint64 p = mesh.positionIndices[t * 3 + k];
+                if (p < 0 || p >= vertexCount) {
+                    badIndex = true;
+                    return;
+                }
+                corner[k] = QVector3D(buffer[p * 6], buffer[p * 6 + 1], buffer[p * 6 + 2]);
+            }
+            valid[t] = isValidTriangle(STLTriangle(QVector3D(0, 0, 0), corner[0], corner[1], corner[2]));
+        }
+    });
     
-    if (!line.toLower().startsWith("solid")) {
-        setError(QString("Text STL should start with 'solid' but line %1 says: %2").arg(lineNumber).arg(line));
-        return InvalidFormat;
+    if (badIndex) {
+        setError("A face uses a vertex that does not exist");
+        return CorruptedFile;
     }
     
-    STLTriangle currentTriangle;
-    int vertexCount = 0;
-    bool inFacet = false;     // Are we currently reading a triangle?
-    bool inLoop = false;      // Are we currently reading the triangle's vertices?
-    int trianglesParsed = 0;
-    
-    while (!stream.atEnd()) {
-        line = stream.readLine().trimmed();
-        lineNumber++;
-        
-        if (line.isEmpty() || line.startsWith("#")) {
-            continue; // Skip blank lines and comments
-        }
-        
-        QString keyword;
-        QStringList values;
-        if (!parseASCIILine(line, keyword, values)) {
-            continue; // Skip lines we can't understand
-        }
-        
-        if (keyword == "facet" && values.size() >= 4 && values[0] == "normal") {
-            // Starting a new triangle
-            if (inFacet) {
-                setError(QString("Line %1: Found new triangle before finishing previous one").arg(lineNumber));
-                return CorruptedFile;
-            }
-            
-            // Read the surface normal (direction the triangle faces)
-            bool ok1, ok2, ok3;
-            float nx = values[1].toFloat(&ok1);
-            float ny = values[2].toFloat(&ok2);
-            float nz = values[3].toFloat(&ok3);
-            
-            if (!ok1 || !ok2 || !ok3) {
-                qWarning() << "Line" << lineNumber << ": Can't read normal vector, using default";
-                nx = ny = nz = 0.0f;
-            }
-            
-            // Fix any corrupted values
-            if (qIsNaN(nx) || qIsInf(nx)) nx = 0.0f;
-            if (qIsNaN(ny) || qIsInf(ny)) ny = 0.0f;
-            if (qIsNaN(nz) || qIsInf(nz)) nz = 0.0f;
-            
-            currentTriangle.normal = QVector3D(nx, ny, nz);
-            inFacet = true;
-            vertexCount = 0;
-            
-        } else if (keyword == "outer" && values.size() >= 1 && values[0] == "loop") {
-            // Starting to read the triangle's corner points
-            if (!inFacet || inLoop) {
-                setError(QString("Line %1: 'outer loop' in wrong place").arg(lineNumber));
-                return CorruptedFile;
-            }
-            inLoop = true;
-            
-        } else if (keyword == "vertex" && values.size() >= 3) {
-            // Reading one corner point of the triangle
-            if (!inLoop) {
-                setError(QString("Line %1: Found vertex outside of loop").arg(lineNumber));
-                return CorruptedFile;
-            }
-            
-            bool ok1, ok2, ok3;
-            float vx = values[0].toFloat(&ok1);
-            float vy = values[1].toFloat(&ok2);
-            float vz = values[2].toFloat(&ok3);
-            
-            if (!ok1 || !ok2 || !ok3) {
-                setError(QString("Line %1: Cannot read vertex coordinates").arg(lineNumber));
-                return CorruptedFile;
-            }
-            
-            // Check for corrupted coordinate values
-            if (qIsNaN(vx) || qIsInf(vx) || qIsNaN(vy) || qIsInf(vy) || qIsNaN(vz) || qIsInf(vz)) {
-                setError(QString("Line %1: Vertex has corrupted coordinates").arg(lineNumber));
-                return CorruptedFile;
-            }
-            
-            QVector3D vertex(vx, vy, vz);
-            
-            // Store this vertex in the right position
-            if (vertexCount == 0) {
-                currentTriangle.vertex1 = vertex;
-            } else if (vertexCount == 1) {
-                currentTriangle.vertex2 = vertex;
-            } else if (vertexCount == 2) {
-                currentTriangle.vertex3 = vertex;
-            } else {
-                setError(QString("Line %1: Triangle has too many vertices").arg(lineNumber));
-                return CorruptedFile;
-            }
-            vertexCount++;
-            
-        } else if (keyword == "endloop") {
-            // Finished reading the triangle's vertices
-            if (!inLoop) {
-                setError(QString("Line %1: 'endloop' without matching 'outer loop'").arg(lineNumber));
-                return CorruptedFile;
-            }
-            
-            if (vertexCount != 3) {
-                setError(QString("Line %1: Triangle has %2 vertices but should have exactly 3").arg(lineNumber).arg(vertexCount));
-                return CorruptedFile;
-            }
-            
-            inLoop = false;
-            
-        } else if (keyword == "endfacet") {
-            // Finished reading this triangle completely
-            if (!inFacet || inLoop) {
-                setError(QString("Line %1: 'endfacet' without proper triangle structure").arg(lineNumber));
-                return CorruptedFile;
-            }
-            
-            // Check if this triangle makes geometric sense and save it
-            if (isValidTriangle(currentTriangle)) {
-                triangles.append(currentTriangle);
-                trianglesParsed++;
-                
-                // Show progress for large files
-                if (trianglesParsed % 1000 == 0) {
-                    qDebug() << "Parsed" << trianglesParsed << "triangles so far...";
-                }
-            } else {
-                qWarning() << "Line" << lineNumber << ": Triangle has zero area - skipping";
+    if (triangleCount > std::numeric_limits<int>::max() / 3) {
+        setError("The file has more triangles than can be drawn at once");
+        return UnsupportedFormat;
+    }
+    indices.reserve(int(triangleCount) * 3);
+    for (qint64 t = 0; t < triangleCount; ++t) {
+        if (valid[t]) {
+            for (int k = 0; k < 3; ++k) {
+                indices.append(static_cast<unsigned int>(mesh.positionIndices[t * 3 + k]));
             }
-            
-            inFacet = false;
-            
-        } else if (keyword == "endsolid") {
-            break; // We've reached the end of the model
         }
     }
+    if (indices.size() / 3 < triangleCount) {
+        degenerateTriangles = int(triangleCount - indices.size() / 3);
+        qWarning() << degenerateTriangles << "degenerate (zero area) triangles skipped";
+    }
     
-    if (triangles.isEmpty()) {
-        setError("No valid triangles found in text STL file");
+    if (indices.isEmpty()) {
+        setError("No valid triangles found in this file");
         return EmptyFile;
     }
     
-    qDebug() << "Successfully read" << triangles.size() << "valid triangles from text STL";
+    float* out = vertexData.data();
+    if (!hasNormals) {
+        // No normals in the file (or they are to be recalculated): every vertex gets the faces
+        // around it added up, larger faces counting for more, so the surface is shaded smoothly
+        for (int i = 0; i + 2 < indices.size(); i += 3) {
+            const unsigned int corner[3] = {indices[i], indices[i + 1], indices[i + 2]};
+            const QVector3D a(out[corner[0] * 6], out[corner[0] * 6 + 1], out[corner[0] * 6 + 2]);
+            const QVector3D b(out[corner[1] * 6], out[corner[1] * 6 + 1], out[corner[1] * 6 + 2]);
+            const QVector3D c(out[corner[2] * 6], out[corner[2] * 6 + 1], out[corner[2] * 6 + 2]);
+            const QVector3D faceNormal = QVector3D::crossProduct(b - a, c - a);
+            for (unsigned int v : corner) {
+                out[v * 6 + 3] += faceNormal.x();
+                out[v * 6 + 4] += faceNormal.y();
+                out[v * 6 + 5] += faceNormal.z();
+            }
+        }
+    }
+    
+    // Normals are drawn with length 1; vertices no face uses keep a default one
+    Parallel::forChunks(vertexCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 v = begin; v < end; ++v) {
+            QVector3D normal(out[v * 6 + 3], out[v * 6 + 4], out[v * 6 + 5]);
+            normal = normal.lengthSquared() > 1e-24f ? normal.normalized() : QVector3D(0, 0, 1);
+            out[v * 6 + 3] = normal.x();
+            out[v * 6 + 4] = normal.y();
+            out[v * 6 + 5] = normal.z();
+        }
+    });
+    
+    if (!mesh.colors.empty() && mesh.colors.size() == size_t(vertexCount) * 3) {
+        vertexColors.resize(int(mesh.colors.size()));
+        std::copy(mesh.colors.begin(), mesh.colors.end(), vertexColors.begin());
+    }
+    vertexBufferFromFile = true;
     return Success;
 }
 
 void STLLoader::processTriangles()
 {
-    if (triangles.isEmpty()) {
+    if (triangles.isEmpty() && !vertexBufferFromFile) {
         qWarning() << "No triangles to process";
         return;
     }
     
-    qDebug() << "Processing" << triangles.size() << "triangles...";
+    qDebug() << "Processing" << getTriangleCount() << "triangles...";
     
     // First, figure out how big the model is and where it sits
     calculateBoundingBox();
@@ -481,17 +1996,53 @@ void STLLoader::processTriangles()
         normalizeModel();
     }
     
-    // Convert triangles into format that graphics card can use efficiently
-    qDebug() << "Converting to graphics format...";
-    generateVertexBuffer();
+    // Convert triangles into format that graphics card can use efficiently.
+    // Files with an index list (OBJ, PLY, ...) already say which corners share a vertex, so their
+    // shared vertices are written out directly instead of one per corner and then merged again.
+    // PLY readers go one step further and fill the vertex buffer themselves.
+    if (vertexBufferFromFile) {
+        qDebug() << "Using the vertex buffer read from the file";
+    } else if (mergeVertices && !fileCorners.isEmpty()) {
+        qDebug() << "Converting to graphics format using the file's vertices...";
+        useFileIndices();
+    } else {
+        qDebug() << "Converting to graphics format...";
+        generateVertexBuffer();
+    }
     
     // Combine duplicate vertices to save memory if requested
-    if (mergeVertices) {
+    if (mergeVertices && fileCorners.isEmpty() && !vertexBufferFromFile) {
         qDebug() << "Removing duplicate vertices...";
         generateIndices();
+    } else if (!mergeVertices && !fileColors.empty()) {
+        // Every corner is its own vertex, so it takes the colour of the file vertex it came from
+        vertexColors.reserve(fileCorners.size() * 3);
+        for (unsigned int corner : fileCorners) {
+            vertexColors << fileColors[corner * 3] << fileColors[corner * 3 + 1] << fileColors[corner * 3 + 2];
+        }
+    }
+    
+    // Drop repeated triangles first - they would look like non-manifold edges to the orientation repair
+    if (removeDuplicateFacets) {
+        if (indices.isEmpty()) {
+            qWarning() << "Cannot remove duplicate facets - it needs merged vertices";
+        } else {
+            qDebug() << "Removing duplicate and overlapping facets...";
+            removeDuplicateTriangles();
+        }
+    }
+    
+    // Make all triangles wind the same way so back-face culling doesn't hide half the model
+    if (repairOrientation) {
+        if (indices.isEmpty()) {
+            qWarning() << "Cannot repair facet orientation - it needs merged vertices";
+        } else {
+            qDebug() << "Repairing facet orientation...";
+            repairFacetOrientation();
+        }
     }
     
-    qDebug() << "Processing complete. Final model has" << vertices.size() << "vertices";
+    qDebug() << "Processing complete. Final model has" << getVertexCount() << "vertices";
 }
 
 void STLLoader::calculateBoundingBox()
@@ -505,6 +2056,13 @@ void STLLoader::calculateBoundingBox()
         boundingBox.update(triangle.vertex3);
     }
     
+    // A vertex buffer filled by the reader has no triangle list; its vertices are looked at instead
+    if (vertexBufferFromFile) {
+        for (int i = 0; i + 5 < vertexData.size(); i += 6) {
+            boundingBox.update(QVector3D(vertexData[i], vertexData[i + 1], vertexData[i + 2]));
+        }
+    }
+    
     // Calculate the center, size, etc.
     boundingBox.finalize();
     
@@ -532,11 +2090,19 @@ void STLLoader::centerModel()
         triangle.vertex2 += offset;
         triangle.vertex3 += offset;
     }
+    if (vertexBufferFromFile) {
+        for (int i = 0; i + 5 < vertexData.size(); i += 6) {
+            vertexData[i] += offset.x();
+            vertexData[i + 1] += offset.y();
+            vertexData[i + 2] += offset.z();
+        }
+    }
     
     // Update our bounding box info
     boundingBox.min += offset;
     boundingBox.max += offset;
     boundingBox.center = QVector3D(0, 0, 0);
+    modelOffset = offset;
     
     qDebug() << "Model centered by moving it" << offset;
 }
@@ -557,6 +2123,13 @@ void STLLoader::normalizeModel()
         triangle.vertex2 *= scale;
         triangle.vertex3 *= scale;
     }
+    if (vertexBufferFromFile) {
+        for (int i = 0; i + 5 < vertexData.size(); i += 6) {
+            vertexData[i] *= scale;
+            vertexData[i + 1] *= scale;
+            vertexData[i + 2] *= scale;
+        }
+    }
     
     // Update our bounding box info
     boundingBox.min *= scale;
@@ -564,6 +2137,7 @@ void STLLoader::normalizeModel()
     boundingBox.center *= scale;
     boundingBox.size *= scale;
     boundingBox.maxDimension *= scale;
+    modelScale = scale;
     
     qDebug() << "Model scaled by factor of" << scale;
 }
@@ -578,20 +2152,7 @@ void STLLoader::generateVertexBuffer()
     vertexData.reserve(totalVertices * 6); // Each vertex needs 6 numbers: 3 for position, 3 for normal
     
     for (const STLTriangle& triangle : triangles) {
-        QVector3D normal = triangle.normal;
-        
-        // If the file didn't provide good normals, or we want to recalculate them
-        if (calculateNormals || normal.lengthSquared() < 0.001f) {
-            normal = calculateTriangleNormal(triangle.vertex1, triangle.vertex2, triangle.vertex3);
-        }
-        
-        // Make sure the normal vector has length 1
-        if (normal.lengthSquared() > 0.001f) {
-            normal.normalize();
-        } else {
-            // If we can't calculate a good normal, use a default
-            normal = QVector3D(0, 0, 1);
-        }
+        const QVector3D normal = facetNormal(triangle);
         
         // Create vertex objects for each corner of the triangle
         vertices.append(STLVertex(triangle.vertex1, normal));
@@ -629,6 +2190,25 @@ void STLLoader::generateVertexBuffer()
     qDebug() << "Created vertex buffer with" << vertices.size() << "vertices (" << vertexData.size() << "numbers total)";
 }
 
+QVector3D STLLoader::facetNormal(const STLTriangle& triangle)
+{
+    QVector3D normal = triangle.normal;
+    
+    // If the file didn't provide good normals, or we want to recalculate them
+    if (calculateNormals || normal.lengthSquared() < 0.001f) {
+        normal = calculateTriangleNormal(triangle.vertex1, triangle.vertex2, triangle.vertex3);
+    }
+    
+    // Make sure the normal vector has length 1
+    if (normal.lengthSquared() > 0.001f) {
+        normal.normalize();
+    } else {
+        // If we can't calculate a good normal, use a default
+        normal = QVector3D(0, 0, 1);
+    }
+    return normal;
+}
+
 void STLLoader::generateIndices()
 {
     if (vertices.isEmpty()) {
@@ -642,10 +2222,63 @@ void STLLoader::generateIndices()
     uniqueVertices.reserve(vertices.size() / 2); // Rough guess at number of unique vertices
     indices.reserve(vertices.size());
     
-    // Go through every vertex and either find an existing identical one or add it as new
-    for (const STLVertex& vertex : vertices) {
-        int index = findOrAddVertex(uniqueVertices, vertex);
-        indices.append(index);
+    if (!(vertexTolerance > 0.0f)) {
+        // With no tolerance no two points count as the same, so every corner stays its own vertex
+        uniqueVertices = vertices;
+        for (int i = 0; i < vertices.size(); ++i) {
+            indices.append(static_cast<unsigned int>(i));
+        }
+    } else {
+        // Every vertex found so far is filed in a hash table under the grid cell it sits in.
+        // Cells are two tolerances wide, so a matching vertex can only be in the corner's own cell
+        // or in the neighbouring cells on the sides the corner is close to - a handful of
+        // candidates, however big the model is (comparing every corner with every vertex found
+        // so far took minutes on a million triangles).
+        const double cellSize = 2.0 * double(vertexTolerance);
+        std::vector<int> table(1024, -1);    // Open addressing: vertex index, -1 for empty
+        size_t mask = table.size() - 1;
+        
+        auto insert = [&](int index, const WeldCell& cell) {
+            size_t slot = size_t(hashWeldCell(cell.x, cell.y, cell.z)) & mask;
+            while (table[slot] >= 0) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot] = index;
+        };
+        
+        for (const STLVertex& vertex : vertices) {
+            const WeldCell cell = weldCell(vertex.position, cellSize);
+            int index = -1;
+            
+            // Own cell first: exact copies, by far the most common match, are found there
+            for (int neighbour = 0; neighbour < 8 && index < 0; ++neighbour) {
+                const qint64 x = cell.x + ((neighbour & 1) ? cell.near[0] : 0);
+                const qint64 y = cell.y + ((neighbour & 2) ? cell.near[1] : 0);
+                const qint64 z = cell.z + ((neighbour & 4) ? cell.near[2] : 0);
+                for (size_t slot = size_t(hashWeldCell(x, y, z)) & mask; table[slot] >= 0; slot = (slot + 1) & mask) {
+                    if (verticesEqual(uniqueVertices[table[slot]], vertex, vertexTolerance)) {
+                        index = table[slot];
+                        break;
+                    }
+                }
+            }
+            
+            if (index < 0) {
+                index = uniqueVertices.size();
+                uniqueVertices.append(vertex);
+                
+                // Keep the table at most half full so searches stay short
+                if (size_t(uniqueVertices.size()) * 2 > table.size()) {
+                    table.assign(table.size() * 2, -1);
+                    mask = table.size() - 1;
+                    for (int i = 0; i < index; ++i) {
+                        insert(i, weldCell(uniqueVertices[i].position, cellSize));
+                    }
+                }
+                insert(index, cell);
+            }
+            indices.append(static_cast<unsigned int>(index));
+        }
     }
     
     // Replace our vertex list with just the unique ones
@@ -667,6 +2300,126 @@ void STLLoader::generateIndices()
     qDebug() << "Created" << indices.size() << "indices pointing to" << vertices.size() << "unique vertices";
 }
 
+void STLLoader::useFileIndices()
+{
+    // The file already says which corners share a vertex, so there is nothing to search for:
+    // every file vertex a triangle uses is written out once, in the order triangles first use it.
+    // Like generateIndices(), a shared vertex keeps the normal of the first triangle using it.
+    unsigned int fileVertexCount = 0;
+    for (unsigned int corner : fileCorners) {
+        fileVertexCount = qMax(fileVertexCount, corner + 1);
+    }
+    
+    std::vector<int> newIndex(fileVertexCount, -1);
+    vertices.clear();
+    vertexData.clear();
+    indices.clear();
+    vertices.reserve(int(fileVertexCount));
+    vertexData.reserve(int(fileVertexCount) * 6);
+    indices.reserve(fileCorners.size());
+    if (!fileColors.empty()) {
+        vertexColors.reserve(int(fileVertexCount) * 3);
+    }
+    
+    for (int t = 0; t < triangles.size() && t * 3 + 2 < fileCorners.size(); ++t) {
+        const STLTriangle& triangle = triangles[t];
+        const QVector3D normal = facetNormal(triangle);
+        const QVector3D* corners[3] = {&triangle.vertex1, &triangle.vertex2, &triangle.vertex3};
+        
+        for (int k = 0; k < 3; ++k) {
+            const unsigned int corner = fileCorners[t * 3 + k];
+            int& index = newIndex[corner];
+            if (index < 0) {
+                index = vertices.size();
+                const QVector3D& position = *corners[k];
+                vertices.append(STLVertex(position, normal));
+                vertexData << position.x() << position.y() << position.z()
+                           << normal.x() << normal.y() << normal.z();
+                if (!fileColors.empty()) {
+                    vertexColors << fileColors[corner * 3] << fileColors[corner * 3 + 1] << fileColors[corner * 3 + 2];
+                }
+            }
+            indices.append(static_cast<unsigned int>(index));
+        }
+    }
+    
+    qDebug() << "Used the file's" << indices.size() << "indices pointing to" << vertices.size() << "vertices";
+}
+
+void STLLoader::removeDuplicateTriangles()
+{
+    QVector<unsigned char> kept;
+    duplicateReport = MeshRepair::removeDuplicateFacets(indices, &kept);
+    
+    if (duplicateReport.removedTriangles == 0) {
+        return;
+    }
+    
+    // Drop the same triangles from our own list so it still lines up with the indices
+    int written = 0;
+    for (int t = 0; t < triangles.size() && t < kept.size(); ++t) {
+        if (kept[t]) {
+            triangles[written++] = triangles[t];
+        }
+    }
+    triangles.resize(written);
+    duplicateReport.bytesRemoved += qint64(duplicateReport.removedTriangles) * qint64(sizeof(STLTriangle));
+    
+    qDebug() << "Removed" << duplicateReport.removedTriangles << "triangles ("
+             << duplicateReport.duplicateTriangles << "duplicates," << duplicateReport.opposingTriangles
+             << "in overlapping pairs), saving" << duplicateReport.bytesRemoved << "bytes";
+}
+
+void STLLoader::repairFacetOrientation()
+{
+    // Flip the index triples in place - the vertex buffer itself stays untouched
+    QVector<unsigned char> flipped;
+    orientationReport = MeshRepair::orientFacets(vertexData, indices, &flipped);
+    
+    if (orientationReport.flippedTriangles == 0) {
+        return;
+    }
+    
+    // Keep the triangle list (when there is one) in step with the flipped indices
+    auto position = [this](int index) {
+        return QVector3D(vertexData[index * 6], vertexData[index * 6 + 1], vertexData[index * 6 + 2]);
+    };
+    QVector<bool> normalChecked(vertexData.size() / 6, false);
+    for (int t = 0; t < flipped.size() && t * 3 + 2 < indices.size(); ++t) {
+        if (!flipped[t]) {
+            continue;
+        }
+        
+        if (t < triangles.size()) {
+            STLTriangle& triangle = triangles[t];
+            std::swap(triangle.vertex2, triangle.vertex3);
+            triangle.normal = -triangle.normal;
+        }
+        
+        // Shared vertices took their normal from whichever triangle came first,
+        // so turn it around if it still points against the repaired face
+        QVector3D faceNormal = calculateTriangleNormal(position(indices[t * 3]), position(indices[t * 3 + 1]),
+                                                       position(indices[t * 3 + 2]));
+        for (int corner = 0; corner < 3; ++corner) {
+            int index = indices[t * 3 + corner];
+            if (normalChecked[index]) {
+                continue;
+            }
+            normalChecked[index] = true;
+            
+            const QVector3D normal(vertexData[index * 6 + 3], vertexData[index * 6 + 4], vertexData[index * 6 + 5]);
+            if (QVector3D::dotProduct(normal, faceNormal) < 0.0f) {
+                vertexData[index * 6 + 3] = -normal.x();
+                vertexData[index * 6 + 4] = -normal.y();
+                vertexData[index * 6 + 5] = -normal.z();
+                if (index < vertices.size()) {
+                    vertices[index].normal = -normal;
+                }
+            }
+        }
+    }
+}
+
 QVector3D STLLoader::calculateTriangleNormal(const QVector3D& v1, const QVector3D& v2, const QVector3D& v3)
 {
     // Calculate which direction this triangle face is pointing
@@ -715,47 +2468,8 @@ bool STLLoader::isValidTriangle(const STLTriangle& triangle)
     return true;
 }
 
-int STLLoader::findOrAddVertex(QVector<STLVertex>& uniqueVertices, const STLVertex& vertex)
-{
-    // Look through existing vertices to see if we already have this one
-    for (int i = 0; i < uniqueVertices.size(); ++i) {
-        if (verticesEqual(uniqueVertices[i], vertex, vertexTolerance)) {
-            return i;  // Found existing vertex, return its index
-        }
-    }
-    
-    // This is a new vertex, add it to the list
-    uniqueVertices.append(vertex);
-    return uniqueVertices.size() - 1;  // Return index of the new vertex
-}
-
 bool STLLoader::verticesEqual(const STLVertex& a, const STLVertex& b, float tolerance)
 {
     // Two vertices are considered the same if they're very close together
     return (a.position - b.position).lengthSquared() < tolerance * tolerance;
 }
-
-bool STLLoader::parseASCIILine(const QString& line, QString& keyword, QStringList& values)
-{
-    // Split a line like "vertex 1.0 2.0 3.0" into keyword="vertex" and values=["1.0", "2.0", "3.0"]
-    QStringList tokens = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-    
-    if (tokens.isEmpty()) {
-        return false;
-    }
-    
-    keyword = tokens[0].toLower();  // First word is the command
-    values = tokens.mid(1);         // Rest are the parameters
-    
-    return true;
-}
-
-QString STLLoader::getFormatString() const
-{
-    // Convert the format enum to human-readable text
-    switch (format) {
-        case Binary: return "Binary STL";
-        case ASCII: return "Text STL";
-        default: return "Unknown format";
-    }
-}
\ No newline at end of file
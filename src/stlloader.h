@@ -2,11 +2,16 @@
 #define STLLOADER_H
 
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include <QVector3D>
 #include <QFile>
 #include <QTextStream>
 #include <QDataStream>
+#include <functional>
+#include <vector>
+#include "asyncfilereader.h"
+#include "meshrepair.h"
 
 // A triangle in 3D space - the basic building block of 3D models
 struct STLTriangle {
@@ -30,6 +35,16 @@ struct STLVertex {
         : position(pos), normal(norm) {}
 };
 
+// Vertices and faces of a file that already shares its vertices (OBJ, PLY, 3MF), in file order
+struct STLIndexedMesh {
+    std::vector<float> positions;          // x, y, z per vertex
+    std::vector<float> normals;            // x, y, z per normal (may be empty)
+    std::vector<float> colors;             // Red, green, blue (0 to 1) per vertex (may be empty)
+    std::vector<qint64> positionIndices;   // Three per triangle, counted from 0
+    std::vector<qint64> normalIndices;     // Three per triangle, -1 if the corner has no normal;
+                                           // empty when normals are numbered like the positions (PLY)
+};
+
 // A box that completely surrounds the 3D model - useful for centering and sizing
 struct BoundingBox {
     QVector3D min;          // Bottom-left-back corner of the box
@@ -82,7 +97,12 @@ public:
     enum STLFormat {
         Unknown,    // We don't know what format this is
         Binary,     // Compact binary format (smaller files)
-        ASCII       // Text format (human readable, larger files)
+        ASCII,      // Text format (human readable, larger files)
+        OBJ,        // Wavefront OBJ (text, polygons on shared vertices)
+        PLY,        // Stanford PLY (binary or text, shared vertices, optional colours)
+        ThreeMF,    // 3MF package (ZIP archive of XML models, placed by the build)
+        Archive,    // Compressed mesh archive (.cmesh) saved by this program
+        Custom      // A format added with registerFormat()
     };
     
     // All the things that can go wrong when loading a file
@@ -97,32 +117,68 @@ public:
         ReadError             // Something went wrong while reading
     };
 
+    // The start of the file, read once when loading begins and shown to every format in turn
+    struct FileHeader {
+        QString fileName;
+        QString suffix;               // Lower case, without the dot
+        qint64 fileSize = 0;
+        const char* data = nullptr;   // The first bytes of the file (mapped when possible)
+        qint64 size = 0;              // How many of them there are (up to HEADER_PROBE_SIZE)
+    };
+    
+    // A file format the loader can read. loadFile() asks the formats in order and reads the file
+    // with the first one whose probe accepts it.
+    struct FileFormat {
+        STLFormat format = Custom;    // Which built-in reader to use; Custom for added formats
+        QString name;                 // Shown to the user, like "Wavefront OBJ"
+        QStringList suffixes;         // For the open dialog, like "obj"
+        std::function<bool(const FileHeader& header)> probe;
+        // Reader for added formats: fill in the shared vertices and faces, or explain what went wrong
+        std::function<bool(QFile& file, STLIndexedMesh& mesh, QString* errorMessage)> read;
+    };
+
 public:
     STLLoader();
     ~STLLoader();
+    
+    // Teach the loader a new format. Added formats are tried before binary and text STL, which
+    // have no signature and would accept almost anything. Call this at startup, before loading.
+    static void registerFormat(const FileFormat& format);
+    static const QVector<FileFormat>& formats();
+    static QString openFileFilter();  // For QFileDialog: all models first, then one entry per format
 
     // The main function - load an STL file from disk
     LoadResult loadFile(const QString& fileName);
     void clear();  // Forget everything and start fresh
     
-    // Figure out if a file is binary or ASCII format
+    // Figure out which format a file is in (each call opens the file once and reads its first few KB)
     STLFormat detectFormat(const QString& fileName);
     static bool isBinarySTL(const QString& fileName);
     static bool isASCIISTL(const QString& fileName);
+    static bool isOBJ(const QString& fileName);
+    static bool isPLY(const QString& fileName);
+    static bool isThreeMF(const QString& fileName);
+    static bool isMeshArchive(const QString& fileName);
     
     // Get the loaded 3D model data
     const QVector<STLTriangle>& getTriangles() const { return triangles; }
     const QVector<STLVertex>& getVertices() const { return vertices; }
     const QVector<float>& getVertexData() const { return vertexData; }        // Ready for OpenGL
     const QVector<unsigned int>& getIndices() const { return indices; }       // For efficient drawing
+    const QVector<float>& getVertexColors() const { return vertexColors; }    // Red, green, blue per vertex (PLY only)
+    bool hasVertexColors() const { return !vertexColors.isEmpty(); }
     const BoundingBox& getBoundingBox() const { return boundingBox; }
     
+    // How the loaded points were moved and scaled: displayed = (original + offset) * scale
+    QVector3D getModelOffset() const { return modelOffset; }
+    float getModelScale() const { return modelScale; }
+    
     // Get information about the loaded model
-    int getTriangleCount() const { return triangles.size(); }
-    int getVertexCount() const { return vertices.size(); }
+    int getTriangleCount() const { return indices.isEmpty() ? triangles.size() : indices.size() / 3; }
+    int getVertexCount() const { return vertexData.size() / 6; }
     QString getFileName() const { return fileName; }
     STLFormat getFormat() const { return format; }
-    QString getFormatString() const;  // Get format as readable text
+    QString getFormatString() const { return formatName.isEmpty() ? QString("Unknown format") : formatName; }
     QString getErrorString() const { return errorString; }  // What went wrong
     
     // Settings for how to process the loaded model
@@ -131,6 +187,9 @@ public:
     void setCalculateNormals(bool enable) { calculateNormals = enable; }  // Recalculate surface directions
     void setMergeVertices(bool enable) { mergeVertices = enable; }     // Combine duplicate points
     void setVertexTolerance(float tolerance) { vertexTolerance = tolerance; }  // How close is "same point"
+    void setRepairOrientation(bool enable) { repairOrientation = enable; }  // Make all triangles face outward
+    void setRemoveDuplicateFacets(bool enable) { removeDuplicateFacets = enable; }  // Drop repeated/overlapping triangles
+    void setDirectIO(bool enable) { directIO = enable; }  // Read binary STL past the page cache (Linux)
     
     // Get current settings
     bool getAutoCenter() const { return autoCenter; }
@@ -138,11 +197,38 @@ public:
     bool getCalculateNormals() const { return calculateNormals; }
     bool getMergeVertices() const { return mergeVertices; }
     float getVertexTolerance() const { return vertexTolerance; }
+    bool getRepairOrientation() const { return repairOrientation; }
+    bool getRemoveDuplicateFacets() const { return removeDuplicateFacets; }
+    bool getDirectIO() const { return directIO; }
+    
+    // What the orientation repair changed during the last load
+    const MeshRepair::OrientationReport& getOrientationReport() const { return orientationReport; }
+    
+    // How many duplicate or overlapping triangles were thrown away during the last load
+    const MeshRepair::DuplicateReport& getDuplicateReport() const { return duplicateReport; }
+    
+    // How fast the last binary STL came off the disk (bytes, time, GB/s, io_uring or pread)
+    const AsyncFileReader::Report& getReadReport() const { return readReport; }
+    
+    // How many zero-area triangles in the last file were skipped while reading
+    int getDegenerateTriangleCount() const { return degenerateTriangles; }
 
 private:
     // The actual work of reading binary and text STL files
     LoadResult loadBinarySTL(QFile& file);
     LoadResult loadASCIISTL(QFile& file);
+    LoadResult loadOBJ(QFile& file);
+    LoadResult loadPLY(QFile& file);
+    LoadResult loadThreeMF(QFile& file);
+    LoadResult loadMeshArchive(QFile& file);
+    LoadResult loadCustom(QFile& file, const FileFormat& fileFormat);  // A format added with registerFormat()
+    LoadResult addIndexedTriangles(STLIndexedMesh& mesh);  // Faces of an OBJ, PLY, 3MF or archive file into triangles (takes the colours)
+    LoadResult addIndexedVertices(STLIndexedMesh& mesh, bool hasNormals);  // Faces of a PLY file whose vertexData is already filled
+    
+    // The formats list, with the built-in formats filled in on first use
+    static QVector<FileFormat>& registry();
+    static const FileFormat* findFormat(const FileHeader& header);
+    static const FileFormat* probeFile(const QString& fileName, STLFormat only = Unknown);  // Opens the file itself
     
     // Clean up and organize the loaded data
     void processTriangles();         // Do all the processing steps
@@ -150,28 +236,37 @@ private:
     void centerModel();              // Move model to center of screen
     void normalizeModel();           // Scale model to fit nicely
     void generateVertexBuffer();     // Prepare data for graphics card
+    QVector3D facetNormal(const STLTriangle& triangle);  // Unit normal a triangle is drawn with
     void generateIndices();          // Create index list for efficient rendering
+    void useFileIndices();           // Vertex buffer and indices straight from a file that already shares its vertices (OBJ)
+    void removeDuplicateTriangles(); // Throw away repeated triangles and zero-thickness pairs
+    void repairFacetOrientation();   // Flip triangles so they all wind the same way, facing outward
     QVector3D calculateTriangleNormal(const QVector3D& v1, const QVector3D& v2, const QVector3D& v3);
     
     // Helper functions
     void setError(const QString& error);  // Record what went wrong
     bool isValidTriangle(const STLTriangle& triangle);  // Check if triangle makes sense
-    int findOrAddVertex(QVector<STLVertex>& uniqueVertices, const STLVertex& vertex);  // Avoid duplicate vertices
     bool verticesEqual(const STLVertex& a, const STLVertex& b, float tolerance);  // Are two points the same?
     
     // Help with reading text STL files
     QVector3D parseVector3D(const QStringList& tokens, int startIndex);
-    bool parseASCIILine(const QString& line, QString& keyword, QStringList& values);
     
     // All the data we've loaded
-    QVector<STLTriangle> triangles;      // All the triangles that make up the model
-    QVector<STLVertex> vertices;         // All the unique points
+    QVector<STLTriangle> triangles;      // All the triangles that make up the model (empty if vertexBufferFromFile)
+    QVector<STLVertex> vertices;         // All the unique points (empty if vertexBufferFromFile)
     QVector<float> vertexData;           // Data formatted for OpenGL graphics
     QVector<unsigned int> indices;       // List of which vertices make each triangle
+    QVector<unsigned int> fileCorners;   // Vertex of every triangle corner as numbered in the file (OBJ, PLY, 3MF)
+    std::vector<float> fileColors;       // Red, green, blue per vertex as numbered in the file (PLY)
+    QVector<float> vertexColors;         // Red, green, blue per vertex of vertexData
+    bool vertexBufferFromFile;           // The reader filled vertexData and indices itself (PLY with faces)
     BoundingBox boundingBox;             // Size and position info
+    QVector3D modelOffset;               // How far centerModel() moved the points
+    float modelScale;                    // How much normalizeModel() scaled the points
     
     QString fileName;        // Name of file we loaded
     STLFormat format;        // Whether it was binary or text format
+    QString formatName;      // The format's name for the user
     QString errorString;     // What went wrong (if anything)
     
     // User preferences for how to process the model
@@ -180,10 +275,19 @@ private:
     bool calculateNormals;   // Should we recalculate surface directions?
     bool mergeVertices;      // Should we combine duplicate points?
     float vertexTolerance;   // How close before we consider points identical?
+    bool repairOrientation;  // Should we fix triangles that face the wrong way?
+    bool removeDuplicateFacets;  // Should we drop triangles that repeat or cancel each other?
+    bool directIO;           // Should binary files skip the page cache (O_DIRECT)?
+    
+    MeshRepair::OrientationReport orientationReport;  // Result of the last orientation repair
+    MeshRepair::DuplicateReport duplicateReport;      // Result of the last duplicate removal
+    AsyncFileReader::Report readReport;               // Speed of the last binary read
+    int degenerateTriangles;                          // Zero-area triangles skipped in the last file
     
     // Important numbers for the STL file format
     static const quint32 BINARY_STL_HEADER_SIZE = 80;      // Binary files start with 80-byte header
     static const quint32 BINARY_STL_TRIANGLE_SIZE = 50;    // Each triangle takes exactly 50 bytes
+    static const qint64 HEADER_PROBE_SIZE = 4096;          // How much of a file the formats get to look at
     static const char* ASCII_STL_HEADER;                   // Text files start with "solid"
     static const float DEFAULT_VERTEX_TOLERANCE;           // Default distance for "same point"
 };
@@ -0,0 +1,624 @@
+#include "stlwriter.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QtEndian>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace {
+
+// A facet as it is stored in the file: normal, then three corners
+const int FacetFloats = 12;
+const int HeaderSize = 80;
+const int RecordSize = 50;
+
+// Longest text one facet can take: 12 numbers of at most 15 characters plus the keywords
+const int MaxFacetText = 320;
+
+// Facets per piece of text output, so a worker never holds more than about 1 MB of text
+const int TextBlock = 4096;
+
+// Read binary files in pieces of this many bytes, text files in lines
+const qint64 TextReadSize = 1 << 20;
+
+void facetNormal(float *facet)
+{
+    const float *a = facet + 3;
+    const float *b = facet + 6;
+    const float *c = facet + 9;
+    float ux = b[0] - a[0], uy = b[1] - a[1], uz = b[2] - a[2];
+    float vx = c[0] - a[0], vy = c[1] - a[1], vz = c[2] - a[2];
+    float nx = uy * vz - uz * vy;
+    float ny = uz * vx - ux * vz;
+    float nz = ux * vy - uy * vx;
+    float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+    if (length > 0.0f) {
+        nx /= length;
+        ny /= length;
+        nz /= length;
+    }
+    facet[0] = nx;
+    facet[1] = ny;
+    facet[2] = nz;
+}
+
+// Run func(begin, end) over [0, count), on all cores or only on this thread
+template<typename Func>
+void runChunks(qint64 count, bool parallel, Func func)
+{
+    if (parallel) {
+        Parallel::forChunks(count, [&](qint64 begin, qint64 end, int) { func(begin, end); }, 8192);
+    } else if (count > 0) {
+        func(0, count);
+    }
+}
+
+// Shortest text that reads back to exactly the same float
+char *appendFloat(char *out, float value)
+{
+    return std::to_chars(out, out + 24, value).ptr;
+}
+
+char *appendText(char *out, const char *text)
+{
+    size_t length = std::strlen(text);
+    std::memcpy(out, text, length);
+    return out + length;
+}
+
+char *appendTriple(char *out, const float *values)
+{
+    for (int k = 0; k < 3; ++k) {
+        *out++ = ' ';
+        out = appendFloat(out, values[k]);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// Format facets as text into out (room for count * MaxFacetText bytes); returns the length
+qint64 formatFacets(const float *facets, qint64 count, char *out)
+{
+    char *start = out;
+    for (qint64 i = 0; i < count; ++i) {
+        const float *facet = facets + i * FacetFloats;
+        out = appendText(out, "  facet normal");
+        out = appendTriple(out, facet);
+        out = appendText(out, "    outer loop\n");
+        for (int corner = 1; corner <= 3; ++corner) {
+            out = appendText(out, "      vertex");
+            out = appendTriple(out, facet + corner * 3);
+        }
+        out = appendText(out, "    endloop\n  endfacet\n");
+    }
+    return out - start;
+}
+
+// Writes facets to an open file in either format, one batch at a time
+class FacetSink
+{
+public:
+    FacetSink(QFile &file, STLWriter::Format format, bool parallel)
+        : file(file), format(format), parallel(parallel) {}
+
+    bool begin(const QByteArray &name)
+    {
+        if (format == STLWriter::ASCII) {
+            return writeBytes("solid " + name + "\n");
+        }
+        // The header must not start with "solid", or readers may take the file for text.
+        // The triangle count is filled in by finish().
+        QByteArray header("Binary STL " + name.left(HeaderSize - 11));
+        header.append(QByteArray(HeaderSize + 4 - header.size(), '\0'));
+        return writeBytes(header);
+    }
+
+    bool add(const float *facets, qint64 count)
+    {
+        if (format == STLWriter::ASCII) {
+            return addText(facets, count);
+        }
+        if (written + count > 0xFFFFFFFFLL) {
+            error = "Too many triangles for binary STL";
+            return false;
+        }
+
+        buffer.resize(int(count * RecordSize));
+        char *data = buffer.data();
+        runChunks(count, parallel, [&](qint64 begin, qint64 end) {
+            for (qint64 i = begin; i < end; ++i) {
+                char *record = data + i * RecordSize;
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+                for (int k = 0; k < FacetFloats; ++k) {
+                    quint32 bits;
+                    std::memcpy(&bits, facets + i * FacetFloats + k, 4);
+                    qToLittleEndian(bits, record + k * 4);
+                }
+#else
+                std::memcpy(record, facets + i * FacetFloats, FacetFloats * 4);
+#endif
+                record[48] = 0;   // Attribute byte count, always zero
+                record[49] = 0;
+            }
+        });
+        written += count;
+        return writeBytes(buffer);
+    }
+
+    bool finish(const QByteArray &name)
+    {
+        if (format == STLWriter::ASCII) {
+            return writeBytes("endsolid " + name + "\n");
+        }
+        char count[4];
+        qToLittleEndian(quint32(written), count);
+        if (!file.seek(HeaderSize) || file.write(count, 4) != 4) {
+            error = file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    qint64 triangles() const { return written; }
+    QString errorString() const { return error; }
+
+private:
+    bool addText(const float *facets, qint64 count)
+    {
+        qint64 blocks = (count + TextBlock - 1) / TextBlock;
+        if (!parallel) {
+            // One piece at a time through the same buffer
+            buffer.resize(TextBlock * MaxFacetText);
+            for (qint64 b = 0; b < blocks; ++b) {
+                qint64 n = qMin<qint64>(TextBlock, count - b * TextBlock);
+                qint64 length = formatFacets(facets + b * TextBlock * FacetFloats, n, buffer.data());
+                if (!writeBytes(buffer.constData(), length)) {
+                    return false;
+                }
+            }
+        } else {
+            // Format every piece at once, then write them in order
+            std::vector<QByteArray> pieces(blocks);
+            Parallel::forBlocks(blocks, 1, [&](qint64 begin, qint64 end, int) {
+                for (qint64 b = begin; b < end; ++b) {
+                    qint64 n = qMin<qint64>(TextBlock, count - b * TextBlock);
+                    pieces[b].resize(int(n * MaxFacetText));
+                    pieces[b].resize(int(formatFacets(facets + b * TextBlock * FacetFloats, n, pieces[b].data())));
+                }
+            });
+            for (const QByteArray &piece : pieces) {
+                if (!writeBytes(piece)) {
+                    return false;
+                }
+            }
+        }
+        written += count;
+        return true;
+    }
+
+    bool writeBytes(const QByteArray &bytes) { return writeBytes(bytes.constData(), bytes.size()); }
+
+    bool writeBytes(const char *data, qint64 size)
+    {
+        if (file.write(data, size) != size) {
+            error = file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    QFile &file;
+    STLWriter::Format format;
+    bool parallel;
+    qint64 written = 0;
+    QByteArray buffer;
+    QString error;
+};
+
+// Called with every batch of facets read; returns false to stop
+using FacetCallback = std::function<bool(const float *facets, qint64 count)>;
+
+bool readBinaryFacets(QFile &file, quint32 count, const FacetCallback &callback, QString *errorMessage)
+{
+    std::vector<char> raw(size_t(STLWriter::BatchTriangles) * RecordSize);
+    std::vector<float> facets(size_t(STLWriter::BatchTriangles) * FacetFloats);
+
+    file.seek(HeaderSize + 4);
+    qint64 remaining = count;
+    while (remaining > 0) {
+        qint64 n = qMin<qint64>(remaining, STLWriter::BatchTriangles);
+        if (file.read(raw.data(), n * RecordSize) != n * RecordSize) {
+            if (errorMessage) {
+                *errorMessage = "The file ends in the middle of the triangles";
+            }
+            return false;
+        }
+        for (qint64 i = 0; i < n; ++i) {
+            const char *record = raw.data() + i * RecordSize;
+            for (int k = 0; k < FacetFloats; ++k) {
+                quint32 bits = qFromLittleEndian<quint32>(record + k * 4);
+                std::memcpy(&facets[i * FacetFloats + k], &bits, 4);
+            }
+        }
+        if (!callback(facets.data(), n)) {
+            return false;
+        }
+        remaining -= n;
+    }
+    return true;
+}
+
+// Does the text at p start with word (any case), followed by a space or the end of the line?
+bool matchKeyword(const char *&p, const char *end, const char *word)
+{
+    const char *q = p;
+    for (; *word; ++word, ++q) {
+        if (q == end || (*q | 0x20) != *word) {
+            return false;
+        }
+    }
+    if (q != end && *q != ' ' && *q != '\t' && *q != '\r') {
+        return false;
+    }
+    p = q;
+    return true;
+}
+
+bool parseFloats(const char *&p, const char *end, float *values, int count)
+{
+    for (int k = 0; k < count; ++k) {
+        while (p != end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        if (p != end && *p == '+') {
+            ++p;   // from_chars does not take a leading plus
+        }
+        std::from_chars_result result = std::from_chars(p, end, values[k]);
+        if (result.ec != std::errc()) {
+            return false;
+        }
+        p = result.ptr;
+    }
+    return true;
+}
+
+bool readTextFacets(QFile &file, const FacetCallback &callback, QString *errorMessage)
+{
+    std::vector<float> facets;
+    facets.reserve(size_t(STLWriter::BatchTriangles) * FacetFloats);
+    float facet[FacetFloats] = {};
+    int corners = 0;
+    qint64 lineNumber = 0;
+
+    auto fail = [&](const QString &what) {
+        if (errorMessage) {
+            *errorMessage = QString("Line %1: %2").arg(lineNumber).arg(what);
+        }
+        return false;
+    };
+
+    // Whole lines are parsed straight out of the read buffer; a line cut at the end of a read is
+    // moved to the front and completed by the next read
+    QByteArray buffer;
+    qint64 kept = 0;
+    bool atEnd = false;
+    while (!atEnd) {
+        buffer.resize(int(kept + TextReadSize));
+        qint64 got = file.read(buffer.data() + kept, TextReadSize);
+        if (got < 0) {
+            return fail(file.errorString());
+        }
+        atEnd = got == 0;
+        qint64 size = kept + got;
+        const char *data = buffer.constData();
+        const char *lineStart = data;
+        const char *dataEnd = data + size;
+
+        for (;;) {
+            const char *lineEnd = static_cast<const char *>(std::memchr(lineStart, '\n', dataEnd - lineStart));
+            if (!lineEnd) {
+                if (!atEnd || lineStart == dataEnd) {
+                    break;
+                }
+                lineEnd = dataEnd;   // Last line without a newline
+            }
+            ++lineNumber;
+
+            const char *p = lineStart;
+            while (p != lineEnd && (*p == ' ' || *p == '\t')) {
+                ++p;
+            }
+            if (matchKeyword(p, lineEnd, "vertex")) {
+                if (corners == 3) {
+                    return fail("a facet has more than three vertices");
+                }
+                if (!parseFloats(p, lineEnd, facet + 3 + corners * 3, 3)) {
+                    return fail("bad vertex");
+                }
+                ++corners;
+            } else if (matchKeyword(p, lineEnd, "facet")) {
+                while (p != lineEnd && (*p == ' ' || *p == '\t')) {
+                    ++p;
+                }
+                if (!matchKeyword(p, lineEnd, "normal") || !parseFloats(p, lineEnd, facet, 3)) {
+                    return fail("bad facet normal");
+                }
+                corners = 0;
+            } else if (matchKeyword(p, lineEnd, "endfacet")) {
+                if (corners != 3) {
+                    return fail("a facet does not have three vertices");
+                }
+                facets.insert(facets.end(), facet, facet + FacetFloats);
+                corners = 0;
+                if (facets.size() == size_t(STLWriter::BatchTriangles) * FacetFloats) {
+                    if (!callback(facets.data(), STLWriter::BatchTriangles)) {
+                        return false;
+                    }
+                    facets.clear();
+                }
+            }
+            // "solid", "outer loop", "endloop" and "endsolid" carry nothing we need
+
+            if (lineEnd == dataEnd) {
+                lineStart = dataEnd;
+                break;
+            }
+            lineStart = lineEnd + 1;
+        }
+
+        kept = dataEnd - lineStart;
+        std::memmove(buffer.data(), lineStart, size_t(kept));
+    }
+
+    if (!facets.empty()) {
+        return callback(facets.data(), qint64(facets.size() / FacetFloats));
+    }
+    return true;
+}
+
+// Write to a temporary name and rename at the end, so a failed write never leaves half a file
+// behind and the input may be replaced by its own conversion
+bool replaceFile(const QString &temporaryFile, const QString &fileName, QString *errorMessage)
+{
+    QFile::remove(fileName);
+    if (!QFile::rename(temporaryFile, fileName)) {
+        QFile::remove(temporaryFile);
+        if (errorMessage) {
+            *errorMessage = "Cannot replace " + fileName;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool convertOne(const QString &inputFile, const QString &outputFile, STLWriter::Format format, bool parallel,
+                qint64 *triangleCount, qint64 *bytesWritten, QString *errorMessage)
+{
+    QFile input(inputFile);
+    if (!input.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot open file: " + input.errorString();
+        }
+        return false;
+    }
+
+    // Same test as the loader: a binary file is exactly header + count + count records long
+    QByteArray header = input.read(HeaderSize + 4);
+    bool binary = false;
+    quint32 count = 0;
+    if (header.size() == HeaderSize + 4) {
+        count = qFromLittleEndian<quint32>(header.constData() + HeaderSize);
+        binary = input.size() == HeaderSize + 4 + qint64(count) * RecordSize;
+    }
+    if (!binary && !header.trimmed().toLower().startsWith("solid")) {
+        if (errorMessage) {
+            *errorMessage = "Not an STL file";
+        }
+        return false;
+    }
+    input.seek(0);
+
+    QString temporaryFile = outputFile + ".part";
+    QFile output(temporaryFile);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + output.errorString();
+        }
+        return false;
+    }
+
+    QByteArray name = QFileInfo(inputFile).completeBaseName().toUtf8();
+    FacetSink sink(output, format, parallel);
+    QString readError;
+    FacetCallback callback = [&](const float *facets, qint64 n) { return sink.add(facets, n); };
+    bool ok = sink.begin(name) &&
+              (binary ? readBinaryFacets(input, count, callback, &readError)
+                      : readTextFacets(input, callback, &readError)) &&
+              sink.finish(name);
+    input.close();
+    qint64 size = output.size();
+    output.close();
+
+    if (!ok) {
+        QFile::remove(temporaryFile);
+        if (errorMessage) {
+            *errorMessage = readError.isEmpty() ? "Cannot write file: " + sink.errorString() : readError;
+        }
+        return false;
+    }
+    if (!replaceFile(temporaryFile, outputFile, errorMessage)) {
+        return false;
+    }
+    if (triangleCount) {
+        *triangleCount = sink.triangles();
+    }
+    if (bytesWritten) {
+        *bytesWritten = size;
+    }
+    return true;
+}
+
+} // namespace
+
+bool STLWriter::write(const QString& fileName, const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                      Format format, float displayScale, const QVector3D& displayOffset, QString* errorMessage)
+{
+    const qint64 triangles = indices.isEmpty() ? vertexData.size() / 18 : indices.size() / 3;
+    if (triangles == 0) {
+        if (errorMessage) {
+            *errorMessage = "No model to save";
+        }
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QString temporaryFile = fileName + ".part";
+    QFile file(temporaryFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + file.errorString();
+        }
+        return false;
+    }
+
+    const float inverseScale = displayScale != 0.0f ? 1.0f / displayScale : 1.0f;
+    const float offset[3] = {displayOffset.x(), displayOffset.y(), displayOffset.z()};
+    const float *vertices = vertexData.constData();
+
+    QByteArray name = QFileInfo(fileName).completeBaseName().toUtf8();
+    FacetSink sink(file, format, true);
+    bool ok = sink.begin(name);
+
+    // Turn the buffers back into facets one batch at a time, so the extra memory stays small
+    std::vector<float> facets(size_t(qMin<qint64>(triangles, BatchTriangles)) * FacetFloats);
+    for (qint64 first = 0; ok && first < triangles; first += BatchTriangles) {
+        qint64 n = qMin<qint64>(BatchTriangles, triangles - first);
+        runChunks(n, true, [&](qint64 begin, qint64 end) {
+            for (qint64 i = begin; i < end; ++i) {
+                float *facet = facets.data() + i * FacetFloats;
+                for (int corner = 0; corner < 3; ++corner) {
+                    qint64 t = (first + i) * 3 + corner;
+                    const float *position = vertices + 6 * (indices.isEmpty() ? t : qint64(indices[int(t)]));
+                    for (int k = 0; k < 3; ++k) {
+                        facet[3 + corner * 3 + k] = position[k] * inverseScale - offset[k];
+                    }
+                }
+                facetNormal(facet);
+            }
+        });
+        ok = sink.add(facets.data(), n);
+    }
+    ok = ok && sink.finish(name);
+    file.close();
+
+    if (!ok) {
+        QFile::remove(temporaryFile);
+        if (errorMessage) {
+            *errorMessage = "Cannot write file: " + sink.errorString();
+        }
+        return false;
+    }
+    if (!replaceFile(temporaryFile, fileName, errorMessage)) {
+        return false;
+    }
+
+    qDebug() << "STLWriter: saved" << triangles << "triangles as" << (format == Binary ? "binary" : "text")
+             << "STL in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool STLWriter::convertFile(const QString& inputFile, const QString& outputFile, Format format,
+                            qint64* triangleCount, QString* errorMessage)
+{
+    return convertOne(inputFile, outputFile, format, true, triangleCount, nullptr, errorMessage);
+}
+
+STLWriter::ConvertReport STLWriter::convertFolder(const QString& inputFolder, const QString& outputFolder,
+                                                  Format format, bool recursive)
+{
+    ConvertReport report;
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir input(inputFolder);
+    QDir output(outputFolder);
+    if (!input.exists()) {
+        report.errors << inputFolder + ": folder not found";
+        return report;
+    }
+    if (!output.exists() && !QDir().mkpath(outputFolder)) {
+        report.errors << outputFolder + ": cannot create folder";
+        return report;
+    }
+
+    // Collect the files first, leaving out anything already inside the output folder
+    QString outputPath = output.absolutePath() + "/";
+    QStringList files;
+    QDirIterator it(input.absolutePath(), QDir::Files,
+                    recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+    while (it.hasNext()) {
+        QString file = it.next();
+        if (QFileInfo(file).suffix().toLower() == "stl" && !file.startsWith(outputPath)) {
+            files << file;
+        }
+    }
+    files.sort();
+    report.files = files.size();
+
+    // Output folders are made up front so the workers only ever touch their own files
+    QStringList outputFiles;
+    QSet<QString> folders;
+    for (const QString& file : files) {
+        QString target = output.absoluteFilePath(input.relativeFilePath(file));
+        outputFiles << target;
+        folders.insert(QFileInfo(target).absolutePath());
+    }
+    for (const QString& folder : folders) {
+        QDir().mkpath(folder);
+    }
+
+    // One file per worker at a time; each file is streamed on its worker's thread alone
+    std::vector<qint64> triangles(files.size(), 0);
+    std::vector<qint64> bytesRead(files.size(), 0);
+    std::vector<qint64> bytesWritten(files.size(), 0);
+    QVector<QString> errors(files.size());
+    Parallel::forBlocks(files.size(), 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 i = begin; i < end; ++i) {
+            bytesRead[i] = QFileInfo(files[int(i)]).size();
+            QString error;
+            if (!convertOne(files[int(i)], outputFiles[int(i)], format, false, &triangles[i], &bytesWritten[i],
+                            &error)) {
+                errors[int(i)] = input.relativeFilePath(files[int(i)]) + ": " + error;
+            }
+        }
+    });
+
+    for (int i = 0; i < files.size(); ++i) {
+        report.bytesRead += bytesRead[i];
+        if (!errors[i].isEmpty()) {
+            report.failed++;
+            report.errors << errors[i];
+            continue;
+        }
+        report.converted++;
+        report.triangles += triangles[i];
+        report.bytesWritten += bytesWritten[i];
+    }
+    report.milliseconds = timer.elapsed();
+
+    qDebug() << "STLWriter: converted" << report.converted << "of" << report.files << "files ("
+             << report.triangles << "triangles) in" << report.milliseconds << "ms";
+    return report;
+}
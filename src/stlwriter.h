@@ -0,0 +1,57 @@
+#ifndef STLWRITER_H
+#define STLWRITER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVector3D>
+
+// Writes STL files, either from the loader's buffers (to save the current model) or by streaming
+// triangles straight from another STL file. Streaming only ever holds one batch of triangles, so
+// files of any size are converted with the same small amount of memory.
+//
+// Binary output is formatted in parallel into large blocks that go to the disk in one write each.
+// Text output uses the shortest number that reads back to exactly the same float, so converting
+// binary -> text -> binary gives back the original coordinates.
+class STLWriter
+{
+public:
+    enum Format {
+        Binary,     // 50 bytes per triangle
+        ASCII       // "facet normal ... endfacet", about 5x bigger
+    };
+
+    // Results of converting a folder
+    struct ConvertReport {
+        int files = 0;              // STL files found
+        int converted = 0;          // Written successfully
+        int failed = 0;             // Could not be read or written (see errors)
+        qint64 triangles = 0;       // Triangles written over all files
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+        qint64 milliseconds = 0;
+        QStringList errors;         // "file: what went wrong", one per failed file
+    };
+
+    // Triangles per batch when streaming (about 3 MB of binary STL)
+    static const int BatchTriangles = 65536;
+
+    // Save a mesh from the loader's buffers (6 floats per vertex, position + normal, with or without
+    // indices). Positions are turned back into file units with file = displayed / scale - offset.
+    // Facet normals are recomputed from the corners.
+    static bool write(const QString& fileName, const QVector<float>& vertexData, const QVector<unsigned int>& indices,
+                      Format format, float displayScale = 1.0f, const QVector3D& displayOffset = QVector3D(),
+                      QString* errorMessage = nullptr);
+
+    // Convert one STL file (binary or text) into the given format. The output is written next to the
+    // target first and renamed at the end, so it may even replace the input.
+    static bool convertFile(const QString& inputFile, const QString& outputFile, Format format,
+                            qint64* triangleCount = nullptr, QString* errorMessage = nullptr);
+
+    // Convert every .stl file in a folder into outputFolder, keeping relative paths. Files are handed
+    // out to one worker per CPU core; each worker streams its file in batches.
+    static ConvertReport convertFolder(const QString& inputFolder, const QString& outputFolder, Format format,
+                                       bool recursive);
+};
+
+#endif // STLWRITER_H
@@ -0,0 +1,836 @@
+#include "threemfreader.h"
+#include "parallel.h"
+#include "zipreader.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Where the root model lives when the package doesn't say
+const char *DefaultModelPath = "3d/3dmodel.model";
+
+// Components nested deeper than this are taken to be a loop
+const int MaxComponentDepth = 32;
+
+// A single tag (or comment) longer than this is refused instead of being held in memory
+const size_t MaxTagLength = size_t(64) << 20;
+
+// Inflated pieces that may wait for the scanner when inflating and scanning run side by side
+const size_t PipelineDepth = 8;
+
+// An affine transform in 3MF order "m00 m01 m02 m10 m11 m12 m20 m21 m22 m30 m31 m32". It works on
+// row vectors, so x' = x * m00 + y * m10 + z * m20 + m30.
+struct Transform {
+    float m[12] = {1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0};
+
+    bool isIdentity() const
+    {
+        return std::equal(m, m + 12, Transform().m);
+    }
+
+    // This transform followed by next
+    Transform then(const Transform& next) const
+    {
+        Transform result;
+        for (int row = 0; row < 4; ++row) {
+            for (int col = 0; col < 3; ++col) {
+                float value = row == 3 ? next.m[9 + col] : 0.0f;
+                for (int k = 0; k < 3; ++k) {
+                    value += m[row * 3 + k] * next.m[k * 3 + col];
+                }
+                result.m[row * 3 + col] = value;
+            }
+        }
+        return result;
+    }
+
+    void apply(const float *p, float *out) const
+    {
+        for (int col = 0; col < 3; ++col) {
+            out[col] = p[0] * m[col] + p[1] * m[3 + col] + p[2] * m[6 + col] + m[9 + col];
+        }
+    }
+
+    // Negative for mirroring transforms, which turn triangles inside out
+    float determinant() const
+    {
+        return m[0] * (m[4] * m[8] - m[5] * m[7])
+             - m[1] * (m[3] * m[8] - m[5] * m[6])
+             + m[2] * (m[3] * m[7] - m[4] * m[6]);
+    }
+};
+
+// A reference to an object, from a <component> or a build <item>
+struct Component {
+    qint64 objectId = 0;
+    QString path;           // Model part holding the object (lower case, no leading '/'), empty = same part
+    Transform transform;
+};
+
+struct MeshObject {
+    qint64 id = 0;
+    std::vector<float> positions;       // x, y, z per vertex
+    std::vector<quint32> indices;       // Three per triangle, counted from 0 within this object
+    std::vector<Component> components;
+};
+
+// Everything read from one .model file of the package
+struct ModelPart {
+    QString path;
+    int entry = -1;
+    QString unit;
+    std::vector<MeshObject> objects;
+    std::vector<Component> items;       // Only the root part has a build
+    std::unordered_map<qint64, size_t> objectIndex;
+    QString error;
+};
+
+// An object placed in the scene
+struct Instance {
+    MeshObject *object;
+    Transform transform;
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool nameIs(const char *name, const char *nameEnd, const char *word)
+{
+    const size_t length = std::strlen(word);
+    return size_t(nameEnd - name) == length && std::memcmp(name, word, length) == 0;
+}
+
+// "p:path" -> "path": namespace prefixes don't matter to us
+inline const char *localName(const char *name, const char *nameEnd)
+{
+    for (const char *p = nameEnd; p > name; --p) {
+        if (p[-1] == ':') {
+            return p;
+        }
+    }
+    return name;
+}
+
+template<typename T>
+bool parseNumber(const char *&p, const char *end, T& value)
+{
+    while (p < end && isSpace(*p)) {
+        ++p;
+    }
+    if (p < end && *p == '+') {
+        ++p;
+    }
+    const std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) {
+        return false;
+    }
+    p = result.ptr;
+    return true;
+}
+
+template<typename T>
+bool parseValue(const char *value, const char *valueEnd, T& result)
+{
+    return parseNumber(value, valueEnd, result);
+}
+
+bool parseTransform(const char *p, const char *end, Transform& transform)
+{
+    for (int i = 0; i < 12; ++i) {
+        if (!parseNumber(p, end, transform.m[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString partPath(const char *value, const char *valueEnd)
+{
+    QString path = QString::fromUtf8(value, int(valueEnd - value)).toLower();
+    while (path.startsWith("/")) {
+        path.remove(0, 1);
+    }
+    return path;
+}
+
+// Call func(name, nameEnd, value, valueEnd) for every attribute in [p, end), with namespace prefixes
+// taken off the names. Returns false for text that isn't a valid attribute list.
+template<typename Func>
+bool forEachAttribute(const char *p, const char *end, Func func)
+{
+    for (;;) {
+        while (p < end && isSpace(*p)) {
+            ++p;
+        }
+        if (p >= end || *p == '/' || *p == '>') {
+            return true;
+        }
+        const char *name = p;
+        while (p < end && *p != '=' && !isSpace(*p)) {
+            ++p;
+        }
+        const char *nameEnd = p;
+        while (p < end && isSpace(*p)) {
+            ++p;
+        }
+        if (p >= end || *p != '=') {
+            return false;
+        }
+        ++p;
+        while (p < end && isSpace(*p)) {
+            ++p;
+        }
+        if (p >= end || (*p != '"' && *p != '\'')) {
+            return false;
+        }
+        const char quote = *p++;
+        const char *value = p;
+        p = static_cast<const char *>(std::memchr(p, quote, size_t(end - p)));
+        if (!p) {
+            return false;
+        }
+        func(localName(name, nameEnd), nameEnd, value, p);
+        ++p;
+    }
+}
+
+// Cuts a stream of XML text into tags, whatever pieces it arrives in, and hands each start or end tag to
+// the handler. Text between tags is skipped: 3MF keeps all mesh data in attributes. The only thing ever
+// copied is a tag that a piece boundary cut in two.
+template<typename Handler>
+class TagScanner
+{
+public:
+    explicit TagScanner(Handler& handler) : handler(handler) {}
+
+    bool feed(const char *p, const char *end)
+    {
+        if (!carry.empty()) {
+            // Finish the tag left over from the last piece, one '>' at a time
+            for (;;) {
+                const char *gt = static_cast<const char *>(std::memchr(p, '>', size_t(end - p)));
+                const char *stop = gt ? gt + 1 : end;
+                carry.insert(carry.end(), p, stop);
+                p = stop;
+                if (carry.size() > MaxTagLength) {
+                    return handler.fail("a tag is too long");
+                }
+                if (!gt) {
+                    return true;
+                }
+                if (tagEnd(carry.data(), carry.data() + carry.size())) {
+                    break;
+                }
+            }
+            if (!handle(carry.data(), carry.data() + carry.size())) {
+                return false;
+            }
+            carry.clear();
+        }
+
+        while (p < end) {
+            const char *lt = static_cast<const char *>(std::memchr(p, '<', size_t(end - p)));
+            if (!lt) {
+                return true;
+            }
+            const char *gt = tagEnd(lt, end);
+            if (!gt) {
+                carry.assign(lt, end);
+                return true;
+            }
+            if (!handle(lt, gt)) {
+                return false;
+            }
+            p = gt;
+        }
+        return true;
+    }
+
+    // False if the text stopped in the middle of a tag
+    bool finished() const { return carry.empty(); }
+
+private:
+    // Just past the '>' that closes the tag starting at lt, or nullptr if it isn't all there yet
+    static const char *tagEnd(const char *lt, const char *end)
+    {
+        const size_t available = size_t(end - lt);
+        // Comments, CDATA and processing instructions end with their own marker and may contain '>'
+        static const char *const openers[3] = {"<!--", "<![CDATA[", "<?"};
+        static const char *const closers[3] = {"-->", "]]>", "?>"};
+        for (int i = 0; i < 3; ++i) {
+            const size_t length = std::strlen(openers[i]);
+            const size_t compared = std::min(length, available);
+            if (std::memcmp(lt, openers[i], compared) != 0) {
+                continue;
+            }
+            if (compared < length) {
+                return nullptr;
+            }
+            const char *closer = closers[i];
+            const char *found = std::search(lt + length, end, closer, closer + std::strlen(closer));
+            return found == end ? nullptr : found + std::strlen(closer);
+        }
+
+        // An ordinary tag ends at the first '>' outside quotes
+        char quote = 0;
+        for (const char *p = lt + 1; p < end; ++p) {
+            const char c = *p;
+            if (quote) {
+                if (c == quote) {
+                    quote = 0;
+                }
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+            } else if (c == '>') {
+                return p + 1;
+            }
+        }
+        return nullptr;
+    }
+
+    bool handle(const char *lt, const char *gt)
+    {
+        const char *p = lt + 1;
+        if (*p == '!' || *p == '?') {
+            return true;
+        }
+        const bool closing = *p == '/';
+        if (closing) {
+            ++p;
+        }
+        const char *name = p;
+        while (p < gt && !isSpace(*p) && *p != '/' && *p != '>') {
+            ++p;
+        }
+        const bool selfClosing = !closing && gt - lt >= 3 && gt[-2] == '/';
+        return handler.element(localName(name, p), p, p, gt - 1, closing, selfClosing);
+    }
+
+    Handler& handler;
+    std::vector<char> carry;
+};
+
+// Collects objects and build items of one model part as the scanner finds them
+class ModelHandler
+{
+public:
+    explicit ModelHandler(ModelPart& part) : part(part) {}
+
+    bool element(const char *name, const char *nameEnd, const char *attributes, const char *end,
+                 bool closing, bool selfClosing)
+    {
+        if (closing) {
+            return nameIs(name, nameEnd, "object") ? finishObject() : true;
+        }
+        // Vertices and triangles are nearly all of the file, so they are checked first
+        if (nameIs(name, nameEnd, "vertex")) {
+            return vertex(attributes, end);
+        }
+        if (nameIs(name, nameEnd, "triangle")) {
+            return triangle(attributes, end);
+        }
+        if (nameIs(name, nameEnd, "object")) {
+            return startObject(attributes, end) && (!selfClosing || finishObject());
+        }
+        if (nameIs(name, nameEnd, "component")) {
+            if (!inObject) {
+                return fail("<component> outside an object");
+            }
+            return reference(attributes, end, current.components);
+        }
+        if (nameIs(name, nameEnd, "item")) {
+            return reference(attributes, end, part.items);
+        }
+        if (nameIs(name, nameEnd, "model")) {
+            forEachAttribute(attributes, end, [this](const char *n, const char *ne, const char *v, const char *ve) {
+                if (nameIs(n, ne, "unit")) {
+                    part.unit = QString::fromUtf8(v, int(ve - v));
+                }
+            });
+        }
+        return true;
+    }
+
+    bool fail(const QString& error)
+    {
+        if (part.error.isEmpty()) {
+            part.error = error;
+        }
+        return false;
+    }
+
+    bool inObject = false;
+
+private:
+    bool vertex(const char *attributes, const char *end)
+    {
+        if (!inObject) {
+            return fail("<vertex> outside an object");
+        }
+        float xyz[3];
+        int found = 0;
+        bool ok = true;
+        const bool listOk = forEachAttribute(attributes, end, [&](const char *n, const char *ne, const char *v, const char *ve) {
+            if (ne - n == 1 && *n >= 'x' && *n <= 'z') {
+                ok = ok && parseValue(v, ve, xyz[*n - 'x']);
+                found |= 1 << (*n - 'x');
+            }
+        });
+        ok = ok && listOk;
+        if (!ok || found != 7) {
+            return fail(QString("object %1: vertex %2 needs numbers for x, y and z")
+                            .arg(current.id).arg(current.positions.size() / 3));
+        }
+        current.positions.insert(current.positions.end(), xyz, xyz + 3);
+        return true;
+    }
+
+    bool triangle(const char *attributes, const char *end)
+    {
+        if (!inObject) {
+            return fail("<triangle> outside an object");
+        }
+        qint64 corners[3];
+        int found = 0;
+        bool ok = true;
+        const bool listOk = forEachAttribute(attributes, end, [&](const char *n, const char *ne, const char *v, const char *ve) {
+            if (ne - n == 2 && n[0] == 'v' && n[1] >= '1' && n[1] <= '3') {
+                const int c = n[1] - '1';
+                ok = ok && parseValue(v, ve, corners[c]) && corners[c] >= 0 && corners[c] <= qint64(0xffffffff);
+                found |= 1 << c;
+            }
+        });
+        ok = ok && listOk;
+        if (!ok || found != 7) {
+            return fail(QString("object %1: triangle %2 needs vertex numbers v1, v2 and v3")
+                            .arg(current.id).arg(current.indices.size() / 3));
+        }
+        for (qint64 corner : corners) {
+            current.indices.push_back(quint32(corner));
+        }
+        return true;
+    }
+
+    bool startObject(const char *attributes, const char *end)
+    {
+        if (inObject) {
+            return fail("<object> inside another object");
+        }
+        current = MeshObject();
+        bool hasId = false;
+        forEachAttribute(attributes, end, [&](const char *n, const char *ne, const char *v, const char *ve) {
+            if (nameIs(n, ne, "id")) {
+                hasId = parseValue(v, ve, current.id);
+            }
+        });
+        if (!hasId) {
+            return fail("<object> without an id");
+        }
+        inObject = true;
+        return true;
+    }
+
+    bool finishObject()
+    {
+        if (!inObject) {
+            return true;
+        }
+        inObject = false;
+
+        // Triangles may only use this object's own vertices
+        const qint64 vertexCount = qint64(current.positions.size() / 3);
+        quint32 highest = 0;
+        for (quint32 index : current.indices) {
+            highest = std::max(highest, index);
+        }
+        if (!current.indices.empty() && qint64(highest) >= vertexCount) {
+            return fail(QString("object %1: a triangle uses vertex %2 but there are only %3")
+                            .arg(current.id).arg(highest).arg(vertexCount));
+        }
+
+        if (!current.indices.empty() || !current.components.empty()) {
+            part.objects.push_back(std::move(current));
+        }
+        current = MeshObject();
+        return true;
+    }
+
+    bool reference(const char *attributes, const char *end, std::vector<Component>& list)
+    {
+        Component component;
+        bool hasId = false;
+        bool ok = true;
+        const bool listOk = forEachAttribute(attributes, end, [&](const char *n, const char *ne, const char *v, const char *ve) {
+            if (nameIs(n, ne, "objectid")) {
+                hasId = parseValue(v, ve, component.objectId);
+            } else if (nameIs(n, ne, "transform")) {
+                ok = ok && parseTransform(v, ve, component.transform);
+            } else if (nameIs(n, ne, "path")) {
+                component.path = partPath(v, ve);
+            }
+        });
+        ok = ok && listOk;
+        if (!ok || !hasId) {
+            return fail("a component or build item has a bad objectid or transform");
+        }
+        list.push_back(component);
+        return true;
+    }
+
+    ModelPart& part;
+    MeshObject current;
+};
+
+// Finds the root model in the package's _rels/.rels
+class RelationshipHandler
+{
+public:
+    bool element(const char *name, const char *nameEnd, const char *attributes, const char *end, bool closing, bool)
+    {
+        if (closing || !nameIs(name, nameEnd, "Relationship") || !target.isEmpty()) {
+            return true;
+        }
+        QString type, path;
+        forEachAttribute(attributes, end, [&](const char *n, const char *ne, const char *v, const char *ve) {
+            if (nameIs(n, ne, "Type")) {
+                type = QString::fromUtf8(v, int(ve - v));
+            } else if (nameIs(n, ne, "Target")) {
+                path = partPath(v, ve);
+            }
+        });
+        if (type.endsWith("/3dmodel")) {
+            target = path;
+        }
+        return true;
+    }
+
+    bool fail(const QString&) { return false; }
+
+    QString target;
+};
+
+// Inflate on a helper thread while the calling thread consumes. Finished pieces go through a short
+// queue, so the inflater runs at most PipelineDepth pieces ahead and buffers are reused.
+bool readPipelined(const ZipReader& zip, int entry, const ZipReader::Sink& consume, QString* errorMessage)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> full;
+    std::vector<std::vector<char>> spare;
+    bool done = false;
+    bool stop = false;
+    bool inflated = true;
+    QString inflateError;
+
+    std::thread producer([&]() {
+        inflated = zip.read(entry, [&](const char *data, qint64 size) {
+            std::vector<char> buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return stop || full.size() < PipelineDepth; });
+                if (stop) {
+                    return false;
+                }
+                if (!spare.empty()) {
+                    buffer.swap(spare.back());
+                    spare.pop_back();
+                }
+            }
+            buffer.assign(data, data + size);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                full.push_back(std::move(buffer));
+            }
+            changed.notify_all();
+            return true;
+        }, &inflateError);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        changed.notify_all();
+    });
+
+    auto stopProducer = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+        producer.join();
+    };
+
+    try {
+        for (;;) {
+            std::vector<char> buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return done || !full.empty(); });
+                if (full.empty()) {
+                    break;
+                }
+                buffer.swap(full.front());
+                full.pop_front();
+            }
+            changed.notify_all();
+            if (!consume(buffer.data(), qint64(buffer.size()))) {
+                stopProducer();
+                return true;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            spare.push_back(std::move(buffer));
+        }
+    } catch (...) {
+        stopProducer();
+        throw;
+    }
+
+    producer.join();
+    if (!inflated && errorMessage) {
+        *errorMessage = inflateError;
+    }
+    return inflated;
+}
+
+void parsePart(const ZipReader& zip, ModelPart& part, bool pipelined)
+{
+    ModelHandler handler(part);
+    TagScanner<ModelHandler> scanner(handler);
+    auto feed = [&scanner](const char *data, qint64 size) {
+        return scanner.feed(data, data + size);
+    };
+
+    QString readError;
+    const bool read = pipelined ? readPipelined(zip, part.entry, feed, &readError)
+                                : zip.read(part.entry, feed, &readError);
+    if (!part.error.isEmpty()) {
+        return;
+    }
+    if (!read) {
+        part.error = readError;
+    } else if (!scanner.finished() || handler.inObject) {
+        part.error = "the model ends too early";
+    }
+}
+
+int findPart(const std::vector<ModelPart>& parts, const QString& path)
+{
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (parts[i].path == path) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+// Place an object and, through its components, every object it is built from
+bool expand(std::vector<ModelPart>& parts, int partIndex, qint64 objectId, const Transform& transform,
+            int depth, std::vector<Instance>& instances, QString& error)
+{
+    if (partIndex < 0) {
+        error = "an object refers to a model part that is not in the package";
+        return false;
+    }
+    if (depth > MaxComponentDepth) {
+        error = "components refer to each other in a loop";
+        return false;
+    }
+    ModelPart& part = parts[partIndex];
+    auto found = part.objectIndex.find(objectId);
+    if (found == part.objectIndex.end()) {
+        error = QString("object %1 does not exist in %2").arg(objectId).arg(part.path);
+        return false;
+    }
+
+    MeshObject& object = part.objects[found->second];
+    if (!object.indices.empty()) {
+        instances.push_back({&object, transform});
+    }
+    for (const Component& component : object.components) {
+        const int target = component.path.isEmpty() ? partIndex : findPart(parts, component.path);
+        if (!expand(parts, target, component.objectId, component.transform.then(transform), depth + 1,
+                    instances, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool ThreeMFReader::read(const QString& fileName, STLIndexedMesh& mesh, Report* report, QString* errorMessage)
+{
+    ZipReader zip;
+    if (!zip.open(fileName, errorMessage)) {
+        return false;
+    }
+    return readPackage(zip, mesh, report, errorMessage);
+}
+
+bool ThreeMFReader::read(QFile& file, STLIndexedMesh& mesh, Report* report, QString* errorMessage)
+{
+    ZipReader zip;
+    if (!zip.open(file, errorMessage)) {
+        return false;
+    }
+    return readPackage(zip, mesh, report, errorMessage);
+}
+
+bool ThreeMFReader::readPackage(ZipReader& zip, STLIndexedMesh& mesh, Report* report, QString* errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    // The package relationships name the root model
+    QString rootPath = DefaultModelPath;
+    const int relationships = zip.find("_rels/.rels");
+    if (relationships >= 0) {
+        const QByteArray text = zip.readAll(relationships);
+        RelationshipHandler handler;
+        TagScanner<RelationshipHandler> scanner(handler);
+        scanner.feed(text.constData(), text.constData() + text.size());
+        if (!handler.target.isEmpty()) {
+            rootPath = handler.target;
+        }
+    }
+
+    // Every model part of the package, root first. Objects split into their own parts (as the
+    // production extension does) can only be found through them.
+    std::vector<ModelPart> parts(1);
+    parts[0].entry = zip.find(rootPath);
+    parts[0].path = rootPath;
+    if (parts[0].entry < 0) {
+        return fail("The package has no 3D model (" + rootPath + " is missing)");
+    }
+    for (int i = 0; i < zip.entries().size(); ++i) {
+        const QString name = zip.entries()[i].name.toLower();
+        if (i != parts[0].entry && name.endsWith(".model")) {
+            ModelPart part;
+            part.entry = i;
+            part.path = name;
+            parts.push_back(part);
+        }
+    }
+
+    // One part per thread; with fewer parts than threads, each part also gets its own inflate thread
+    const bool pipelined = Parallel::threadCount() > 1 && int(parts.size()) < Parallel::threadCount();
+    Parallel::forBlocks(qint64(parts.size()), 1, [&](qint64 begin, qint64 end, int) {
+        for (qint64 i = begin; i < end; ++i) {
+            parsePart(zip, parts[i], pipelined);
+        }
+    });
+
+    for (ModelPart& part : parts) {
+        if (!part.error.isEmpty()) {
+            return fail(part.path + ": " + part.error);
+        }
+        for (size_t i = 0; i < part.objects.size(); ++i) {
+            part.objectIndex[part.objects[i].id] = i;
+        }
+    }
+
+    // Resolve the build into placed meshes. A model without a build shows all of its objects.
+    std::vector<Instance> instances;
+    QString error;
+    const ModelPart& root = parts[0];
+    if (root.items.empty()) {
+        for (const MeshObject& object : root.objects) {
+            if (!expand(parts, 0, object.id, Transform(), 0, instances, error)) {
+                return fail(error);
+            }
+        }
+    } else {
+        for (const Component& item : root.items) {
+            const int part = item.path.isEmpty() ? 0 : findPart(parts, item.path);
+            if (!expand(parts, part, item.objectId, item.transform, 0, instances, error)) {
+                return fail(error);
+            }
+        }
+    }
+
+    std::vector<qint64> vertexStart(instances.size() + 1, 0);
+    std::vector<qint64> triangleStart(instances.size() + 1, 0);
+    for (size_t i = 0; i < instances.size(); ++i) {
+        vertexStart[i + 1] = vertexStart[i] + qint64(instances[i].object->positions.size() / 3);
+        triangleStart[i + 1] = triangleStart[i] + qint64(instances[i].object->indices.size() / 3);
+    }
+    const qint64 vertexCount = vertexStart.back();
+    const qint64 triangleCount = triangleStart.back();
+    if (triangleCount == 0) {
+        return fail("The 3MF build has no triangles");
+    }
+
+    // A single untransformed object is taken over as it is; everything else is copied into place
+    mesh = STLIndexedMesh();
+    const bool takeOver = instances.size() == 1 && instances[0].transform.isIdentity();
+    if (takeOver) {
+        mesh.positions.swap(instances[0].object->positions);
+    } else {
+        mesh.positions.resize(size_t(vertexCount) * 3);
+    }
+    mesh.positionIndices.resize(size_t(triangleCount) * 3);
+
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const MeshObject& object = *instances[i].object;
+        const Transform& transform = instances[i].transform;
+        const qint64 firstVertex = vertexStart[i];
+        const qint64 firstTriangle = triangleStart[i];
+        // Mirrored copies would face inward, so their corners are swapped
+        const bool flip = transform.determinant() < 0.0f;
+
+        if (!takeOver) {
+            Parallel::forChunks(vertexStart[i + 1] - firstVertex, [&](qint64 begin, qint64 end, int) {
+                for (qint64 v = begin; v < end; ++v) {
+                    transform.apply(&object.positions[size_t(v) * 3], &mesh.positions[size_t(firstVertex + v) * 3]);
+                }
+            });
+        }
+        Parallel::forChunks(triangleStart[i + 1] - firstTriangle, [&](qint64 begin, qint64 end, int) {
+            for (qint64 t = begin; t < end; ++t) {
+                const quint32 *corners = &object.indices[size_t(t) * 3];
+                qint64 *out = &mesh.positionIndices[size_t(firstTriangle + t) * 3];
+                out[0] = firstVertex + corners[0];
+                out[1] = firstVertex + corners[flip ? 2 : 1];
+                out[2] = firstVertex + corners[flip ? 1 : 2];
+            }
+        });
+    }
+
+    if (report) {
+        report->modelParts = int(parts.size());
+        report->objects = 0;
+        for (const ModelPart& part : parts) {
+            for (const MeshObject& object : part.objects) {
+                report->objects += object.indices.empty() ? 0 : 1;
+            }
+        }
+        report->buildItems = int(root.items.size());
+        report->instances = int(instances.size());
+        report->vertices = vertexCount;
+        report->triangles = triangleCount;
+        report->unit = root.unit.isEmpty() ? QString("millimeter") : root.unit;
+        report->milliseconds = timer.elapsed();
+    }
+
+    qDebug() << "ThreeMFReader:" << parts.size() << "model parts," << instances.size() << "meshes,"
+             << triangleCount << "triangles in" << timer.elapsed() << "ms";
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef THREEMFREADER_H
+#define THREEMFREADER_H
+
+#include <QString>
+#include "stlloader.h"
+
+class ZipReader;
+
+// Reads the meshes of a 3MF package: a ZIP archive holding one or more XML model parts.
+//
+// Model parts are inflated a piece at a time and scanned tag by tag as the text comes out, so no
+// document tree is ever built and a 500 MB model needs little more memory than its vertices and
+// triangles. Packages that keep their objects in separate parts (3D/Objects/*.model) have every part
+// parsed on its own thread; a single big part is inflated on one thread while another one scans it.
+//
+// Every <item> of the <build> becomes a copy of its object (and of the objects it is made of through
+// <component>s) moved by the item's transform, so the result is the scene as it would be printed.
+class ThreeMFReader
+{
+public:
+    struct Report {
+        int modelParts = 0;         // XML model files read from the package
+        int objects = 0;            // <object>s with a mesh
+        int buildItems = 0;         // <item>s in the build
+        int instances = 0;          // Meshes placed in the scene after resolving components
+        qint64 vertices = 0;        // Vertices in the scene (every instance counted)
+        qint64 triangles = 0;
+        qint64 milliseconds = 0;
+        QString unit;               // Unit of the root model ("millimeter" unless it says otherwise)
+    };
+
+    // Read the whole build into one mesh. Positions stay in the file's units.
+    static bool read(const QString& fileName, STLIndexedMesh& mesh, Report* report = nullptr,
+                     QString* errorMessage = nullptr);
+    // The same for a package the caller already has open
+    static bool read(QFile& file, STLIndexedMesh& mesh, Report* report = nullptr,
+                     QString* errorMessage = nullptr);
+
+private:
+    static bool readPackage(ZipReader& zip, STLIndexedMesh& mesh, Report* report, QString* errorMessage);
+};
+
+#endif // THREEMFREADER_H
@@ -0,0 +1,905 @@
+#include "tileset.h"
+#include "meshcodec.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+// File layout (little-endian):
+//   header       "TILE", version, node count, level count, source triangles (u64), level table
+//                offset (u64), root cube corner[3] and size (float), padding to 64 bytes
+//   node table   48 bytes per node: bounds min[3] and max[3] (float), first child (~0 for leaves),
+//                child count, first level, level count, depth, padding
+//   level table  32 bytes per level: data offset (u64), vertices, triangles, error (float), padding
+//   levels       vertex data, then index data, each level starting on a 4 KB boundary
+const quint32 TileMagic = 0x454c4954;  // "TILE"
+const quint32 TileVersion = 1;
+const int HeaderSize = 64;
+const int NodeEntrySize = 48;
+const int LevelEntrySize = 32;
+const qint64 LevelAlignment = 4096;
+
+// Leaves hold at most this many triangles, unless they already are the smallest cells
+const qint64 LeafTriangles = 1 << 17;
+
+// The smallest cells split the root cube 2^MaxDepth times along each axis
+const int MaxDepth = 7;
+const int GridSize = 1 << MaxDepth;
+
+// Coarse copies snap vertices to grids with this many cells across their node
+const int ClusterResolutions[] = {128, 32};
+
+// A coarser copy is only kept if it has at most this fraction of the triangles of the last one
+const double MinimumReduction = 0.75;
+
+const qint64 STLHeaderSize = 84;
+const qint64 STLFacetSize = 50;
+
+// A mesh while it is being cut and simplified: positions only, normals are added when it is stored
+struct TileMesh {
+    std::vector<float> positions;         // x, y, z per vertex
+    std::vector<unsigned int> triangles;  // Three vertices per triangle
+};
+
+// One octree node while the file is being built
+struct BuildNode {
+    int depth = 0;
+    quint32 code = 0;            // Morton code of the node's cube at its depth
+    qint64 triangles = 0;        // Source triangles whose centre is inside the cube
+    int firstChild = -1;
+    int childCount = 0;
+    qint64 firstId = 0;          // Leaves: where their triangle numbers start in the sorted list
+    float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    std::vector<TileSet::Level> levels;
+};
+
+// Spread the low 10 bits of v out to every third bit, for Morton codes
+quint32 spreadBits(quint32 v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Undo spreadBits
+quint32 compactBits(quint32 v)
+{
+    v &= 0x09249249;
+    v = (v | (v >> 2)) & 0x030c30c3;
+    v = (v | (v >> 4)) & 0x0300f00f;
+    v = (v | (v >> 8)) & 0x030000ff;
+    v = (v | (v >> 16)) & 0x3ff;
+    return v;
+}
+
+void readCorner(const uchar* stl, qint64 triangle, int corner, float p[3])
+{
+    std::memcpy(p, stl + STLHeaderSize + triangle * STLFacetSize + 12 + corner * 12, 3 * sizeof(float));
+}
+
+bool isFinitePoint(const float p[3])
+{
+    return std::isfinite(p[0]) && std::isfinite(p[1]) && std::isfinite(p[2]);
+}
+
+// Smallest cell (Morton code at MaxDepth) that holds the centre of a triangle
+quint32 cellOf(const uchar* stl, qint64 triangle, const float rootMin[3], double cellsPerUnit)
+{
+    float centre[3] = {0.0f, 0.0f, 0.0f};
+    for (int c = 0; c < 3; ++c) {
+        float p[3];
+        readCorner(stl, triangle, c, p);
+        for (int k = 0; k < 3; ++k) {
+            centre[k] += p[k];
+        }
+    }
+    quint32 code = 0;
+    for (int k = 0; k < 3; ++k) {
+        const double cell = (double(centre[k]) / 3.0 - rootMin[k]) * cellsPerUnit;
+        const quint32 i = cell >= 0.0 ? quint32(std::min(cell, double(GridSize - 1))) : 0;  // NaN ends up in 0
+        code |= spreadBits(i) << k;
+    }
+    return code;
+}
+
+// Merge corners with exactly the same position (binary STL repeats every shared vertex) and drop
+// triangles that collapse to a line or a point
+TileMesh weldCorners(const std::vector<float>& corners)
+{
+    struct Corner {
+        quint32 bits[3];
+        unsigned int index;
+    };
+    const size_t cornerCount = corners.size() / 3;
+    std::vector<Corner> sorted(cornerCount);
+    for (size_t i = 0; i < cornerCount; ++i) {
+        std::memcpy(sorted[i].bits, &corners[i * 3], sizeof(sorted[i].bits));
+        sorted[i].index = unsigned(i);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Corner& a, const Corner& b) {
+        return std::lexicographical_compare(a.bits, a.bits + 3, b.bits, b.bits + 3);
+    });
+
+    TileMesh mesh;
+    std::vector<unsigned int> vertexOf(cornerCount);
+    for (size_t i = 0; i < cornerCount; ++i) {
+        if (i == 0 || !std::equal(sorted[i].bits, sorted[i].bits + 3, sorted[i - 1].bits)) {
+            mesh.positions.insert(mesh.positions.end(), &corners[size_t(sorted[i].index) * 3],
+                                  &corners[size_t(sorted[i].index) * 3] + 3);
+        }
+        vertexOf[sorted[i].index] = unsigned(mesh.positions.size() / 3 - 1);
+    }
+    for (size_t i = 0; i + 2 < cornerCount; i += 3) {
+        const unsigned int a = vertexOf[i], b = vertexOf[i + 1], c = vertexOf[i + 2];
+        if (a != b && b != c && a != c) {
+            mesh.triangles.insert(mesh.triangles.end(), {a, b, c});
+        }
+    }
+    return mesh;
+}
+
+// Vertex clustering: every vertex moves to the average of the vertices in its grid cell.
+// Triangles that end up with two corners in one cell disappear, as do exact duplicates.
+TileMesh clusterMesh(const TileMesh& mesh, const float origin[3], float cellSize)
+{
+    const size_t vertexCount = mesh.positions.size() / 3;
+    const double cellsPerUnit = 1.0 / cellSize;
+    const double bias = 1 << 20;  // Cells just outside the node still get a key of their own
+    std::vector<std::pair<quint64, unsigned int>> cells(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        quint64 key = 0;
+        for (int k = 0; k < 3; ++k) {
+            const double cell = std::floor((double(mesh.positions[v * 3 + k]) - origin[k]) * cellsPerUnit) + bias;
+            const quint64 i = cell >= 0.0 ? quint64(std::min(cell, 2.0 * bias - 1.0)) : 0;
+            key |= i << (21 * k);
+        }
+        cells[v] = std::make_pair(key, unsigned(v));
+    }
+    std::sort(cells.begin(), cells.end());
+
+    std::vector<unsigned int> clusterOf(vertexCount);
+    std::vector<double> sums;
+    std::vector<unsigned int> members;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        if (i == 0 || cells[i].first != cells[i - 1].first) {
+            sums.insert(sums.end(), {0.0, 0.0, 0.0});
+            members.push_back(0);
+        }
+        const size_t cluster = members.size() - 1;
+        const unsigned int v = cells[i].second;
+        clusterOf[v] = unsigned(cluster);
+        for (int k = 0; k < 3; ++k) {
+            sums[cluster * 3 + k] += mesh.positions[size_t(v) * 3 + k];
+        }
+        ++members[cluster];
+    }
+
+    // Rotate every triangle so its smallest vertex comes first (keeps the winding), then sort to
+    // find duplicates
+    std::vector<std::array<unsigned int, 3>> triangles;
+    triangles.reserve(mesh.triangles.size() / 3);
+    for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+        std::array<unsigned int, 3> t = {clusterOf[mesh.triangles[i]], clusterOf[mesh.triangles[i + 1]],
+                                         clusterOf[mesh.triangles[i + 2]]};
+        if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) {
+            continue;
+        }
+        while (t[0] > t[1] || t[0] > t[2]) {
+            std::rotate(t.begin(), t.begin() + 1, t.end());
+        }
+        triangles.push_back(t);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+    // Keep only clusters that some triangle still uses, so they don't pull on the next level
+    TileMesh result;
+    std::vector<unsigned int> newIndex(members.size(), ~0u);
+    result.triangles.reserve(triangles.size() * 3);
+    for (const std::array<unsigned int, 3>& t : triangles) {
+        for (unsigned int cluster : t) {
+            if (newIndex[cluster] == ~0u) {
+                newIndex[cluster] = unsigned(result.positions.size() / 3);
+                for (int k = 0; k < 3; ++k) {
+                    result.positions.push_back(float(sums[size_t(cluster) * 3 + k] / members[cluster]));
+                }
+            }
+            result.triangles.push_back(newIndex[cluster]);
+        }
+    }
+    return result;
+}
+
+// The stored form of a mesh: triangles in vertex cache order, vertices in the order they are first
+// used, with area-weighted normals
+QByteArray levelData(const TileMesh& mesh, TileSet::Level& level)
+{
+    const size_t vertexCount = mesh.positions.size() / 3;
+    std::vector<unsigned int> triangles = MeshCodec::optimizeVertexCache(mesh.triangles.data(), mesh.triangles.size(),
+                                                                          vertexCount);
+    std::vector<unsigned int> remap;
+    const size_t usedVertices = MeshCodec::optimizeVertexFetch(triangles.data(), triangles.size(), vertexCount, remap);
+
+    level.vertices = int(usedVertices);
+    level.triangles = int(triangles.size() / 3);
+    QByteArray data(int(level.bytes()), '\0');
+    float* vertices = reinterpret_cast<float*>(data.data());
+    for (size_t v = 0; v < vertexCount; ++v) {
+        if (remap[v] != ~0u) {
+            std::memcpy(vertices + size_t(remap[v]) * 6, &mesh.positions[v * 3], 3 * sizeof(float));
+        }
+    }
+
+    // The cross product is twice the triangle's area long, so big triangles count for more
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+        const float* a = vertices + size_t(triangles[i]) * 6;
+        const float* b = vertices + size_t(triangles[i + 1]) * 6;
+        const float* c = vertices + size_t(triangles[i + 2]) * 6;
+        const QVector3D normal = QVector3D::crossProduct(QVector3D(b[0] - a[0], b[1] - a[1], b[2] - a[2]),
+                                                         QVector3D(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+        for (int corner = 0; corner < 3; ++corner) {
+            float* n = vertices + size_t(triangles[i + corner]) * 6 + 3;
+            n[0] += normal.x();
+            n[1] += normal.y();
+            n[2] += normal.z();
+        }
+    }
+    for (size_t v = 0; v < usedVertices; ++v) {
+        float* n = vertices + v * 6 + 3;
+        QVector3D normal(n[0], n[1], n[2]);
+        normal = normal.lengthSquared() > 0.0f ? normal.normalized() : QVector3D(0.0f, 0.0f, 1.0f);
+        n[0] = normal.x();
+        n[1] = normal.y();
+        n[2] = normal.z();
+    }
+
+    std::memcpy(vertices + usedVertices * 6, triangles.data(), triangles.size() * sizeof(unsigned int));
+    return data;
+}
+
+// Add a stored level's positions and triangles to a mesh
+void appendLevel(TileMesh& mesh, const QByteArray& data, const TileSet::Level& level)
+{
+    const float* vertices = reinterpret_cast<const float*>(data.constData());
+    const unsigned int* triangles = reinterpret_cast<const unsigned int*>(vertices + size_t(level.vertices) * 6);
+    const unsigned int base = unsigned(mesh.positions.size() / 3);
+    for (int v = 0; v < level.vertices; ++v) {
+        mesh.positions.insert(mesh.positions.end(), vertices + size_t(v) * 6, vertices + size_t(v) * 6 + 3);
+    }
+    for (qint64 i = 0; i < qint64(level.triangles) * 3; ++i) {
+        mesh.triangles.push_back(base + triangles[i]);
+    }
+}
+
+// The output file while several threads add levels to it (and read their children's back)
+class TileWriter
+{
+public:
+    bool open(const QString& fileName, qint64 dataStart)
+    {
+        file.setFileName(fileName);
+        if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Unbuffered) || !file.resize(dataStart)) {
+            return false;
+        }
+        end = dataStart;
+        return true;
+    }
+
+    // Returns where the data went, or -1 if it could not be written
+    qint64 append(const QByteArray& data)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const qint64 offset = end;
+        if (!file.seek(offset) || file.write(data) != data.size()) {
+            return -1;
+        }
+        end = (offset + data.size() + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+        return offset;
+    }
+
+    bool read(qint64 offset, qint64 size, QByteArray& data)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file.seek(offset)) {
+            return false;
+        }
+        data = file.read(size);
+        return data.size() == size;
+    }
+
+    QFile file;
+    qint64 end = 0;
+
+private:
+    std::mutex mutex;
+};
+
+void appendUInt32(QByteArray& data, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 4);
+}
+
+void appendUInt64(QByteArray& data, quint64 value)
+{
+    char bytes[8];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 8);
+}
+
+void appendFloat(QByteArray& data, float value)
+{
+    quint32 bits;
+    std::memcpy(&bits, &value, 4);
+    appendUInt32(data, bits);
+}
+
+float readFloat(const uchar* data)
+{
+    const quint32 bits = qFromLittleEndian<quint32>(data);
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+} // namespace
+
+TileSet::TileSet()
+    : mapped(nullptr)
+    , sourceTriangleCount(0)
+{
+}
+
+TileSet::~TileSet()
+{
+    close();
+}
+
+bool TileSet::isTileSet(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray start = file.read(4);
+    return start.size() == 4 && qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(start.constData())) == TileMagic;
+}
+
+bool TileSet::build(const QString& stlFileName, const QString& tileFileName, BuildReport* report, QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile input(stlFileName);
+    if (!input.open(QIODevice::ReadOnly)) {
+        return fail("Cannot open " + stlFileName + ": " + input.errorString());
+    }
+    const qint64 size = input.size();
+    QByteArray content;
+    const uchar* stl = input.map(0, size);
+    if (!stl) {
+        qWarning() << "TileSet: cannot map" << stlFileName << "- reading it into memory instead";
+        content = input.readAll();
+        stl = reinterpret_cast<const uchar*>(content.constData());
+    }
+    const qint64 triangleCount = size >= STLHeaderSize ? qint64(qFromLittleEndian<quint32>(stl + 80)) : -1;
+    if (triangleCount < 0 || STLHeaderSize + triangleCount * STLFacetSize != size) {
+        return fail("Tiles are made from binary STL files (convert text STL with --convert first)");
+    }
+    if (triangleCount == 0) {
+        return fail("The model has no triangles");
+    }
+
+    // Bounding box of all corners (per thread, then combined)
+    const int threads = Parallel::threadCount();
+    std::vector<float> boxes(size_t(threads) * 6);
+    for (int t = 0; t < threads; ++t) {
+        std::fill(boxes.begin() + t * 6, boxes.begin() + t * 6 + 3, FLT_MAX);
+        std::fill(boxes.begin() + t * 6 + 3, boxes.begin() + t * 6 + 6, -FLT_MAX);
+    }
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int thread) {
+        float* box = &boxes[size_t(thread) * 6];
+        for (qint64 t = begin; t < end; ++t) {
+            for (int c = 0; c < 3; ++c) {
+                float p[3];
+                readCorner(stl, t, c, p);
+                if (!isFinitePoint(p)) {
+                    continue;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    box[k] = std::min(box[k], p[k]);
+                    box[3 + k] = std::max(box[3 + k], p[k]);
+                }
+            }
+        }
+    });
+    float boxMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float boxMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int t = 0; t < threads; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            boxMin[k] = std::min(boxMin[k], boxes[t * 6 + k]);
+            boxMax[k] = std::max(boxMax[k], boxes[t * 6 + 3 + k]);
+        }
+    }
+    if (boxMin[0] > boxMax[0]) {
+        return fail("The model has no valid vertices");
+    }
+
+    // The octree splits a cube a little bigger than the model
+    float rootSize = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+        rootSize = std::max(rootSize, boxMax[k] - boxMin[k]);
+    }
+    rootSize = rootSize > 0.0f ? rootSize * 1.001f : 1.0f;
+    float rootMin[3];
+    for (int k = 0; k < 3; ++k) {
+        rootMin[k] = (boxMin[k] + boxMax[k]) * 0.5f - rootSize * 0.5f;
+    }
+    const double cellsPerUnit = GridSize / double(rootSize);
+
+    // Count the triangles whose centre falls in each of the smallest cells, then add them up for
+    // every bigger cell
+    std::vector<std::vector<qint64>> counts(MaxDepth + 1);
+    {
+        std::vector<std::atomic<quint32>> cellCounts(size_t(1) << (3 * MaxDepth));
+        Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int) {
+            for (qint64 t = begin; t < end; ++t) {
+                cellCounts[cellOf(stl, t, rootMin, cellsPerUnit)].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        counts[MaxDepth].assign(cellCounts.size(), 0);
+        for (size_t i = 0; i < cellCounts.size(); ++i) {
+            counts[MaxDepth][i] = cellCounts[i].load(std::memory_order_relaxed);
+        }
+    }
+    for (int depth = MaxDepth - 1; depth >= 0; --depth) {
+        counts[depth].assign(size_t(1) << (3 * depth), 0);
+        for (size_t i = 0; i < counts[depth + 1].size(); ++i) {
+            counts[depth][i >> 3] += counts[depth + 1][i];
+        }
+    }
+
+    // Split top-down, breadth first so every node's children sit next to each other
+    std::vector<BuildNode> tree(1);
+    tree[0].triangles = triangleCount;
+    qint64 idCount = 0;
+    std::vector<int> leafOfCell(counts[MaxDepth].size(), -1);
+    for (size_t i = 0; i < tree.size(); ++i) {
+        const int depth = tree[i].depth;
+        const quint32 code = tree[i].code;
+        if (tree[i].triangles <= LeafTriangles || depth == MaxDepth) {
+            tree[i].firstId = idCount;
+            idCount += tree[i].triangles;
+            const int shift = 3 * (MaxDepth - depth);
+            std::fill(leafOfCell.begin() + (size_t(code) << shift), leafOfCell.begin() + (size_t(code + 1) << shift), int(i));
+            continue;
+        }
+        tree[i].firstChild = int(tree.size());
+        for (quint32 k = 0; k < 8; ++k) {
+            const quint32 childCode = code * 8 + k;
+            if (counts[depth + 1][childCode] > 0) {
+                BuildNode child;
+                child.depth = depth + 1;
+                child.code = childCode;
+                child.triangles = counts[depth + 1][childCode];
+                tree.push_back(child);
+                ++tree[i].childCount;
+            }
+        }
+    }
+    std::vector<std::vector<qint64>>().swap(counts);
+
+    // Sort the triangle numbers by leaf, in a scratch file next to the output
+    QFile idFile(tileFileName + ".ids");
+    if (!idFile.open(QIODevice::ReadWrite | QIODevice::Truncate) || !idFile.resize(triangleCount * 4)) {
+        return fail("Cannot write file: " + idFile.errorString());
+    }
+    std::vector<quint32> idMemory;
+    quint32* ids = reinterpret_cast<quint32*>(idFile.map(0, triangleCount * 4));
+    if (!ids) {
+        qWarning() << "TileSet: cannot map the scratch file - sorting in memory instead";
+        idMemory.resize(size_t(triangleCount));
+        ids = idMemory.data();
+    }
+    std::vector<std::atomic<qint64>> cursors(tree.size());
+    for (size_t i = 0; i < tree.size(); ++i) {
+        cursors[i].store(tree[i].firstId, std::memory_order_relaxed);
+    }
+    Parallel::forChunks(triangleCount, [&](qint64 begin, qint64 end, int) {
+        for (qint64 t = begin; t < end; ++t) {
+            const int leaf = leafOfCell[cellOf(stl, t, rootMin, cellsPerUnit)];
+            ids[cursors[size_t(leaf)].fetch_add(1, std::memory_order_relaxed)] = quint32(t);
+        }
+    });
+    std::vector<int>().swap(leafOfCell);
+
+    // Room for the header and tables (written last), then the levels
+    qint64 leafCount = 0;
+    int deepest = 0;
+    std::vector<std::vector<int>> nodesAtDepth(MaxDepth + 1);
+    for (size_t i = 0; i < tree.size(); ++i) {
+        leafCount += tree[i].childCount == 0;
+        deepest = std::max(deepest, tree[i].depth);
+        nodesAtDepth[size_t(tree[i].depth)].push_back(int(i));
+    }
+    const qint64 nodeCount = qint64(tree.size());
+    const qint64 maxLevels = leafCount * (1 + qint64(std::size(ClusterResolutions))) +
+                             (nodeCount - leafCount) * qint64(std::size(ClusterResolutions));
+    const qint64 dataStart = (HeaderSize + nodeCount * NodeEntrySize + maxLevels * LevelEntrySize + LevelAlignment - 1) /
+                             LevelAlignment * LevelAlignment;
+    const QString temporaryFile = tileFileName + ".part";
+    TileWriter writer;
+    if (!writer.open(temporaryFile, dataStart)) {
+        idFile.remove();
+        return fail("Cannot write file: " + writer.file.errorString());
+    }
+
+    std::mutex errorMutex;
+    QString buildError;
+    std::atomic<bool> failed(false);
+    auto setError = [&](const QString& error) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (buildError.isEmpty()) {
+            buildError = error;
+        }
+        failed = true;
+    };
+
+    // Deepest nodes first: every node above the leaves is made from its children's levels
+    auto buildNode = [&](BuildNode& node) {
+        const float cubeSize = rootSize / float(1 << node.depth);
+        float cubeMin[3];
+        for (int k = 0; k < 3; ++k) {
+            cubeMin[k] = rootMin[k] + float(compactBits(node.code >> k)) * cubeSize;
+        }
+
+        TileMesh mesh;
+        float inputError = 0.0f;
+        if (node.childCount == 0) {
+            quint32* first = ids + node.firstId;
+            quint32* last = first + node.triangles;
+            std::sort(first, last);  // Read the STL front to back
+            std::vector<float> corners;
+            corners.reserve(size_t(node.triangles) * 9);
+            for (const quint32* id = first; id != last; ++id) {
+                float p[3][3];
+                for (int c = 0; c < 3; ++c) {
+                    readCorner(stl, *id, c, p[c]);
+                }
+                if (isFinitePoint(p[0]) && isFinitePoint(p[1]) && isFinitePoint(p[2])) {
+                    corners.insert(corners.end(), &p[0][0], &p[0][0] + 9);
+                }
+            }
+            mesh = weldCorners(corners);
+            for (size_t v = 0; v < mesh.positions.size(); v += 3) {
+                for (int k = 0; k < 3; ++k) {
+                    node.boundsMin[k] = std::min(node.boundsMin[k], mesh.positions[v + k]);
+                    node.boundsMax[k] = std::max(node.boundsMax[k], mesh.positions[v + k]);
+                }
+            }
+        } else {
+            // From each child, the coarsest level that is still finer than this node's first grid
+            const float sourceError = cubeSize / float(ClusterResolutions[0]) * std::sqrt(3.0f) * 1.01f;
+            for (int c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+                const BuildNode& child = tree[size_t(c)];
+                const TileSet::Level* source = &child.levels.front();
+                for (const TileSet::Level& level : child.levels) {
+                    if (level.error <= sourceError) {
+                        source = &level;
+                    }
+                }
+                QByteArray data;
+                if (!writer.read(source->offset, source->bytes(), data)) {
+                    setError("Cannot read back tile data: " + temporaryFile);
+                    return;
+                }
+                appendLevel(mesh, data, *source);
+                inputError = std::max(inputError, source->error);
+                for (int k = 0; k < 3; ++k) {
+                    node.boundsMin[k] = std::min(node.boundsMin[k], child.boundsMin[k]);
+                    node.boundsMax[k] = std::max(node.boundsMax[k], child.boundsMax[k]);
+                }
+            }
+        }
+        if (node.boundsMin[0] > node.boundsMax[0]) {
+            for (int k = 0; k < 3; ++k) {
+                node.boundsMin[k] = cubeMin[k];
+                node.boundsMax[k] = cubeMin[k] + cubeSize;
+            }
+        }
+
+        auto store = [&](const TileMesh& levelMesh, float error) {
+            TileSet::Level level;
+            level.error = error;
+            if (qint64(levelMesh.positions.size()) * 8 + qint64(levelMesh.triangles.size()) * 4 > INT_MAX) {
+                setError("A tile of the model is too dense to store");
+                return false;
+            }
+            const QByteArray data = levelData(levelMesh, level);
+            level.offset = writer.append(data);
+            if (level.offset < 0) {
+                setError("Cannot write file: " + writer.file.errorString());
+                return false;
+            }
+            node.levels.push_back(level);
+            return true;
+        };
+
+        // Leaves keep their triangles as they are; coarser copies are only kept when they save
+        // enough to be worth a level
+        if (node.childCount == 0 && !store(mesh, 0.0f)) {
+            return;
+        }
+        qint64 lastTriangles = qint64(mesh.triangles.size() / 3);
+        for (int resolution : ClusterResolutions) {
+            const float cellSize = cubeSize / float(resolution);
+            const TileMesh simpler = clusterMesh(mesh, cubeMin, cellSize);
+            const qint64 simplerTriangles = qint64(simpler.triangles.size() / 3);
+            if (!node.levels.empty() && simplerTriangles > lastTriangles * MinimumReduction) {
+                continue;
+            }
+            if (!store(simpler, inputError + cellSize * std::sqrt(3.0f))) {
+                return;
+            }
+            lastTriangles = simplerTriangles;
+        }
+    };
+    for (int depth = deepest; depth >= 0 && !failed; --depth) {
+        const std::vector<int>& nodes = nodesAtDepth[size_t(depth)];
+        Parallel::forBlocks(qint64(nodes.size()), 1, [&](qint64 begin, qint64 end, int) {
+            for (qint64 i = begin; i < end && !failed; ++i) {
+                buildNode(tree[size_t(nodes[size_t(i)])]);
+            }
+        });
+    }
+    if (ids != idMemory.data()) {
+        idFile.unmap(reinterpret_cast<uchar*>(ids));
+    }
+    idFile.remove();
+    if (failed) {
+        writer.file.remove();
+        return fail(buildError);
+    }
+
+    // Header and tables
+    qint64 levelCount = 0;
+    qint64 storedTriangles = 0;
+    for (const BuildNode& node : tree) {
+        levelCount += qint64(node.levels.size());
+        for (const TileSet::Level& level : node.levels) {
+            storedTriangles += level.triangles;
+        }
+    }
+    QByteArray tables;
+    appendUInt32(tables, TileMagic);
+    appendUInt32(tables, TileVersion);
+    appendUInt32(tables, quint32(nodeCount));
+    appendUInt32(tables, quint32(levelCount));
+    appendUInt64(tables, quint64(triangleCount));
+    appendUInt64(tables, quint64(HeaderSize + nodeCount * NodeEntrySize));
+    for (int k = 0; k < 3; ++k) {
+        appendFloat(tables, rootMin[k]);
+    }
+    appendFloat(tables, rootSize);
+    tables.append(QByteArray(HeaderSize - tables.size(), '\0'));
+    qint64 firstLevel = 0;
+    for (const BuildNode& node : tree) {
+        for (int k = 0; k < 3; ++k) {
+            appendFloat(tables, node.boundsMin[k]);
+        }
+        for (int k = 0; k < 3; ++k) {
+            appendFloat(tables, node.boundsMax[k]);
+        }
+        appendUInt32(tables, node.childCount > 0 ? quint32(node.firstChild) : ~0u);
+        appendUInt32(tables, quint32(node.childCount));
+        appendUInt32(tables, quint32(firstLevel));
+        appendUInt32(tables, quint32(node.levels.size()));
+        appendUInt32(tables, quint32(node.depth));
+        appendUInt32(tables, 0);
+        firstLevel += qint64(node.levels.size());
+    }
+    for (const BuildNode& node : tree) {
+        for (const TileSet::Level& level : node.levels) {
+            appendUInt64(tables, quint64(level.offset));
+            appendUInt32(tables, quint32(level.vertices));
+            appendUInt32(tables, quint32(level.triangles));
+            appendFloat(tables, level.error);
+            tables.append(QByteArray(LevelEntrySize - 20, '\0'));
+        }
+    }
+    const bool ok = writer.file.seek(0) && writer.file.write(tables) == tables.size();
+    const qint64 fileBytes = writer.file.size();
+    writer.file.close();
+    if (!ok) {
+        QFile::remove(temporaryFile);
+        return fail("Cannot write file: " + writer.file.errorString());
+    }
+    QFile::remove(tileFileName);
+    if (!QFile::rename(temporaryFile, tileFileName)) {
+        QFile::remove(temporaryFile);
+        return fail("Cannot replace " + tileFileName);
+    }
+
+    const qint64 milliseconds = timer.elapsed();
+    if (report) {
+        report->sourceTriangles = triangleCount;
+        report->nodes = nodeCount;
+        report->leaves = leafCount;
+        report->levels = levelCount;
+        report->depth = deepest;
+        report->storedTriangles = storedTriangles;
+        report->fileBytes = fileBytes;
+        report->trianglesPerSecond = milliseconds > 0 ? triangleCount * 1000.0 / milliseconds : 0.0;
+        report->milliseconds = milliseconds;
+    }
+
+    qDebug() << "TileSet: cut" << triangleCount << "triangles into" << nodeCount << "nodes (" << leafCount << "leaves,"
+             << levelCount << "levels) in" << milliseconds << "ms";
+    return true;
+}
+
+bool TileSet::open(const QString& fileName, QString* errorMessage)
+{
+    auto fail = [this, errorMessage](const QString& error) {
+        close();
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    close();
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail("Cannot open " + fileName + ": " + file.errorString());
+    }
+    const qint64 size = file.size();
+    const QByteArray header = file.read(HeaderSize);
+    const uchar* data = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() < HeaderSize || qFromLittleEndian<quint32>(data) != TileMagic) {
+        return fail("Not a tile set");
+    }
+    if (qFromLittleEndian<quint32>(data + 4) != TileVersion) {
+        return fail("Unsupported tile set version");
+    }
+    const qint64 nodeCount = qFromLittleEndian<quint32>(data + 8);
+    const qint64 levelCount = qFromLittleEndian<quint32>(data + 12);
+    const quint64 triangles = qFromLittleEndian<quint64>(data + 16);
+    const quint64 levelTable = qFromLittleEndian<quint64>(data + 24);
+    const qint64 tableEnd = qint64(levelTable) + levelCount * LevelEntrySize;
+    if (nodeCount == 0 || nodeCount > INT_MAX / NodeEntrySize || levelCount > INT_MAX / LevelEntrySize ||
+        levelTable != quint64(HeaderSize + nodeCount * NodeEntrySize) || tableEnd > size) {
+        return fail("Tile set is truncated or damaged");
+    }
+    const QByteArray tables = file.read(tableEnd - HeaderSize);
+    if (tables.size() != tableEnd - HeaderSize) {
+        return fail("Tile set is truncated or damaged");
+    }
+
+    // Check everything the viewer will follow: children come after their parent (so walking the
+    // tree always ends), and every level lies inside the file
+    nodeList.resize(int(nodeCount));
+    for (int i = 0; i < nodeCount; ++i) {
+        const uchar* entry = reinterpret_cast<const uchar*>(tables.constData()) + qint64(i) * NodeEntrySize;
+        Node& node = nodeList[i];
+        for (int k = 0; k < 3; ++k) {
+            node.boundsMin[k] = readFloat(entry + k * 4);
+            node.boundsMax[k] = readFloat(entry + 12 + k * 4);
+        }
+        const quint32 firstChild = qFromLittleEndian<quint32>(entry + 24);
+        const quint32 childCount = qFromLittleEndian<quint32>(entry + 28);
+        const quint32 firstLevel = qFromLittleEndian<quint32>(entry + 32);
+        const quint32 levels = qFromLittleEndian<quint32>(entry + 36);
+        const quint32 depth = qFromLittleEndian<quint32>(entry + 40);
+        bool valid = childCount <= 8 && levels >= 1 && depth <= 32 && qint64(firstLevel) + levels <= levelCount;
+        if (childCount > 0) {
+            valid = valid && firstChild != ~0u && qint64(firstChild) > i && qint64(firstChild) + childCount <= nodeCount;
+        }
+        for (int k = 0; k < 3; ++k) {
+            valid = valid && std::isfinite(node.boundsMin[k]) && std::isfinite(node.boundsMax[k]) &&
+                    node.boundsMin[k] <= node.boundsMax[k];
+        }
+        if (!valid) {
+            return fail(QString("Tile set node %1 is damaged").arg(i));
+        }
+        node.firstChild = childCount > 0 ? int(firstChild) : -1;
+        node.childCount = int(childCount);
+        node.firstLevel = int(firstLevel);
+        node.levelCount = int(levels);
+        node.depth = int(depth);
+    }
+    levelList.resize(int(levelCount));
+    for (int i = 0; i < levelCount; ++i) {
+        const uchar* entry = reinterpret_cast<const uchar*>(tables.constData()) + (qint64(levelTable) - HeaderSize) +
+                             qint64(i) * LevelEntrySize;
+        Level& level = levelList[i];
+        const quint64 offset = qFromLittleEndian<quint64>(entry);
+        const quint32 vertices = qFromLittleEndian<quint32>(entry + 8);
+        const quint32 levelTriangles = qFromLittleEndian<quint32>(entry + 12);
+        level.error = readFloat(entry + 16);
+        if (offset < quint64(tableEnd) || offset > quint64(size) || vertices > quint32(INT_MAX / 6) ||
+            levelTriangles > quint32(INT_MAX / 3) || !std::isfinite(level.error) || level.error < 0.0f) {
+            return fail(QString("Tile set level %1 is damaged").arg(i));
+        }
+        level.offset = qint64(offset);
+        level.vertices = int(vertices);
+        level.triangles = int(levelTriangles);
+        if (level.bytes() > INT_MAX || level.bytes() > size - level.offset) {
+            return fail(QString("Tile set level %1 is damaged").arg(i));
+        }
+    }
+    sourceTriangleCount = qint64(std::min<quint64>(triangles, quint64(LLONG_MAX)));
+
+    // Levels are copied straight out of the mapping; without one, readLevel seeks and reads
+    mapped = file.map(0, size);
+    if (!mapped) {
+        qDebug() << "TileSet: cannot map" << fileName << "- reading levels from the file instead";
+    }
+    qDebug() << "TileSet: opened" << fileName << "with" << nodeCount << "nodes and" << levelCount << "levels";
+    return true;
+}
+
+void TileSet::close()
+{
+    if (mapped) {
+        file.unmap(const_cast<uchar*>(mapped));
+        mapped = nullptr;
+    }
+    file.close();
+    nodeList.clear();
+    levelList.clear();
+    sourceTriangleCount = 0;
+}
+
+bool TileSet::readLevel(int level, QByteArray& data) const
+{
+    if (level < 0 || level >= levelList.size()) {
+        return false;
+    }
+    const Level& entry = levelList[level];
+    const qint64 bytes = entry.bytes();
+    if (mapped) {
+        data = QByteArray(reinterpret_cast<const char*>(mapped + entry.offset), int(bytes));
+    } else {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        if (!file.seek(entry.offset)) {
+            return false;
+        }
+        data = file.read(bytes);
+    }
+    if (data.size() != bytes) {
+        return false;
+    }
+
+    // A damaged file must not send the renderer outside its vertex buffer
+    const uchar* indices = reinterpret_cast<const uchar*>(data.constData()) + qint64(entry.vertices) * 6 * 4;
+    for (qint64 i = 0; i < qint64(entry.triangles) * 3; ++i) {
+        if (qFromLittleEndian<quint32>(indices + i * 4) >= quint32(entry.vertices)) {
+            return false;
+        }
+    }
+    return true;
+}
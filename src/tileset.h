@@ -0,0 +1,89 @@
+#ifndef TILESET_H
+#define TILESET_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include <mutex>
+
+// Level-of-detail tiles for models too big to load at once (full-ship laser scans and the like):
+// .tiles files, made from a binary STL with build() and drawn a piece at a time by the viewer.
+//
+// The model is cut into an octree. Every leaf keeps its own triangles exactly, plus coarser copies
+// made by vertex clustering; every node above the leaves holds a coarse copy of everything below
+// it. The viewer walks the tree and only needs the few pieces ("levels") that are visible, at the
+// detail the current view can actually show, so memory use does not grow with the model.
+//
+// Levels are stored ready to upload: 6 floats per vertex (position + normal, file units), then
+// three 32-bit indices per triangle, each starting on a 4 KB boundary so the file can be mapped.
+class TileSet
+{
+public:
+    struct Node {
+        float boundsMin[3] = {0.0f, 0.0f, 0.0f};  // Box around the node's triangles, file units
+        float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+        int firstChild = -1;   // Children are stored next to each other; -1 for leaves
+        int childCount = 0;
+        int firstLevel = 0;    // Levels run from the most detailed to the coarsest
+        int levelCount = 0;
+        int depth = 0;
+    };
+
+    struct Level {
+        qint64 offset = 0;     // Where the level's data starts in the file
+        int vertices = 0;
+        int triangles = 0;
+        float error = 0.0f;    // How far simplification may have moved the surface (file units), 0 = exact
+
+        qint64 bytes() const { return qint64(vertices) * 6 * 4 + qint64(triangles) * 3 * 4; }
+    };
+
+    struct BuildReport {
+        qint64 sourceTriangles = 0;
+        qint64 nodes = 0;
+        qint64 leaves = 0;
+        qint64 levels = 0;
+        int depth = 0;                  // Deepest leaf
+        qint64 storedTriangles = 0;     // All levels together
+        qint64 fileBytes = 0;
+        double trianglesPerSecond = 0.0;
+        qint64 milliseconds = 0;
+    };
+
+    TileSet();
+    ~TileSet();
+
+    // Cut a binary STL into a tile file. The STL and the sorted triangle numbers are read through
+    // memory maps, and only a few tiles are worked on at a time, so the model does not have to fit
+    // in memory.
+    static bool build(const QString& stlFileName, const QString& tileFileName,
+                      BuildReport* report = nullptr, QString* errorMessage = nullptr);
+
+    // Does the file start like a tile set?
+    static bool isTileSet(const QString& fileName);
+
+    // Read the node and level tables and map the rest of the file
+    bool open(const QString& fileName, QString* errorMessage = nullptr);
+    void close();
+    bool isOpen() const { return !nodeList.isEmpty(); }
+
+    const QVector<Node>& nodes() const { return nodeList; }      // Node 0 is the root
+    const QVector<Level>& levels() const { return levelList; }
+    qint64 sourceTriangles() const { return sourceTriangleCount; }
+
+    // Copy one level's vertex and index data. Safe to call from several threads at once;
+    // returns false if the level is damaged.
+    bool readLevel(int level, QByteArray& data) const;
+
+private:
+    mutable QFile file;
+    mutable std::mutex fileMutex;   // Guards reads when the file could not be mapped
+    const uchar* mapped;
+    QVector<Node> nodeList;
+    QVector<Level> levelList;
+    qint64 sourceTriangleCount;
+};
+
+#endif // TILESET_H
@@ -0,0 +1,141 @@
+#include "tilestreamer.h"
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// Two readers keep a fast disk busy while one waits for a page fault; more only add seeking
+const int ReaderThreads = 2;
+
+} // namespace
+
+TileStreamer::TileStreamer()
+    : tiles(nullptr)
+    , stagedBytes(0)
+    , stagingLimit(0)
+    , stopping(false)
+{
+}
+
+TileStreamer::~TileStreamer()
+{
+    stop();
+}
+
+void TileStreamer::start(const TileSet* tileSet, qint64 stagingBytes, std::function<void()> levelLoaded)
+{
+    stop();
+    tiles = tileSet;
+    stagingLimit = stagingBytes;
+    loadedCallback = std::move(levelLoaded);
+    stopping = false;
+    for (int i = 0; i < ReaderThreads; ++i) {
+        readers.emplace_back(&TileStreamer::readLevels, this);
+    }
+}
+
+void TileStreamer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    readers.clear();
+
+    queue.clear();
+    busy.clear();
+    staged.clear();
+    stagedBytes = 0;
+    tiles = nullptr;
+    loadedCallback = nullptr;
+}
+
+void TileStreamer::request(const QVector<Request>& wanted)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        for (const Request& request : wanted) {
+            if (!busy.contains(request.level)) {
+                queue.push_back(request);
+            }
+        }
+        // The same level can be wished for twice in one frame (for itself and as a stand-in);
+        // keep its most urgent wish
+        std::sort(queue.begin(), queue.end(), [](const Request& a, const Request& b) {
+            return a.level != b.level ? a.level < b.level : a.priority > b.priority;
+        });
+        queue.erase(std::unique(queue.begin(), queue.end(), [](const Request& a, const Request& b) {
+            return a.level == b.level;
+        }), queue.end());
+        std::sort(queue.begin(), queue.end(), [](const Request& a, const Request& b) {
+            return a.priority < b.priority;
+        });
+    }
+    wake.notify_all();
+}
+
+QVector<TileStreamer::LoadedLevel> TileStreamer::takeLoaded(qint64 maxBytes)
+{
+    QVector<LoadedLevel> loaded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        qint64 bytes = 0;
+        while (!staged.empty() && (loaded.isEmpty() || bytes + staged.front().data.size() <= maxBytes)) {
+            bytes += staged.front().data.size();
+            stagedBytes -= staged.front().data.size();
+            busy.remove(staged.front().level);
+            loaded.append(std::move(staged.front()));
+            staged.pop_front();
+        }
+    }
+    if (!loaded.isEmpty()) {
+        wake.notify_all();
+    }
+    return loaded;
+}
+
+int TileStreamer::pendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return int(queue.size()) + busy.size();
+}
+
+void TileStreamer::readLevels()
+{
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || (!queue.empty() && stagedBytes < stagingLimit); });
+            if (stopping) {
+                return;
+            }
+            request = queue.back();
+            queue.pop_back();
+            busy.insert(request.level);
+        }
+
+        // Page faults and disk reads happen here, away from the viewer's thread
+        LoadedLevel level;
+        level.level = request.level;
+        level.ok = tiles->readLevel(request.level, level.data);
+        if (!level.ok) {
+            qWarning() << "TileStreamer: level" << request.level << "could not be read";
+            level.data.clear();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stagedBytes += level.data.size();
+            staged.push_back(std::move(level));
+        }
+        if (loadedCallback) {
+            loadedCallback();
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef TILESTREAMER_H
+#define TILESTREAMER_H
+
+#include "tileset.h"
+#include <QByteArray>
+#include <QSet>
+#include <QVector>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reads tile levels from a TileSet on background threads, so the viewer never waits for the disk.
+//
+// Every frame the viewer hands over the levels it is missing, each with a priority (bigger on
+// screen = more important); the new list replaces the old one, so levels that scrolled out of view
+// are never read. Finished levels wait in a staging area until the viewer collects them. When the
+// staging area is full the readers pause, which keeps memory use bounded however fast the disk is.
+class TileStreamer
+{
+public:
+    struct Request {
+        int level = -1;
+        float priority = 0.0f;   // Bigger is read first
+    };
+
+    struct LoadedLevel {
+        int level = -1;
+        bool ok = false;         // False if the level could not be read or is damaged
+        QByteArray data;         // Vertex data, then index data (see TileSet)
+    };
+
+    TileStreamer();
+    ~TileStreamer();
+
+    // Start reading from tileSet, which must stay open until stop(). levelLoaded is called on a
+    // reader thread whenever a level is ready to collect.
+    void start(const TileSet* tileSet, qint64 stagingBytes, std::function<void()> levelLoaded);
+    void stop();
+
+    // Replace the wish list. Levels already being read or waiting to be collected are skipped.
+    void request(const QVector<Request>& wanted);
+
+    // Collect finished levels, oldest first, up to about maxBytes (always at least one)
+    QVector<LoadedLevel> takeLoaded(qint64 maxBytes);
+
+    // Levels wished for, being read, or waiting to be collected
+    int pendingCount() const;
+
+private:
+    void readLevels();
+
+    const TileSet* tiles;
+    std::vector<std::thread> readers;
+    mutable std::mutex mutex;
+    std::condition_variable wake;   // New wishes, room in the staging area, or stopping
+    std::vector<Request> queue;     // Sorted so the most important level is at the back
+    QSet<int> busy;                 // Being read or staged
+    std::deque<LoadedLevel> staged;
+    qint64 stagedBytes;
+    qint64 stagingLimit;
+    bool stopping;
+    std::function<void()> loadedCallback;
+};
+
+#endif // TILESTREAMER_H
@@ -0,0 +1,621 @@
+#include "zipreader.h"
+#include <QDebug>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Signatures of the ZIP records we look at
+const quint32 LocalHeaderSignature = 0x04034b50;
+const quint32 CentralHeaderSignature = 0x02014b50;
+const quint32 EndSignature = 0x06054b50;
+const quint32 Zip64EndSignature = 0x06064b50;
+const quint32 Zip64LocatorSignature = 0x07064b50;
+
+const qint64 LocalHeaderSize = 30;
+const qint64 CentralHeaderSize = 46;
+const qint64 EndRecordSize = 22;
+
+// Deflate matches reach at most this far back, so that much output has to stay in the window
+const qint64 InflateHistory = 32768;
+// Bytes handed to the sink at a time
+const qint64 InflateChunk = 256 * 1024;
+// Longest match deflate can produce
+const qint64 MaxMatch = 258;
+
+quint16 le16(const uchar *p) { return qFromLittleEndian<quint16>(p); }
+quint32 le32(const uchar *p) { return qFromLittleEndian<quint32>(p); }
+quint64 le64(const uchar *p) { return qFromLittleEndian<quint64>(p); }
+
+// A canonical Huffman code as used by deflate. Codes of up to FastBits bits are decoded with one table
+// lookup; longer (rare) codes are walked one bit at a time with the count/symbol lists.
+struct HuffmanTable {
+    static const int FastBits = 10;
+    quint16 count[16];               // How many codes have each length
+    quint16 symbols[288];            // Symbols sorted by code
+    quint16 fast[1 << FastBits];     // (length << 9) | symbol, 0 if the code is longer than FastBits
+
+    bool build(const quint8 *lengths, int n)
+    {
+        std::fill(count, count + 16, 0);
+        for (int i = 0; i < n; ++i) {
+            count[lengths[i]]++;
+        }
+        count[0] = 0;
+
+        // A code with more codes of some length than there is room for is broken
+        int left = 1;
+        for (int len = 1; len < 16; ++len) {
+            left = (left << 1) - count[len];
+            if (left < 0) {
+                return false;
+            }
+        }
+
+        quint16 offsets[16];
+        offsets[1] = 0;
+        for (int len = 1; len < 15; ++len) {
+            offsets[len + 1] = offsets[len] + count[len];
+        }
+        for (int i = 0; i < n; ++i) {
+            if (lengths[i]) {
+                symbols[offsets[lengths[i]]++] = quint16(i);
+            }
+        }
+
+        // First code of every length (RFC 1951, 3.2.2), then every short code into the table. The
+        // stream holds codes starting with their highest bit, so the table is indexed bit-reversed.
+        int nextCode[16];
+        int code = 0;
+        for (int len = 1; len < 16; ++len) {
+            code = (code + count[len - 1]) << 1;
+            nextCode[len] = code;
+        }
+        std::fill(fast, fast + (1 << FastBits), 0);
+        for (int i = 0; i < n; ++i) {
+            const int len = lengths[i];
+            if (len == 0 || len > FastBits) {
+                continue;
+            }
+            int c = nextCode[len]++;
+            int reversed = 0;
+            for (int b = 0; b < len; ++b) {
+                reversed = (reversed << 1) | ((c >> b) & 1);
+            }
+            for (int r = reversed; r < (1 << FastBits); r += 1 << len) {
+                fast[r] = quint16((len << 9) | i);
+            }
+        }
+        return true;
+    }
+};
+
+const quint16 LengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const quint8 LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const quint16 DistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const quint8 DistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Decodes a raw deflate stream (RFC 1951) from memory. Output collects in a window that keeps the last
+// 32 KB for back-references; whenever it fills up, the new part goes to the sink and the window slides.
+class Inflater
+{
+public:
+    Inflater(const uchar *input, qint64 inputSize, const ZipReader::Sink& sink)
+        : in(input), inSize(inputSize), sink(sink), window(InflateHistory + InflateChunk + MaxMatch) {}
+
+    // Empty string on success
+    QString run()
+    {
+        bool last = false;
+        while (!last && !stopped) {
+            last = bits(1);
+            const int type = int(bits(2));
+            QString error;
+            if (type == 0) {
+                error = storedBlock();
+            } else if (type == 1) {
+                error = fixedBlock();
+            } else if (type == 2) {
+                error = dynamicBlock();
+            } else {
+                error = "invalid block type";
+            }
+            if (!error.isEmpty()) {
+                return error;
+            }
+            if (truncated()) {
+                return "compressed data ends too early";
+            }
+        }
+        flush();
+        return QString();
+    }
+
+private:
+    // Keep at least 57 bits in the buffer. Past the end of the input zeros are shifted in and counted,
+    // so truncated() can tell when real bits ran out.
+    void refill()
+    {
+        while (bitCount <= 56) {
+            if (inPos < inSize) {
+                bitBuffer |= quint64(in[inPos++]) << bitCount;
+            } else {
+                padBytes++;
+            }
+            bitCount += 8;
+        }
+    }
+
+    bool truncated() const { return padBytes * 8 > bitCount; }
+
+    quint32 bits(int n)
+    {
+        if (bitCount < n) {
+            refill();
+        }
+        const quint32 value = quint32(bitBuffer & ((quint64(1) << n) - 1));
+        bitBuffer >>= n;
+        bitCount -= n;
+        return value;
+    }
+
+    int decode(const HuffmanTable& table)
+    {
+        if (bitCount < 16) {
+            refill();
+        }
+        const quint16 entry = table.fast[bitBuffer & ((1 << HuffmanTable::FastBits) - 1)];
+        if (entry) {
+            const int len = entry >> 9;
+            bitBuffer >>= len;
+            bitCount -= len;
+            return entry & 511;
+        }
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16; ++len) {
+            code |= int(bits(1));
+            const int count = table.count[len];
+            if (code - count < first) {
+                return table.symbols[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    // Hand everything new to the sink, then keep only the last 32 KB for later matches
+    void flush()
+    {
+        if (outPos > flushed && !stopped) {
+            stopped = !sink(reinterpret_cast<const char *>(window.data() + flushed), outPos - flushed);
+        }
+        if (outPos > InflateHistory) {
+            std::memmove(window.data(), window.data() + outPos - InflateHistory, InflateHistory);
+            outPos = InflateHistory;
+        }
+        flushed = outPos;
+    }
+
+    QString storedBlock()
+    {
+        // Stored data starts at the next whole byte
+        bits(bitCount % 8);
+        const quint32 len = bits(16);
+        const quint32 check = bits(16);
+        if ((len ^ 0xffff) != check) {
+            return "stored block length is damaged";
+        }
+        qint64 left = len;
+        while (left > 0) {
+            if (outPos == qint64(window.size())) {
+                flush();
+            }
+            // Whole bytes still sitting in the bit buffer come first
+            if (bitCount >= 8) {
+                window[outPos++] = uchar(bits(8));
+                left--;
+                continue;
+            }
+            const qint64 n = std::min(left, qint64(window.size()) - outPos);
+            if (inPos + n > inSize) {
+                return "compressed data ends too early";
+            }
+            std::memcpy(window.data() + outPos, in + inPos, n);
+            inPos += n;
+            outPos += n;
+            left -= n;
+        }
+        return truncated() ? "compressed data ends too early" : QString();
+    }
+
+    QString fixedBlock()
+    {
+        if (!fixedBuilt) {
+            quint8 lengths[320];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            std::fill(lengths + 288, lengths + 320, 5);
+            fixedLiterals.build(lengths, 288);
+            fixedDistances.build(lengths + 288, 30);
+            fixedBuilt = true;
+        }
+        return codes(fixedLiterals, fixedDistances);
+    }
+
+    QString dynamicBlock()
+    {
+        static const quint8 order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        const int literalCount = int(bits(5)) + 257;
+        const int distanceCount = int(bits(5)) + 1;
+        const int codeLengthCount = int(bits(4)) + 4;
+        if (literalCount > 286 || distanceCount > 30) {
+            return "too many codes in block header";
+        }
+
+        quint8 lengths[320] = {};
+        for (int i = 0; i < codeLengthCount; ++i) {
+            lengths[order[i]] = quint8(bits(3));
+        }
+        HuffmanTable lengthCode;
+        if (!lengthCode.build(lengths, 19)) {
+            return "damaged code length table";
+        }
+
+        // Code lengths of both tables, with runs written as repeat codes 16, 17 and 18
+        std::fill(lengths, lengths + 19, 0);
+        int index = 0;
+        while (index < literalCount + distanceCount) {
+            const int symbol = decode(lengthCode);
+            if (symbol < 0) {
+                return "damaged code lengths";
+            }
+            if (symbol < 16) {
+                lengths[index++] = quint8(symbol);
+                continue;
+            }
+            quint8 value = 0;
+            int repeat;
+            if (symbol == 16) {
+                if (index == 0) {
+                    return "repeat code without a previous length";
+                }
+                value = lengths[index - 1];
+                repeat = 3 + int(bits(2));
+            } else if (symbol == 17) {
+                repeat = 3 + int(bits(3));
+            } else {
+                repeat = 11 + int(bits(7));
+            }
+            if (index + repeat > literalCount + distanceCount) {
+                return "code lengths run past the end";
+            }
+            while (repeat--) {
+                lengths[index++] = value;
+            }
+        }
+        if (lengths[256] == 0) {
+            return "block has no end code";
+        }
+
+        if (!literals.build(lengths, literalCount) || !distances.build(lengths + literalCount, distanceCount)) {
+            return "damaged Huffman table";
+        }
+        return codes(literals, distances);
+    }
+
+    QString codes(const HuffmanTable& literalTable, const HuffmanTable& distanceTable)
+    {
+        uchar *out = window.data();
+        const qint64 limit = qint64(window.size()) - MaxMatch;
+        for (;;) {
+            if (outPos > limit) {
+                flush();
+                if (stopped) {
+                    return QString();
+                }
+            }
+            if (truncated()) {
+                return "compressed data ends too early";
+            }
+
+            int symbol = decode(literalTable);
+            if (symbol < 256) {
+                if (symbol < 0) {
+                    return "invalid literal code";
+                }
+                out[outPos++] = uchar(symbol);
+                continue;
+            }
+            if (symbol == 256) {
+                return QString();
+            }
+
+            symbol -= 257;
+            if (symbol >= 29) {
+                return "invalid length code";
+            }
+            const int length = LengthBase[symbol] + int(bits(LengthExtra[symbol]));
+            const int distanceSymbol = decode(distanceTable);
+            if (distanceSymbol < 0 || distanceSymbol >= 30) {
+                return "invalid distance code";
+            }
+            const qint64 distance = DistanceBase[distanceSymbol] + bits(DistanceExtra[distanceSymbol]);
+            if (distance > outPos) {
+                return "match reaches before the start of the data";
+            }
+
+            uchar *dst = out + outPos;
+            const uchar *src = dst - distance;
+            if (distance >= length) {
+                std::memcpy(dst, src, length);
+            } else {
+                // Overlapping match repeats the last few bytes
+                for (int i = 0; i < length; ++i) {
+                    dst[i] = src[i];
+                }
+            }
+            outPos += length;
+        }
+    }
+
+    const uchar *in;
+    qint64 inSize;
+    qint64 inPos = 0;
+    quint64 bitBuffer = 0;
+    int bitCount = 0;
+    qint64 padBytes = 0;
+
+    const ZipReader::Sink& sink;
+    std::vector<uchar> window;
+    qint64 outPos = 0;
+    qint64 flushed = 0;
+    bool stopped = false;
+
+    HuffmanTable literals;
+    HuffmanTable distances;
+    HuffmanTable fixedLiterals;
+    HuffmanTable fixedDistances;
+    bool fixedBuilt = false;
+};
+
+} // namespace
+
+ZipReader::ZipReader()
+{
+}
+
+ZipReader::~ZipReader()
+{
+    close();
+}
+
+bool ZipReader::open(const QString& fileName, QString* errorMessage)
+{
+    close();
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = "Cannot open " + fileName + ": " + file.errorString();
+        }
+        return false;
+    }
+    return attach(file, errorMessage);
+}
+
+bool ZipReader::open(QFile& openFile, QString* errorMessage)
+{
+    close();
+    return attach(openFile, errorMessage);
+}
+
+bool ZipReader::attach(QFile& source, QString* errorMessage)
+{
+    size = source.size();
+    data = source.map(0, size);
+    if (!data) {
+        source.seek(0);
+        content = source.readAll();
+        data = reinterpret_cast<const uchar *>(content.constData());
+        size = content.size();
+    }
+
+    if (!readCentralDirectory(errorMessage)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ZipReader::close()
+{
+    entryList.clear();
+    content.clear();
+    data = nullptr;
+    size = 0;
+    if (file.isOpen()) {
+        file.close();
+    }
+}
+
+bool ZipReader::readCentralDirectory(QString* errorMessage)
+{
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    // The end record sits at the very end, followed only by an optional comment of up to 64 KB
+    qint64 endPos = -1;
+    for (qint64 pos = size - EndRecordSize; pos >= 0 && pos >= size - EndRecordSize - 65535; --pos) {
+        if (le32(data + pos) == EndSignature) {
+            endPos = pos;
+            break;
+        }
+    }
+    if (endPos < 0) {
+        return fail("Not a ZIP archive (no end of central directory)");
+    }
+
+    qint64 entryCount = le16(data + endPos + 10);
+    qint64 directorySize = le32(data + endPos + 12);
+    qint64 directoryOffset = le32(data + endPos + 16);
+
+    // ZIP64 archives put the real numbers in a second end record pointed to by a locator
+    if (entryCount == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff) {
+        const qint64 locatorPos = endPos - 20;
+        if (locatorPos < 0 || le32(data + locatorPos) != Zip64LocatorSignature) {
+            return fail("ZIP64 archive without a ZIP64 locator");
+        }
+        const qint64 zip64End = qint64(le64(data + locatorPos + 8));
+        if (zip64End < 0 || zip64End + 56 > size || le32(data + zip64End) != Zip64EndSignature) {
+            return fail("Damaged ZIP64 end of central directory");
+        }
+        entryCount = qint64(le64(data + zip64End + 32));
+        directorySize = qint64(le64(data + zip64End + 40));
+        directoryOffset = qint64(le64(data + zip64End + 48));
+    }
+
+    if (directoryOffset < 0 || directorySize < 0 || directoryOffset + directorySize > size) {
+        return fail("Central directory lies outside the file");
+    }
+
+    const qint64 directoryEnd = directoryOffset + directorySize;
+    qint64 pos = directoryOffset;
+    entryList.reserve(int(std::min<qint64>(entryCount, 1 << 20)));
+    for (qint64 i = 0; i < entryCount; ++i) {
+        if (pos + CentralHeaderSize > directoryEnd || le32(data + pos) != CentralHeaderSignature) {
+            return fail("Damaged central directory entry");
+        }
+        const uchar *header = data + pos;
+        const int nameLength = le16(header + 28);
+        const int extraLength = le16(header + 30);
+        const int commentLength = le16(header + 32);
+        if (pos + CentralHeaderSize + nameLength + extraLength + commentLength > directoryEnd) {
+            return fail("Damaged central directory entry");
+        }
+
+        Entry entry;
+        entry.encrypted = le16(header + 8) & 1;
+        entry.method = le16(header + 10);
+        entry.compressedSize = le32(header + 20);
+        entry.size = le32(header + 24);
+        entry.headerOffset = le32(header + 42);
+        entry.name = QString::fromUtf8(reinterpret_cast<const char *>(header + CentralHeaderSize), nameLength);
+
+        // Sizes and offset that didn't fit in 32 bits are in the ZIP64 extra field, in this order
+        const uchar *extra = header + CentralHeaderSize + nameLength;
+        const uchar *extraEnd = extra + extraLength;
+        while (extra + 4 <= extraEnd) {
+            const int id = le16(extra);
+            const int length = le16(extra + 2);
+            const uchar *field = extra + 4;
+            const uchar *fieldEnd = std::min(field + length, extraEnd);
+            if (id == 0x0001) {
+                if (entry.size == 0xffffffff && field + 8 <= fieldEnd) {
+                    entry.size = qint64(le64(field));
+                    field += 8;
+                }
+                if (entry.compressedSize == 0xffffffff && field + 8 <= fieldEnd) {
+                    entry.compressedSize = qint64(le64(field));
+                    field += 8;
+                }
+                if (entry.headerOffset == 0xffffffff && field + 8 <= fieldEnd) {
+                    entry.headerOffset = qint64(le64(field));
+                }
+            }
+            extra += 4 + length;
+        }
+
+        entryList.append(entry);
+        pos += CentralHeaderSize + nameLength + extraLength + commentLength;
+    }
+
+    qDebug() << "ZipReader: found" << entryList.size() << "entries";
+    return true;
+}
+
+int ZipReader::find(const QString& name) const
+{
+    QString wanted = name.toLower();
+    while (wanted.startsWith("/")) {
+        wanted.remove(0, 1);
+    }
+    for (int i = 0; i < entryList.size(); ++i) {
+        if (entryList[i].name.toLower() == wanted) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool ZipReader::read(int index, const Sink& sink, QString* errorMessage) const
+{
+    auto fail = [errorMessage](const QString& error) {
+        if (errorMessage) {
+            *errorMessage = error;
+        }
+        return false;
+    };
+
+    if (index < 0 || index >= entryList.size()) {
+        return fail("No such entry in the archive");
+    }
+    const Entry& entry = entryList[index];
+    if (entry.encrypted) {
+        return fail(entry.name + " is encrypted");
+    }
+
+    // The local header repeats the name and may have a different extra field, so skip by its own lengths
+    const qint64 headerPos = entry.headerOffset;
+    if (headerPos < 0 || headerPos + LocalHeaderSize > size || le32(data + headerPos) != LocalHeaderSignature) {
+        return fail(entry.name + ": damaged local header");
+    }
+    const qint64 start = headerPos + LocalHeaderSize + le16(data + headerPos + 26) + le16(data + headerPos + 28);
+    if (entry.compressedSize < 0 || start + entry.compressedSize > size) {
+        return fail(entry.name + ": data runs past the end of the archive");
+    }
+    const uchar *compressed = data + start;
+
+    if (entry.method == 0) {
+        for (qint64 pos = 0; pos < entry.compressedSize; pos += InflateChunk) {
+            const qint64 n = std::min(InflateChunk, entry.compressedSize - pos);
+            if (!sink(reinterpret_cast<const char *>(compressed + pos), n)) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    if (entry.method != 8) {
+        return fail(QString("%1: compression method %2 is not supported").arg(entry.name).arg(entry.method));
+    }
+
+    Inflater inflater(compressed, entry.compressedSize, sink);
+    const QString error = inflater.run();
+    if (!error.isEmpty()) {
+        return fail(entry.name + ": " + error);
+    }
+    return true;
+}
+
+QByteArray ZipReader::readAll(int index, QString* errorMessage) const
+{
+    QByteArray result;
+    const bool ok = read(index, [&result](const char* piece, qint64 n) {
+        result.append(piece, int(n));
+        return true;
+    }, errorMessage);
+    return ok ? result : QByteArray();
+}
@@ -0,0 +1,59 @@
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+// Reads files out of a ZIP archive, the container used by 3MF packages. The archive is memory-mapped
+// and an entry is inflated a piece at a time into a small window, so even a multi-gigabyte part is read
+// with a fixed amount of memory. Stored and deflated entries are supported, including ZIP64 archives.
+//
+// Reading is const and only touches the mapped file, so several threads may read different entries of
+// the same archive at once.
+class ZipReader
+{
+public:
+    struct Entry {
+        QString name;               // Path inside the archive, with '/' separators
+        qint64 headerOffset = 0;    // Where the entry's local header starts
+        qint64 compressedSize = 0;
+        qint64 size = 0;            // Size once inflated
+        int method = 0;             // 0 = stored, 8 = deflate
+        bool encrypted = false;
+    };
+
+    // Called with consecutive pieces of an entry; return false to stop reading early
+    using Sink = std::function<bool(const char* data, qint64 size)>;
+
+    ZipReader();
+    ~ZipReader();
+
+    bool open(const QString& fileName, QString* errorMessage = nullptr);
+    // Read an archive the caller already has open. It must stay open while entries are read;
+    // the mapping is released when the caller closes it.
+    bool open(QFile& openFile, QString* errorMessage = nullptr);
+    void close();
+
+    const QVector<Entry>& entries() const { return entryList; }
+    int find(const QString& name) const;   // Index of an entry (case doesn't matter, leading '/' ignored), or -1
+
+    // Hand an entry to sink in pieces of up to a few hundred kilobytes
+    bool read(int entry, const Sink& sink, QString* errorMessage = nullptr) const;
+    // Whole entry in memory - only for small parts like relationship files
+    QByteArray readAll(int entry, QString* errorMessage = nullptr) const;
+
+private:
+    bool attach(QFile& source, QString* errorMessage);   // Map (or read in) an open file
+    bool readCentralDirectory(QString* errorMessage);
+
+    QFile file;                  // The archive, when open() was given its name
+    QByteArray content;          // Copy of the archive when it can't be mapped
+    const uchar* data = nullptr;
+    qint64 size = 0;
+    QVector<Entry> entryList;
+};
+
+#endif // ZIPREADER_H